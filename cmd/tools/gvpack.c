@@ -276,7 +276,7 @@ static void init_node_edge(Agraph_t * g)
 
     for (n = agfstnode(g); n; n = agnxtnode(g, n)) {
 	neato_init_node(n);
-	user_pos(N_pos, N_pin, n, nG);	/* set user position if given */
+	user_pos(N_pos, N_pin, n, nG, PSinputscale);	/* set user position if given */
     }
     for (n = agfstnode(g); n; n = agnxtnode(g, n)) {
 	for (e = agfstout(g, n); e; e = agnxtout(g, e))
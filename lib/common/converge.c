@@ -0,0 +1,109 @@
+/* $Id$ $Revision$ */
+/* vim:set shiftwidth=4 ts=8: */
+
+/*************************************************************************
+ * Copyright (c) 2011 AT&T Intellectual Property
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors: See CVS logs. Details at http://www.graphviz.org/
+ *************************************************************************/
+
+/* Convergence monitor; see converge.h.
+ * Like random.c, this file depends on nothing else in the library.
+ * gvConvergeMonitor is in gvlayout.c, next to the GVC context.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <math.h>
+#ifdef _WIN32
+#include <time.h>
+#else
+#include <sys/time.h>
+#endif
+#include "converge.h"
+
+double gvWallTime(void)
+{
+#ifdef _WIN32
+    return clock() / (double) CLOCKS_PER_SEC;
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+#endif
+}
+
+/* convInit:
+ * Start monitoring a stage of at most maxiter iterations.
+ * cp may be NULL, for no limits and no callback, with times counted
+ * from the start of the stage.
+ */
+void
+convInit(convmon_t * cm, convparms_t * cp, const char *stage, int maxiter)
+{
+    cm->info.stage = stage;
+    cm->info.iter = 0;
+    cm->info.maxiter = maxiter;
+    cm->info.energy = -1;
+    cm->info.disp = -1;
+    cm->info.elapsed = 0;
+    if (cp)
+	cm->parms = *cp;
+    else {
+	cm->parms.maxtime = 0;
+	cm->parms.reltol = 0;
+	cm->parms.start = gvWallTime();
+	cm->parms.fn = NULL;
+	cm->parms.data = NULL;
+    }
+    cm->first = -1;
+}
+
+/* convActive:
+ * True if the stage should compute energy or displacement values it
+ * would not otherwise need.
+ */
+int convActive(convmon_t * cm)
+{
+    return (cm->parms.fn || cm->parms.reltol > 0);
+}
+
+/* convStep:
+ * Report one iteration. Pass energy or disp < 0 if not computed.
+ * Return nonzero if the stage should stop.
+ */
+int convStep(convmon_t * cm, double energy, double disp)
+{
+    convergence_t *ci = &cm->info;
+    double prev = ci->energy;
+    double tol = cm->parms.reltol;
+    int stop = 0;
+
+    ci->iter++;
+    if (!cm->parms.fn && cm->parms.maxtime <= 0 && tol <= 0)
+	return 0;
+
+    ci->energy = energy;
+    ci->disp = disp;
+    ci->elapsed = gvWallTime() - cm->parms.start;
+    if (cm->first < 0 && disp > 0)
+	cm->first = disp;
+
+    if (tol > 0 && ci->iter > 1) {
+	if (energy >= 0 && prev >= 0)
+	    stop = (fabs(prev - energy) < tol * prev);
+	else if (disp >= 0 && cm->first > 0)
+	    stop = (disp < tol * cm->first);
+    }
+    if (cm->parms.maxtime > 0 && ci->elapsed >= cm->parms.maxtime)
+	stop = 1;
+    if (cm->parms.fn && cm->parms.fn(ci, cm->parms.data))
+	stop = 1;
+    return stop;
+}
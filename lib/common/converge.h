@@ -0,0 +1,83 @@
+/* $Id$ $Revision$ */
+/* vim:set shiftwidth=4 ts=8: */
+
+/*************************************************************************
+ * Copyright (c) 2011 AT&T Intellectual Property
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors: See CVS logs. Details at http://www.graphviz.org/
+ *************************************************************************/
+
+/* Convergence monitoring for the iterative layouts.
+ * Each iterative stage (sfdp, stress, kk, fdp, prism) reports once per
+ * iteration through convStep. The report is passed to the callback set
+ * with gvConvergeMonitor, if any, and checked against the graph's
+ * maxtime and reltol attributes. A nonzero return from the callback stops
+ * the stage, which then finishes as if it had converged.
+ * The callback belongs to a GVC context and applies to the layouts done
+ * with it. It may be called from several threads at once when components
+ * are laid out concurrently (see packthreads). The maxtime budget is per
+ * layout: gvLayoutJobs records the start of each layout in the root
+ * graph (GD_convstart). getConvParms copies both into convparms_t.
+ */
+
+#ifndef GV_CONVERGE_H
+#define GV_CONVERGE_H
+
+#include "gvcext.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char *stage;		/* "sfdp", "stress", "kk", "fdp", "prism" */
+    int iter;			/* iterations done, counting this one */
+    int maxiter;		/* iteration cap of the stage */
+    double energy;		/* energy or stress; < 0 if not computed */
+    double disp;		/* total node displacement; < 0 if not computed */
+    double elapsed;		/* seconds since the layout started */
+} convergence_t;
+
+typedef int (*convergefn_t) (convergence_t *, void *);
+
+typedef struct {
+    double maxtime;		/* stop after this many seconds; 0 = no limit */
+    double reltol;		/* stop when the relative improvement drops
+				 * below this; 0 = off */
+    double start;		/* wall time the layout started */
+    convergefn_t fn;		/* callback of the GVC context, or NULL */
+    void *data;			/* its argument */
+} convparms_t;
+
+typedef struct {
+    convergence_t info;
+    convparms_t parms;
+    double first;		/* displacement of the first iteration */
+} convmon_t;
+
+/*visual studio*/
+#ifdef _WIN32
+#ifndef GVC_EXPORTS
+#define extern __declspec(dllimport)
+#endif
+#endif
+/*end visual studio*/
+
+extern void gvConvergeMonitor(GVC_t * gvc, convergefn_t fn, void *data);
+extern double gvWallTime(void);
+extern void convInit(convmon_t * cm, convparms_t * cp, const char *stage,
+		     int maxiter);
+extern int convActive(convmon_t * cm);
+extern int convStep(convmon_t * cm, double energy, double disp);
+
+#undef extern
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
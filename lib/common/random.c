@@ -0,0 +1,95 @@
+/* $Id$ $Revision$ */
+/* vim:set shiftwidth=4 ts=8: */
+
+/*************************************************************************
+ * Copyright (c) 2011 AT&T Intellectual Property
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors: See CVS logs. Details at http://www.graphviz.org/
+ *************************************************************************/
+
+/* Random numbers for layouts.
+ * The layout code draws its random numbers through gvdrand48 and gvrand,
+ * which are normally just drand48 and rand. Between gvLocalRandom(TRUE, seed)
+ * and gvLocalRandom(FALSE, 0), the calling thread uses generators of its
+ * own instead, so that layouts run at the same time (see layoutComps)
+ * neither disturb nor depend on each other. The local drand48 is the
+ * drand48 generator itself, so gvsrand48(s) followed by gvdrand48() gives
+ * the same numbers either way.
+ * This file depends on nothing else in the library, so that programs
+ * linking only some of the layout code do not pull in the rest.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <math.h>
+#include <inttypes.h>
+#include "types.h"
+
+#ifndef HAVE_DRAND48
+extern double drand48(void);
+#endif
+
+static boolean LocalRandom;
+static uint64_t Rand48;		/* state of the local drand48 */
+static uint64_t Rand;		/* state of the local rand */
+#ifdef _OPENMP
+#pragma omp threadprivate(LocalRandom, Rand48, Rand)
+#endif
+
+#define RAND48_MASK ((((uint64_t) 1) << 48) - 1)
+
+static uint64_t rand48_seed(long seed)
+{
+    return ((((uint64_t) seed & 0xffffffff) << 16) | 0x330E);
+}
+
+static uint64_t rand48_next(uint64_t * x)
+{
+    *x = (*x * 0x5DEECE66DULL + 0xB) & RAND48_MASK;
+    return *x;
+}
+
+void gvLocalRandom(boolean on, long seed)
+{
+    LocalRandom = on;
+    Rand48 = Rand = rand48_seed(seed);
+}
+
+double gvdrand48(void)
+{
+    if (LocalRandom)
+	return ldexp((double) rand48_next(&Rand48), -48);
+    return drand48();
+}
+
+void gvsrand48(long seed)
+{
+    if (LocalRandom)
+	Rand48 = rand48_seed(seed);
+    else
+#ifdef HAVE_SRAND48
+	srand48(seed);
+#else
+	srand(seed);
+#endif
+}
+
+int gvrand(void)
+{
+    if (LocalRandom)
+	return (int) ((rand48_next(&Rand) >> 17) % ((uint64_t) RAND_MAX + 1));
+    return rand();
+}
+
+void gvsrand(unsigned int seed)
+{
+    if (LocalRandom)
+	Rand = rand48_seed(seed);
+    else
+	srand(seed);
+}
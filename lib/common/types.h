@@ -349,6 +349,7 @@ typedef enum {NATIVEFONTS,PSFONTS,SVGFONTS} fontname_kind;
 	boolean exact_ranksep;
 #endif
 
+	double convstart;	/* wall time the layout started; see converge.h */
     } Agraphinfo_t;
 
 #define GD_parent(g) (((Agraphinfo_t*)AGDATA(g))->parent)
@@ -356,6 +357,7 @@ typedef enum {NATIVEFONTS,PSFONTS,SVGFONTS} fontname_kind;
 #define GD_drawing(g) (((Agraphinfo_t*)AGDATA(g))->drawing)
 #define GD_bb(g) (((Agraphinfo_t*)AGDATA(g))->bb)
 #define GD_gvc(g) (((Agraphinfo_t*)AGDATA(g))->gvc)
+#define GD_convstart(g) (((Agraphinfo_t*)AGDATA(g))->convstart)
 #define GD_cleanup(g) (((Agraphinfo_t*)AGDATA(g))->cleanup)
 #define GD_dist(g) (((Agraphinfo_t*)AGDATA(g))->dist)
 #define GD_alg(g) (((Agraphinfo_t*)AGDATA(g))->alg)
@@ -27,6 +27,7 @@
 #endif // HAVE_UNISTD_H
 
 #include <ctype.h>
+#include <stdarg.h>
 
 /*
  *  a queue of nodes
@@ -119,6 +120,108 @@ double get_inputscale (graph_t* g)
     else return d;
 }
 
+/* getConvParms:
+ * Set the convergence limits of an iterative layout from the graph's
+ * maxtime and reltol attributes. Both default to 0, meaning no limit.
+ * The time budget counts from the start of the layout of g's root,
+ * or from now if that was not recorded. The callback is the one set
+ * on the root's GVC context, if any.
+ */
+void getConvParms(graph_t * g, convparms_t * cp)
+{
+    graph_t *root = agroot(g);
+    GVC_t *gvc = NULL;
+
+    cp->maxtime = late_double(g, agfindgraphattr(g, "maxtime"), 0, 0);
+    cp->reltol = late_double(g, agfindgraphattr(g, "reltol"), 0, 0);
+    cp->start = 0;
+    if (aggetrec(root, "Agraphinfo_t", 0)) {
+	cp->start = GD_convstart(root);
+	gvc = GD_gvc(root);
+    }
+    if (cp->start <= 0)
+	cp->start = gvWallTime();
+    cp->fn = gvc ? gvc->converge_fn : NULL;
+    cp->data = gvc ? gvc->converge_data : NULL;
+}
+
+/* Messages of layouts that may run at the same time (see layoutComps).
+ * cgraph's agerr keeps its state in statics, so code that may run in
+ * such a layout reports through gvagerr instead. Between
+ * gvDeferErrors(TRUE) and gvDeferErrors(FALSE), gvagerr holds the
+ * calling thread's messages back; the caller then passes them on with
+ * gvReportErrors from a single thread, in an order of its choosing.
+ * Otherwise gvagerr is just agerr.
+ */
+struct gverr_s {
+    agerrlevel_t level;
+    char *msg;			/* NULL ends the list */
+};
+
+static boolean Defer;
+static gverr_t *Deferred;
+static int NDeferred;
+#ifdef _OPENMP
+#pragma omp threadprivate(Defer, Deferred, NDeferred)
+#endif
+
+/* gvDeferErrors:
+ * Start or stop holding back the calling thread's messages. On stopping,
+ * return the messages held, or NULL if there were none.
+ */
+gverr_t *gvDeferErrors(boolean on)
+{
+    gverr_t *errs = Deferred;
+
+    Defer = on;
+    Deferred = NULL;
+    NDeferred = 0;
+    return errs;
+}
+
+/* gvReportErrors:
+ * Pass the messages returned by gvDeferErrors on to agerr, and free them.
+ */
+void gvReportErrors(gverr_t * errs)
+{
+    gverr_t *ep;
+
+    if (!errs)
+	return;
+    for (ep = errs; ep->msg; ep++) {
+	agerr(ep->level, "%s", ep->msg);
+	free(ep->msg);
+    }
+    free(errs);
+}
+
+int gvagerr(agerrlevel_t level, const char *fmt, ...)
+{
+    va_list args;
+    char *msg;
+    int len, rv = 0;
+
+    va_start(args, fmt);
+    len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    msg = N_NEW(len + 1, char);
+    va_start(args, fmt);
+    vsnprintf(msg, len + 1, fmt, args);
+    va_end(args);
+
+    if (!Defer) {
+	rv = agerr(level, "%s", msg);
+	free(msg);
+	return rv;
+    }
+    Deferred = ALLOC(NDeferred + 2, Deferred, gverr_t);
+    Deferred[NDeferred].level = level;
+    Deferred[NDeferred].msg = msg;
+    NDeferred++;
+    Deferred[NDeferred].msg = NULL;
+    return rv;
+}
+
 char *late_string(void *obj, attrsym_t * attr, char *def)
 {
     if (!attr || !obj)
@@ -14,6 +14,8 @@
 #ifndef _UTILS_H
 #define _UTILS_H 1
 
+#include "converge.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -61,6 +63,7 @@ extern "C" {
     extern char *late_string(void *, Agsym_t *, char *);
     extern boolean late_bool(void *, Agsym_t *, int);
     extern double get_inputscale (graph_t* g);
+    extern void getConvParms(graph_t * g, convparms_t * cp);
 
     extern Agnode_t *UF_find(Agnode_t *);
     extern Agnode_t *UF_union(Agnode_t *, Agnode_t *);
@@ -113,6 +116,19 @@ extern "C" {
     extern void start_timer(void);
     extern double elapsed_sec(void);
 
+    /* from random.c */
+    extern void gvLocalRandom(boolean on, long seed);
+    extern double gvdrand48(void);
+    extern void gvsrand48(long seed);
+    extern int gvrand(void);
+    extern void gvsrand(unsigned int seed);
+
+    /* messages of layouts run at the same time; see utils.c */
+    typedef struct gverr_s gverr_t;
+    extern gverr_t *gvDeferErrors(boolean on);
+    extern void gvReportErrors(gverr_t * errs);
+    extern int gvagerr(agerrlevel_t level, const char *fmt, ...);
+
     /* from psusershape.c */
     extern void cat_libfile(GVJ_t * job, const char **arglib, const char **stdlib);
 
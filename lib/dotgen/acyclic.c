@@ -13,7 +13,8 @@
 
 
 /*
- * Break cycles in a directed graph by depth-first search.
+ * Break cycles in a directed graph by depth-first search or, if
+ * cyclebreak=greedy, by the Eades-Lin-Smyth feedback arc set heuristic.
  */
 
 #include "dot.h"
@@ -54,13 +55,180 @@ dfs(node_t * n)
 }
 
 
+/* Bucket queue for greedy_order. Nodes are indexed by ND_low.
+ * Bucket SINKS holds nodes with no remaining out-edges, SOURCES nodes
+ * with no remaining in-edges, and the rest are kept by out - in weight.
+ */
+typedef struct {
+    int *outw, *inw;		/* remaining weighted degrees */
+    int *next, *prev;		/* bucket lists; -1 terminated */
+    int *where;			/* bucket of node, or -1 if removed */
+    int *head;			/* first node of each bucket */
+    int maxd;			/* offset of delta 0 */
+    int top;			/* no delta bucket above this is in use */
+} fasq_t;
+
+#define SINKS	0
+#define SOURCES	1
+#define DELTA0(q)	(2 + (q)->maxd)
+
+static void fasq_remove(fasq_t * q, int i)
+{
+    int b = q->where[i];
+
+    if (q->prev[i] >= 0)
+	q->next[q->prev[i]] = q->next[i];
+    else
+	q->head[b] = q->next[i];
+    if (q->next[i] >= 0)
+	q->prev[q->next[i]] = q->prev[i];
+    q->where[i] = -1;
+}
+
+static void fasq_insert(fasq_t * q, int i)
+{
+    int b;
+
+    if (q->outw[i] == 0)
+	b = SINKS;
+    else if (q->inw[i] == 0)
+	b = SOURCES;
+    else {
+	b = DELTA0(q) + q->outw[i] - q->inw[i];
+	if (b > q->top)
+	    q->top = b;
+    }
+    q->prev[i] = -1;
+    q->next[i] = q->head[b];
+    if (q->next[i] >= 0)
+	q->prev[q->next[i]] = i;
+    q->head[b] = i;
+    q->where[i] = b;
+}
+
+/* greedy_order:
+ * Eades, Lin and Smyth, "A fast and effective heuristic for the
+ * feedback arc set problem", IPL 47 (1993).
+ * Repeatedly remove sinks, placing them at the right end of the order,
+ * and sources, placing them at the left; when there are neither, place
+ * the node maximizing out-weight - in-weight at the left. Edges pointing
+ * leftward in the result form the feedback set. The weight of an edge
+ * is its count of original edges. Runs in O(V + E).
+ * On return, ND_low(n) is the position of n.
+ */
+static void greedy_order(node_t * list, int nn)
+{
+    fasq_t q;
+    node_t *n, **nodes;
+    edge_t *e;
+    int i, j, k, b, maxd, left, right, *pos;
+
+    nodes = N_NEW(nn, node_t *);
+    q.outw = N_NEW(nn, int);
+    q.inw = N_NEW(nn, int);
+    q.next = N_NEW(nn, int);
+    q.prev = N_NEW(nn, int);
+    q.where = N_NEW(nn, int);
+    pos = N_NEW(nn, int);
+    for (i = 0, n = list; n; n = ND_next(n), i++) {
+	nodes[i] = n;
+	ND_low(n) = i;
+    }
+    maxd = 0;
+    for (i = 0; i < nn; i++) {
+	n = nodes[i];
+	for (k = 0; (e = ND_out(n).list[k]); k++)
+	    q.outw[i] += ED_count(e);
+	for (k = 0; (e = ND_in(n).list[k]); k++)
+	    q.inw[i] += ED_count(e);
+	maxd = MAX(maxd, MAX(q.outw[i], q.inw[i]));
+    }
+    q.maxd = maxd;
+    q.head = N_NEW(2 * maxd + 3, int);
+    for (b = 0; b < 2 * maxd + 3; b++)
+	q.head[b] = -1;
+    q.top = 0;
+    for (i = nn - 1; i >= 0; i--)
+	fasq_insert(&q, i);
+
+    left = 0;
+    right = nn - 1;
+    while (left <= right) {
+	if ((i = q.head[SINKS]) < 0 && (i = q.head[SOURCES]) < 0) {
+	    while (q.head[q.top] < 0)
+		q.top--;
+	    i = q.head[q.top];
+	}
+	fasq_remove(&q, i);
+	n = nodes[i];
+	if (q.outw[i] == 0)
+	    pos[i] = right--;
+	else
+	    pos[i] = left++;
+	for (k = 0; (e = ND_out(n).list[k]); k++) {
+	    j = ND_low(aghead(e));
+	    if (q.where[j] >= 0) {
+		fasq_remove(&q, j);
+		q.inw[j] -= ED_count(e);
+		fasq_insert(&q, j);
+	    }
+	}
+	for (k = 0; (e = ND_in(n).list[k]); k++) {
+	    j = ND_low(agtail(e));
+	    if (q.where[j] >= 0) {
+		fasq_remove(&q, j);
+		q.outw[j] -= ED_count(e);
+		fasq_insert(&q, j);
+	    }
+	}
+    }
+
+    for (i = 0; i < nn; i++)
+	ND_low(nodes[i]) = pos[i];
+    free(nodes);
+    free(pos);
+    free(q.outw);
+    free(q.inw);
+    free(q.next);
+    free(q.prev);
+    free(q.where);
+    free(q.head);
+}
+
+static void greedy(node_t * list)
+{
+    int i, nn;
+    node_t *n;
+    edge_t *e;
+
+    for (nn = 0, n = list; n; n = ND_next(n))
+	nn++;
+    greedy_order(list, nn);
+    for (n = list; n; n = ND_next(n)) {
+	for (i = 0; (e = ND_out(n).list[i]); i++) {
+	    if (ND_low(aghead(e)) < ND_low(n)) {
+		reverse_edge(e);
+		i--;
+	    }
+	}
+    }
+}
+
 void acyclic(graph_t * g)
 {
     int c;
     node_t *n;
+    char *s;
+    boolean use_greedy;
 
+    s = agget(dot_root(g), "cyclebreak");
+    use_greedy = (s && streq(s, "greedy"));
     for (c = 0; c < GD_comp(g).size; c++) {
 	GD_nlist(g) = GD_comp(g).list[c];
+	if (use_greedy) {
+	    greedy(GD_nlist(g));
+	    continue;
+	}
 	for (n = GD_nlist(g); n; n = ND_next(n))
 	    ND_mark(n) = FALSE;
 	for (n = GD_nlist(g); n; n = ND_next(n))
@@ -0,0 +1,754 @@
+/* $Id$ $Revision$ */
+/* vim:set shiftwidth=4 ts=8: */
+
+/*************************************************************************
+ * Copyright (c) 2011 AT&T Intellectual Property
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors: See CVS logs. Details at http://www.graphviz.org/
+ *************************************************************************/
+
+
+/*
+ * Brandes-Koepf horizontal coordinate assignment.
+ *
+ * This is a linear-time alternative to solving the auxiliary graph of
+ * position.c with network simplex. Four candidate placements are
+ * computed, one for each combination of vertical (top-down, bottom-up)
+ * and horizontal (left, right) direction, by aligning each node with a
+ * median neighbor and compacting the resulting blocks. The final x of a
+ * node is the average median of its four candidates.
+ *
+ * The constraint edges built by make_LR_constraints and pos_clusters
+ * are kept. Once the Brandes-Koepf coordinates are known, one longest-path
+ * pass over that constraint graph pushes nodes right as needed, so
+ * node separation, cluster containment and cluster separation hold
+ * exactly as with network simplex.
+ *
+ * U. Brandes and B. Koepf, "Fast and Simple Horizontal Coordinate
+ * Assignment", Graph Drawing 2001, LNCS 2265, pp. 31-44.
+ */
+
+#include <float.h>
+#include "dot.h"
+
+/* The network simplex fields are unused in this mode; ND_low holds
+ * the node's index into the arrays below.
+ */
+#define IDX(v) ND_low(v)
+
+#define UNPLACED (-DBL_MAX)
+
+typedef struct {
+    int n;			/* number of nodes in GD_nlist */
+    node_t **nodes;
+    int *layer;			/* rank, or -1 for aux nodes */
+    int *pos;			/* order within the rank */
+    int *sep;			/* minimum distance to right neighbor */
+    int *lw, *rw;
+    /* layered edges, as CSR lists sorted by position of the other end */
+    int nedges;
+    int *etail, *ehead;
+    char *conflict;		/* type 1 conflict */
+    int *up_start, *up;		/* edges into a node from rank above */
+    int *down_start, *down;	/* edges out of a node to rank below */
+    /* per-direction scratch */
+    int *root, *align, *sink;
+    double *shift, *x;
+    int *stack, *curw;
+    char *phase;
+} bkinfo_t;
+
+typedef struct {
+    int key;			/* position of the other end */
+    int eid;
+} edgekey_t;
+
+static int
+edgecmpf(const void *a, const void *b)
+{
+    const edgekey_t *ea = (const edgekey_t *) a;
+    const edgekey_t *eb = (const edgekey_t *) b;
+
+    if (ea->key != eb->key)
+	return (ea->key > eb->key) - (ea->key < eb->key);
+    return (ea->eid > eb->eid) - (ea->eid < eb->eid);
+}
+
+/* sort_edges:
+ * Sort the edge list el[0..cnt-1] by the position of the end given
+ * by endp, using keys as scratch.
+ */
+static void
+sort_edges(bkinfo_t * bk, int *el, int cnt, int *endp, edgekey_t * keys)
+{
+    int i;
+
+    if (cnt <= 1)
+	return;
+    for (i = 0; i < cnt; i++) {
+	keys[i].key = bk->pos[endp[el[i]]];
+	keys[i].eid = el[i];
+    }
+    qsort(keys, cnt, sizeof(edgekey_t), edgecmpf);
+    for (i = 0; i < cnt; i++)
+	el[i] = keys[i].eid;
+}
+
+/* clust_depth:
+ * Nesting depth of cluster c, with the root g at depth 0.
+ */
+static int
+clust_depth(graph_t * g, graph_t * c)
+{
+    int d = 0;
+
+    while (c && (c != g)) {
+	c = GD_parent(c);
+	d++;
+    }
+    return d;
+}
+
+/* clust_gap:
+ * Extra space needed between adjacent nodes lying in the lowest
+ * clusters cu and cv, to leave room for the cluster margins and
+ * left or right borders that separate them.
+ */
+static int
+clust_gap(graph_t * g, graph_t * cu, graph_t * cv)
+{
+    int du, dv, gap = 0;
+
+    if (!cu)
+	cu = g;
+    if (!cv)
+	cv = g;
+    du = clust_depth(g, cu);
+    dv = clust_depth(g, cv);
+    while (cu != cv) {
+	if (du >= dv) {
+	    gap += late_int(cu, G_margin, CL_OFFSET, 0)
+		+ GD_border(cu)[RIGHT_IX].x;
+	    cu = GD_parent(cu);
+	    du--;
+	} else {
+	    gap += late_int(cv, G_margin, CL_OFFSET, 0)
+		+ GD_border(cv)[LEFT_IX].x;
+	    cv = GD_parent(cv);
+	    dv--;
+	}
+	if (!cu || !cv)
+	    break;
+    }
+    return gap;
+}
+
+static void
+bk_free(bkinfo_t * bk)
+{
+    free(bk->nodes);
+    free(bk->layer);
+    free(bk->pos);
+    free(bk->sep);
+    free(bk->lw);
+    free(bk->rw);
+    free(bk->etail);
+    free(bk->ehead);
+    free(bk->conflict);
+    free(bk->up_start);
+    free(bk->up);
+    free(bk->down_start);
+    free(bk->down);
+    free(bk->root);
+    free(bk->align);
+    free(bk->sink);
+    free(bk->shift);
+    free(bk->x);
+    free(bk->stack);
+    free(bk->curw);
+    free(bk->phase);
+}
+
+/* bk_init:
+ * Index the nodes and collect the edges between adjacent ranks.
+ * The layout edges are in ND_save_out at this point; ND_out holds
+ * the constraint edges.
+ */
+static void
+bk_init(graph_t * g, bkinfo_t * bk)
+{
+    int i, j, r, n, ne, u, v;
+    node_t *nd;
+    edge_t *e;
+    rank_t *rank = GD_rank(g);
+
+    n = 0;
+    for (nd = GD_nlist(g); nd; nd = ND_next(nd))
+	n++;
+    bk->n = n;
+    bk->nodes = N_NEW(n, node_t *);
+    bk->layer = N_NEW(n, int);
+    bk->pos = N_NEW(n, int);
+    bk->sep = N_NEW(n, int);
+    bk->lw = N_NEW(n, int);
+    bk->rw = N_NEW(n, int);
+    i = 0;
+    for (nd = GD_nlist(g); nd; nd = ND_next(nd)) {
+	IDX(nd) = i;
+	bk->nodes[i] = nd;
+	bk->layer[i] = -1;
+	bk->lw[i] = ROUND(ND_lw(nd));
+	bk->rw[i] = ROUND(ND_rw(nd));
+	i++;
+    }
+
+    /* make_LR_constraints left the packed position of each node in
+     * ND_rank, so consecutive differences are the node separations.
+     */
+    ne = 0;
+    for (r = GD_minrank(g); r <= GD_maxrank(g); r++) {
+	for (j = 0; j < rank[r].n; j++) {
+	    nd = rank[r].v[j];
+	    i = IDX(nd);
+	    bk->layer[i] = r;
+	    bk->pos[i] = j;
+	    if (j + 1 < rank[r].n)
+		bk->sep[i] = ND_rank(rank[r].v[j + 1]) - ND_rank(nd)
+		    + clust_gap(g, ND_clust(nd), ND_clust(rank[r].v[j + 1]));
+	    if (ND_save_out(nd).list)
+		ne += ND_save_out(nd).size;
+	}
+    }
+
+    bk->etail = N_NEW(ne + 1, int);
+    bk->ehead = N_NEW(ne + 1, int);
+    bk->up_start = N_NEW(n + 1, int);
+    bk->down_start = N_NEW(n + 1, int);
+    ne = 0;
+    for (r = GD_minrank(g); r <= GD_maxrank(g); r++) {
+	for (j = 0; j < rank[r].n; j++) {
+	    nd = rank[r].v[j];
+	    if (!ND_save_out(nd).list)
+		continue;
+	    u = IDX(nd);
+	    for (i = 0; (e = ND_save_out(nd).list[i]); i++) {
+		v = IDX(aghead(e));
+		if (bk->layer[v] != r + 1)
+		    continue;
+		bk->etail[ne] = u;
+		bk->ehead[ne] = v;
+		bk->up_start[v + 1]++;
+		bk->down_start[u + 1]++;
+		ne++;
+	    }
+	}
+    }
+    bk->nedges = ne;
+    for (i = 0; i < n; i++) {
+	bk->up_start[i + 1] += bk->up_start[i];
+	bk->down_start[i + 1] += bk->down_start[i];
+    }
+    bk->up = N_NEW(ne + 1, int);
+    bk->down = N_NEW(ne + 1, int);
+    bk->conflict = N_NEW(ne + 1, char);
+    {
+	int *ufill = N_NEW(n, int);
+	int *dfill = N_NEW(n, int);
+	for (i = 0; i < ne; i++) {
+	    u = bk->etail[i];
+	    v = bk->ehead[i];
+	    bk->up[bk->up_start[v] + ufill[v]++] = i;
+	    bk->down[bk->down_start[u] + dfill[u]++] = i;
+	}
+	free(ufill);
+	free(dfill);
+    }
+    {
+	edgekey_t *keys = N_NEW(ne + 1, edgekey_t);
+	for (i = 0; i < n; i++) {
+	    sort_edges(bk, bk->up + bk->up_start[i],
+		       bk->up_start[i + 1] - bk->up_start[i], bk->etail,
+		       keys);
+	    sort_edges(bk, bk->down + bk->down_start[i],
+		       bk->down_start[i + 1] - bk->down_start[i],
+		       bk->ehead, keys);
+	}
+	free(keys);
+    }
+
+    bk->root = N_NEW(n, int);
+    bk->align = N_NEW(n, int);
+    bk->sink = N_NEW(n, int);
+    bk->shift = N_NEW(n, double);
+    bk->x = N_NEW(n, double);
+    bk->stack = N_NEW(n, int);
+    bk->curw = N_NEW(n, int);
+    bk->phase = N_NEW(n, char);
+}
+
+/* is_inner:
+ * An inner segment joins two virtual nodes. Such segments are given
+ * priority so that long edges are drawn straight.
+ */
+static int
+is_inner(bkinfo_t * bk, int eid)
+{
+    return (ND_node_type(bk->nodes[bk->etail[eid]]) == VIRTUAL)
+	&& (ND_node_type(bk->nodes[bk->ehead[eid]]) == VIRTUAL);
+}
+
+/* mark_conflicts:
+ * Mark type 1 conflicts, i.e. non-inner segments crossing an inner
+ * segment, so that alignment never uses them.
+ */
+static void
+mark_conflicts(graph_t * g, bkinfo_t * bk)
+{
+    int r, l, l1, k0, k1, i, v, w, eid, last;
+    rank_t *rank = GD_rank(g);
+
+    for (r = GD_minrank(g) + 1; r < GD_maxrank(g); r++) {
+	if (rank[r].n == 0 || rank[r + 1].n == 0)
+	    continue;
+	last = rank[r].n - 1;
+	k0 = 0;
+	l = 0;
+	for (l1 = 0; l1 < rank[r + 1].n; l1++) {
+	    v = IDX(rank[r + 1].v[l1]);
+	    eid = -1;
+	    for (i = bk->up_start[v]; i < bk->up_start[v + 1]; i++) {
+		if (is_inner(bk, bk->up[i])) {
+		    eid = bk->up[i];
+		    break;
+		}
+	    }
+	    if ((l1 == rank[r + 1].n - 1) || (eid >= 0)) {
+		k1 = last;
+		if (eid >= 0)
+		    k1 = bk->pos[bk->etail[eid]];
+		for (; l <= l1; l++) {
+		    w = IDX(rank[r + 1].v[l]);
+		    for (i = bk->up_start[w]; i < bk->up_start[w + 1]; i++) {
+			int k = bk->pos[bk->etail[bk->up[i]]];
+			if ((k < k0 || k > k1) && !is_inner(bk, bk->up[i]))
+			    bk->conflict[bk->up[i]] = TRUE;
+		    }
+		}
+		k0 = k1;
+	    }
+	}
+    }
+}
+
+/* vertical_align:
+ * Align each node with a median neighbor in the previous rank, in the
+ * given vertical and horizontal directions.
+ */
+static void
+vertical_align(graph_t * g, bkinfo_t * bk, int down, int left)
+{
+    int i, j, k, m, n, d, r, rr, v, u, eid, start;
+    int med[2];
+    int *nstart, *nlist, *other;
+    rank_t *rank = GD_rank(g);
+
+    for (i = 0; i < bk->n; i++)
+	bk->root[i] = bk->align[i] = i;
+
+    if (down) {
+	nstart = bk->up_start;
+	nlist = bk->up;
+	other = bk->etail;
+    } else {
+	nstart = bk->down_start;
+	nlist = bk->down;
+	other = bk->ehead;
+    }
+    for (k = 0; k <= GD_maxrank(g) - GD_minrank(g); k++) {
+	rr = down ? GD_minrank(g) + k : GD_maxrank(g) - k;
+	n = rank[rr].n;
+	r = left ? -1 : INT_MAX;
+	for (j = 0; j < n; j++) {
+	    v = IDX(rank[rr].v[left ? j : n - 1 - j]);
+	    start = nstart[v];
+	    d = nstart[v + 1] - start;
+	    if (d == 0)
+		continue;
+	    /* try the medians in sweep order */
+	    med[0] = left ? (d - 1) / 2 : d / 2;
+	    med[1] = left ? d / 2 : (d - 1) / 2;
+	    for (m = 0; m < ((med[0] == med[1]) ? 1 : 2); m++) {
+		if (bk->align[v] != v)
+		    break;
+		eid = nlist[start + med[m]];
+		u = other[eid];
+		if (bk->conflict[eid])
+		    continue;
+		if (left ? (r < bk->pos[u]) : (r > bk->pos[u])) {
+		    bk->align[u] = v;
+		    bk->root[v] = bk->root[u];
+		    bk->align[v] = bk->root[v];
+		    r = bk->pos[u];
+		}
+	    }
+	}
+    }
+}
+
+/* pred:
+ * Index of the node preceding v in the horizontal sweep direction,
+ * or -1. *delta is set to the separation between the two.
+ */
+static int
+pred(graph_t * g, bkinfo_t * bk, int v, int left, int *delta)
+{
+    rank_t *rk = GD_rank(g) + bk->layer[v];
+    int p = bk->pos[v];
+    int w;
+
+    if (left) {
+	if (p == 0)
+	    return -1;
+	w = IDX(rk->v[p - 1]);
+	*delta = bk->sep[w];
+    } else {
+	if (p == rk->n - 1)
+	    return -1;
+	w = IDX(rk->v[p + 1]);
+	*delta = bk->sep[v];
+    }
+    return w;
+}
+
+/* place_block:
+ * Place the block rooted at v0, and recursively all blocks to its
+ * left (in sweep direction). Written with an explicit stack since the
+ * chain of preceding blocks can be as long as the widest rank.
+ */
+static void
+place_block(graph_t * g, bkinfo_t * bk, int v0, int left)
+{
+    int sp = 0;
+    int v, w, u, pw, delta;
+
+    bk->x[v0] = 0;
+    bk->curw[v0] = v0;
+    bk->phase[v0] = 0;
+    bk->stack[sp++] = v0;
+    while (sp > 0) {
+	v = bk->stack[sp - 1];
+	w = bk->curw[v];
+	pw = pred(g, bk, w, left, &delta);
+	if (bk->phase[v] == 0 && pw >= 0) {
+	    u = bk->root[pw];
+	    if (bk->x[u] == UNPLACED) {
+		bk->x[u] = 0;
+		bk->curw[u] = u;
+		bk->phase[u] = 0;
+		bk->stack[sp++] = u;
+		bk->phase[v] = 1;
+		continue;
+	    }
+	    bk->phase[v] = 1;
+	}
+	if (pw >= 0) {
+	    u = bk->root[pw];
+	    if (bk->sink[v] == v)
+		bk->sink[v] = bk->sink[u];
+	    if ((bk->sink[v] == bk->sink[u]) && (bk->x[v] < bk->x[u] + delta))
+		bk->x[v] = bk->x[u] + delta;
+	}
+	w = bk->align[w];
+	if (w == v)
+	    sp--;
+	else {
+	    bk->curw[v] = w;
+	    bk->phase[v] = 0;
+	}
+    }
+}
+
+/* class_shifts:
+ * Blocks sharing a sink form a class, and place_block only positions
+ * blocks relative to their own class. Each pair of adjacent nodes in
+ * different classes constrains the offset of the left class against the
+ * right one. The offsets are resolved from the rightmost classes
+ * inwards, so that they compose along chains of classes, as in the
+ * corrected version of the algorithm by Brandes, Walter and Zink.
+ */
+static void
+class_shifts(graph_t * g, bkinfo_t * bk, int left)
+{
+    int n = bk->n;
+    int *cstart = N_NEW(n + 1, int);
+    int *cfrom = N_NEW(n + 1, int);
+    double *cd = N_NEW(n + 1, double);
+    int *fill = N_NEW(n, int);
+    int *outdeg = N_NEW(n, int);
+    int *queue = N_NEW(n, int);
+    int i, w, cu, cv, delta, nc, head, tail;
+
+    for (i = 0; i < n; i++) {
+	if (bk->layer[i] < 0)
+	    continue;
+	if ((w = pred(g, bk, i, left, &delta)) < 0)
+	    continue;
+	cu = bk->sink[bk->root[w]];
+	cv = bk->sink[bk->root[i]];
+	if (cu != cv)
+	    cstart[cv + 1]++;
+    }
+    for (i = 0; i < n; i++)
+	cstart[i + 1] += cstart[i];
+    for (i = 0; i < n; i++) {
+	if (bk->layer[i] < 0)
+	    continue;
+	if ((w = pred(g, bk, i, left, &delta)) < 0)
+	    continue;
+	cu = bk->sink[bk->root[w]];
+	cv = bk->sink[bk->root[i]];
+	if (cu == cv)
+	    continue;
+	nc = cstart[cv] + fill[cv]++;
+	cfrom[nc] = cu;
+	cd[nc] = bk->x[bk->root[i]] - bk->x[bk->root[w]] - delta;
+	outdeg[cu]++;
+    }
+
+    tail = 0;
+    for (i = 0; i < n; i++) {
+	if ((bk->layer[i] >= 0) && (bk->sink[i] == i) && (outdeg[i] == 0)) {
+	    bk->shift[i] = 0;
+	    queue[tail++] = i;
+	}
+    }
+    for (head = 0; head < tail; head++) {
+	cv = queue[head];
+	for (i = cstart[cv]; i < cstart[cv + 1]; i++) {
+	    cu = cfrom[i];
+	    if (bk->shift[cv] + cd[i] < bk->shift[cu])
+		bk->shift[cu] = bk->shift[cv] + cd[i];
+	    if (--outdeg[cu] == 0)
+		queue[tail++] = cu;
+	}
+    }
+
+    free(cstart);
+    free(cfrom);
+    free(cd);
+    free(fill);
+    free(outdeg);
+    free(queue);
+}
+
+/* horizontal_compaction:
+ * Assign coordinates to the blocks found by vertical_align.
+ * Coordinates grow in the sweep direction; callers negate them for
+ * right-to-left sweeps.
+ */
+static void
+horizontal_compaction(graph_t * g, bkinfo_t * bk, int left, double *xs)
+{
+    int i, s;
+
+    for (i = 0; i < bk->n; i++) {
+	bk->sink[i] = i;
+	bk->shift[i] = DBL_MAX;
+	bk->x[i] = UNPLACED;
+    }
+    for (i = 0; i < bk->n; i++) {
+	if (bk->layer[i] < 0)
+	    continue;
+	if ((bk->root[i] == i) && (bk->x[i] == UNPLACED))
+	    place_block(g, bk, i, left);
+    }
+    class_shifts(g, bk, left);
+    for (i = 0; i < bk->n; i++) {
+	if (bk->layer[i] < 0)
+	    continue;
+	xs[i] = bk->x[bk->root[i]];
+	s = bk->sink[bk->root[i]];
+	if (bk->shift[s] < DBL_MAX)
+	    xs[i] += bk->shift[s];
+	if (!left)
+	    xs[i] = -xs[i];
+    }
+}
+
+static int
+dblcmpf(const void *a, const void *b)
+{
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+
+    return (da > db) - (da < db);
+}
+
+/* balance:
+ * Align the four candidate layouts to the narrowest one and set each
+ * node to the average of its two median candidates.
+ */
+static void
+balance(bkinfo_t * bk, double *xs[4], double *xf)
+{
+    double lo[4], hi[4], shift[4], c[4];
+    int i, k, best = 0;
+
+    for (k = 0; k < 4; k++) {
+	lo[k] = DBL_MAX;
+	hi[k] = -DBL_MAX;
+	for (i = 0; i < bk->n; i++) {
+	    if (bk->layer[i] < 0)
+		continue;
+	    lo[k] = MIN(lo[k], xs[k][i] - bk->lw[i]);
+	    hi[k] = MAX(hi[k], xs[k][i] + bk->rw[i]);
+	}
+	if (hi[k] - lo[k] < hi[best] - lo[best])
+	    best = k;
+    }
+    /* layouts 0 and 1 were swept left to right, 2 and 3 right to left */
+    for (k = 0; k < 4; k++) {
+	if (k < 2)
+	    shift[k] = lo[best] - lo[k];
+	else
+	    shift[k] = hi[best] - hi[k];
+    }
+    for (i = 0; i < bk->n; i++) {
+	if (bk->layer[i] < 0)
+	    continue;
+	for (k = 0; k < 4; k++)
+	    c[k] = xs[k][i] + shift[k];
+	qsort(c, 4, sizeof(double), dblcmpf);
+	xf[i] = (c[1] + c[2]) / 2;
+    }
+}
+
+static void
+mark_left(graph_t * g, char *isleft)
+{
+    int c;
+
+    if (GD_ln(g))
+	isleft[IDX(GD_ln(g))] = TRUE;
+    for (c = 1; c <= GD_n_cluster(g); c++)
+	mark_left(GD_clust(g)[c], isleft);
+}
+
+/* make_feasible:
+ * Move nodes right, as little as possible, until every constraint edge
+ * of the auxiliary graph is satisfied. Nodes in ranks start at their
+ * Brandes-Koepf coordinate. Left cluster boundaries are then pulled
+ * right against their contents; all other auxiliary nodes stay at
+ * their least feasible position.
+ * Return non-zero if the constraint graph has a cycle.
+ */
+static int
+make_feasible(graph_t * g, bkinfo_t * bk, double *xf)
+{
+    int n = bk->n;
+    int *indeg = N_NEW(n, int);
+    int *order = N_NEW(n, int);
+    char *isleft = N_NEW(n, char);
+    double *val = N_NEW(n, double);
+    int i, j, k, head, tail, rv = 0;
+    double minv;
+    node_t *v;
+    edge_t *e;
+
+    for (i = 0; i < n; i++) {
+	v = bk->nodes[i];
+	indeg[i] = ND_in(v).size;
+	val[i] = (bk->layer[i] >= 0) ? ROUND(xf[i]) : UNPLACED;
+    }
+    tail = 0;
+    for (i = 0; i < n; i++)
+	if (indeg[i] == 0)
+	    order[tail++] = i;
+    for (head = 0; head < tail; head++) {
+	i = order[head];
+	v = bk->nodes[i];
+	for (j = 0; (e = ND_out(v).list[j]); j++) {
+	    k = IDX(aghead(e));
+	    if ((val[i] != UNPLACED) && (val[k] < val[i] + ED_minlen(e)))
+		val[k] = val[i] + ED_minlen(e);
+	    if (--indeg[k] == 0)
+		order[tail++] = k;
+	}
+    }
+    if (tail < n) {
+	rv = 1;
+	goto done;
+    }
+
+    mark_left(g, isleft);
+    for (head = n - 1; head >= 0; head--) {
+	i = order[head];
+	if (bk->layer[i] >= 0)
+	    continue;
+	v = bk->nodes[i];
+	if (!isleft[i] && (val[i] != UNPLACED))
+	    continue;
+	minv = DBL_MAX;
+	for (j = 0; (e = ND_out(v).list[j]); j++) {
+	    k = IDX(aghead(e));
+	    if (val[k] != UNPLACED)
+		minv = MIN(minv, val[k] - ED_minlen(e));
+	}
+	if (minv < DBL_MAX)
+	    val[i] = minv;
+    }
+
+    minv = DBL_MAX;
+    for (i = 0; i < n; i++)
+	if (val[i] != UNPLACED)
+	    minv = MIN(minv, val[i]);
+    for (i = 0; i < n; i++) {
+	if (val[i] == UNPLACED)
+	    val[i] = minv;
+	ND_rank(bk->nodes[i]) = ROUND(val[i] - minv);
+    }
+
+  done:
+    free(indeg);
+    free(order);
+    free(isleft);
+    free(val);
+    return rv;
+}
+
+/* bk_position:
+ * Assign x coordinates to the nodes of g, storing them in ND_rank as
+ * the network simplex solver would. Assumes the constraint edges
+ * have been built and that ND_save_in/ND_save_out hold the layout edges.
+ * Return non-zero on failure, in which case the caller should fall
+ * back to network simplex.
+ */
+int bk_position(graph_t * g)
+{
+    bkinfo_t bk;
+    double *xs[4];
+    double *xf;
+    int k, rv;
+
+    memset(&bk, 0, sizeof(bk));
+    bk_init(g, &bk);
+    mark_conflicts(g, &bk);
+    for (k = 0; k < 4; k++) {
+	xs[k] = N_NEW(bk.n, double);
+	vertical_align(g, &bk, !(k & 1), k < 2);
+	horizontal_compaction(g, &bk, k < 2, xs[k]);
+    }
+    xf = N_NEW(bk.n, double);
+    balance(&bk, xs, xf);
+    rv = make_feasible(g, &bk, xf);
+
+    for (k = 0; k < 4; k++)
+	free(xs[k]);
+    free(xf);
+    bk_free(&bk);
+    return rv;
+}
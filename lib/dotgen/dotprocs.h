@@ -22,6 +22,7 @@ extern "C" {
 
     extern void acyclic(Agraph_t *);
     extern void allocate_ranks(Agraph_t *);
+    extern int bk_position(Agraph_t *);
     extern void build_ranks(Agraph_t *, int);
     extern void build_skeleton(Agraph_t *, Agraph_t *);
     extern void checkLabelOrder (graph_t* g);
@@ -20,6 +20,9 @@
  */
 
 #include "dot.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 /* #define DEBUG */
 #define MARK(v)		(ND_mark(v))
@@ -38,6 +41,7 @@ static void merge2(graph_t * g);
 static void init_mccomp(graph_t * g, int c);
 static void cleanup2(graph_t * g, int nc);
 static int mincross_clust(graph_t * par, graph_t * g, int);
+static int mincross_clusters(graph_t * g, int);
 static int mincross(graph_t * g, int startpass, int endpass, int);
 static void mincross_step(graph_t * g, int pass);
 static void mincross_options(graph_t * g);
@@ -68,7 +72,12 @@ static graph_t *Root;
 static int GlobalMinRank, GlobalMaxRank;
 static edge_t **TE_list;
 static int *TI_list;
+#ifdef _OPENMP
+#pragma omp threadprivate(TI_list)
+#endif
 static boolean ReMincross;
+static int MCThreads;
+static boolean ClustCross;
 
 #if DEBUG > 1
 static void indent(graph_t* g)
@@ -344,7 +353,9 @@ void dot_mincross(graph_t * g, int doBalance)
     merge2(g);
 
     /* run mincross on contents of each cluster */
-    for (c = 1; c <= GD_n_cluster(g); c++) {
+    if (MCThreads > 0)
+	nc += mincross_clusters(g, doBalance);
+    else for (c = 1; c <= GD_n_cluster(g); c++) {
 	nc += mincross_clust(g, GD_clust(g)[c], doBalance);
 #ifdef DEBUG
 	check_vlists(GD_clust(g)[c]);
@@ -524,6 +535,162 @@ static int mincross_clust(graph_t * par, graph_t * g, int doBalance)
     return nc;
 }
 
+/* set_vlist:
+ * Point the vlists of an expanded cluster back into the root's ranks,
+ * using the leaders recorded by save_vlist. Expanding other clusters
+ * shifts the root's ranks, but does not insert nodes inside g.
+ */
+static void set_vlist(graph_t * g)
+{
+    int r;
+
+    for (r = GD_minrank(g); r <= GD_maxrank(g); r++) {
+	if (GD_rank(g)[r].n > 0)
+	    GD_rank(g)[r].v = GD_rank(Root)[r].v + ND_order(GD_rankleader(g)[r]);
+    }
+}
+
+/* mark_shared:
+ * own gives, for each rank position, the top-level cluster containing it.
+ * Mark cluster c, and any other top-level cluster that an edge of l
+ * joins v to, as shared.
+ */
+static void
+mark_shared(node_t * v, elist l, int c, int **own, boolean * shared)
+{
+    int i, d;
+    edge_t *e;
+    node_t *u;
+
+    for (i = 0; i < l.size; i++) {
+	e = l.list[i];
+	u = (agtail(e) == v) ? aghead(e) : agtail(e);
+	d = own[ND_rank(u)][ND_order(u)];
+	if (d && (d != c))
+	    shared[c] = shared[d] = TRUE;
+    }
+}
+
+static int clustsizecmpf(graph_t ** g0, graph_t ** g1)
+{
+    return (GD_n_nodes(*g1) - GD_n_nodes(*g0));
+}
+
+/* mincross_clusters:
+ * Order the contents of the top-level clusters of g, as mincross_clust
+ * does, but treating each cluster as an independent unit. All of them
+ * are expanded first, and while one is being ordered the rest of the
+ * graph is fixed, so its crossings can be counted locally (clust_ncross).
+ * Clusters with no fast edges into other top-level clusters do not see
+ * each other's orderings at all; with OpenMP, they are ordered in
+ * parallel, up to MCThreads at a time and largest first. The others
+ * follow, in sequence. Sub-clusters are then handled as usual.
+ * The result does not depend on the number of threads.
+ */
+static int mincross_clusters(graph_t * g, int doBalance)
+{
+    int c, d, i, r, nc, npar, base;
+#ifdef _OPENMP
+    int size;
+#endif
+    int **own;
+    boolean *shared;
+    graph_t *clust, **par;
+    node_t *v;
+
+    for (c = 1; c <= GD_n_cluster(g); c++) {
+	clust = GD_clust(g)[c];
+	expand_cluster(clust);
+	ordered_edges(clust);
+	flat_breakcycles(clust);
+	flat_reorder(clust);
+	save_vlist(clust);
+    }
+
+    own = N_NEW(GD_maxrank(g) + 1, int *);
+    for (r = GD_minrank(g); r <= GD_maxrank(g); r++)
+	own[r] = N_NEW(GD_rank(g)[r].n + 1, int);
+    for (c = 1; c <= GD_n_cluster(g); c++) {
+	clust = GD_clust(g)[c];
+	set_vlist(clust);
+	for (r = GD_minrank(clust); r <= GD_maxrank(clust); r++) {
+	    base = GD_rank(clust)[r].v - GD_rank(g)[r].v;
+	    for (i = 0; i < GD_rank(clust)[r].n; i++)
+		own[r][base + i] = c;
+	}
+    }
+    shared = N_NEW(GD_n_cluster(g) + 1, boolean);
+    for (c = 1; c <= GD_n_cluster(g); c++) {
+	clust = GD_clust(g)[c];
+	for (r = GD_minrank(clust); r <= GD_maxrank(clust); r++) {
+	    for (i = 0; i < GD_rank(clust)[r].n; i++) {
+		v = GD_rank(clust)[r].v[i];
+		mark_shared(v, ND_out(v), c, own, shared);
+		mark_shared(v, ND_in(v), c, own, shared);
+		mark_shared(v, ND_flat_out(v), c, own, shared);
+		mark_shared(v, ND_flat_in(v), c, own, shared);
+	    }
+	}
+    }
+
+    par = N_NEW(GD_n_cluster(g), graph_t *);
+    for (npar = 0, c = 1; c <= GD_n_cluster(g); c++)
+	if (!shared[c])
+	    par[npar++] = GD_clust(g)[c];
+    qsort(par, npar, sizeof(graph_t *), (qsort_cmpf) clustsizecmpf);
+
+    ClustCross = TRUE;
+    nc = 0;
+#ifdef _OPENMP
+    size = agnedges(g) + 1;
+#pragma omp parallel num_threads(MCThreads) reduction(+:nc)
+    {
+	int *list = NULL;
+
+	/* medians needs its own scratch list in each thread */
+	if (omp_get_thread_num() > 0)
+	    TI_list = list = N_NEW(size, int);
+#pragma omp for schedule(dynamic)
+	for (d = 0; d < npar; d++)
+	    nc += mincross(par[d], 2, 2, doBalance);
+	if (list) {
+	    free(list);
+	    TI_list = NULL;
+	}
+    }
+#else
+    for (d = 0; d < npar; d++)
+	nc += mincross(par[d], 2, 2, doBalance);
+#endif
+    for (c = 1; c <= GD_n_cluster(g); c++)
+	if (shared[c])
+	    nc += mincross(GD_clust(g)[c], 2, 2, doBalance);
+
+    for (c = 1; c <= GD_n_cluster(g); c++)
+	save_vlist(GD_clust(g)[c]);
+    for (c = 1; c <= GD_n_cluster(g); c++) {
+	clust = GD_clust(g)[c];
+	set_vlist(clust);
+	for (d = 1; d <= GD_n_cluster(clust); d++)
+	    nc += mincross_clust(clust, GD_clust(clust)[d], doBalance);
+	save_vlist(clust);
+#ifdef DEBUG
+	check_vlists(clust);
+	check_order();
+#endif
+    }
+    ClustCross = FALSE;
+    for (r = GD_minrank(g); r <= GD_maxrank(g); r++)
+	GD_rank(g)[r].valid = FALSE;
+
+    for (r = GD_minrank(g); r <= GD_maxrank(g); r++)
+	free(own[r]);
+    free(own);
+    free(shared);
+    free(par);
+    return nc;
+}
+
 static int left2right(graph_t * g, node_t * v, node_t * w)
 {
     adjmatrix_t *M;
@@ -602,6 +769,18 @@ static int out_cross(node_t * v, node_t * w)
 
 }
 
+/* invalidate_rank:
+ * Discard the root's cached count of crossings between ranks r and r+1.
+ * While clusters are ordered with local counts, the cache is not used,
+ * and several clusters may be working at once, so it is left alone and
+ * reset as a whole by mincross_clusters.
+ */
+static void invalidate_rank(int r)
+{
+    if (!ClustCross)
+	GD_rank(Root)[r].valid = FALSE;
+}
+
 static void exchange(node_t * v, node_t * w)
 {
     int vi, wi, r;
@@ -735,15 +914,15 @@ static int balance(graph_t * g)
 	    if ((c1 < c0) || ((c0 > 0) && reverse && (c1 == c0))) {
 		exchange(v, w);
 		rv += (c0 - c1);
-		GD_rank(Root)[r].valid = FALSE;
+		invalidate_rank(r);
 		GD_rank(g)[r].candidate = TRUE;
 
 		if (r > GD_minrank(g)) {
-		    GD_rank(Root)[r - 1].valid = FALSE;
+		    invalidate_rank(r - 1);
 		    GD_rank(g)[r - 1].candidate = TRUE;
 		}
 		if (r < GD_maxrank(g)) {
-		    GD_rank(Root)[r + 1].valid = FALSE;
+		    invalidate_rank(r + 1);
 		    GD_rank(g)[r + 1].candidate = TRUE;
 		}
 	    }
@@ -782,15 +961,15 @@ static int transpose_step(graph_t * g, int r, int reverse)
 	if ((c1 < c0) || ((c0 > 0) && reverse && (c1 == c0))) {
 	    exchange(v, w);
 	    rv += (c0 - c1);
-	    GD_rank(Root)[r].valid = FALSE;
+	    invalidate_rank(r);
 	    GD_rank(g)[r].candidate = TRUE;
 
 	    if (r > GD_minrank(g)) {
-		GD_rank(Root)[r - 1].valid = FALSE;
+		invalidate_rank(r - 1);
 		GD_rank(g)[r - 1].candidate = TRUE;
 	    }
 	    if (r < GD_maxrank(g)) {
-		GD_rank(Root)[r + 1].valid = FALSE;
+		invalidate_rank(r + 1);
 		GD_rank(g)[r + 1].candidate = TRUE;
 	    }
 	}
@@ -902,7 +1081,7 @@ static void restore_best(graph_t * g)
 	}
     }
     for (r = GD_minrank(g); r <= GD_maxrank(g); r++) {
-	GD_rank(Root)[r].valid = FALSE;
+	invalidate_rank(r);
 	qsort(GD_rank(g)[r].v, GD_rank(g)[r].n, sizeof(GD_rank(g)[0].v[0]),
 	      (qsort_cmpf) nodeposcmpf);
     }
@@ -1621,9 +1800,9 @@ static void reorder(graph_t * g, int r, int reverse, int hasfixed)
     }
 
     if (changed) {
-	GD_rank(Root)[r].valid = FALSE;
+	invalidate_rank(r);
 	if (r > 0)
-	    GD_rank(Root)[r - 1].valid = FALSE;
+	    invalidate_rank(r - 1);
     }
 }
 
@@ -1738,10 +1917,191 @@ static int rcross(graph_t * g, int r)
     return cross;
 }
 
+/* edges between two ranks, as seen by clust_ncross */
+typedef struct {
+    int t, h;			/* orders of tail and head */
+    int hc;			/* compressed head order, from 1 */
+    int w;			/* crossing penalty */
+    int in;			/* TAIL_IN and/or HEAD_IN */
+} xedge_t;
+
+#define TAIL_IN	1
+#define HEAD_IN	2
+
+static int xedgecmpf(xedge_t * e0, xedge_t * e1)
+{
+    if (e0->t != e1->t)
+	return (e0->t - e1->t);
+    return (e0->h - e1->h);
+}
+
+/* xcross:
+ * Weighted count of crossing pairs among the edges of xe that have all
+ * of the mask bits in their in field. xe is sorted by tail; a Fenwick
+ * tree over the compressed heads accumulates the edges of earlier tails.
+ */
+static int xcross(xedge_t * xe, int ne, int mask, int *tree, int nh)
+{
+    int i, j, k, x, cross, seen, below;
+
+    memset(tree, 0, (nh + 1) * sizeof(int));
+    cross = seen = 0;
+    for (i = 0; i < ne; i = j) {
+	for (j = i; (j < ne) && (xe[j].t == xe[i].t); j++) {
+	    if ((xe[j].in & mask) != mask)
+		continue;
+	    below = 0;
+	    for (x = xe[j].hc; x > 0; x -= (x & -x))
+		below += tree[x];
+	    cross += xe[j].w * (seen - below);
+	}
+	for (k = i; k < j; k++) {
+	    if ((xe[k].in & mask) != mask)
+		continue;
+	    seen += xe[k].w;
+	    for (x = xe[k].hc; x <= nh; x += (x & -x))
+		tree[x] += xe[k].w;
+	}
+    }
+    return cross;
+}
+
+/* clust_ncross:
+ * Count the crossings of cluster g that its ordering can change, with
+ * the rest of the graph fixed. Nodes of g occupy one contiguous slice of
+ * each root rank, so two edges can only change whether they cross if
+ * both their tails or both their heads lie in g. Between each pair of
+ * ranks, we count the crossings among edges with tails in g (T), among
+ * edges with heads in g (H), and subtract those counted twice.
+ * Edges at nodes with ports are added in full; the part that does not
+ * involve g is the same on every call.
+ * Unlike ncross, this touches only the edges of g, and no shared state.
+ */
+static int clust_ncross(graph_t * g)
+{
+    int r, r0, r1, lo, hi, lo1, hi1, i, j, ne, nh, sz, cross;
+    node_t **rv, **rv1, *u;
+    edge_t *e;
+    xedge_t *xe;
+    int *hs, *tree;
+    char *mark;
+
+    r0 = MAX(GD_minrank(g) - 1, GD_minrank(Root));
+    r1 = MIN(GD_maxrank(g), GD_maxrank(Root) - 1);
+    sz = 0;
+    xe = NULL;
+    hs = tree = NULL;
+    mark = NULL;
+    cross = 0;
+    for (r = r0; r <= r1; r++) {
+	rv = GD_rank(Root)[r].v;
+	rv1 = GD_rank(Root)[r + 1].v;
+	lo = hi = lo1 = hi1 = 0;
+	if (r >= GD_minrank(g)) {
+	    lo = GD_rank(g)[r].v - rv;
+	    hi = lo + GD_rank(g)[r].n;
+	}
+	if (r + 1 <= GD_maxrank(g)) {
+	    lo1 = GD_rank(g)[r + 1].v - rv1;
+	    hi1 = lo1 + GD_rank(g)[r + 1].n;
+	}
+
+	ne = 0;
+	for (i = lo; i < hi; i++)
+	    ne += ND_out(rv[i]).size;
+	for (i = lo1; i < hi1; i++)
+	    ne += ND_in(rv1[i]).size;
+	if (ne == 0)
+	    continue;
+	if (ne > sz) {
+	    sz = ne;
+	    xe = ALLOC(sz, xe, xedge_t);
+	    hs = ALLOC(sz, hs, int);
+	    tree = ALLOC(sz + 1, tree, int);
+	    mark = ALLOC(sz + 1, mark, char);
+	}
+
+	ne = 0;
+	for (i = lo; i < hi; i++) {
+	    for (j = 0; (e = ND_out(rv[i]).list[j]); j++) {
+		xe[ne].t = i;
+		xe[ne].h = ND_order(aghead(e));
+		xe[ne].w = ED_xpenalty(e);
+		xe[ne].in = TAIL_IN;
+		if ((xe[ne].h >= lo1) && (xe[ne].h < hi1))
+		    xe[ne].in |= HEAD_IN;
+		ne++;
+	    }
+	}
+	for (i = lo1; i < hi1; i++) {
+	    for (j = 0; (e = ND_in(rv1[i]).list[j]); j++) {
+		xe[ne].t = ND_order(agtail(e));
+		if ((xe[ne].t >= lo) && (xe[ne].t < hi))
+		    continue;
+		xe[ne].h = i;
+		xe[ne].w = ED_xpenalty(e);
+		xe[ne].in = HEAD_IN;
+		ne++;
+	    }
+	}
+	qsort(xe, ne, sizeof(xedge_t), (qsort_cmpf) xedgecmpf);
+
+	/* compress head orders to 1..nh */
+	for (i = 0; i < ne; i++)
+	    hs[i] = xe[i].h;
+	qsort(hs, ne, sizeof(int), (qsort_cmpf) ordercmpf);
+	for (nh = 0, i = 0; i < ne; i++)
+	    if ((nh == 0) || (hs[i] != hs[nh - 1]))
+		hs[nh++] = hs[i];
+	for (i = 0; i < ne; i++) {
+	    int l = 0, h = nh - 1, m;
+	    while (l < h) {
+		m = (l + h) / 2;
+		if (hs[m] < xe[i].h)
+		    l = m + 1;
+		else
+		    h = m;
+	    }
+	    xe[i].hc = l + 1;
+	}
+
+	cross += xcross(xe, ne, TAIL_IN, tree, nh);
+	cross += xcross(xe, ne, HEAD_IN, tree, nh);
+	cross -= xcross(xe, ne, TAIL_IN | HEAD_IN, tree, nh);
+
+	for (i = lo; i < hi; i++)
+	    if (ND_has_port(rv[i]))
+		cross += local_cross(ND_out(rv[i]), 1);
+	for (i = lo1; i < hi1; i++)
+	    if (ND_has_port(rv1[i]))
+		cross += local_cross(ND_in(rv1[i]), -1);
+	memset(mark, 0, nh + 1);
+	for (i = 0; i < ne; i++) {
+	    if ((xe[i].in == HEAD_IN) && ((i == 0) || (xe[i - 1].t != xe[i].t))) {
+		u = rv[xe[i].t];
+		if (ND_has_port(u))
+		    cross += local_cross(ND_out(u), 1);
+	    } else if ((xe[i].in == TAIL_IN) && !mark[xe[i].hc]) {
+		mark[xe[i].hc] = TRUE;
+		u = rv1[xe[i].h];
+		if (ND_has_port(u))
+		    cross += local_cross(ND_in(u), -1);
+	    }
+	}
+    }
+    free(xe);
+    free(hs);
+    free(tree);
+    free(mark);
+    return cross;
+}
+
 int ncross(graph_t * g)
 {
     int r, count, nc;
 
+    if (ClustCross && (g != Root))
+	return clust_ncross(g);
     g = Root;
     count = 0;
     for (r = GD_minrank(g); r < GD_maxrank(g); r++) {
@@ -1956,12 +2316,16 @@ static void mincross_options(graph_t * g)
     MinQuit = 8;
     MaxIter = 24;
     Convergence = .995;
+    MCThreads = 0;
 
     p = agget(g, "mclimit");
     if (p && ((f = atof(p)) > 0.0)) {
 	MinQuit = MAX(1, MinQuit * f);
 	MaxIter = MAX(1, MaxIter * f);
     }
+    p = agget(g, "mcthreads");
+    if (p && (atoi(p) > 0))
+	MCThreads = atoi(p);
 }
 
 #ifdef DEBUG
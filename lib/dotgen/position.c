@@ -24,7 +24,8 @@
 #include "aspect.h"
 
 static int nsiter2(graph_t * g);
-static void create_aux_edges(graph_t * g);
+static void create_aux_edges(graph_t * g, int pairs);
+static void make_edge_pairs(graph_t * g);
 static void remove_aux_edges(graph_t * g);
 static void set_xcoords(graph_t * g);
 static void set_ycoords(graph_t * g);
@@ -117,6 +118,28 @@ connectGraph (graph_t* g)
     }
 }
 
+/* use_bk:
+ * Return true if x coordinates are to be assigned with the
+ * Brandes-Koepf heuristic instead of network simplex.
+ */
+static boolean
+use_bk(graph_t * g)
+{
+    char *s = agget(g, "xcoord");
+
+    return (s && streq(s, "bk"));
+}
+
+static void
+ns_position(graph_t * g)
+{
+    if (rank(g, 2, nsiter2(g))) { /* LR balance == 2 */
+	connectGraph (g);
+	const int rank_result = rank(g, 2, nsiter2(g));
+	assert(rank_result == 0);
+    }
+}
+
 void dot_position(graph_t * g, aspect_t* asp)
 {
     if (GD_nlist(g) == NULL)
@@ -128,11 +151,16 @@ void dot_position(graph_t * g, aspect_t* asp)
     expand_leaves(g);
     if (flat_edges(g))
 	set_ycoords(g);
-    create_aux_edges(g);
-    if (rank(g, 2, nsiter2(g))) { /* LR balance == 2 */
-	connectGraph (g);
-	const int rank_result = rank(g, 2, nsiter2(g));
-	assert(rank_result == 0);
+    if (use_bk(g)) {
+	create_aux_edges(g, FALSE);
+	if (bk_position(g)) {
+	    agerr(AGWARN, "Brandes-Koepf positioning failed - using network simplex\n");
+	    make_edge_pairs(g);
+	    ns_position(g);
+	}
+    } else {
+	create_aux_edges(g, TRUE);
+	ns_position(g);
     }
     set_xcoords(g);
     set_aspect(g, asp);
@@ -538,11 +566,16 @@ static void compress_graph(graph_t * g)
     make_aux_edge(GD_ln(g), GD_rn(g), x, 1000);
 }
 
-static void create_aux_edges(graph_t * g)
+/* create_aux_edges:
+ * Build the auxiliary constraint graph. The edge pairs, which carry the
+ * network simplex objective, are omitted if pairs is false.
+ */
+static void create_aux_edges(graph_t * g, int pairs)
 {
     allocate_aux_edges(g);
     make_LR_constraints(g);
-    make_edge_pairs(g);
+    if (pairs)
+	make_edge_pairs(g);
     pos_clusters(g);
     compress_graph(g);
 }
@@ -382,18 +382,198 @@ minmax_edges2(graph_t * g, point slen)
     return (e != 0);
 }
 
-/* Run the network simplex algorithm on each component. */
+#define PROMOTE_LIMIT	64
+#define PROMOTE_ROUNDS	16
+
+/* promote:
+ * Move v down one rank, together with every node that would otherwise
+ * end up too close: the successors reached from v along tight edges.
+ * These are collected in moved, a worklist of at most limit nodes, and
+ * each node is counted against limit before it is added, so an attempt
+ * touches at most limit nodes and their edges. Return the resulting
+ * change in weighted edge length, or INT_MAX, with no rank changed, if
+ * more than limit nodes would have to move. On success the caller can
+ * undo the promotion by decrementing the ranks of moved[0..*nmoved-1].
+ * ND_priority is used as the visited mark and must be 0 on entry.
+ */
+static int promote(node_t * v, node_t ** moved, int *nmoved, int limit)
+{
+    int i, j, cnt, diff;
+    node_t *u, *w;
+    edge_t *e;
+
+    cnt = 0;
+    moved[cnt++] = v;
+    ND_priority(v) = 1;
+    for (j = 0; j < cnt; j++) {
+	u = moved[j];
+	for (i = 0; (e = ND_out(u).list[i]); i++) {
+	    w = aghead(e);
+	    if (ND_priority(w) || (ND_rank(w) - ND_rank(u) != ED_minlen(e)))
+		continue;
+	    if (cnt >= limit) {
+		for (j = 0; j < cnt; j++)
+		    ND_priority(moved[j]) = 0;
+		return INT_MAX;
+	    }
+	    moved[cnt++] = w;
+	    ND_priority(w) = 1;
+	}
+    }
+
+    /* edges between two moved nodes keep their length and cancel out */
+    diff = 0;
+    for (j = 0; j < cnt; j++) {
+	u = moved[j];
+	ND_priority(u) = 0;
+	ND_rank(u)++;
+	for (i = 0; (e = ND_in(u).list[i]); i++)
+	    diff += ED_weight(e);
+	for (i = 0; (e = ND_out(u).list[i]); i++)
+	    diff -= ED_weight(e);
+    }
+    *nmoved = cnt;
+    return diff;
+}
+
+/* fast_rank:
+ * Rank the nodes of GD_nlist(g), an acyclic fast graph, without network
+ * simplex. Nodes are first put on their longest-path ranks from the
+ * sources, which satisfies every minlen but leaves the edges out of
+ * nodes with few predecessors long. Then, taking nodes sinks first,
+ * each node whose out-edges outweigh its in-edges is promoted down to
+ * the lowest rank its out-edges allow, since that shortens the former
+ * more than it lengthens the latter. Finally, up to PROMOTE_ROUNDS
+ * rounds of promote move single nodes, with their tight successors,
+ * down one rank while that shortens the weighted edge length. Each
+ * attempt touches at most PROMOTE_LIMIT nodes and their edges, and each
+ * successful one shortens the weighted edge length by at least one, so
+ * a round costs O(PROMOTE_LIMIT * D) per attempt, D the maximum degree,
+ * for V failed attempts plus at most one per unit of length saved.
+ * Space is O(V).
+ */
+static void fast_rank(graph_t * g)
+{
+    int i, j, nn, hd, tl, r, hi, inw, outw, minrank, round, cnt, nmoved, d;
+    int total = 0;
+    node_t *n, *v, **order, **moved;
+    edge_t *e;
+
+    if (Verbose)
+	start_timer();
+    nn = 0;
+    for (n = GD_nlist(g); n; n = ND_next(n)) {
+	ND_priority(n) = ND_in(n).size;
+	nn++;
+    }
+    order = N_NEW(nn, node_t *);
+    hd = tl = 0;
+    for (n = GD_nlist(g); n; n = ND_next(n))
+	if (ND_priority(n) == 0)
+	    order[tl++] = n;
+    while (hd < tl) {
+	n = order[hd++];
+	r = 0;
+	for (i = 0; (e = ND_in(n).list[i]); i++)
+	    r = MAX(r, ND_rank(agtail(e)) + ED_minlen(e));
+	ND_rank(n) = r;
+	for (i = 0; (e = ND_out(n).list[i]); i++) {
+	    v = aghead(e);
+	    if (--ND_priority(v) == 0)
+		order[tl++] = v;
+	}
+    }
+    if (tl != nn) {
+	agerr(AGERR, "trouble in fast_rank\n");
+	for (n = GD_nlist(g); n; n = ND_next(n))
+	    if (ND_priority(n)) {
+		agerr(AGPREV, "\t%s %d\n", agnameof(n), ND_priority(n));
+		ND_priority(n) = 0;
+	    }
+    }
+
+    for (j = tl - 1; j >= 0; j--) {
+	n = order[j];
+	if (ND_out(n).size == 0)
+	    continue;
+	inw = outw = 0;
+	hi = INT_MAX;
+	for (i = 0; (e = ND_out(n).list[i]); i++) {
+	    outw += ED_weight(e);
+	    hi = MIN(hi, ND_rank(aghead(e)) - ED_minlen(e));
+	}
+	for (i = 0; (e = ND_in(n).list[i]); i++)
+	    inw += ED_weight(e);
+	if ((outw >= inw) && (hi > ND_rank(n)) && (hi < INT_MAX))
+	    ND_rank(n) = hi;
+    }
+
+    moved = N_NEW(PROMOTE_LIMIT, node_t *);
+    for (round = 0; round < PROMOTE_ROUNDS; round++) {
+	cnt = 0;
+	for (j = tl - 1; j >= 0; j--) {
+	    n = order[j];
+	    if (ND_in(n).size == 0 && ND_out(n).size == 0)
+		continue;
+	    for (;;) {
+		nmoved = 0;
+		d = promote(n, moved, &nmoved, PROMOTE_LIMIT);
+		if (d < 0) {
+		    cnt++;
+		    continue;
+		}
+		while (nmoved > 0)
+		    ND_rank(moved[--nmoved])--;
+		break;
+	    }
+	}
+	total += cnt;
+	if (cnt == 0)
+	    break;
+    }
+    free(moved);
+    free(order);
+    if (Verbose)
+	fprintf(stderr, "fast rank: %d nodes %d promotions %.2f sec\n",
+		nn, total, elapsed_sec());
+
+    minrank = INT_MAX;
+    for (n = GD_nlist(g); n; n = ND_next(n))
+	if (ND_node_type(n) == NORMAL)
+	    minrank = MIN(minrank, ND_rank(n));
+    if ((minrank != INT_MAX) && (minrank != 0))
+	for (n = GD_nlist(g); n; n = ND_next(n))
+	    ND_rank(n) -= minrank;
+}
+
+/* use_fast_rank:
+ * Return true if ranker=fast.
+ */
+static boolean use_fast_rank(graph_t * g)
+{
+    char *s = agget(dot_root(g), "ranker");
+
+    return (s && streq(s, "fast"));
+}
+
+/* Run the network simplex algorithm on each component,
+ * or fast_rank if ranker=fast.
+ */
 void rank1(graph_t * g)
 {
     int maxiter = INT_MAX;
     int c;
     char *s;
+    boolean fast = use_fast_rank(g);
 
     if ((s = agget(g, "nslimit1")))
 	maxiter = atof(s) * agnnodes(g);
     for (c = 0; c < GD_comp(g).size; c++) {
 	GD_nlist(g) = GD_comp(g).list[c];
-	rank(g, (GD_n_cluster(g) == 0 ? 1 : 0), maxiter);	/* TB balance */
+	if (fast)
+	    fast_rank(g);
+	else
+	    rank(g, (GD_n_cluster(g) == 0 ? 1 : 0), maxiter);	/* TB balance */
     }
 }
 
@@ -1228,7 +1408,10 @@ void dot2_rank(graph_t * g, aspect_t* asp)
 	ssize = atoi(s);
     else
 	ssize = -1;
-    rank2(Xg, 1, maxiter, ssize);
+    if (use_fast_rank(g))
+	fast_rank(Xg);
+    else
+	rank2(Xg, 1, maxiter, ssize);
 /* fastgr(Xg); */
     readout_levels(g, Xg, ncc);
 #ifdef DEBUG
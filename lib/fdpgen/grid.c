@@ -19,142 +19,146 @@
  * Support for grid to speed up layout. On each pass, nodes are
  * put into grid cells. Given a node, repulsion is only computed 
  * for nodes in one of that nodes 9 adjacent grids.
+ *
+ * As the grid is refilled on every pass, it is kept in flat arrays.
+ * addGrid only records a node and its cell. The first query then sorts
+ * the records by cell, using a counting sort, stores the nodes of each
+ * cell next to each other, and hashes the occupied cells.
  */
 
-/* uses PRIVATE interface for NOTUSED */
-#define FDP_PRIVATE 1
-
 #include <fdp.h>
 #include <grid.h>
 #include <macros.h>
 
-  /* structure for maintaining a free list of cells */
-typedef struct _block {
-    cell *mem;			/* block of cells */
-    cell *cur;			/* next available cell */
-    cell *endp;			/* after last cell */
-    struct _block *next;	/* next memory block */
-} block_t;
-
-/* newBlock:
- * Create new block of size cells
- */
-static block_t *newBlock(int size)
-{
-    block_t *newb;
-
-    newb = GNEW(block_t);
-    newb->next = 0;
-    newb->mem = N_GNEW(size, cell);
-    newb->endp = newb->mem + size;
-    newb->cur = newb->mem;
-
-    return newb;
-}
-
-/* freeBlock:
- * Free malloc'ed memory and block.
- * Recurse to next block
- */
-static void freeBlock(block_t * b)
-{
-    if (b) {
-	block_t *next = b->next;
-	free(b->mem);
-	free(b);
-	freeBlock(next);
-    }
-}
+typedef struct {
+    gridpt p;			/* cell of node */
+    int seq;			/* order in which node was added */
+    Agnode_t *node;
+} gitem_t;
 
 struct _grid {
-    Dt_t *data;			/* cells indexed by (i,j) */
-    block_t *cellMem;		/* list of memory blocks for cells */
-    block_t *cellCur;		/* current block */
-    int listSize;		/* memory of nodes */
-    node_list *listMem;		/* list of memory for node items */
-    node_list *listCur;		/* next node item */
+    int size;			/* no. of nodes there is room for */
+    int nitems;			/* no. of nodes added */
+    gitem_t *items;		/* nodes added, with their cells */
+    gitem_t *tmp;		/* scratch space for sorting */
+    Agnode_t **nodes;		/* nodes, grouped by cell */
+    cell *cells;		/* occupied cells, in (i,j) order */
+    int ncells;			/* no. of occupied cells */
+    int *hash;			/* 1 + index into cells; 0 if slot empty */
+    int hashSize;		/* no. of hash slots, a power of 2 */
+    int *count;			/* counts for counting sort */
+    int countSize;
+    boolean built;		/* cells, nodes and hash reflect items */
 };
 
-/* getCell:
- * Create a new cell using memory blocks.
+#define HASH(i,j) (((unsigned int)(i) * 73856093U) ^ ((unsigned int)(j) * 19349663U))
+
+/* countSort:
+ * Stable sort of the n items in src by their i index (if byi)
+ * or j index into dst. Returns FALSE, doing nothing, if the indices
+ * span too large a range to count.
  */
-static cell *getCell(Grid * g)
+static boolean
+countSort(Grid * g, gitem_t * src, gitem_t * dst, int n, boolean byi)
 {
-    cell *cp;
-    block_t *bp = g->cellCur;	/* current block */
-
-    if (bp->cur == bp->endp) {	/* current block is full */
-	if (bp->next == 0) {
-	    bp->next = newBlock(2 * (bp->endp - bp->mem));
-	}
-	bp = g->cellCur = bp->next;
-	bp->cur = bp->mem;
+    int k, v, lo, hi, range, sum, c;
+
+    lo = hi = (byi ? src[0].p.i : src[0].p.j);
+    for (k = 1; k < n; k++) {
+	v = (byi ? src[k].p.i : src[k].p.j);
+	if (v < lo)
+	    lo = v;
+	else if (v > hi)
+	    hi = v;
     }
-    cp = bp->cur++;
-    return cp;
-}
-
-static int ijcmpf(Dt_t * d, gridpt * p1, gridpt * p2, Dtdisc_t * disc)
-{
-    int diff;
-
-    NOTUSED(d);
-    NOTUSED(disc);
-    if ((diff = (p1->i - p2->i)))
-	return diff;
-    else
-	return (p1->j - p2->j);
+    if ((double) hi - lo >= 4.0 * n + 64)
+	return FALSE;
+
+    range = hi - lo + 1;
+    if (range > g->countSize) {
+	free(g->count);
+	g->count = N_GNEW(range, int);
+	g->countSize = range;
+    }
+    memset(g->count, 0, range * sizeof(int));
+    for (k = 0; k < n; k++)
+	g->count[(byi ? src[k].p.i : src[k].p.j) - lo]++;
+    for (sum = 0, k = 0; k < range; k++) {
+	c = g->count[k];
+	g->count[k] = sum;
+	sum += c;
+    }
+    for (k = 0; k < n; k++)
+	dst[g->count[(byi ? src[k].p.i : src[k].p.j) - lo]++] = src[k];
+    return TRUE;
 }
 
-static Grid *_grid;		/* hack because can't attach info. to Dt_t */
-
-/* newCell:
- * Allocate a new cell from free store and initialize its indices
- * This is used by the grid discipline to create cells.
- */
-static void *newCell(Dt_t * d, void *obj, Dtdisc_t * disc)
+static int itemcmpf(const void *x, const void *y)
 {
-    cell *cellp = (cell *) obj;
-    cell *newp;
-
-    NOTUSED(disc);
-    newp = getCell(_grid);
-    newp->p.i = cellp->p.i;
-    newp->p.j = cellp->p.j;
-    newp->nodes = 0;
-
-    return newp;
+    gitem_t *p1 = (gitem_t *) x;
+    gitem_t *p2 = (gitem_t *) y;
+
+    if (p1->p.i != p2->p.i)
+	return (p1->p.i < p2->p.i ? -1 : 1);
+    if (p1->p.j != p2->p.j)
+	return (p1->p.j < p2->p.j ? -1 : 1);
+    return (p1->seq - p2->seq);
 }
 
-/* newNode:
- * Allocate a new node item from free store. 
- * Set node value and hook into list.
- * A grid assumes the memory allocated in adjustGrid
- * will be enough more all nodes added.
+/* buildGrid:
+ * Set up the cells from the nodes added since the grid was last
+ * built. Cells are ordered by (i,j), and each lists its nodes last
+ * added first.
  */
-static node_list *newNode(Grid * g, Agnode_t * n, node_list * nxt)
+static void buildGrid(Grid * g)
 {
-    node_list *newp;
+    int n = g->nitems;
+    int k, len, start;
+    unsigned int h, mask;
+    gitem_t *ip;
+    cell *cp;
 
-    newp = g->listCur++;
-    newp->node = n;
-    newp->next = nxt;
+    if (g->built)
+	return;
+    g->built = TRUE;
+    g->ncells = 0;
+    if (n == 0)
+	return;
+
+    /* sort by j, then stably by i */
+    if (!countSort(g, g->items, g->tmp, n, FALSE) ||
+	!countSort(g, g->tmp, g->items, n, TRUE))
+	qsort(g->items, n, sizeof(gitem_t), itemcmpf);
+
+    for (start = 0; start < n; start += len) {
+	ip = g->items + start;
+	for (len = 1; start + len < n; len++) {
+	    if ((ip[len].p.i != ip->p.i) || (ip[len].p.j != ip->p.j))
+		break;
+	}
+	cp = g->cells + g->ncells++;
+	cp->p = ip->p;
+	cp->nodes = g->nodes + start;
+	cp->nnodes = len;
+	for (k = 0; k < len; k++)
+	    cp->nodes[len - 1 - k] = ip[k].node;
+    }
 
-    return newp;
+    for (k = 1; k < 2 * g->ncells; k *= 2);
+    if (k > g->hashSize) {
+	free(g->hash);
+	g->hash = N_GNEW(k, int);
+	g->hashSize = k;
+    }
+    memset(g->hash, 0, g->hashSize * sizeof(int));
+    mask = g->hashSize - 1;
+    for (k = 0; k < g->ncells; k++) {
+	cp = g->cells + k;
+	for (h = HASH(cp->p.i, cp->p.j) & mask; g->hash[h]; h = (h + 1) & mask);
+	g->hash[h] = k + 1;
+    }
 }
 
-static Dtdisc_t gridDisc = {
-    offsetof(cell, p),
-    sizeof(gridpt),
-    offsetof(cell, link),
-    (Dtmake_f) newCell,
-    NIL(Dtfree_f),
-    (Dtcompar_f) ijcmpf,
-    NIL(Dthash_f),
-    NIL(Dtmemory_f),
-    NIL(Dtevent_f)
-};
-
 /* mkGrid:
  * Create grid data structure.
  * cellHint provides rough idea of how many cells
@@ -164,12 +168,8 @@ Grid *mkGrid(int cellHint)
 {
     Grid *g;
 
-    g = GNEW(Grid);
-    _grid = g;			/* see comment above */
-    g->data = dtopen(&gridDisc, Dtoset);
-    g->listMem = 0;
-    g->listSize = 0;
-    g->cellMem = newBlock(cellHint);
+    g = NEW(Grid);
+    adjustGrid(g, cellHint);
     return g;
 }
 
@@ -183,25 +183,28 @@ void adjustGrid(Grid * g, int nnodes)
 {
     int nsize;
 
-    if (nnodes > g->listSize) {
-	nsize = MAX(nnodes, 2 * (g->listSize));
-	if (g->listMem)
-	    free(g->listMem);
-	g->listMem = N_GNEW(nsize, node_list);
-	g->listSize = nsize;
+    if (nnodes > g->size) {
+	nsize = MAX(nnodes, 2 * (g->size));
+	free(g->items);
+	free(g->tmp);
+	free(g->nodes);
+	free(g->cells);
+	g->items = N_GNEW(nsize, gitem_t);
+	g->tmp = N_GNEW(nsize, gitem_t);
+	g->nodes = N_GNEW(nsize, Agnode_t *);
+	g->cells = N_GNEW(nsize, cell);
+	g->size = nsize;
     }
 }
 
 /* clearGrid:
- * Reset grid. This clears the dictionary,
+ * Reset grid. This removes all nodes,
  * and reuses available memory.
  */
 void clearGrid(Grid * g)
 {
-    dtclear(g->data);
-    g->listCur = g->listMem;
-    g->cellCur = g->cellMem;
-    g->cellCur->cur = g->cellCur->mem;
+    g->nitems = 0;
+    g->built = FALSE;
 }
 
 /* delGrid:
@@ -209,9 +212,12 @@ void clearGrid(Grid * g)
  */
 void delGrid(Grid * g)
 {
-    dtclose(g->data);
-    freeBlock(g->cellMem);
-    free(g->listMem);
+    free(g->items);
+    free(g->tmp);
+    free(g->nodes);
+    free(g->cells);
+    free(g->hash);
+    free(g->count);
     free(g);
 }
 
@@ -220,29 +226,28 @@ void delGrid(Grid * g)
  */
 void addGrid(Grid * g, int i, int j, Agnode_t * n)
 {
-    cell *cellp;
-    cell key;
+    gitem_t *ip = g->items + g->nitems;
 
-    key.p.i = i;
-    key.p.j = j;
-    cellp = dtinsert(g->data, &key);
-    cellp->nodes = newNode(g, n, cellp->nodes);
+    ip->p.i = i;
+    ip->p.j = j;
+    ip->seq = g->nitems++;
+    ip->node = n;
+    g->built = FALSE;
     if (Verbose >= 3) {
 	fprintf(stderr, "grid(%d,%d): %s\n", i, j, agnameof(n));
     }
 }
 
-typedef int (*walkfn_t) (Dt_t *, void *, void *);
-
-/* walkGrid:
- * Apply function walkf to each cell in the grid.
- * The second argument to walkf is the cell; the
- * third argument is the grid. (The first argument
- * is the dictionary.) walkf must return 0.
+/* gridCells:
+ * Return the occupied cells of the grid, in (i,j) order,
+ * storing their number in cnt. Once this is called, the grid
+ * may be queried from several threads until it is changed.
  */
-void walkGrid(Grid * g, int (*walkf) (Dt_t *, cell *, Grid *))
+cell *gridCells(Grid * g, int *cnt)
 {
-    dtwalk(g->data, (walkfn_t) walkf, g);
+    buildGrid(g);
+    *cnt = g->ncells;
+    return g->cells;
 }
 
 /* findGrid;
@@ -251,11 +256,20 @@ void walkGrid(Grid * g, int (*walkf) (Dt_t *, cell *, Grid *))
  */
 cell *findGrid(Grid * g, int i, int j)
 {
-    cell key;
+    unsigned int h, mask;
+    int k;
+    cell *cp;
 
-    key.p.i = i;
-    key.p.j = j;
-    return ((cell *) dtsearch(g->data, &key));
+    buildGrid(g);
+    if (g->ncells == 0)
+	return NULL;
+    mask = g->hashSize - 1;
+    for (h = HASH(i, j) & mask; (k = g->hash[h]); h = (h + 1) & mask) {
+	cp = g->cells + (k - 1);
+	if ((cp->p.i == i) && (cp->p.j == j))
+	    return cp;
+    }
+    return NULL;
 }
 
 /* gLength:
@@ -263,12 +277,5 @@ cell *findGrid(Grid * g, int i, int j)
  */
 int gLength(cell * p)
 {
-    int len = 0;
-    node_list *nodes = p->nodes;
-
-    while (nodes) {
-	len++;
-	nodes = nodes->next;
-    }
-    return len;
+    return p->nnodes;
 }
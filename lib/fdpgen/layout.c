@@ -53,6 +53,7 @@ typedef struct {
     attrsym_t *G_height;
     int gid;
     pack_info pack;
+    int nthreads;     /* see layoutComps */
 } layout_info;
 
 typedef struct {
@@ -854,6 +855,11 @@ setClustNodes(graph_t* root)
  * Add edges per components to get better packing, rather than
  * wait until the end.
  */
+static void tLayoutComp(graph_t * cg, int i, void *state)
+{
+    fdp_tLayout(cg, (xparams *) state + i);
+}
+
 static 
 void layout(graph_t * g, layout_info * infop)
 {
@@ -867,7 +873,9 @@ void layout(graph_t * g, layout_info * infop)
     graph_t **pg;
     int c_cnt;
     int pinned;
+    int i;
     xparams xpms;
+    xparams *xpmv = NULL;	/* parameters of each component */
 
 #ifdef DEBUG
     incInd();
@@ -885,9 +893,21 @@ void layout(graph_t * g, layout_info * infop)
     dg = deriveGraph(g, infop);
     cc = pg = findCComp(dg, &c_cnt, &pinned);
 
-    while ((cg = *pg++)) {
+    /* The spring layouts of the components are independent, so they
+     * can be done at the same time. fdp_tLayout seeds its own random
+     * positions; the seed here only starts the jitter of coincident nodes.
+     */
+    if ((infop->nthreads > 0) && (c_cnt > 1)) {
+	xpmv = N_NEW(c_cnt, xparams);
+	layoutComps(c_cnt, cc, infop->nthreads, 1, tLayoutComp, xpmv);
+    }
+
+    for (i = 0; (cg = *pg++); i++) {
 	node_t* nxtnode;
-	fdp_tLayout(cg, &xpms);
+	if (xpmv)
+	    xpms = xpmv[i];
+	else
+	    fdp_tLayout(cg, &xpms);
 	for (n = agfstnode(cg); n; n = nxtnode) {
 	    nxtnode = agnxtnode(cg, n);
 	    if (ND_clust(n)) {
@@ -969,6 +989,7 @@ void layout(graph_t * g, layout_info * infop)
     /* clean up temp graphs */
     freeDerivedGraph(dg, cc);
     free(cc);
+    free(xpmv);
     if (Verbose) {
 #ifdef DEBUG
 	prIndent ();
@@ -1010,6 +1031,7 @@ static void init_info(graph_t * g, layout_info * infop)
     infop->rootg = g;
     infop->gid = 0;
     infop->pack.mode = getPackInfo(g, l_node, CL_OFFSET / 2, &(infop->pack));
+    infop->nthreads = getPackThreads(g);
 }
 
 /* mkClusters:
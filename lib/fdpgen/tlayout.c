@@ -43,13 +43,6 @@
 #include <grid.h>
 #include <neato.h>
 
-#ifndef HAVE_SRAND48
-#define srand48 srand
-#endif
-#ifndef HAVE_DRAND48
-extern double drand48(void);
-#endif
-
 #include "tlayout.h"
 #include "globals.h"
 
@@ -86,30 +79,43 @@ typedef struct {
     double Ht2;		/* Ht*Ht */
     int pass1;		/* iterations used in pass 1 */
     int loopcnt;        /* actual iterations in this pass */
+    int nthreads;	/* threads for grid repulsion */
+    convparms_t conv;	/* time budget and tolerance */
 } parms_t;
 
 static parms_t parms;
 
-#define T_useGrid   (parms.useGrid)
-#define T_useNew    (parms.useNew)
-#define T_seed      (parms.seed)
-#define T_numIters  (parms.numIters)
-#define T_maxIters  (parms.maxIters)
-#define T_unscaled  (parms.unscaled)
-#define T_C         (parms.C)
-#define T_Tfact     (parms.Tfact)
-#define T_K         (parms.K)
-#define T_T0        (parms.T0)
-#define T_smode     (parms.smode)
-#define T_Cell      (parms.Cell)
-#define T_Cell2     (parms.Cell2)
-#define T_K2        (parms.K2)
-#define T_Wd        (parms.Wd)
-#define T_Ht        (parms.Ht)
-#define T_Wd2       (parms.Wd2)
-#define T_Ht2       (parms.Ht2)
-#define T_pass1     (parms.pass1)
-#define T_loopcnt   (parms.loopcnt)
+  /* Working copy of parms, which fdp_tLayout updates as it goes.
+   * Each thread has its own, so components can be laid out at the
+   * same time (see layoutComps).
+   */
+static parms_t tparms;
+#ifdef _OPENMP
+#pragma omp threadprivate(tparms)
+#endif
+
+#define T_useGrid   (tparms.useGrid)
+#define T_useNew    (tparms.useNew)
+#define T_seed      (tparms.seed)
+#define T_numIters  (tparms.numIters)
+#define T_maxIters  (tparms.maxIters)
+#define T_unscaled  (tparms.unscaled)
+#define T_C         (tparms.C)
+#define T_Tfact     (tparms.Tfact)
+#define T_K         (tparms.K)
+#define T_T0        (tparms.T0)
+#define T_smode     (tparms.smode)
+#define T_Cell      (tparms.Cell)
+#define T_Cell2     (tparms.Cell2)
+#define T_K2        (tparms.K2)
+#define T_Wd        (tparms.Wd)
+#define T_Ht        (tparms.Ht)
+#define T_Wd2       (tparms.Wd2)
+#define T_Ht2       (tparms.Ht2)
+#define T_pass1     (tparms.pass1)
+#define T_loopcnt   (tparms.loopcnt)
+#define T_nthreads  (tparms.nthreads)
+#define T_conv      (tparms.conv)
 
 #define EXPFACTOR  1.2
 #define DFLT_maxIters 600
@@ -123,24 +129,15 @@ static double cool(double temp, int t)
     return (T_T0 * (T_maxIters - t)) / T_maxIters;
 }
 
-/* reset_params:
- */
-static void reset_params(void)
-{
-    T_T0 = -1.0;
-}
-
 /* init_params:
  * Set parameters for expansion phase based on initial
  * layout parameters. If T0 is not set, we set it here
- * based on the size of the graph. In this case, we
- * return 1, so that fdp_tLayout can unset T0, to be
- * reset by a recursive call to fdp_tLayout. 
+ * based on the size of the graph. This only changes the
+ * working copy, so a recursive call to fdp_tLayout will
+ * set T0 again.
  */
-static int init_params(graph_t * g, xparams * xpms)
+static void init_params(graph_t * g, xparams * xpms)
 {
-    int ret = 0;
-
     if (T_T0 == -1.0) {
 	int nnodes = agnnodes(g);
 
@@ -152,7 +149,6 @@ static int init_params(graph_t * g, xparams * xpms)
 	    fprintf(stderr, "(%s) : T0 %f\n", agnameof(GORIG(g->root)), T_T0);
 	}
 #endif
-	ret = 1;
     }
 
     xpms->T0 = cool(T_T0, T_pass1);
@@ -172,7 +168,6 @@ static int init_params(graph_t * g, xparams * xpms)
 	T_loopcnt = T_pass1;
 	xpms->loopcnt = xpms->numIters;
     }
-    return ret;
 }
 
 /* fdp_initParams:
@@ -195,11 +190,15 @@ void fdp_initParams(graph_t * g)
 	T_T0 = D_T0;
     T_seed = DFLT_seed;
     T_smode = setSeed (g, DFLT_smode, &T_seed);
-    if (T_smode == INIT_SELF) {
-	agerr(AGWARN, "fdp does not support start=self - ignoring\n");
-	T_seed = DFLT_smode;
+    if ((T_smode == INIT_SELF) || (T_smode == INIT_MULTILEVEL)) {
+	agerr(AGWARN, "fdp does not support start=%s - ignoring\n",
+	      (T_smode == INIT_SELF ? "self" : "multilevel"));
+	T_smode = DFLT_smode;
     }
 
+    T_nthreads = late_int(g, agattr(g,AGRAPH, "threads", NULL), 0, 0);
+    getConvParms(g, &T_conv);
+
     T_pass1 = (T_unscaled * T_maxIters) / 100;
     T_K2 = T_K * T_K;
 
@@ -217,26 +216,41 @@ void fdp_initParams(graph_t * g)
                 T_K, T_T0, T_Tfact, T_maxIters, T_unscaled);
     }
 #endif
+    parms = tparms;
 }
 
-static void
-doRep(node_t * p, node_t * q, double xdelta, double ydelta, double dist2)
+/* repForce:
+ * Repulsive force between p and q at squared distance dist2,
+ * per unit of displacement.
+ */
+static inline double
+repForce(parms_t * prm, node_t * p, node_t * q, double dist2)
 {
     double force;
     double dist;
 
-    while (dist2 == 0.0) {
-	xdelta = 5 - rand() % 10;
-	ydelta = 5 - rand() % 10;
-	dist2 = xdelta * xdelta + ydelta * ydelta;
-    }
-    if (T_useNew) {
+    if (prm->useNew) {
 	dist = sqrt(dist2);
-	force = T_K2 / (dist * dist2);
+	force = prm->K2 / (dist * dist2);
     } else
-	force = T_K2 / dist2;
+	force = prm->K2 / dist2;
     if (IS_PORT(p) && IS_PORT(q))
 	force *= 10.0;
+    return force;
+}
+
+static void
+doRep(parms_t * prm, node_t * p, node_t * q, double xdelta, double ydelta,
+      double dist2)
+{
+    double force;
+
+    while (dist2 == 0.0) {
+	xdelta = 5 - gvrand() % 10;
+	ydelta = 5 - gvrand() % 10;
+	dist2 = xdelta * xdelta + ydelta * ydelta;
+    }
+    force = repForce(prm, p, q, dist2);
     DISP(q)[0] += xdelta * force;
     DISP(q)[1] += ydelta * force;
     DISP(p)[0] -= xdelta * force;
@@ -247,19 +261,20 @@ doRep(node_t * p, node_t * q, double xdelta, double ydelta, double dist2)
  * Repulsive force = (K*K)/d
  *  or K*K/d*d
  */
-static void applyRep(Agnode_t * p, Agnode_t * q)
+static void applyRep(parms_t * prm, Agnode_t * p, Agnode_t * q)
 {
     double xdelta, ydelta;
 
     xdelta = ND_pos(q)[0] - ND_pos(p)[0];
     ydelta = ND_pos(q)[1] - ND_pos(p)[1];
-    doRep(p, q, xdelta, ydelta, xdelta * xdelta + ydelta * ydelta);
+    doRep(prm, p, q, xdelta, ydelta, xdelta * xdelta + ydelta * ydelta);
 }
 
-static void doNeighbor(Grid * grid, int i, int j, node_list * nodes)
+static void
+doNeighbor(parms_t * prm, Grid * grid, int i, int j, cell * ps)
 {
     cell *cellp = findGrid(grid, i, j);
-    node_list *qs;
+    int k, l;
     Agnode_t *p;
     Agnode_t *q;
     double xdelta, ydelta;
@@ -273,29 +288,28 @@ static void doNeighbor(Grid * grid, int i, int j, node_list * nodes)
 		    gLength(cellp));
 	}
 #endif
-	for (; nodes != 0; nodes = nodes->next) {
-	    p = nodes->node;
-	    for (qs = cellp->nodes; qs != 0; qs = qs->next) {
-		q = qs->node;
+	for (k = 0; k < ps->nnodes; k++) {
+	    p = ps->nodes[k];
+	    for (l = 0; l < cellp->nnodes; l++) {
+		q = cellp->nodes[l];
 		xdelta = (ND_pos(q))[0] - (ND_pos(p))[0];
 		ydelta = (ND_pos(q))[1] - (ND_pos(p))[1];
 		dist2 = xdelta * xdelta + ydelta * ydelta;
-		if (dist2 < T_Cell2)
-		    doRep(p, q, xdelta, ydelta, dist2);
+		if (dist2 < prm->Cell2)
+		    doRep(prm, p, q, xdelta, ydelta, dist2);
 	    }
 	}
     }
 }
 
-static int gridRepulse(Dt_t * dt, cell * cellp, Grid * grid)
+static void gridRepulse(parms_t * prm, cell * cellp, Grid * grid)
 {
-    node_list *nodes = cellp->nodes;
+    Agnode_t **nodes = cellp->nodes;
+    int n = cellp->nnodes;
     int i = cellp->p.i;
     int j = cellp->p.j;
-    node_list *p;
-    node_list *q;
+    int p, q;
 
-    NOTUSED(dt);
 #ifdef DEBUG
     if (Verbose >= 3) {
 	prIndent();
@@ -303,29 +317,92 @@ static int gridRepulse(Dt_t * dt, cell * cellp, Grid * grid)
 		gLength(cellp));
     }
 #endif
-    for (p = nodes; p != 0; p = p->next) {
-	for (q = nodes; q != 0; q = q->next)
+    for (p = 0; p < n; p++) {
+	for (q = 0; q < n; q++)
 	    if (p != q)
-		applyRep(p->node, q->node);
+		applyRep(prm, nodes[p], nodes[q]);
     }
 
-    doNeighbor(grid, i - 1, j - 1, nodes);
-    doNeighbor(grid, i - 1, j, nodes);
-    doNeighbor(grid, i - 1, j + 1, nodes);
-    doNeighbor(grid, i, j - 1, nodes);
-    doNeighbor(grid, i, j + 1, nodes);
-    doNeighbor(grid, i + 1, j - 1, nodes);
-    doNeighbor(grid, i + 1, j, nodes);
-    doNeighbor(grid, i + 1, j + 1, nodes);
+    doNeighbor(prm, grid, i - 1, j - 1, cellp);
+    doNeighbor(prm, grid, i - 1, j, cellp);
+    doNeighbor(prm, grid, i - 1, j + 1, cellp);
+    doNeighbor(prm, grid, i, j - 1, cellp);
+    doNeighbor(prm, grid, i, j + 1, cellp);
+    doNeighbor(prm, grid, i + 1, j - 1, cellp);
+    doNeighbor(prm, grid, i + 1, j, cellp);
+    doNeighbor(prm, grid, i + 1, j + 1, cellp);
+}
 
-    return 0;
+/* nodeRepulse:
+ * Add to DISP(p) the repulsion on node p, in cell cellp, from the
+ * nodes in its own and the 8 adjacent cells. This is the force
+ * gridRepulse applies to p, whose pairs are each seen twice, but
+ * only p is changed, so the nodes can be done in parallel. Coincident
+ * nodes are pushed apart in a direction fixed by their sequence numbers
+ * rather than a random one, so the result does not depend on the
+ * order the nodes are done in.
+ */
+static void
+nodeRepulse(parms_t * prm, Grid * grid, cell * cellp, Agnode_t * p)
+{
+    int di, dj, l;
+    cell *cp;
+    Agnode_t *q;
+    double xdelta, ydelta;
+    double dist2, force;
+
+    for (di = -1; di <= 1; di++) {
+	for (dj = -1; dj <= 1; dj++) {
+	    if (di || dj)
+		cp = findGrid(grid, cellp->p.i + di, cellp->p.j + dj);
+	    else
+		cp = cellp;
+	    if (!cp)
+		continue;
+	    for (l = 0; l < cp->nnodes; l++) {
+		q = cp->nodes[l];
+		if (q == p)
+		    continue;
+		xdelta = ND_pos(q)[0] - ND_pos(p)[0];
+		ydelta = ND_pos(q)[1] - ND_pos(p)[1];
+		dist2 = xdelta * xdelta + ydelta * ydelta;
+		if ((di || dj) && (dist2 >= prm->Cell2))
+		    continue;
+		if (dist2 == 0.0) {
+		    xdelta = ydelta = (AGSEQ(q) > AGSEQ(p) ? 1.0 : -1.0);
+		    dist2 = 2.0;
+		}
+		force = 2 * repForce(prm, p, q, dist2);
+		DISP(p)[0] -= xdelta * force;
+		DISP(p)[1] -= ydelta * force;
+	    }
+	}
+    }
+}
+
+/* parRepulse:
+ * Apply the grid repulsion using nodeRepulse on prm->nthreads threads.
+ */
+static void
+parRepulse(parms_t * prm, Grid * grid, cell * cells, int ncells)
+{
+    int k, l;
+
+#ifdef _OPENMP
+#pragma omp parallel for private(l) schedule(dynamic, 16) num_threads(prm->nthreads)
+#endif
+    for (k = 0; k < ncells; k++) {
+	for (l = 0; l < cells[k].nnodes; l++)
+	    nodeRepulse(prm, grid, cells + k, cells[k].nodes[l]);
+    }
 }
 
 /* applyAttr:
  * Attractive force = weight*(d*d)/K
  *  or        force = (d - L(e))*weight(e)
  */
-static void applyAttr(Agnode_t * p, Agnode_t * q, Agedge_t * e)
+static void
+applyAttr(parms_t * prm, Agnode_t * p, Agnode_t * q, Agedge_t * e)
 {
     double xdelta, ydelta;
     double force;
@@ -336,12 +413,12 @@ static void applyAttr(Agnode_t * p, Agnode_t * q, Agedge_t * e)
     ydelta = ND_pos(q)[1] - ND_pos(p)[1];
     dist2 = xdelta * xdelta + ydelta * ydelta;
     while (dist2 == 0.0) {
-	xdelta = 5 - rand() % 10;
-	ydelta = 5 - rand() % 10;
+	xdelta = 5 - gvrand() % 10;
+	ydelta = 5 - gvrand() % 10;
 	dist2 = xdelta * xdelta + ydelta * ydelta;
     }
     dist = sqrt(dist2);
-    if (T_useNew)
+    if (prm->useNew)
 	force = (ED_factor(e) * (dist - ED_dist(e))) / dist;
     else
 	force = (ED_factor(e) * dist) / ED_dist(e);
@@ -351,13 +428,19 @@ static void applyAttr(Agnode_t * p, Agnode_t * q, Agedge_t * e)
     DISP(p)[1] += ydelta * force;
 }
 
-static void updatePos(Agraph_t * g, double temp, bport_t * pp)
+/* updatePos:
+ * Move the nodes by their displacements, limited by temp.
+ * Return the total distance moved.
+ */
+static double
+updatePos(parms_t * prm, Agraph_t * g, double temp, bport_t * pp)
 {
     Agnode_t *n;
     double temp2;
     double len2;
     double x, y, d;
     double dx, dy;
+    double disp = 0;
 
     temp2 = temp * temp;
     for (n = agfstnode(g); n; n = agnxtnode(g, n)) {
@@ -371,15 +454,17 @@ static void updatePos(Agraph_t * g, double temp, bport_t * pp)
 	if (len2 < temp2) {
 	    x = ND_pos(n)[0] + dx;
 	    y = ND_pos(n)[1] + dy;
+	    disp += sqrt(len2);
 	} else {
 	    double fact = temp / (sqrt(len2));
 	    x = ND_pos(n)[0] + dx * fact;
 	    y = ND_pos(n)[1] + dy * fact;
+	    disp += temp;
 	}
 
 	/* if ports, limit by boundary */
 	if (pp) {
-	    d = sqrt((x * x) / T_Wd2 + (y * y) / T_Ht2);
+	    d = sqrt((x * x) / prm->Wd2 + (y * y) / prm->Ht2);
 	    if (IS_PORT(n)) {
 		ND_pos(n)[0] = x / d;
 		ND_pos(n)[1] = y / d;
@@ -395,49 +480,66 @@ static void updatePos(Agraph_t * g, double temp, bport_t * pp)
 	    ND_pos(n)[1] = y;
 	}
     }
+    return disp;
 }
 
 #define FLOOR(d) ((int)floor(d))
 
 /* gAdjust:
+ * The force routines take their parameters from a local copy of
+ * tparms, which, being thread-local, is costly to reach in the
+ * inner loops.
+ * Return the total distance moved.
  */
-static void gAdjust(Agraph_t * g, double temp, bport_t * pp, Grid * grid)
+static double gAdjust(Agraph_t * g, double temp, bport_t * pp, Grid * grid)
 {
+    parms_t lparms = tparms;
+    parms_t *prm = &lparms;
     Agnode_t *n;
     Agedge_t *e;
+    cell *cells;
+    int ncells, k;
 
     if (temp <= 0.0)
-	return;
+	return 0;
 
     clearGrid(grid);
 
     for (n = agfstnode(g); n; n = agnxtnode(g, n)) {
 	DISP(n)[0] = DISP(n)[1] = 0;
-	addGrid(grid, FLOOR((ND_pos(n))[0] / T_Cell), FLOOR((ND_pos(n))[1] / T_Cell),
+	addGrid(grid, FLOOR((ND_pos(n))[0] / prm->Cell), FLOOR((ND_pos(n))[1] / prm->Cell),
 		n);
     }
 
     for (n = agfstnode(g); n; n = agnxtnode(g, n)) {
 	for (e = agfstout(g, n); e; e = agnxtout(g, e))
 	    if (n != aghead(e))
-		applyAttr(n, aghead(e), e);
+		applyAttr(prm, n, aghead(e), e);
     }
-    walkGrid(grid, gridRepulse);
+    cells = gridCells(grid, &ncells);
+    if (prm->nthreads > 0)
+	parRepulse(prm, grid, cells, ncells);
+    else
+	for (k = 0; k < ncells; k++)
+	    gridRepulse(prm, cells + k, grid);
 
 
-    updatePos(g, temp, pp);
+    return updatePos(prm, g, temp, pp);
 }
 
 /* adjust:
+ * As gAdjust, comparing all pairs of nodes.
  */
-static void adjust(Agraph_t * g, double temp, bport_t * pp)
+static double adjust(Agraph_t * g, double temp, bport_t * pp)
 {
+    parms_t lparms = tparms;
+    parms_t *prm = &lparms;
     Agnode_t *n;
     Agnode_t *n1;
     Agedge_t *e;
 
     if (temp <= 0.0)
-	return;
+	return 0;
 
     for (n = agfstnode(g); n; n = agnxtnode(g, n)) {
 	DISP(n)[0] = DISP(n)[1] = 0;
@@ -445,15 +547,15 @@ static void adjust(Agraph_t * g, double temp, bport_t * pp)
 
     for (n = agfstnode(g); n; n = agnxtnode(g, n)) {
 	for (n1 = agnxtnode(g, n); n1; n1 = agnxtnode(g, n1)) {
-	    applyRep(n, n1);
+	    applyRep(prm, n, n1);
 	}
 	for (e = agfstout(g, n); e; e = agnxtout(g, e)) {
 	    if (n != aghead(e))
-		applyAttr(n, aghead(e), e);
+		applyAttr(prm, n, aghead(e), e);
 	}
     }
 
-    updatePos(g, temp, pp);
+    return updatePos(prm, g, temp, pp);
 }
 
 /* initPositions:
@@ -543,7 +645,7 @@ static pointf initPositions(graph_t * g, bport_t * pp)
 	local_seed = getpid() ^ time(NULL);
 #endif
     }
-    srand48(local_seed);
+    gvsrand48(local_seed);
 
     /* If ports, place ports on and nodes within an ellipse centered at origin
      * with halfwidth Wd and halfheight Ht. 
@@ -599,8 +701,8 @@ static pointf initPositions(graph_t * g, bport_t * pp)
 		    ND_pos(np)[1] = 0.9 * p.y + 0.1 * ctr.y;
 /* fprintf (stderr, "%s %d (%g,%g)\n", agnameof(np), cnt, ND_pos(np)[0], ND_pos(np)[1]); */
 		} else {
-		    double angle = PItimes2 * drand48();
-		    double radius = 0.9 * drand48();
+		    double angle = PItimes2 * gvdrand48();
+		    double radius = 0.9 * gvdrand48();
 		    ND_pos(np)[0] = radius * T_Wd * cos(angle);
 		    ND_pos(np)[1] = radius * T_Ht * sin(angle);
 /* fprintf (stderr, "%s 0 (%g,%g)\n", agnameof(np), ND_pos(np)[0], ND_pos(np)[1]); */
@@ -615,14 +717,14 @@ static pointf initPositions(graph_t * g, bport_t * pp)
 		    ND_pos(np)[0] -= ctr.x;
 		    ND_pos(np)[1] -= ctr.y;
 		} else {
-		    ND_pos(np)[0] = T_Wd * (2.0 * drand48() - 1.0);
-		    ND_pos(np)[1] = T_Ht * (2.0 * drand48() - 1.0);
+		    ND_pos(np)[0] = T_Wd * (2.0 * gvdrand48() - 1.0);
+		    ND_pos(np)[1] = T_Ht * (2.0 * gvdrand48() - 1.0);
 		}
 	    }
 	} else {		/* No ports or positions; place randomly */
 	    for (np = agfstnode(g); np; np = agnxtnode(g, np)) {
-		ND_pos(np)[0] = T_Wd * (2.0 * drand48() - 1.0);
-		ND_pos(np)[1] = T_Ht * (2.0 * drand48() - 1.0);
+		ND_pos(np)[0] = T_Wd * (2.0 * gvdrand48() - 1.0);
+		ND_pos(np)[1] = T_Ht * (2.0 * gvdrand48() - 1.0);
 	    }
 	}
     }
@@ -664,30 +766,34 @@ void dumpstat(graph_t * g)
 void fdp_tLayout(graph_t * g, xparams * xpms)
 {
     int i;
-    int reset;
     bport_t *pp = PORTS(g);
     double temp;
     Grid *grid;
     pointf ctr;
     Agnode_t *n;
+    convmon_t cm;
 
-    reset = init_params(g, xpms);
+    tparms = parms;
+    init_params(g, xpms);
     temp = T_T0;
 
     ctr = initPositions(g, pp);
 
+    convInit(&cm, &T_conv, "fdp", T_loopcnt);
     if (T_useGrid) {
 	grid = mkGrid(agnnodes(g));
 	adjustGrid(grid, agnnodes(g));
 	for (i = 0; i < T_loopcnt; i++) {
 	    temp = cool(temp, i);
-	    gAdjust(g, temp, pp, grid);
+	    if (convStep(&cm, -1, gAdjust(g, temp, pp, grid)))
+		break;
 	}
 	delGrid(grid);
     } else {
 	for (i = 0; i < T_loopcnt; i++) {
 	    temp = cool(temp, i);
-	    adjust(g, temp, pp);
+	    if (convStep(&cm, -1, adjust(g, temp, pp)))
+		break;
 	}
     }
 
@@ -698,6 +804,4 @@ void fdp_tLayout(graph_t * g, xparams * xpms)
 	}
     }
 /* dumpstat (g); */
-    if (reset)
-	reset_params();
 }
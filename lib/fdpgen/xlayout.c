@@ -265,8 +265,8 @@ doRep(node_t * p, node_t * q, double xdelta, double ydelta, double dist2)
     /* double factor; */
 
     while (dist2 == 0.0) {
-	xdelta = 5 - rand() % 10;
-	ydelta = 5 - rand() % 10;
+	xdelta = 5 - gvrand() % 10;
+	ydelta = 5 - gvrand() % 10;
 	dist2 = xdelta * xdelta + ydelta * ydelta;
     }
 #if defined(MS)
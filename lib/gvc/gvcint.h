@@ -23,6 +23,7 @@ extern "C" {
 #include "cdt.h"
 #include "gvcommon.h"
 #include "color.h"
+#include "converge.h"
 
     /* active plugin headers */
     typedef struct gvplugin_active_layout_s {
@@ -141,6 +142,10 @@ extern "C" {
 
 	/* whether to mangle font names (at least in SVG), usually false */
 	int fontrenaming;
+
+	/* gvConvergeMonitor() */
+	convergefn_t converge_fn;
+	void *converge_data;
     };
 
 extern GVC_t* gvCloneGVC (GVC_t *);
@@ -118,6 +118,8 @@ GVC_t* gvCloneGVC (GVC_t * gvc0)
     memcpy (&gvc->apis, &gvc0->apis, sizeof(gvc->apis));
     memcpy (&gvc->api, &gvc0->api, sizeof(gvc->api));
     gvc->packages = gvc0->packages;
+    gvc->converge_fn = gvc0->converge_fn;
+    gvc->converge_data = gvc0->converge_data;
     
     return gvc;
 }
@@ -24,6 +24,7 @@
 #include "cgraph.h"
 #include "gvcproc.h"
 #include "gvc.h"
+#include "converge.h"
 
 extern void graph_init(Agraph_t *g, boolean use_rankdir);
 extern void graph_cleanup(Agraph_t *g);
@@ -47,6 +48,16 @@ int gvlayout_select(GVC_t * gvc, const char *layout)
     return NO_SUPPORT;
 }
 
+/* gvConvergeMonitor:
+ * Set the function called on each iteration of the iterative layouts
+ * done with gvc; see converge.h. fn = NULL removes it.
+ */
+void gvConvergeMonitor(GVC_t * gvc, convergefn_t fn, void *data)
+{
+    gvc->converge_fn = fn;
+    gvc->converge_data = data;
+}
+
 /* gvLayoutJobs:
  * Layout input graph g based on layout engine attached to gvc.
  * Check that the root graph has been initialized. If not, initialize it.
@@ -78,6 +89,7 @@ int gvLayoutJobs(GVC_t * gvc, Agraph_t * g)
 	return -1;
 
     gv_fixLocale (1);
+    GD_convstart(agroot(g)) = gvWallTime();
     graph_init(g, gvc->layout.features->flags & LAYOUT_USES_RANKDIR);
     GD_drawing(agroot(g)) = GD_drawing(g);
     gv_initShapes ();
@@ -37,7 +37,7 @@
 
 #define SEPFACT         0.8  /* default esep/sep */
 
-static double margin = 0.05;	/* Create initial bounding box by adding
+#define DFLT_VORO_MARGIN 0.05	/* Create initial bounding box by adding
 				 * margin * dimension around box enclosing
 				 * nodes.
 				 */
@@ -47,40 +47,55 @@ static double incr = 0.05;	/* Increase bounding box by adding
 static int iterations = -1;	/* Number of iterations */
 static int useIter = 0;		/* Use specified number of iterations */
 
-static int doAll = 0;		/* Move all nodes, regardless of overlap */
-static Site **sites;		/* Array of pointers to sites; used in qsort */
-static Site **endSite;		/* Sentinel on sites array */
-static Point nw, ne, sw, se;	/* Corners of clipping window */
-
-static Site **nextSite;
+typedef struct {
+    double x;			/* left side of node's bounding box */
+    int i;			/* index of node in nodeInfo */
+} xitem_t;
 
-static void setBoundBox(Point * ll, Point * ur)
+/* State of one voronoi or scale adjustment. Everything lives here
+ * rather than in globals, so that several graphs can be adjusted at once.
+ */
+typedef struct {
+    vstate_t vs;		/* voronoi diagram state */
+    Point nw, ne, sw, se;	/* Corners of clipping window */
+    int doAll;			/* Move all nodes, regardless of overlap */
+    xitem_t *xorder;		/* Sites sorted by left side, for countOverlap */
+    polywork_t pw;		/* Scratch space of polyOverlap */
+} adjstate_t;
+
+static void setBoundBox(adjstate_t * st, Point * ll, Point * ur)
 {
-    pxmin = ll->x;
-    pxmax = ur->x;
-    pymin = ll->y;
-    pymax = ur->y;
-    nw.x = sw.x = pxmin;
-    ne.x = se.x = pxmax;
-    nw.y = ne.y = pymax;
-    sw.y = se.y = pymin;
+    vstate_t *vs = &st->vs;
+
+    vs->pxmin = ll->x;
+    vs->pxmax = ur->x;
+    vs->pymin = ll->y;
+    vs->pymax = ur->y;
+    st->nw.x = st->sw.x = vs->pxmin;
+    st->ne.x = st->se.x = vs->pxmax;
+    st->nw.y = st->ne.y = vs->pymax;
+    st->sw.y = st->se.y = vs->pymin;
 }
 
  /* freeNodes:
   * Free node resources.
   */
-static void freeNodes(void)
+static void freeNodes(adjstate_t * st)
 {
     int i;
-    Info_t *ip = nodeInfo;
+    Info_t *ip = st->vs.nodeInfo;
 
-    for (i = 0; i < nsites; i++) {
-	breakPoly(&ip->poly);
-	ip++;
+    if (ip) {
+	for (i = 0; i < st->vs.nsites; i++) {
+	    breakPoly(&ip->poly);
+	    ip++;
+	}
     }
-    polyFree();
-    infoinit();			/* Free vertices */
-    free(nodeInfo);
+    polyFree(&st->pw);
+    vfree(&st->vs);		/* Free vertices */
+    free(st->vs.nodeInfo);
+    free(st->vs.sites);
+    free(st->xorder);
 }
 
 /* chkBoundBox:
@@ -91,7 +106,7 @@ static void freeNodes(void)
  *   graph extremes.
  *   In the first two cases, check that graph fits in bounding box.
  */
-static void chkBoundBox(Agraph_t * graph)
+static void chkBoundBox(adjstate_t * st, Agraph_t * graph)
 {
     char *marg;
     Point ll, ur;
@@ -100,11 +115,12 @@ static void chkBoundBox(Agraph_t * graph)
     double xmin, xmax, ymin, ymax;
     double xmn, xmx, ymn, ymx;
     double ydelta, xdelta;
+    double margin = DFLT_VORO_MARGIN;
     Info_t *ip;
     Poly *pp;
     /* int          cnt; */
 
-    ip = nodeInfo;
+    ip = st->vs.nodeInfo;
     pp = &ip->poly;
     x = ip->site.coord.x;
     y = ip->site.coord.y;
@@ -112,7 +128,7 @@ static void chkBoundBox(Agraph_t * graph)
     ymin = pp->origin.y + y;
     xmax = pp->corner.x + x;
     ymax = pp->corner.y + y;
-    for (i = 1; i < nsites; i++) {
+    for (i = 1; i < st->vs.nsites; i++) {
 	ip++;
 	pp = &ip->poly;
 	x = ip->site.coord.x;
@@ -142,27 +158,33 @@ static void chkBoundBox(Agraph_t * graph)
     ur.x = xmax + xdelta;
     ur.y = ymax + ydelta;
 
-    setBoundBox(&ll, &ur);
+    setBoundBox(st, &ll, &ur);
 }
 
  /* makeInfo:
   * For each node in the graph, create a Info data structure 
   */
-static int makeInfo(Agraph_t * graph)
+static int makeInfo(adjstate_t * st, Agraph_t * graph)
 {
     Agnode_t *node;
-    int i;
+    int i, nsites;
     Info_t *ip;
     expand_t pmargin;
     int (*polyf)(Poly *, Agnode_t *, float, float);
 
     nsites = agnnodes(graph);
-    geominit();
+    vinit(&st->vs, nsites);
+    st->doAll = 0;
+    st->xorder = NULL;
+    st->pw.maxcnt = 0;
+    st->pw.tp1 = st->pw.tp2 = st->pw.tp3 = NULL;
 
-    nodeInfo = N_GNEW(nsites, Info_t);
+    st->vs.nodeInfo = N_GNEW(nsites, Info_t);
+    st->vs.sites = N_GNEW(nsites, Site *);
+    st->vs.endSite = st->vs.sites + nsites;
 
     node = agfstnode(graph);
-    ip = nodeInfo;
+    ip = st->vs.nodeInfo;
 
     pmargin = sepFactor (graph);
 
@@ -179,8 +201,8 @@ static int makeInfo(Agraph_t * graph)
 	ip->site.coord.y = ND_pos(node)[1];
 
 	if (polyf(&ip->poly, node, pmargin.x, pmargin.y)) {
-	    free (nodeInfo);
-	    nodeInfo = NULL;
+	    /* only the first i polys need breaking */
+	    st->vs.nsites = i;
 	    return 1;
         }
 
@@ -188,13 +210,16 @@ static int makeInfo(Agraph_t * graph)
 	ip->site.refcnt = 1;
 	ip->node = node;
 	ip->verts = NULL;
+	st->vs.sites[i] = &ip->site;
 	node = agnxtnode(graph, node);
 	ip++;
     }
     return 0;
 }
 
-/* sort sites on y, then x, coord */
+/* sort sites on y, then x, coord, then site number, so that no two
+ * sites compare equal
+ */
 static int scomp(const void *S1, const void *S2)
 {
     Site *s1, *s2;
@@ -209,88 +234,92 @@ static int scomp(const void *S1, const void *S2)
 	return (-1);
     if (s1->coord.x > s2->coord.x)
 	return (1);
+    if (s1->sitenbr < s2->sitenbr)
+	return (-1);
+    if (s1->sitenbr > s2->sitenbr)
+	return (1);
     return (0);
 }
 
  /* sortSites:
-  * Fill array of pointer to sites and sort the sites using scomp
+  * Reset the per-diagram site data and sort the sites using scomp.
+  * The first time through, the sites are in node order and are sorted
+  * with qsort. Afterwards, sites only move a little between
+  * iterations, so the previous order is nearly sorted and an insertion
+  * sort is close to linear. scomp is a total order, so both sorts give
+  * the same order, and hence the same diagram, whatever qsort does
+  * with equal elements.
   */
-static void sortSites(void)
+static void sortSites(adjstate_t * st, int resort)
 {
-    int i;
-    Site **sp;
+    int i, j;
+    Site *s;
+    Site **sites = st->vs.sites;
+    int nsites = st->vs.nsites;
     Info_t *ip;
 
-    if (sites == 0) {
-	sites = N_GNEW(nsites, Site *);
-	endSite = sites + nsites;
-    }
-
-    sp = sites;
-    ip = nodeInfo;
-    infoinit();
+    ip = st->vs.nodeInfo;
+    infoinit(&st->vs);
     for (i = 0; i < nsites; i++) {
-	*sp++ = &(ip->site);
 	ip->verts = NULL;
 	ip->site.refcnt = 1;
 	ip++;
     }
 
-    qsort(sites, nsites, sizeof(Site *), scomp);
-
-    /* Reset site index for nextOne */
-    nextSite = sites;
+    if (resort) {
+	for (i = 1; i < nsites; i++) {
+	    s = sites[i];
+	    for (j = i; j > 0 && scomp(&sites[j - 1], &s) > 0; j--)
+		sites[j] = sites[j - 1];
+	    sites[j] = s;
+	}
+    } else
+	qsort(sites, nsites, sizeof(Site *), scomp);
 
+    /* Reset site index for nextsite */
+    st->vs.nextSite = sites;
 }
 
-static void geomUpdate(int doSort)
+static void geomUpdate(adjstate_t * st, int doSort)
 {
     int i;
+    vstate_t *vs = &st->vs;
+    Site **sites = vs->sites;
 
     if (doSort)
-	sortSites();
+	sortSites(st, 1);
 
     /* compute ranges */
-    xmin = sites[0]->coord.x;
-    xmax = sites[0]->coord.x;
-    for (i = 1; i < nsites; i++) {
-	if (sites[i]->coord.x < xmin)
-	    xmin = sites[i]->coord.x;
-	if (sites[i]->coord.x > xmax)
-	    xmax = sites[i]->coord.x;
+    vs->xmin = sites[0]->coord.x;
+    vs->xmax = sites[0]->coord.x;
+    for (i = 1; i < vs->nsites; i++) {
+	if (sites[i]->coord.x < vs->xmin)
+	    vs->xmin = sites[i]->coord.x;
+	if (sites[i]->coord.x > vs->xmax)
+	    vs->xmax = sites[i]->coord.x;
     }
-    ymin = sites[0]->coord.y;
-    ymax = sites[nsites - 1]->coord.y;
-
-    deltay = ymax - ymin;
-    deltax = xmax - xmin;
-}
-
-static Site *nextOne(void)
-{
-    Site *s;
+    vs->ymin = sites[0]->coord.y;
+    vs->ymax = sites[vs->nsites - 1]->coord.y;
 
-    if (nextSite < endSite) {
-	s = *nextSite++;
-	return (s);
-    } else
-	return ((Site *) NULL);
+    vs->deltay = vs->ymax - vs->ymin;
+    vs->deltax = vs->xmax - vs->xmin;
 }
 
 /* rmEquality:
  * Check for nodes with identical positions and tweak
  * the positions.
  */
-static void rmEquality(void)
+static void rmEquality(adjstate_t * st)
 {
     int i, cnt;
     Site **ip;
     Site **jp;
     Site **kp;
+    Site **endSite = st->vs.endSite;
     double xdel;
 
-    sortSites();
-    ip = sites;
+    sortSites(st, 0);
+    ip = st->vs.sites;
 
     while (ip < endSite) {
 	jp = ip + 1;
@@ -323,9 +352,9 @@ static void rmEquality(void)
 	} else {		/* nothing is to the right */
 	    Info_t *info;
 	    for (jp = ip + 1; jp < kp; ip++, jp++) {
-		info = nodeInfo + (*ip)->sitenbr;
+		info = st->vs.nodeInfo + (*ip)->sitenbr;
 		xdel = info->poly.corner.x - info->poly.origin.x;
-		info = nodeInfo + (*jp)->sitenbr;
+		info = st->vs.nodeInfo + (*jp)->sitenbr;
 		xdel += info->poly.corner.x - info->poly.origin.x;
 		(*jp)->coord.x = (*ip)->coord.x + xdel / 2;
 	    }
@@ -334,31 +363,62 @@ static void rmEquality(void)
     }
 }
 
+/* sort nodes on left side of bounding box, then node index */
+static int xcomp(const void *X1, const void *X2)
+{
+    xitem_t *p = (xitem_t *) X1;
+    xitem_t *q = (xitem_t *) X2;
+
+    if (p->x < q->x)
+	return (-1);
+    if (p->x > q->x)
+	return (1);
+    return (p->i - q->i);
+}
+
 /* countOverlap:
  * Count number of node-node overlaps at iteration iter.
+ * Nodes are swept in order of the left side of their bounding boxes,
+ * so only pairs whose x extents intersect are passed to polyOverlap.
+ * The extents are computed and compared as polyOverlap does, so the
+ * count and overlap flags are those of testing every pair.
  */
-static int countOverlap(int iter)
+static int countOverlap(adjstate_t * st, int iter)
 {
     int count = 0;
-    int i, j;
-    Info_t *ip = nodeInfo;
-    Info_t *jp;
+    int i, j, k, m;
+    int nsites = st->vs.nsites;
+    Info_t *nodeInfo = st->vs.nodeInfo;
+    Info_t *ip;
+    xitem_t *xorder;
+    double right;
 
-    for (i = 0; i < nsites; i++)
-	nodeInfo[i].overlaps = 0;
+    if (!st->xorder)
+	st->xorder = N_GNEW(nsites, xitem_t);
+    xorder = st->xorder;
 
-    for (i = 0; i < nsites - 1; i++) {
-	jp = ip + 1;
-	for (j = i + 1; j < nsites; j++) {
-	    if (polyOverlap
-		(ip->site.coord, &ip->poly, jp->site.coord, &jp->poly)) {
+    for (i = 0; i < nsites; i++) {
+	ip = nodeInfo + i;
+	ip->overlaps = 0;
+	xorder[i].x = ip->site.coord.x + ip->poly.origin.x;
+	xorder[i].i = i;
+    }
+    qsort(xorder, nsites, sizeof(xitem_t), xcomp);
+
+    for (k = 0; k < nsites - 1; k++) {
+	ip = nodeInfo + xorder[k].i;
+	right = ip->site.coord.x + ip->poly.corner.x;
+	for (m = k + 1; m < nsites && xorder[m].x <= right; m++) {
+	    /* test in node order, as a full scan would */
+	    i = MIN(xorder[k].i, xorder[m].i);
+	    j = MAX(xorder[k].i, xorder[m].i);
+	    if (polyOverlap(nodeInfo[i].site.coord, &nodeInfo[i].poly,
+			    nodeInfo[j].site.coord, &nodeInfo[j].poly, &st->pw)) {
 		count++;
-		ip->overlaps = 1;
-		jp->overlaps = 1;
+		nodeInfo[i].overlaps = 1;
+		nodeInfo[j].overlaps = 1;
 	    }
-	    jp++;
 	}
-	ip++;
     }
 
     if (Verbose > 1)
@@ -366,15 +426,15 @@ static int countOverlap(int iter)
     return count;
 }
 
-static void increaseBoundBox(void)
+static void increaseBoundBox(adjstate_t * st)
 {
     double ydelta, xdelta;
     Point ll, ur;
 
-    ur.x = pxmax;
-    ur.y = pymax;
-    ll.x = pxmin;
-    ll.y = pymin;
+    ur.x = st->vs.pxmax;
+    ur.y = st->vs.pymax;
+    ll.x = st->vs.pxmin;
+    ll.y = st->vs.pymin;
 
     ydelta = incr * (ur.y - ll.y);
     xdelta = incr * (ur.x - ll.x);
@@ -384,7 +444,7 @@ static void increaseBoundBox(void)
     ll.x -= xdelta;
     ll.y -= ydelta;
 
-    setBoundBox(&ll, &ur);
+    setBoundBox(st, &ll, &ur);
 }
 
  /* areaOf:
@@ -448,38 +508,38 @@ static void newpos(Info_t * ip)
   * Add corners of clipping window to appropriate sites.
   * A site gets a corner if it is the closest site to that corner.
   */
-static void addCorners(void)
+static void addCorners(adjstate_t * st)
 {
-    Info_t *ip = nodeInfo;
+    Info_t *ip = st->vs.nodeInfo;
     Info_t *sws = ip;
     Info_t *nws = ip;
     Info_t *ses = ip;
     Info_t *nes = ip;
-    double swd = dist_2(&ip->site.coord, &sw);
-    double nwd = dist_2(&ip->site.coord, &nw);
-    double sed = dist_2(&ip->site.coord, &se);
-    double ned = dist_2(&ip->site.coord, &ne);
+    double swd = dist_2(&ip->site.coord, &st->sw);
+    double nwd = dist_2(&ip->site.coord, &st->nw);
+    double sed = dist_2(&ip->site.coord, &st->se);
+    double ned = dist_2(&ip->site.coord, &st->ne);
     double d;
     int i;
 
     ip++;
-    for (i = 1; i < nsites; i++) {
-	d = dist_2(&ip->site.coord, &sw);
+    for (i = 1; i < st->vs.nsites; i++) {
+	d = dist_2(&ip->site.coord, &st->sw);
 	if (d < swd) {
 	    swd = d;
 	    sws = ip;
 	}
-	d = dist_2(&ip->site.coord, &se);
+	d = dist_2(&ip->site.coord, &st->se);
 	if (d < sed) {
 	    sed = d;
 	    ses = ip;
 	}
-	d = dist_2(&ip->site.coord, &nw);
+	d = dist_2(&ip->site.coord, &st->nw);
 	if (d < nwd) {
 	    nwd = d;
 	    nws = ip;
 	}
-	d = dist_2(&ip->site.coord, &ne);
+	d = dist_2(&ip->site.coord, &st->ne);
 	if (d < ned) {
 	    ned = d;
 	    nes = ip;
@@ -487,10 +547,10 @@ static void addCorners(void)
 	ip++;
     }
 
-    addVertex(&sws->site, sw.x, sw.y);
-    addVertex(&ses->site, se.x, se.y);
-    addVertex(&nws->site, nw.x, nw.y);
-    addVertex(&nes->site, ne.x, ne.y);
+    addVertex(&st->vs, &sws->site, st->sw.x, st->sw.y);
+    addVertex(&st->vs, &ses->site, st->se.x, st->se.y);
+    addVertex(&st->vs, &nws->site, st->nw.x, st->nw.y);
+    addVertex(&st->vs, &nes->site, st->ne.x, st->ne.y);
 }
 
  /* newPos:
@@ -501,36 +561,20 @@ static void addCorners(void)
   * We first add the corner of the clipping windows to the
   * vertex lists of the appropriate sites.
   */
-static void newPos(void)
+static void newPos(adjstate_t * st)
 {
     int i;
-    Info_t *ip = nodeInfo;
+    Info_t *ip = st->vs.nodeInfo;
 
-    addCorners();
-    for (i = 0; i < nsites; i++) {
-	if (doAll || ip->overlaps)
+    addCorners(st);
+    for (i = 0; i < st->vs.nsites; i++) {
+	if (st->doAll || ip->overlaps)
 	    newpos(ip);
 	ip++;
     }
 }
 
-/* cleanup:
- * Cleanup voronoi memory.
- * Note that PQcleanup and ELcleanup rely on the number
- * of sites, so should at least be reset everytime we use
- * vAdjust.
- * This could be optimized, over multiple components or
- * even multiple graphs, but probably not worth it.
- */
-static void cleanup(void)
-{
-    PQcleanup();
-    ELcleanup();
-    siteinit();			/* free memory */
-    edgeinit();			/* free memory */
-}
-
-static int vAdjust(void)
+static int vAdjust(adjstate_t * st)
 {
     int iterCnt = 0;
     int overlapCnt = 0;
@@ -539,21 +583,21 @@ static int vAdjust(void)
     int cnt;
 
     if (!useIter || (iterations > 0))
-	overlapCnt = countOverlap(iterCnt);
+	overlapCnt = countOverlap(st, iterCnt);
 
     if ((overlapCnt == 0) || (iterations == 0))
 	return 0;
 
-    rmEquality();
-    geomUpdate(0);
-    voronoi(0, nextOne);
+    rmEquality(st);
+    geomUpdate(st, 0);
+    voronoi(&st->vs);
     while (1) {
-	newPos();
+	newPos(st);
 	iterCnt++;
 
 	if (useIter && (iterCnt == iterations))
 	    break;
-	cnt = countOverlap(iterCnt);
+	cnt = countOverlap(st, iterCnt);
 	if (cnt == 0)
 	    break;
 	if (cnt >= overlapCnt)
@@ -564,22 +608,22 @@ static int vAdjust(void)
 
 	switch (badLevel) {
 	case 0:
-	    doAll = 1;
+	    st->doAll = 1;
 	    break;
 /*
       case 1:
-        doAll = 1;
+        st->doAll = 1;
         break;
 */
 	default:
-	    doAll = 1;
+	    st->doAll = 1;
 	    increaseCnt++;
-	    increaseBoundBox();
+	    increaseBoundBox(st);
 	    break;
 	}
 
-	geomUpdate(1);
-	voronoi(0, nextOne);
+	geomUpdate(st, 1);
+	voronoi(&st->vs);
     }
 
     if (Verbose) {
@@ -587,17 +631,16 @@ static int vAdjust(void)
 	fprintf(stderr, "Number of increases = %d\n", increaseCnt);
     }
 
-    cleanup();
     return 1;
 }
 
-static double rePos(Point c)
+static double rePos(adjstate_t * st, Point c)
 {
     int i;
-    Info_t *ip = nodeInfo;
+    Info_t *ip = st->vs.nodeInfo;
     double f = 1.0 + incr;
 
-    for (i = 0; i < nsites; i++) {
+    for (i = 0; i < st->vs.nsites; i++) {
 	/* ip->site.coord.x = f*(ip->site.coord.x - c.x) + c.x; */
 	/* ip->site.coord.y = f*(ip->site.coord.y - c.y) + c.y; */
 	ip->site.coord.x = f * ip->site.coord.x;
@@ -607,7 +650,7 @@ static double rePos(Point c)
     return f;
 }
 
-static int sAdjust(void)
+static int sAdjust(adjstate_t * st)
 {
     int iterCnt = 0;
     int overlapCnt = 0;
@@ -616,21 +659,21 @@ static int sAdjust(void)
     /* double sc; */
 
     if (!useIter || (iterations > 0))
-	overlapCnt = countOverlap(iterCnt);
+	overlapCnt = countOverlap(st, iterCnt);
 
     if ((overlapCnt == 0) || (iterations == 0))
 	return 0;
 
-    rmEquality();
-    center.x = (pxmin + pxmax) / 2.0;
-    center.y = (pymin + pymax) / 2.0;
+    rmEquality(st);
+    center.x = (st->vs.pxmin + st->vs.pxmax) / 2.0;
+    center.y = (st->vs.pymin + st->vs.pymax) / 2.0;
     while (1) {
-	/* sc = */ rePos(center);
+	/* sc = */ rePos(st, center);
 	iterCnt++;
 
 	if (useIter && (iterCnt == iterations))
 	    break;
-	cnt = countOverlap(iterCnt);
+	cnt = countOverlap(st, iterCnt);
 	if (cnt == 0)
 	    break;
     }
@@ -645,15 +688,15 @@ static int sAdjust(void)
  /* updateGraph:
   * Enter new node positions into the graph
   */
-static void updateGraph(Agraph_t * graph)
+static void updateGraph(adjstate_t * st)
 {
     /* Agnode_t*    node; */
     int i;
     Info_t *ip;
     /* char         pos[100]; */
 
-    ip = nodeInfo;
-    for (i = 0; i < nsites; i++) {
+    ip = st->vs.nodeInfo;
+    for (i = 0; i < st->vs.nsites; i++) {
 	ND_pos(ip->node)[0] = ip->site.coord.x;
 	ND_pos(ip->node)[1] = ip->site.coord.y;
 	ip++;
@@ -671,7 +714,8 @@ static void updateGraph(Agraph_t * graph)
 double *getSizes(Agraph_t * g, pointf pad, int* n_elabels, int** elabels)
 {
     Agnode_t *n;
-    real *sizes = N_GNEW(Ndim * agnnodes(g), real);
+    int dim = GD_ndim(agroot(g));
+    real *sizes = N_GNEW(dim * agnnodes(g), real);
     int i, nedge_nodes = 0;
     int* elabs;
 
@@ -679,8 +723,8 @@ double *getSizes(Agraph_t * g, pointf pad, int* n_elabels, int** elabels)
 	if (elabels && IS_LNODE(n)) nedge_nodes++;
 
 	i = ND_id(n);
-	sizes[i * Ndim] = ND_width(n) * .5 + pad.x;
-	sizes[i * Ndim + 1] = ND_height(n) * .5 + pad.y;
+	sizes[i * dim] = ND_width(n) * .5 + pad.x;
+	sizes[i * dim + 1] = ND_height(n) * .5 + pad.y;
     }
 
     if (elabels && nedge_nodes) {
@@ -773,14 +817,16 @@ SparseMatrix makeMatrix(Agraph_t* g, int dim, SparseMatrix *D)
 static int
 fdpAdjust (graph_t* g, adjust_data* am)
 {
-    SparseMatrix A0 = makeMatrix(g, Ndim, NULL);
+    int dim = GD_ndim(agroot(g));
+    SparseMatrix A0 = makeMatrix(g, dim, NULL);
     SparseMatrix A = A0;
     real *sizes;
-    real *pos = N_NEW(Ndim * agnnodes(g), real);
+    real *pos = N_NEW(dim * agnnodes(g), real);
     Agnode_t *n;
     int flag, i;
     expand_t sep = sepFactor(g);
     pointf pad;
+    convparms_t cp;
 
     if (sep.doAdd) {
 	pad.x = PS2INCH(sep.x);
@@ -792,8 +838,8 @@ fdpAdjust (graph_t* g, adjust_data* am)
     sizes = getSizes(g, pad, NULL, NULL);
 
     for (n = agfstnode(g); n; n = agnxtnode(g, n)) {
-	real* npos = pos + (Ndim * ND_id(n));
-	for (i = 0; i < Ndim; i++) {
+	real* npos = pos + (dim * ND_id(n));
+	for (i = 0; i < dim; i++) {
 	    npos[i] = ND_pos(n)[i];
 	}
     }
@@ -805,12 +851,13 @@ fdpAdjust (graph_t* g, adjust_data* am)
 	A = SparseMatrix_remove_diagonal(A);
     }
 
-    remove_overlap(Ndim, A, pos, sizes, am->value, am->scaling, 
-		   ELSCHEME_NONE, 0, NULL, NULL, mapBool (agget(g, "overlap_shrink"), TRUE), &flag);
+    getConvParms(g, &cp);
+    remove_overlap(dim, A, pos, sizes, am->value, am->scaling, 
+		   ELSCHEME_NONE, 0, NULL, NULL, mapBool (agget(g, "overlap_shrink"), TRUE), &cp, &flag);
 
     for (n = agfstnode(g); n; n = agnxtnode(g, n)) {
-	real *npos = pos + (Ndim * ND_id(n));
-	for (i = 0; i < Ndim; i++) {
+	real *npos = pos + (dim * ND_id(n));
+	for (i = 0; i < dim; i++) {
 	    ND_pos(n)[i] = npos[i];
 	}
     }
@@ -1119,6 +1166,7 @@ int
 removeOverlapWith (graph_t * G, adjust_data* am)
 {
     int ret, nret;
+    adjstate_t st;
 
     if (agnnodes(G) < 2)
 	return 0;
@@ -1188,27 +1236,23 @@ removeOverlapWith (graph_t * G, adjust_data* am)
 
     /* create main array */
 /* start_timer(); */
-    if (makeInfo(G)) {
-	freeNodes();
-	free(sites);
-	sites = 0;
+    if (makeInfo(&st, G)) {
+	freeNodes(&st);
 	return nret;
     }
 
     /* establish and verify bounding box */
-    chkBoundBox(G);
+    chkBoundBox(&st, G);
 
     if (am->mode == AM_SCALE)
-	ret = sAdjust();
+	ret = sAdjust(&st);
     else
-	ret = vAdjust();
+	ret = vAdjust(&st);
 
     if (ret)
-	updateGraph(G);
+	updateGraph(&st);
 
-    freeNodes();
-    free(sites);
-    sites = 0;
+    freeNodes(&st);
 /* fprintf (stderr, "%s %.4f sec\n", am->print, elapsed_sec()); */
 
     return ret+nret;
@@ -88,7 +88,7 @@ typedef struct {
 #define parent(i) ((i)/2)
 #define insideHeap(h,i) ((i)<h->heapSize)
 #define greaterPriority(h,i,j) \
-  (LT(h->data[i],h->data[j]) || ((EQ(h->data[i],h->data[j])) && (rand()%2)))
+  (LT(h->data[i],h->data[j]) || ((EQ(h->data[i],h->data[j])) && (gvrand()%2)))
 
 #define exchange(h,i,j) {Pair temp; \
         temp=h->data[i]; \
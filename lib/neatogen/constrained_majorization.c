@@ -39,6 +39,7 @@ int stress_majorization_with_hierarchy(vtx_data * graph,	/* Input graph in spars
 				       int opts,	/* options */
 				       int model,	/* difference model */
 				       int maxi,	/* max iterations */
+				       double eps,	/* convergence tolerance */
 				       double levels_gap)
 {
     int iterations = 0;		/* Output: number of iteration of the process */
@@ -99,7 +100,7 @@ int stress_majorization_with_hierarchy(vtx_data * graph,	/* Input graph in spars
     if (!directionalityExist) {
 	return stress_majorization_kD_mkernel(graph, n, nedges_graph,
 					      d_coords, nodes, dim, opts,
-					      model, maxi);
+					      model, maxi, eps, NULL, 1);
     }
 
 	/******************************************************************
@@ -113,7 +114,7 @@ int stress_majorization_with_hierarchy(vtx_data * graph,	/* Input graph in spars
 	    /* the dim==2 case is handled below                      */
 	    if (stress_majorization_kD_mkernel(graph, n, nedges_graph,
 					   d_coords + 1, nodes, dim - 1,
-					   opts, model, 15) < 0)
+					   opts, model, 15, eps, NULL, 1) < 0)
 		return -1;
 	    /* now copy the y-axis into the (dim-1)-axis */
 	    for (i = 0; i < n; i++) {
@@ -136,7 +137,7 @@ int stress_majorization_with_hierarchy(vtx_data * graph,	/* Input graph in spars
 	    /* no hierarchy found, use faster algorithm */
 	    return stress_majorization_kD_mkernel(graph, n, nedges_graph,
 						  d_coords, nodes, dim,
-						  opts, model, maxi);
+						  opts, model, maxi, eps, NULL, 1);
 	}
 
 	if (levels_gap > 0) {
@@ -156,7 +157,7 @@ int stress_majorization_with_hierarchy(vtx_data * graph,	/* Input graph in spars
 	    }
 	}
 	if (dim == 2) {
-	    if (IMDS_given_dim(graph, n, y, x, Epsilon)) {
+	    if (IMDS_given_dim(graph, n, y, x, eps)) {
 		iterations = -1;
 		goto finish;
 	    }
@@ -189,7 +190,7 @@ int stress_majorization_with_hierarchy(vtx_data * graph,	/* Input graph in spars
 	/* and perform slower Dijkstra-based computation */
 	if (Verbose)
 	    fprintf(stderr, "Calculating subset model");
-	Dij = compute_apsp_artifical_weights_packed(graph, n);
+	Dij = compute_apsp_artifical_weights_packed(graph, n, 1);
     } else if (model == MODEL_CIRCUIT) {
 	Dij = circuitModel(graph, n);
 	if (!Dij) {
@@ -201,12 +202,12 @@ int stress_majorization_with_hierarchy(vtx_data * graph,	/* Input graph in spars
     } else if (model == MODEL_MDS) {
 	if (Verbose)
 	    fprintf(stderr, "Calculating MDS model");
-	Dij = mdsModel(graph, n);
+	Dij = mdsModel(graph, n, 1);
     }
     if (!Dij) {
 	if (Verbose)
 	    fprintf(stderr, "Calculating shortest paths");
-	Dij = compute_apsp_packed(graph, n);
+	Dij = compute_apsp_packed(graph, n, 1);
     }
     if (Verbose) {
 	fprintf(stderr, ": %.2f sec\n", elapsed_sec());
@@ -458,7 +459,7 @@ int stress_majorization_with_hierarchy(vtx_data * graph,	/* Input graph in spars
 	/* check for convergence */
 	converged =
 	    fabs(new_stress - old_stress) / fabs(old_stress + 1e-10) <
-	    Epsilon;
+	    eps;
 	converged = converged || (iterations > 1
 				  && new_stress > old_stress);
 	/* in first iteration we allowed stress increase, which 
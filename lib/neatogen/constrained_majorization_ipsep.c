@@ -62,6 +62,7 @@ int stress_majorization_cola(vtx_data * graph,	/* Input graph in sparse represen
 			     int dim,	/* Dimemsionality of layout */
 			     int model,	/* difference model */
 			     int maxi,	/* max iterations */
+			     double eps,	/* convergence tolerance */
 			     ipsep_options * opt)
 {
     int iterations = 0;		/* Output: number of iteration of the process */
@@ -128,7 +129,7 @@ int stress_majorization_cola(vtx_data * graph,	/* Input graph in sparse represen
 	/* and perform slower Dijkstra-based computation */
 	if (Verbose)
 	    fprintf(stderr, "Calculating subset model");
-	Dij = compute_apsp_artifical_weights_packed(graph, n);
+	Dij = compute_apsp_artifical_weights_packed(graph, n, 1);
     } else if (model == MODEL_CIRCUIT) {
 	Dij = circuitModel(graph, n);
 	if (!Dij) {
@@ -140,12 +141,12 @@ int stress_majorization_cola(vtx_data * graph,	/* Input graph in sparse represen
     } else if (model == MODEL_MDS) {
 	if (Verbose)
 	    fprintf(stderr, "Calculating MDS model");
-	Dij = mdsModel(graph, n);
+	Dij = mdsModel(graph, n, 1);
     }
     if (!Dij) {
 	if (Verbose)
 	    fprintf(stderr, "Calculating shortest paths");
-	Dij = compute_apsp_packed(graph, n);
+	Dij = compute_apsp_packed(graph, n, 1);
     }
     if (Verbose) {
 	fprintf(stderr, ": %.2f sec\n", elapsed_sec());
@@ -379,7 +380,7 @@ int stress_majorization_cola(vtx_data * graph,	/* Input graph in sparse represen
 	}
 	converged = new_stress < old_stress
 	    && fabs(new_stress - old_stress) / fabs(old_stress + 1e-10) <
-	    Epsilon;
+	    eps;
 	/*converged = converged || (iterations>1 && new_stress>old_stress); */
 	/* in first iteration we allowed stress increase, which 
 	 * might result ny imposing constraints
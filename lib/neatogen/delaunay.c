@@ -316,6 +316,7 @@ static void addEdge (GtsSegment * e, estate* es)
  * instead of having a global variable.
  */
 static double* _vals;
+#pragma omp threadprivate(_vals)
 typedef int (*qsort_cmpf) (const void *, const void *);
 
 static int 
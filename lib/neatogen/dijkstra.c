@@ -158,12 +158,12 @@ void dijkstra(int vertex, vtx_data * graph, int n, DistType * dist)
     heap H;
     int closestVertex, neighbor;
     DistType closestDist, prevClosestDist = INT_MAX;
-    static int *index;
+    int *index;
 
 #ifdef OBSOLETE
     mkHeap(&H, n);
 #endif
-    index = (int *) realloc(index, n * sizeof(int));
+    index = N_GNEW(n, int);
 
     /* initial distances with edge weights: */
     for (i = 0; i < n; i++)
@@ -193,6 +193,7 @@ void dijkstra(int vertex, vtx_data * graph, int n, DistType * dist)
 	if (dist[i] == MAX_DIST)	/* 'i' is not connected to 'vertex' */
 	    dist[i] = prevClosestDist + 10;
     freeHeap(&H);
+    free(index);
 }
 
  /* Dijkstra bounded to nodes in *unweighted* radius */
@@ -205,9 +206,8 @@ dijkstra_bounded(int vertex, vtx_data * graph, int n, DistType * dist,
 {
     int num_visited_nodes;
     int i;
-    static boolean *node_in_neighborhood = NULL;
-    static int size = 0;
-    static int *index;
+    boolean *node_in_neighborhood;
+    int *index;
     Queue Q;
     heap H;
     int closestVertex, neighbor;
@@ -222,14 +222,8 @@ dijkstra_bounded(int vertex, vtx_data * graph, int n, DistType * dist,
     }
     num_visited_nodes =
 	bfs_bounded(vertex, graph, n, dist, &Q, bound, visited_nodes);
-    if (size < n) {
-	node_in_neighborhood =
-	    (boolean *) realloc(node_in_neighborhood, n * sizeof(boolean));
-	for (i = size; i < n; i++) {
-	    node_in_neighborhood[i] = FALSE;
-	}
-	size = n;
-    }
+    /* dist is cleared above, so this O(n) allocation costs no more */
+    node_in_neighborhood = N_NEW(n, boolean);
     for (i = 0; i < num_visited_nodes; i++) {
 	node_in_neighborhood[visited_nodes[i]] = TRUE;
     }
@@ -238,7 +232,7 @@ dijkstra_bounded(int vertex, vtx_data * graph, int n, DistType * dist,
 #ifdef OBSOLETE
     mkHeap(&H, n);
 #endif
-    index = (int *) realloc(index, n * sizeof(int));
+    index = N_GNEW(n, int);
 
     /* initial distances with edge weights: */
     for (i = 0; i < n; i++)	/* far, TOO COSTLY (O(n))! */
@@ -267,10 +261,8 @@ dijkstra_bounded(int vertex, vtx_data * graph, int n, DistType * dist,
 	}
     }
 
-    /* restore initial false-status of 'node_in_neighborhood' */
-    for (i = 0; i < num_visited_nodes; i++) {
-	node_in_neighborhood[visited_nodes[i]] = FALSE;
-    }
+    free(node_in_neighborhood);
+    free(index);
     freeHeap(&H);
     freeQueue(&Q);
     return num_visited_nodes;
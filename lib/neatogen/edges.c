@@ -18,23 +18,18 @@
 #include <math.h>
 
 
-double pxmin, pxmax, pymin, pymax;	/* clipping window */
-
-static int nedges;
-static Freelist efl;
-
-void edgeinit()
+void edgeinit(vstate_t * vs)
 {
-    freeinit(&efl, sizeof(Edge));
-    nedges = 0;
+    freereset(&vs->efl);
+    vs->nedges = 0;
 }
 
-Edge *gvbisect(Site * s1, Site * s2)
+Edge *gvbisect(vstate_t * vs, Site * s1, Site * s2)
 {
     double dx, dy, adx, ady;
     Edge *newedge;
 
-    newedge = (Edge *) getfree(&efl);
+    newedge = (Edge *) getfree(&vs->efl);
 
     newedge->reg[0] = s1;
     newedge->reg[1] = s2;
@@ -59,27 +54,30 @@ Edge *gvbisect(Site * s1, Site * s2)
 	newedge->c /= dy;
     };
 
-    newedge->edgenbr = nedges;
+    newedge->edgenbr = vs->nedges;
 #ifdef STANDALONE
     out_bisector(newedge);
 #endif
-    nedges += 1;
+    vs->nedges += 1;
     return (newedge);
 }
 
 
-static void doSeg(Edge * e, double x1, double y1, double x2, double y2)
+static void doSeg(vstate_t * vs, Edge * e, double x1, double y1,
+		  double x2, double y2)
 {
-    addVertex(e->reg[0], x1, y1);
-    addVertex(e->reg[0], x2, y2);
-    addVertex(e->reg[1], x1, y1);
-    addVertex(e->reg[1], x2, y2);
+    addVertex(vs, e->reg[0], x1, y1);
+    addVertex(vs, e->reg[0], x2, y2);
+    addVertex(vs, e->reg[1], x1, y1);
+    addVertex(vs, e->reg[1], x2, y2);
 }
 
-void clip_line(Edge * e)
+void clip_line(vstate_t * vs, Edge * e)
 {
     Site *s1, *s2;
     double x1, x2, y1, y2;
+    double pxmin = vs->pxmin, pxmax = vs->pxmax;
+    double pymin = vs->pymin, pymax = vs->pymax;
 
     if (e->a == 1.0 && e->b >= 0.0) {
 	s1 = e->ep[1];
@@ -189,24 +187,24 @@ void clip_line(Edge * e)
 	};
     }
 
-    doSeg(e, x1, y1, x2, y2);
+    doSeg(vs, e, x1, y1, x2, y2);
 #ifdef STANDALONE
     if (doPS)
 	line(x1, y1, x2, y2);
 #endif
 }
 
-void endpoint(Edge * e, int lr, Site * s)
+void endpoint(vstate_t * vs, Edge * e, int lr, Site * s)
 {
     e->ep[lr] = s;
     ref(s);
     if (e->ep[re - lr] == (Site *) NULL)
 	return;
-    clip_line(e);
+    clip_line(vs, e);
 #ifdef STANDALONE
     out_ep(e);
 #endif
-    deref(e->reg[le]);
-    deref(e->reg[re]);
-    makefree(e, &efl);
+    deref(vs, e->reg[le]);
+    deref(vs, e->reg[re]);
+    makefree(e, &vs->efl);
 }
@@ -32,11 +32,10 @@ extern "C" {
 #define le 0
 #define re 1
 
-    extern double pxmin, pxmax, pymin, pymax;	/* clipping window */
-    extern void edgeinit(void);
-    extern void endpoint(Edge *, int, Site *);
-    extern void clip_line(Edge * e);
-    extern Edge *gvbisect(Site *, Site *);
+    extern void edgeinit(vstate_t *);
+    extern void endpoint(vstate_t *, Edge *, int, Site *);
+    extern void clip_line(vstate_t *, Edge * e);
+    extern Edge *gvbisect(vstate_t *, Site *, Site *);
 
 #endif
 
@@ -63,7 +63,7 @@ void embed_graph(vtx_data * graph, int n, int dim, DistType *** Coords,
     }
 
     /* select the first pivot */
-    node = rand() % n;
+    node = gvrand() % n;
 
     mkQueue(&Q, n);
     if (reweight_graph) {
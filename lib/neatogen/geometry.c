@@ -17,23 +17,6 @@
 
 Point origin = { 0, 0 };
 
-double xmin, xmax, ymin, ymax;	/* min and max x and y values of sites */
-double deltax,			/* xmax - xmin */
- deltay;			/* ymax - ymin */
-
-int nsites;
-int sqrt_nsites;
-
-void geominit()
-{
-    double sn;
-
-    sn = nsites + 4;
-    sqrt_nsites = (int) sqrt(sn);
-    /* deltay = ymax - ymin; */
-    /* deltax = xmax - xmin; */
-}
-
 double dist_2(Point * pp, Point * qp)
 {
     double dx = pp->x - qp->x;
@@ -28,15 +28,11 @@ extern "C" {
     } Point;
 #endif
 
-    extern Point origin;
-
-    extern double xmin, xmax, ymin, ymax;	/* extreme x,y values of sites */
-    extern double deltax, deltay;	/* xmax - xmin, ymax - ymin */
+    /* State of a Voronoi diagram computation; see voronoi.h */
+    typedef struct vstate_s vstate_t;
 
-    extern int nsites;		/* Number of sites */
-    extern int sqrt_nsites;
+    extern Point origin;
 
-    extern void geominit(void);
     extern double dist_2(Point *, Point *);	/* Distance squared between two points */
     extern void subpt(Point * a, Point b, Point c);
     extern void addpt(Point * a, Point b, Point c);
@@ -16,40 +16,35 @@
 #include <stdio.h>
 
 #include "mem.h"
-#include "hedges.h"
+#include "voronoi.h"
 #include "heap.h"
 
 
-static Halfedge *PQhash;
-static int PQhashsize;
-static int PQcount;
-static int PQmin;
-
-static int PQbucket(Halfedge * he)
+static int PQbucket(vstate_t * vs, Halfedge * he)
 {
     int bucket;
     double b;
 
-    b = (he->ystar - ymin) / deltay * PQhashsize;
+    b = (he->ystar - vs->ymin) / vs->deltay * vs->PQhashsize;
     if (b < 0)
 	bucket = 0;
-    else if (b >= PQhashsize)
-	bucket = PQhashsize - 1;
+    else if (b >= vs->PQhashsize)
+	bucket = vs->PQhashsize - 1;
     else
 	bucket = b;
-    if (bucket < PQmin)
-	PQmin = bucket;
+    if (bucket < vs->PQmin)
+	vs->PQmin = bucket;
     return (bucket);
 }
 
-void PQinsert(Halfedge * he, Site * v, double offset)
+void PQinsert(vstate_t * vs, Halfedge * he, Site * v, double offset)
 {
     Halfedge *last, *next;
 
     he->vertex = v;
     ref(v);
     he->ystar = v->coord.y + offset;
-    last = &PQhash[PQbucket(he)];
+    last = &vs->PQhash[PQbucket(vs, he)];
     while ((next = last->PQnext) != (struct Halfedge *) NULL &&
 	   (he->ystar > next->ystar ||
 	    (he->ystar == next->ystar
@@ -58,70 +53,70 @@ void PQinsert(Halfedge * he, Site * v, double offset)
     }
     he->PQnext = last->PQnext;
     last->PQnext = he;
-    PQcount += 1;
+    vs->PQcount += 1;
 }
 
-void PQdelete(Halfedge * he)
+void PQdelete(vstate_t * vs, Halfedge * he)
 {
     Halfedge *last;
 
     if (he->vertex != (Site *) NULL) {
-	last = &PQhash[PQbucket(he)];
+	last = &vs->PQhash[PQbucket(vs, he)];
 	while (last->PQnext != he)
 	    last = last->PQnext;
 	last->PQnext = he->PQnext;
-	PQcount -= 1;
-	deref(he->vertex);
+	vs->PQcount -= 1;
+	deref(vs, he->vertex);
 	he->vertex = (Site *) NULL;
     }
 }
 
 
-int PQempty(void)
+int PQempty(vstate_t * vs)
 {
-    return (PQcount == 0);
+    return (vs->PQcount == 0);
 }
 
 
-Point PQ_min(void)
+Point PQ_min(vstate_t * vs)
 {
     Point answer;
 
-    while (PQhash[PQmin].PQnext == (struct Halfedge *) NULL) {
-	PQmin += 1;
+    while (vs->PQhash[vs->PQmin].PQnext == (struct Halfedge *) NULL) {
+	vs->PQmin += 1;
     }
-    answer.x = PQhash[PQmin].PQnext->vertex->coord.x;
-    answer.y = PQhash[PQmin].PQnext->ystar;
+    answer.x = vs->PQhash[vs->PQmin].PQnext->vertex->coord.x;
+    answer.y = vs->PQhash[vs->PQmin].PQnext->ystar;
     return (answer);
 }
 
-Halfedge *PQextractmin(void)
+Halfedge *PQextractmin(vstate_t * vs)
 {
     Halfedge *curr;
 
-    curr = PQhash[PQmin].PQnext;
-    PQhash[PQmin].PQnext = curr->PQnext;
-    PQcount -= 1;
+    curr = vs->PQhash[vs->PQmin].PQnext;
+    vs->PQhash[vs->PQmin].PQnext = curr->PQnext;
+    vs->PQcount -= 1;
     return (curr);
 }
 
-void PQcleanup(void)
+void PQcleanup(vstate_t * vs)
 {
-    free(PQhash);
-    PQhash = NULL;
+    free(vs->PQhash);
+    vs->PQhash = NULL;
 }
 
-void PQinitialize(void)
+void PQinitialize(vstate_t * vs)
 {
     int i;
 
-    PQcount = 0;
-    PQmin = 0;
-    PQhashsize = 4 * sqrt_nsites;
-    if (PQhash == NULL)
-	PQhash = N_GNEW(PQhashsize, Halfedge);
-    for (i = 0; i < PQhashsize; i += 1)
-	PQhash[i].PQnext = (Halfedge *) NULL;
+    vs->PQcount = 0;
+    vs->PQmin = 0;
+    vs->PQhashsize = 4 * vs->sqrt_nsites;
+    if (vs->PQhash == NULL)
+	vs->PQhash = N_GNEW(vs->PQhashsize, Halfedge);
+    for (i = 0; i < vs->PQhashsize; i += 1)
+	vs->PQhash[i].PQnext = (Halfedge *) NULL;
 }
 
 static void PQdumphe(Halfedge * p)
@@ -132,14 +127,14 @@ static void PQdumphe(Halfedge * p)
 	   p->ystar);
 }
 
-void PQdump(void)
+void PQdump(vstate_t * vs)
 {
     int i;
     Halfedge *p;
 
-    for (i = 0; i < PQhashsize; i += 1) {
+    for (i = 0; i < vs->PQhashsize; i += 1) {
 	printf("[%d]\n", i);
-	p = PQhash[i].PQnext;
+	p = vs->PQhash[i].PQnext;
 	while (p != NULL) {
 	    PQdumphe(p);
 	    p = p->PQnext;
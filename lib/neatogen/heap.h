@@ -22,13 +22,13 @@ extern "C" {
 
 #include "hedges.h"
 
-    extern void PQinitialize(void);
-    extern void PQcleanup(void);
-    extern Halfedge *PQextractmin(void);
-    extern Point PQ_min(void);
-    extern int PQempty(void);
-    extern void PQdelete(Halfedge *);
-    extern void PQinsert(Halfedge *, Site *, double);
+    extern void PQinitialize(vstate_t *);
+    extern void PQcleanup(vstate_t *);
+    extern Halfedge *PQextractmin(vstate_t *);
+    extern Point PQ_min(vstate_t *);
+    extern int PQempty(vstate_t *);
+    extern void PQdelete(vstate_t *, Halfedge *);
+    extern void PQinsert(vstate_t *, Halfedge *, Site *, double);
 
 #endif
 
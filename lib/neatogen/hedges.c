@@ -12,48 +12,40 @@
  *************************************************************************/
 
 #include "mem.h"
-#include "hedges.h"
+#include "voronoi.h"
 #include "render.h"
 
 
 #define DELETED -2
 
-Halfedge *ELleftend, *ELrightend;
-
-static Freelist hfl;
-static int ELhashsize;
-static Halfedge **ELhash;
-static int ntry, totalsearch;
-
-void ELcleanup()
+void ELcleanup(vstate_t * vs)
 {
-    freeinit(&hfl, sizeof **ELhash);
-    free(ELhash);
-    ELhash = NULL;
+    free(vs->ELhash);
+    vs->ELhash = NULL;
 }
 
-void ELinitialize()
+void ELinitialize(vstate_t * vs)
 {
     int i;
 
-    freeinit(&hfl, sizeof **ELhash);
-    ELhashsize = 2 * sqrt_nsites;
-    if (ELhash == NULL)
-	ELhash = N_GNEW(ELhashsize, Halfedge *);
-    for (i = 0; i < ELhashsize; i += 1)
-	ELhash[i] = (Halfedge *) NULL;
-    ELleftend = HEcreate((Edge *) NULL, 0);
-    ELrightend = HEcreate((Edge *) NULL, 0);
-    ELleftend->ELleft = (Halfedge *) NULL;
-    ELleftend->ELright = ELrightend;
-    ELrightend->ELleft = ELleftend;
-    ELrightend->ELright = (Halfedge *) NULL;
-    ELhash[0] = ELleftend;
-    ELhash[ELhashsize - 1] = ELrightend;
+    freereset(&vs->hfl);
+    vs->ELhashsize = 2 * vs->sqrt_nsites;
+    if (vs->ELhash == NULL)
+	vs->ELhash = N_GNEW(vs->ELhashsize, Halfedge *);
+    for (i = 0; i < vs->ELhashsize; i += 1)
+	vs->ELhash[i] = (Halfedge *) NULL;
+    vs->ELleftend = HEcreate(vs, (Edge *) NULL, 0);
+    vs->ELrightend = HEcreate(vs, (Edge *) NULL, 0);
+    vs->ELleftend->ELleft = (Halfedge *) NULL;
+    vs->ELleftend->ELright = vs->ELrightend;
+    vs->ELrightend->ELleft = vs->ELleftend;
+    vs->ELrightend->ELright = (Halfedge *) NULL;
+    vs->ELhash[0] = vs->ELleftend;
+    vs->ELhash[vs->ELhashsize - 1] = vs->ELrightend;
 }
 
 
-Site *hintersect(Halfedge * el1, Halfedge * el2)
+Site *hintersect(vstate_t * vs, Halfedge * el1, Halfedge * el2)
 {
     Edge *e1, *e2, *e;
     Halfedge *el;
@@ -89,7 +81,7 @@ Site *hintersect(Halfedge * el1, Halfedge * el2)
 	(!right_of_site && el->ELpm == re))
 	return ((Site *) NULL);
 
-    v = getsite();
+    v = getsite(vs);
     v->refcnt = 0;
     v->coord.x = xint;
     v->coord.y = yint;
@@ -144,10 +136,10 @@ int right_of(Halfedge * el, Point * p)
     return (el->ELpm == le ? above : !above);
 }
 
-Halfedge *HEcreate(Edge * e, char pm)
+Halfedge *HEcreate(vstate_t * vs, Edge * e, char pm)
 {
     Halfedge *answer;
-    answer = (Halfedge *) getfree(&hfl);
+    answer = (Halfedge *) getfree(&vs->hfl);
     answer->ELedge = e;
     answer->ELpm = pm;
     answer->PQnext = (Halfedge *) NULL;
@@ -166,45 +158,45 @@ void ELinsert(Halfedge * lb, Halfedge * new)
 }
 
 /* Get entry from hash table, pruning any deleted nodes */
-static Halfedge *ELgethash(int b)
+static Halfedge *ELgethash(vstate_t * vs, int b)
 {
     Halfedge *he;
 
-    if (b < 0 || b >= ELhashsize)
+    if (b < 0 || b >= vs->ELhashsize)
 	return ((Halfedge *) NULL);
-    he = ELhash[b];
+    he = vs->ELhash[b];
     if (he == (Halfedge *) NULL || he->ELedge != (Edge *) DELETED)
 	return (he);
 
 /* Hash table points to deleted half edge.  Patch as necessary. */
-    ELhash[b] = (Halfedge *) NULL;
+    vs->ELhash[b] = (Halfedge *) NULL;
     if ((he->ELrefcnt -= 1) == 0)
-	makefree(he, &hfl);
+	makefree(he, &vs->hfl);
     return ((Halfedge *) NULL);
 }
 
-Halfedge *ELleftbnd(Point * p)
+Halfedge *ELleftbnd(vstate_t * vs, Point * p)
 {
     int i, bucket;
     Halfedge *he;
+    Halfedge *ELleftend = vs->ELleftend;
+    Halfedge *ELrightend = vs->ELrightend;
 
 /* Use hash table to get close to desired halfedge */
-    bucket = (p->x - xmin) / deltax * ELhashsize;
+    bucket = (p->x - vs->xmin) / vs->deltax * vs->ELhashsize;
     if (bucket < 0)
 	bucket = 0;
-    if (bucket >= ELhashsize)
-	bucket = ELhashsize - 1;
-    he = ELgethash(bucket);
+    if (bucket >= vs->ELhashsize)
+	bucket = vs->ELhashsize - 1;
+    he = ELgethash(vs, bucket);
     if (he == (Halfedge *) NULL) {
 	for (i = 1; 1; i += 1) {
-	    if ((he = ELgethash(bucket - i)) != (Halfedge *) NULL)
+	    if ((he = ELgethash(vs, bucket - i)) != (Halfedge *) NULL)
 		break;
-	    if ((he = ELgethash(bucket + i)) != (Halfedge *) NULL)
+	    if ((he = ELgethash(vs, bucket + i)) != (Halfedge *) NULL)
 		break;
 	};
-	totalsearch += i;
     };
-    ntry += 1;
 /* Now search linear list of halfedges for the corect one */
     if (he == ELleftend || (he != ELrightend && right_of(he, p))) {
 	do {
@@ -217,11 +209,11 @@ Halfedge *ELleftbnd(Point * p)
 	} while (he != ELleftend && !right_of(he, p));
 
 /* Update hash table and reference counts */
-    if (bucket > 0 && bucket < ELhashsize - 1) {
-	if (ELhash[bucket] != (Halfedge *) NULL)
-	    ELhash[bucket]->ELrefcnt -= 1;
-	ELhash[bucket] = he;
-	ELhash[bucket]->ELrefcnt += 1;
+    if (bucket > 0 && bucket < vs->ELhashsize - 1) {
+	if (vs->ELhash[bucket] != (Halfedge *) NULL)
+	    vs->ELhash[bucket]->ELrefcnt -= 1;
+	vs->ELhash[bucket] = he;
+	vs->ELhash[bucket]->ELrefcnt += 1;
     };
     return (he);
 }
@@ -248,16 +240,16 @@ Halfedge *ELleft(Halfedge * he)
 }
 
 
-Site *leftreg(Halfedge * he)
+Site *leftreg(vstate_t * vs, Halfedge * he)
 {
     if (he->ELedge == (Edge *) NULL)
-	return (bottomsite);
+	return (vs->bottomsite);
     return (he->ELpm == le ? he->ELedge->reg[le] : he->ELedge->reg[re]);
 }
 
-Site *rightreg(Halfedge * he)
+Site *rightreg(vstate_t * vs, Halfedge * he)
 {
     if (he->ELedge == (Edge *) NULL)
-	return (bottomsite);
+	return (vs->bottomsite);
     return (he->ELpm == le ? he->ELedge->reg[re] : he->ELedge->reg[le]);
 }
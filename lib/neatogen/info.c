@@ -17,12 +17,9 @@
 #include "info.h"
 
 
-Info_t *nodeInfo;		/* Array of node info */
-static Freelist pfl;
-
-void infoinit()
+void infoinit(vstate_t * vs)
 {
-    freeinit(&pfl, sizeof(PtItem));
+    freereset(&vs->pfl);
 }
 
 /* compare:
@@ -158,7 +155,7 @@ static int sorted(Point * origin, PtItem * vp)
 }
 #endif
 
-void addVertex(Site * s, double x, double y)
+void addVertex(vstate_t * vs, Site * s, double x, double y)
 {
     Info_t *ip;
     PtItem *p;
@@ -168,7 +165,7 @@ void addVertex(Site * s, double x, double y)
     PtItem tmp;
     int cmp;
 
-    ip = nodeInfo + (s->sitenbr);
+    ip = vs->nodeInfo + (s->sitenbr);
     curr = ip->verts;
 
     tmp.p.x = x;
@@ -178,7 +175,7 @@ void addVertex(Site * s, double x, double y)
     if (cmp == 0)
 	return;
     else if (cmp < 0) {
-	p = (PtItem *) getfree(&pfl);
+	p = (PtItem *) getfree(&vs->pfl);
 	p->p.x = x;
 	p->p.y = y;
 	p->next = curr;
@@ -194,7 +191,7 @@ void addVertex(Site * s, double x, double y)
     }
     if (cmp == 0)
 	return;
-    p = (PtItem *) getfree(&pfl);
+    p = (PtItem *) getfree(&vs->pfl);
     p->p.x = x;
     p->p.y = y;
     prev->next = p;
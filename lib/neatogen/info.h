@@ -22,12 +22,7 @@ extern "C" {
 #include "voronoi.h"
 #include "poly.h"
 
-    typedef struct ptitem {	/* Point list */
-	struct ptitem *next;
-	Point p;
-    } PtItem;
-
-    typedef struct {		/* Info concerning site */
+    typedef struct Info_t {	/* Info concerning site */
 	Agnode_t *node;		/* libgraph node */
 	Site site;		/* site used by voronoi code */
 	int overlaps;		/* true if node overlaps other nodes */
@@ -36,11 +31,9 @@ extern "C" {
 	/* voronoi polygon */
     } Info_t;
 
-    extern Info_t *nodeInfo;	/* Array of node info */
-
-    extern void infoinit(void);
+    extern void infoinit(vstate_t *);
     /* Insert vertex into sorted list */
-    extern void addVertex(Site *, double, double);
+    extern void addVertex(vstate_t *, Site *, double, double);
 #endif
 
 #ifdef __cplusplus
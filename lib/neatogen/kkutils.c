@@ -126,7 +126,7 @@ DistType **compute_apsp_artifical_weights(vtx_data * graph, int n)
 static void
 split_by_place(double *place, int *nodes, int first, int last, int *middle)
 {
-    unsigned int splitter=((unsigned int)rand()|((unsigned int)rand())<<16)%(unsigned int)(last-first+1)+(unsigned int)first;
+    unsigned int splitter=((unsigned int)gvrand()|((unsigned int)gvrand())<<16)%(unsigned int)(last-first+1)+(unsigned int)first;
     int val;
     double place_val;
     int left = first + 1;
@@ -181,6 +181,7 @@ double distance_kD(double **coords, int dim, int i, int j)
 }
 
 static float* fvals;
+#pragma omp threadprivate(fvals)
 static int
 fcmpf (int* ip1, int* ip2)
 {
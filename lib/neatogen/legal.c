@@ -16,6 +16,7 @@
 #include <setjmp.h>
 
 static jmp_buf jbuf;
+#pragma omp threadprivate(jbuf)
 
 #define MAXINTS  10000		/* modify this line to reflect the max no. of 
 				   intersections you want reported -- 50000 seems to break the program */
@@ -51,6 +51,7 @@
 static double *scales;
 static double **lu;
 static int *ps;
+#pragma omp threadprivate(scales, lu, ps)
 
 /* lu_decompose() decomposes the coefficient matrix A into upper and lower
  * triangular matrices, the composite being the LU matrix.
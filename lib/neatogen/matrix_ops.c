@@ -12,6 +12,7 @@
  *************************************************************************/
 
 
+#include "render.h"
 #include "matrix_ops.h"
 #include "memory.h"
 #include <stdlib.h>
@@ -50,7 +51,7 @@ power_iteration(double **square_mat, int n, int neigs, double **eigs,
       choose:
 	if (initialize)
 	    for (j = 0; j < n; j++)
-		curr_vector[j] = rand() % 100;
+		curr_vector[j] = gvrand() % 100;
 	/* orthogonalize against higher eigenvectors */
 	for (j = 0; j < i; j++) {
 	    alpha = -dot(eigs[j], 0, n - 1, curr_vector);
@@ -97,7 +98,7 @@ power_iteration(double **square_mat, int n, int neigs, double **eigs,
 	curr_vector = eigs[i];
 	/* guess the i-th eigen vector */
 	for (j = 0; j < n; j++)
-	    curr_vector[j] = rand() % 100;
+	    curr_vector[j] = gvrand() % 100;
 	/* orthogonalize against higher eigenvectors */
 	for (j = 0; j < i; j++) {
 	    alpha = -dot(eigs[j], 0, n - 1, curr_vector);
@@ -344,7 +345,7 @@ void init_vec_orth1(int n, double *vec)
     int i;
 
     for (i = 0; i < n; i++)
-	vec[i] = rand() % RANGE;
+	vec[i] = gvrand() % RANGE;
 
     orthog1(n, vec);
 }
@@ -771,7 +772,7 @@ void init_vec_orth1f(int n, float *vec)
     int i;
 
     for (i = 0; i < n; i++)
-	vec[i] = (float) (rand() % RANGE);
+	vec[i] = (float) (gvrand() % RANGE);
 
     orthog1f(n, vec);
 }
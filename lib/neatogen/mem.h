@@ -30,10 +30,12 @@ extern "C" {
 	struct freenode *head;	/* List of free nodes */
 	struct freeblock *blocklist;	/* List of malloced blocks */
 	int nodesize;		/* Size of node */
+	int blocksize;		/* Number of nodes per block */
     } Freelist;
 
     extern void *getfree(Freelist *);
-    extern void freeinit(Freelist *, int);
+    extern void freeinit(Freelist *, int, int);
+    extern void freereset(Freelist *);
     extern void makefree(void *, Freelist *);
 
 #endif
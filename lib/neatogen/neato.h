@@ -26,11 +26,13 @@
 #define MODE_MAJOR       1
 #define MODE_HIER        2
 #define MODE_IPSEP       3
+#define MODE_SSTRESS     4
 
 #define INIT_ERROR       -1
 #define INIT_SELF        0
 #define INIT_REGULAR     1
 #define INIT_RANDOM      2
+#define INIT_MULTILEVEL  3
 
 #include	"render.h"
 #include	"pathplan.h"
@@ -23,22 +23,29 @@
 #include "neato.h"
 #include "pack.h"
 #include "stress.h"
+#include "SparseMatrix.h"
 #ifdef DIGCOLA
 #include "digcola.h"
 #endif
 #include "kkutils.h"
 #include "pointset.h"
 
-#ifndef HAVE_SRAND48
-#define srand48 srand
-#endif
-
-static attrsym_t *N_pos;
-static int Pack;		/* If >= 0, layout components separately and pack together
-				 * The value of Pack gives margins around graphs.
-				 */
 static char *cc_pfx = "_neato_cc";
 
+/* neato_init_state:
+ * Start the state of a layout of g, dividing input positions by scale.
+ */
+static void neato_init_state(neato_state_t * st, graph_t * g, double scale)
+{
+    memset(st, 0, sizeof(neato_state_t));
+    st->Nop = Nop;
+    st->Ndim = GD_ndim(agroot(g));
+    st->inputscale = scale;
+    st->E_len = agattr(g, AGEDGE, "len", 0);
+    getConvParms(g, &st->conv);
+    st->nthreads = late_int(g, agfindgraphattr(g, "threads"), 0, 0);
+}
+
 void neato_init_node(node_t * n)
 {
     agbindrec(n, "Agnodeinfo_t", sizeof(Agnodeinfo_t), TRUE);	//node custom data
@@ -54,11 +61,17 @@ static void neato_init_edge(edge_t * e)
     ED_factor(e) = late_double(e, E_weight, 1.0, 1.0);
 }
 
-int user_pos(attrsym_t * posptr, attrsym_t * pinptr, node_t * np, int nG)
+/* user_pos:
+ * Set the position of np from posptr, dividing it by scale if that is
+ * positive. Return TRUE if np has a position.
+ */
+int user_pos(attrsym_t * posptr, attrsym_t * pinptr, node_t * np, int nG,
+	     double scale)
 {
     double *pvec;
     char *p, c;
     double z;
+    int dim = GD_ndim(agraphof(np));
 
     if (posptr == NULL)
 	return FALSE;
@@ -66,15 +79,15 @@ int user_pos(attrsym_t * posptr, attrsym_t * pinptr, node_t * np, int nG)
     p = agxget(np, posptr);
     if (p[0]) {
 	c = '\0';
-	if ((Ndim >= 3) && 
+	if ((dim >= 3) && 
             (sscanf(p, "%lf,%lf,%lf%c", pvec, pvec+1, pvec+2, &c) >= 3)){
 	    ND_pinned(np) = P_SET;
-	    if (PSinputscale > 0.0) {
+	    if (scale > 0.0) {
 		int i;
-		for (i = 0; i < Ndim; i++)
-		    pvec[i] = pvec[i] / PSinputscale;
+		for (i = 0; i < dim; i++)
+		    pvec[i] = pvec[i] / scale;
 	    }
-	    if (Ndim > 3)
+	    if (dim > 3)
 		jitter_d(np, nG, 3);
 	    if ((c == '!') || (pinptr && mapbool(agxget(np, pinptr))))
 		ND_pinned(np) = P_PIN;
@@ -82,15 +95,15 @@ int user_pos(attrsym_t * posptr, attrsym_t * pinptr, node_t * np, int nG)
 	}
 	else if (sscanf(p, "%lf,%lf%c", pvec, pvec + 1, &c) >= 2) {
 	    ND_pinned(np) = P_SET;
-	    if (PSinputscale > 0.0) {
+	    if (scale > 0.0) {
 		int i;
-		for (i = 0; i < Ndim; i++)
-		    pvec[i] = pvec[i] / PSinputscale;
+		for (i = 0; i < dim; i++)
+		    pvec[i] = pvec[i] / scale;
 	    }
-	    if (Ndim > 2) {
+	    if (dim > 2) {
 		if (N_z && (p = agxget(np, N_z)) && (sscanf(p,"%lf",&z) == 1)) { 
-		    if (PSinputscale > 0.0) {
-			pvec[2] = z / PSinputscale;
+		    if (scale > 0.0) {
+			pvec[2] = z / scale;
 		    }
 		    else
 			pvec[2] = z;
@@ -109,19 +122,19 @@ int user_pos(attrsym_t * posptr, attrsym_t * pinptr, node_t * np, int nG)
     return FALSE;
 }
 
-static void neato_init_node_edge(graph_t * g)
+static void neato_init_node_edge(neato_state_t * st, graph_t * g)
 {
     node_t *n;
     edge_t *e;
     int nG = agnnodes(g);
     attrsym_t *N_pin;
 
-    N_pos = agfindnodeattr(g, "pos");
+    st->N_pos = agfindnodeattr(g, "pos");
     N_pin = agfindnodeattr(g, "pin");
 
     for (n = agfstnode(g); n; n = agnxtnode(g, n)) {
 	neato_init_node(n);
-	user_pos(N_pos, N_pin, n, nG);	/* set user position if given */
+	user_pos(st->N_pos, N_pin, n, nG, st->inputscale);	/* set user position if given */
     }
     for (n = agfstnode(g); n; n = agnxtnode(g, n)) {
 	for (e = agfstout(g, n); e; e = agnxtout(g, e))
@@ -131,8 +144,7 @@ static void neato_init_node_edge(graph_t * g)
 
 static void neato_cleanup_graph(graph_t * g)
 {
-    if (Nop || (Pack < 0))
-	free_scan_graph(g);
+    free_scan_graph(g);
     if (g != agroot(g))
         agclean(g, AGRAPH , "Agraphinfo_t");
 }
@@ -368,7 +380,7 @@ typedef enum { NoEdges, SomeEdges, AllEdges } pos_edge;
  * If position info exists, check for edge label positions.
  * Return number of edges with position info.
  */
-static pos_edge nop_init_edges(Agraph_t * g)
+static pos_edge nop_init_edges(Agraph_t * g, int nop)
 {
     node_t *n;
     edge_t *e;
@@ -379,7 +391,7 @@ static pos_edge nop_init_edges(Agraph_t * g)
 	return AllEdges;
 
     E_pos = agfindedgeattr(g, "pos");
-    if (!E_pos || (Nop < 2))
+    if (!E_pos || (nop < 2))
 	return NoEdges;
 
     for (n = agfstnode(g); n; n = agnxtnode(g, n)) {
@@ -525,6 +537,7 @@ nop_init_graphs(Agraph_t * g, attrsym_t * G_lp, attrsym_t * G_bb)
  */
 int init_nop(Agraph_t * g, int adjust)
 {
+    neato_state_t st;
     int i;
     node_t *np;
     pos_edge posEdges;		/* How many edges have spline info */
@@ -538,7 +551,8 @@ int init_nop(Agraph_t * g, int adjust)
     if (!G_bb)
 	G_bb = agattr(g, AGRAPH, "bb", "");
 
-    scan_graph(g);		/* mainly to set up GD_neato_nlist */
+    neato_init_state(&st, g, POINTS_PER_INCH);
+    scan_graph(&st, g);		/* mainly to set up GD_neato_nlist */
     for (i = 0; (np = GD_neato_nlist(g)[i]); i++) {
 	if (!hasPos(np) && strncmp(agnameof(np), "cluster", 7)) {
 	    agerr(AGERR, "node %s in graph %s has no position\n",
@@ -549,7 +563,7 @@ int init_nop(Agraph_t * g, int adjust)
 	    set_label(np, ND_xlabel(np), "xlp");
     }
     nop_init_graphs(g, G_lp, G_bb);
-    posEdges = nop_init_edges(g);
+    posEdges = nop_init_edges(g, st.Nop);
 
     if (GD_drawing(g)->xdots) {
 	haveBackground = 1;
@@ -558,7 +572,7 @@ int init_nop(Agraph_t * g, int adjust)
     else
 	haveBackground = 0;
 
-    if (adjust && (Nop == 1) && !haveBackground)
+    if (adjust && (st.Nop == 1) && !haveBackground)
 	didAdjust = adjustNodes(g);
 
     if (didAdjust) {
@@ -604,16 +618,16 @@ int init_nop(Agraph_t * g, int adjust)
     return haveBackground;
 }
 
-static void neato_init_graph (Agraph_t * g)
+static void neato_init_graph (neato_state_t * st, Agraph_t * g)
 {
     int outdim;
 
     setEdgeType (g, ET_LINE);
     outdim = late_int(g, agfindgraphattr(g, "dimen"), 2, 2);
     GD_ndim(agroot(g)) = late_int(g, agfindgraphattr(g, "dim"), outdim, 2);
-    Ndim = GD_ndim(g->root) = MIN(GD_ndim(g->root), MAXDIM);
-    GD_odim(g->root) = MIN(outdim, Ndim);
-    neato_init_node_edge(g);
+    st->Ndim = GD_ndim(g->root) = MIN(GD_ndim(g->root), MAXDIM);
+    GD_odim(g->root) = MIN(outdim, st->Ndim);
+    neato_init_node_edge(st, g);
 }
 
 static int neatoModel(graph_t * g)
@@ -660,6 +674,8 @@ static int neatoMode(graph_t * g)
 	    mode = MODE_KK;
 	else if (streq(str, "major"))
 	    mode = MODE_MAJOR;
+	else if (streq(str, "sparse_stress"))
+	    mode = MODE_SSTRESS;
 #ifdef DIGCOLA
 	else if (streq(str, "hier"))
 	    mode = MODE_HIER;
@@ -767,7 +783,7 @@ acyclic (vtx_data* graph, int nv, int mode, node_t* nodes[])
  * the graph is acyclic.
  *
  */
-static vtx_data *makeGraphData(graph_t * g, int nv, int *nedges, int mode, int model, node_t*** nodedata)
+static vtx_data *makeGraphData(neato_state_t * st, graph_t * g, int nv, int *nedges, int mode, int model, node_t*** nodedata)
 {
     vtx_data *graph;
     node_t** nodes;
@@ -791,7 +807,7 @@ static vtx_data *makeGraphData(graph_t * g, int nv, int *nedges, int mode, int m
 	haveLen = FALSE;
 	haveWt = FALSE;
     } else {
-	haveLen = agattr(g, AGEDGE, "len", 0) ;
+	haveLen = st->E_len;
 	haveWt = (E_weight != 0);
     }
     if (mode == MODE_HIER || mode == MODE_IPSEP)
@@ -933,7 +949,7 @@ static void initRegular(graph_t * G, int nG)
 	ND_pos(np)[1] = nG * Spring_coeff * sin(a);
 	ND_pinned(np) = P_SET;
 	a = a + da;
-	if (Ndim > 2)
+	if (GD_ndim(agraphof(np)) > 2)
 	    jitter3d(np, nG);
     }
 }
@@ -942,13 +958,15 @@ static void initRegular(graph_t * G, int nG)
 #define SMART   "self"
 #define REGULAR "regular"
 #define RANDOM  "random"
+#define MULTILEVEL "multilevel"
 
 /* setSeed:
  * Analyze "start" attribute. If unset, return dflt.
- * If it begins with self, regular, or random, return set init to same,
- * else set init to dflt.
+ * If it begins with self, regular, random or multilevel, return set init
+ * to same, else set init to dflt.
  * If init is random, look for value integer suffix to use a seed; if not
  * found, use time to set seed and store seed in graph.
+ * If init is multilevel, an integer suffix is also used as the seed.
  * Return seed in seedp.
  * Return init.
  */
@@ -970,6 +988,9 @@ setSeed (graph_t * G, int dflt, long* seedp)
 	} else if (!strncmp(p, RANDOM, SLEN(RANDOM))) {
 	    init = INIT_RANDOM;
 	    p += SLEN(RANDOM);
+	} else if (!strncmp(p, MULTILEVEL, SLEN(MULTILEVEL))) {
+	    init = INIT_MULTILEVEL;
+	    p += SLEN(MULTILEVEL);
 	}
 	else init = dflt;
     }
@@ -991,6 +1012,11 @@ setSeed (graph_t * G, int dflt, long* seedp)
 	}
 	*seedp = seed;
     }
+    else if (init == INIT_MULTILEVEL) {
+	long seed;
+	if (isdigit(*(unsigned char *)p) && sscanf(p, "%ld", &seed) == 1)
+	    *seedp = seed;
+    }
     return init;
 }
 
@@ -1011,30 +1037,43 @@ static int checkExp (graph_t * G)
 }
 
 /* checkStart:
- * Analyzes start attribute, setting seed.
+ * Analyzes start attribute, saving it and the seed in st->init and
+ * st->seed for applyStart.
  * If set,
- *   If start is regular, places nodes and returns INIT_REGULAR.
+ *   If start is regular, returns INIT_REGULAR.
  *   If start is self, returns INIT_SELF.
  *   If start is random, returns INIT_RANDOM
- *   Set RNG seed
  * else return default
  * 
  */
-int checkStart(graph_t * G, int nG, int dflt)
+int checkStart(neato_state_t * st, graph_t * G, int dflt)
 {
     long seed;
     int init;
 
     seed = 1;
     init = setSeed (G, dflt, &seed); 
-    if (N_pos && (init != INIT_RANDOM)) {
+    if (st->N_pos && (init != INIT_RANDOM)) {
 	agerr(AGWARN, "node positions are ignored unless start=random\n");
     }
-    if (init == INIT_REGULAR) initRegular(G, nG);
-    srand48(seed);
+    st->init = init;
+    st->seed = seed;
     return init;
 }
 
+/* applyStart:
+ * Act on the values saved by checkStart: if start is regular, place
+ * the nodes; then set the RNG seed. Returns st->init.
+ * Unlike checkStart, this reads no attributes, so it is done as part
+ * of the solver (see neatoSolve).
+ */
+int applyStart(neato_state_t * st, graph_t * G, int nG)
+{
+    if (st->init == INIT_REGULAR) initRegular(G, nG);
+    gvsrand48(st->seed);
+    return st->init;
+}
+
 #ifdef DEBUG_COLA
 void dumpData(graph_t * g, vtx_data * gp, int nv, int ne)
 {
@@ -1118,10 +1157,10 @@ void dumpOpts (ipsep_options* opp, int nv)
  * Solve stress using majorization.
  * Old neato attributes to incorporate:
  *  weight
- * mode will be MODE_MAJOR, MODE_HIER or MODE_IPSEP
+ * mode will be MODE_MAJOR, MODE_SSTRESS, MODE_HIER or MODE_IPSEP
  */
 static void
-majorization(graph_t *mg, graph_t * g, int nv, int mode, int model, int dim, int steps, adjust_data* am)
+majorization(neato_state_t * st, graph_t *mg, graph_t * g, int nv, int mode, int model, int dim, int steps, adjust_data* am)
 {
     double **coords;
     int ne;
@@ -1134,37 +1173,42 @@ majorization(graph_t *mg, graph_t * g, int nv, int mode, int model, int dim, int
     expand_t margin;
 #endif
 #endif
-    int init = checkStart(g, nv, (mode == MODE_HIER ? INIT_SELF : INIT_RANDOM));
-    int opts = checkExp (g);
+    int init = applyStart(st, g, nv);
+    int opts = st->stresswt;
 	
     if (init == INIT_SELF)
 	opts |= opt_smart_init;
+    else if (init == INIT_MULTILEVEL)
+	opts |= opt_multilevel_init;
 
     coords = N_GNEW(dim, double *);
     coords[0] = N_GNEW(nv * dim, double);
-    for (i = 1; i < Ndim; i++) {
+    for (i = 1; i < dim; i++) {
 	coords[i] = coords[0] + i * nv;
     }
     if (Verbose) {
-	fprintf(stderr, "model %d smart_init %d stresswt %d iterations %d tol %f\n",
-		model, (init == INIT_SELF), opts & opt_exp_flag, MaxIter, Epsilon);
+	fprintf(stderr, "model %d smart_init %d multilevel_init %d stresswt %d iterations %d tol %f\n",
+		model, (init == INIT_SELF), (init == INIT_MULTILEVEL), opts & opt_exp_flag, steps, st->Epsilon);
 	fprintf(stderr, "convert graph: ");
 	start_timer();
         fprintf(stderr, "majorization\n");
 //     fprintf(stderr, "%i\n", count_nodes(g));
     }
-    gp = makeGraphData(g, nv, &ne, mode, model, &nodes);
+    gp = makeGraphData(st, g, nv, &ne, mode, model, &nodes);
 
     if (Verbose) {
 	fprintf(stderr, "%d nodes %.2f sec\n", nv, elapsed_sec());
     }
 
+    if (mode == MODE_SSTRESS)
+	rv = sparse_stress_majorization_kD(gp, nv, coords, nodes, dim, opts, model, steps, st->Epsilon, &st->conv);
+    else
 #ifdef DIGCOLA
     if (mode != MODE_MAJOR) {
         double lgap = late_double(g, agfindgraphattr(g, "levelsgap"), 0.0, -MAXDOUBLE);
         if (mode == MODE_HIER) {        
-            rv = stress_majorization_with_hierarchy(gp, nv, ne, coords, nodes, Ndim,
-                       opts, model, MaxIter, lgap);
+            rv = stress_majorization_with_hierarchy(gp, nv, ne, coords, nodes, dim,
+                       opts, model, steps, st->Epsilon, lgap);
         } 
 #ifdef IPSEPCOLA
 	else {
@@ -1223,7 +1267,7 @@ majorization(graph_t *mg, graph_t * g, int nv, int mode, int model, int dim, int
             }
 
 #ifdef DEBUG_COLA
-	    fprintf (stderr, "nv %d ne %d Ndim %d model %d MaxIter %d\n", nv, ne, Ndim, model, MaxIter);
+	    fprintf (stderr, "nv %d ne %d Ndim %d model %d MaxIter %d\n", nv, ne, dim, model, steps);
 	    fprintf (stderr, "Nodes:\n");
 	    for (i = 0; i < nv; i++) {
 		fprintf (stderr, "  %s (%f,%f)\n", nodes[i]->name, coords[0][i],  coords[1][i]);
@@ -1233,7 +1277,7 @@ majorization(graph_t *mg, graph_t * g, int nv, int mode, int model, int dim, int
 	    fprintf (stderr, "\n");
 	    dumpOpts (&opt, nv);
 #endif
-            rv = stress_majorization_cola(gp, nv, ne, coords, nodes, Ndim, model, MaxIter, &opt);
+            rv = stress_majorization_cola(gp, nv, ne, coords, nodes, dim, model, steps, st->Epsilon, &opt);
 	    freeClusterData(cs);
 	    free (nsize);
         }
@@ -1241,15 +1285,15 @@ majorization(graph_t *mg, graph_t * g, int nv, int mode, int model, int dim, int
     }
     else
 #endif
-	rv = stress_majorization_kD_mkernel(gp, nv, ne, coords, nodes, Ndim, opts, model, MaxIter);
+	rv = stress_majorization_kD_mkernel(gp, nv, ne, coords, nodes, dim, opts, model, steps, st->Epsilon, &st->conv, st->nthreads);
 
     if (rv < 0) {
-	agerr(AGPREV, "layout aborted\n");
+	gvagerr(AGPREV, "layout aborted\n");
     }
     else for (v = agfstnode(g); v; v = agnxtnode(g, v)) { /* store positions back in nodes */
 	int idx = ND_id(v);
 	int i;
-	for (i = 0; i < Ndim; i++) {
+	for (i = 0; i < dim; i++) {
 	    ND_pos(v)[i] = coords[i][idx];
 	}
     }
@@ -1259,13 +1303,13 @@ majorization(graph_t *mg, graph_t * g, int nv, int mode, int model, int dim, int
     free(nodes);
 }
 
-static void subset_model(Agraph_t * G, int nG)
+static void subset_model(neato_state_t * st, Agraph_t * G, int nG)
 {
     int i, j, ne;
     DistType **Dij;
     vtx_data *gp;
 
-    gp = makeGraphData(G, nG, &ne, MODE_KK, MODEL_SUBSET, NULL);
+    gp = makeGraphData(st, G, nG, &ne, MODE_KK, MODEL_SUBSET, NULL);
     Dij = compute_apsp_artifical_weights(gp, nG);
     for (i = 0; i < nG; i++) {
 	for (j = 0; j < nG; j++) {
@@ -1301,10 +1345,10 @@ static void mds_model(graph_t * g, int nG)
 /* kkNeato:
  * Solve using gradient descent a la Kamada-Kawai.
  */
-static void kkNeato(Agraph_t * g, int nG, int model)
+static void kkNeato(neato_state_t * st, Agraph_t * g, int nG, int model)
 {
     if (model == MODEL_SUBSET) {
-	subset_model(g, nG);
+	subset_model(st, g, nG);
     } else if (model == MODEL_CIRCUIT) {
 	if (!circuit_model(g, nG)) {
 	    agerr(AGWARN,
@@ -1315,47 +1359,162 @@ static void kkNeato(Agraph_t * g, int nG, int model)
 	    agerr(AGPREV,
 		  "Alternatively, consider running neato using -Gpack=true or decomposing\n");
 	    agerr(AGPREV, "the graph into connected components.\n");
-	    shortest_path(g, nG);
+	    shortest_path(st, g, nG);
 	}
     } else if (model == MODEL_MDS) {
-	shortest_path(g, nG);
+	shortest_path(st, g, nG);
 	mds_model(g, nG);
     } else
-	shortest_path(g, nG);
-    initial_positions(g, nG);
-    diffeq_model(g, nG);
+	shortest_path(st, g, nG);
+    initial_positions(st, g, nG);
+    diffeq_model(st, g, nG);
     if (Verbose) {
 	fprintf(stderr, "Solving model %d iterations %d tol %f\n",
-		model, MaxIter, Epsilon);
+		model, st->MaxIter, st->Epsilon);
 	start_timer();
     }
-    solve_model(g, nG);
+    solve_model(st, g, nG);
+    free(st->Krow);
+    st->Krow = NULL;
+    free(st->Hess);
+    st->Hess = NULL;
 }
 
-/* neatoLayout:
- * Use stress optimization to layout a single component
+/* neatoSetup:
+ * Prepare the layout of a single component, reading its attributes
+ * into st. Returns the number of nodes, or 0 if there is nothing
+ * for the solver to do.
  */
-static void 
-neatoLayout(Agraph_t * mg, Agraph_t * g, int layoutMode, int layoutModel,
-  adjust_data* am)
+static int
+neatoSetup(neato_state_t * st, Agraph_t * g, int layoutMode)
 {
     int nG;
+    int dflt;
     char *str;
 
     if ((str = agget(g, "maxiter")))
-	MaxIter = atoi(str);
-    else if (layoutMode == MODE_MAJOR)
-	MaxIter = DFLT_ITERATIONS;
+	st->MaxIter = atoi(str);
+    else if (layoutMode == MODE_MAJOR || layoutMode == MODE_SSTRESS)
+	st->MaxIter = DFLT_ITERATIONS;
     else
-	MaxIter = 100 * agnnodes(g);
+	st->MaxIter = 100 * agnnodes(g);
 
-    nG = scan_graph_mode(g, layoutMode);
-    if ((nG < 2) || (MaxIter < 0))
-	return;
+    nG = scan_graph_mode(st, g, layoutMode);
+    if ((nG < 2) || (st->MaxIter < 0))
+	return 0;
+    if (layoutMode) {
+	dflt = ((layoutMode == MODE_HIER || layoutMode == MODE_SSTRESS) ? INIT_SELF : INIT_RANDOM);
+	if ((checkStart(st, g, dflt) == INIT_MULTILEVEL) && (layoutMode != MODE_MAJOR)) {
+	    agerr(AGWARN, "start=multilevel is only supported with mode=major - ignoring\n");
+	    st->init = dflt;
+	}
+	st->stresswt = checkExp (g);
+    }
+    else
+	checkStart(st, g, INIT_RANDOM);
+    return nG;
+}
+
+/* neatoSolve:
+ * Run the solver on a component prepared by neatoSetup.
+ */
+static void
+neatoSolve(neato_state_t * st, Agraph_t * mg, Agraph_t * g, int nG,
+  int layoutMode, int layoutModel, adjust_data* am)
+{
     if (layoutMode)
-	majorization(mg, g, nG, layoutMode, layoutModel, Ndim, MaxIter, am);
+	majorization(st, mg, g, nG, layoutMode, layoutModel, st->Ndim, st->MaxIter, am);
     else
-	kkNeato(g, nG, layoutModel);
+	kkNeato(st, g, nG, layoutModel);
+}
+
+/* neatoFinish:
+ * Report on a component laid out by neatoSolve. This is left to the
+ * caller, as the solver may have run in a thread of its own.
+ */
+static void
+neatoFinish(neato_state_t * st, Agraph_t * g, int layoutMode)
+{
+    if ((layoutMode == MODE_KK) && (GD_move(g) == st->MaxIter))
+	agerr(AGWARN, "Max. iterations (%d) reached on graph %s\n",
+	      st->MaxIter, agnameof(g));
+}
+
+/* neatoLayout:
+ * Use stress optimization to layout a single component
+ */
+static void 
+neatoLayout(neato_state_t * st, Agraph_t * mg, Agraph_t * g, int layoutMode,
+  int layoutModel, adjust_data* am)
+{
+    int nG = neatoSetup(st, g, layoutMode);
+
+    if (nG) {
+	neatoSolve(st, mg, g, nG, layoutMode, layoutModel, am);
+	neatoFinish(st, g, layoutMode);
+    }
+}
+
+typedef struct {
+    neato_state_t *st;		/* state of each component */
+    int *nG;			/* its size, from neatoSetup */
+    Agraph_t *mg;
+    int layoutMode;
+    int layoutModel;
+    adjust_data *am;
+} comps_t;
+
+static void solveComp(Agraph_t * g, int i, void *state)
+{
+    comps_t *cs = (comps_t *) state;
+
+    if (cs->nG[i])
+	neatoSolve(cs->st + i, cs->mg, g, cs->nG[i], cs->layoutMode,
+		   cs->layoutModel, cs->am);
+}
+
+/* neatoLayoutComps:
+ * Lay out the n_cc components cc of g as neatoLayout does, but with
+ * the solvers running concurrently on up to nthreads threads (see
+ * layoutComps). Each component gets its own copy of st, and the steps
+ * that read attributes or report errors are done in order, before and
+ * after the solvers.
+ * Returns FALSE, having done nothing, if the solver cannot run in
+ * threads: mode=hier and mode=ipsep read edge attributes, and
+ * model=circuit uses static LU decomposition state.
+ */
+static boolean
+neatoLayoutComps(neato_state_t * st, Agraph_t * g, Agraph_t ** cc,
+  int n_cc, int layoutMode, int layoutModel, adjust_data* am, int nthreads)
+{
+    comps_t cs;
+    int i;
+
+    if ((layoutMode == MODE_HIER) || (layoutMode == MODE_IPSEP) ||
+	(layoutModel == MODEL_CIRCUIT))
+	return FALSE;
+
+    cs.st = N_NEW(n_cc, neato_state_t);
+    cs.nG = N_NEW(n_cc, int);
+    cs.mg = g;
+    cs.layoutMode = layoutMode;
+    cs.layoutModel = layoutModel;
+    cs.am = am;
+    for (i = 0; i < n_cc; i++) {
+	nodeInduce(cc[i]);
+	cs.st[i] = *st;
+	if (nthreads > 1)	/* the components already share the threads */
+	    cs.st[i].nthreads = 1;
+	cs.nG[i] = neatoSetup(cs.st + i, cc[i], layoutMode);
+    }
+    layoutComps(n_cc, cc, nthreads, cs.st[0].seed, solveComp, &cs);
+    for (i = 0; i < n_cc; i++) {
+	if (cs.nG[i])
+	    neatoFinish(cs.st + i, cc[i], layoutMode);
+    }
+    free(cs.st);
+    free(cs.nG);
+    return TRUE;
 }
 
 /* addZ;
@@ -1367,7 +1526,7 @@ static void addZ (Agraph_t* g)
     node_t* n;
     char    buf[BUFSIZ];
 
-    if ((Ndim >= 3) && N_z) { 
+    if ((GD_ndim(agroot(g)) >= 3) && N_z) { 
 	for (n = agfstnode(g); n; n = agnxtnode(g, n)) {
 	    sprintf(buf, "%lf", POINTS_PER_INCH * (ND_pos(n)[2]));
 	    agxset(n, N_z, buf);
@@ -1409,12 +1568,16 @@ void neato_layout(Agraph_t * g)
     pack_mode mode;
     pack_info pinfo;
     adjust_data am;
-    double save_scale = PSinputscale;
+    neato_state_t st;
+    int Pack;		/* If >= 0, layout components separately and pack together
+			 * The value of Pack gives margins around graphs.
+			 */
+    int oldthreads;
 
     if (Nop) {
 	int ret;
-	PSinputscale = POINTS_PER_INCH;
-	neato_init_graph(g);
+	neato_init_state(&st, g, POINTS_PER_INCH);
+	neato_init_graph(&st, g);
 	addZ (g);
 	ret = init_nop(g, 1);
 	if (ret < 0) {
@@ -1424,8 +1587,9 @@ void neato_layout(Agraph_t * g)
 	else gv_postprocess(g, 0);
     } else {
 	boolean noTranslate = mapBool(agget(g, "notranslate"), FALSE);
-	PSinputscale = get_inputscale (g);
-	neato_init_graph(g);
+	neato_init_state(&st, g, get_inputscale (g));
+	neato_init_graph(&st, g);
+	oldthreads = SparseMatrix_set_threads(st.nthreads);
 	layoutMode = neatoMode(g);
 	graphAdjustMode (g, &am, 0);
 	model = neatoModel(g);
@@ -1452,10 +1616,15 @@ void neato_layout(Agraph_t * g)
 
 	    if (n_cc > 1) {
 		boolean *bp;
+		int nthreads = getPackThreads(g);
+		boolean done = (nthreads > 0) &&
+		    neatoLayoutComps(&st, g, cc, n_cc, layoutMode, model, &am, nthreads);
 		for (i = 0; i < n_cc; i++) {
 		    gc = cc[i];
-		    nodeInduce(gc);
-		    neatoLayout(g, gc, layoutMode, model, &am);
+		    if (!done) {
+			nodeInduce(gc);
+			neatoLayout(&st, g, gc, layoutMode, model, &am);
+		    }
 		    removeOverlapWith(gc, &am);
 		    setEdgeType (gc, ET_LINE);
 		    if (noTranslate) doEdges(gc);
@@ -1474,7 +1643,7 @@ void neato_layout(Agraph_t * g)
 		    free(bp);
 	    }
 	    else {
-		neatoLayout(g, g, layoutMode, model, &am);
+		neatoLayout(&st, g, g, layoutMode, model, &am);
 		removeOverlapWith(g, &am);
 		if (noTranslate) doEdges(g);
 		else spline_edges(g);
@@ -1494,13 +1663,13 @@ void neato_layout(Agraph_t * g)
 	    addCluster (g);
 #endif
 	} else {
-	    neatoLayout(g, g, layoutMode, model, &am);
+	    neatoLayout(&st, g, g, layoutMode, model, &am);
 	    removeOverlapWith(g, &am);
 	    addZ (g);
 	    if (noTranslate) doEdges(g);
 	    else spline_edges(g);
 	}
+	SparseMatrix_set_threads(oldthreads);
 	gv_postprocess(g, !noTranslate);
     }
-    PSinputscale = save_scale;
 }
@@ -19,20 +19,61 @@ extern "C" {
 #endif
 #include "adjust.h"
 
+    /* neato_state_t:
+     * State of one neato layout. neato_layout sets one up for each graph
+     * it lays out and passes it down, in place of the globals of the same
+     * names, so that separate graphs can be laid out at the same time.
+     * Some process-wide state is still shared and keeps concurrent layouts
+     * from being safe in general: Nop and the attribute symbols E_weight
+     * and N_z are set by graph_init, State is written once splines are
+     * done, and the Agraphinfo_t/Agnodeinfo_t records come from cgraph,
+     * which is not thread-safe when graphs share a root. The scratch
+     * statics of lu.c, kkutils.c, quad_prog_solve.c, delaunay.c and
+     * legal.c are threadprivate.
+     */
+    typedef struct {
+	int Nop;			/* value of Nop when the layout started */
+	int Ndim;			/* dimension of the layout */
+	double inputscale;		/* divides input positions if > 0 */
+	attrsym_t *N_pos;		/* node attribute giving input positions */
+	attrsym_t *E_len;		/* edge attribute giving edge lengths */
+	int MaxIter;		/* iteration limit of the solvers */
+	double Epsilon;		/* convergence tolerance of the solvers */
+	double Initial_dist;	/* distance between disconnected nodes */
+	double Damping;		/* damping of the KK solver */
+	int init;			/* initial layout, set by checkStart */
+	long seed;			/* its random seed */
+	int stresswt;		/* stress weighting of majorization */
+	int warned_self;		/* warned that start is ignored with mode=self */
+	convparms_t conv;		/* time budget and tolerance of the solvers */
+	int nthreads;		/* threads for the solver kernels; see SparseMatrix_set_threads */
+	/* working state of the KK solver; see stuff.c */
+	double Epsilon2;
+	double *Krow;		/* spring constants of the current row */
+	int Maxnode;		/* node with the largest gradient */
+	double Maxgrad;		/* its squared gradient */
+	double *Hess;		/* Hessian of the node being moved */
+	int cnt;			/* calls to choose_node */
+	node_t **Heap;		/* Dijkstra heap of shortest_path */
+	int Heapsize;
+	node_t *Src;
+    } neato_state_t;
+
+    extern int applyStart(neato_state_t *, graph_t * G, int nG);
     extern void avoid_cycling(graph_t *, Agnode_t *, double *);
-    extern int checkStart(graph_t * G, int nG, int);
-    extern Agnode_t *choose_node(graph_t *, int);
+    extern int checkStart(neato_state_t *, graph_t * G, int);
+    extern Agnode_t *choose_node(neato_state_t *, graph_t *);
     extern int circuit_model(graph_t *, int);
-    extern void D2E(Agraph_t *, int, int, double *);
-    extern void diffeq_model(graph_t *, int);
-    extern double distvec(double *, double *, double *);
-    extern void final_energy(graph_t *, int);
+    extern void D2E(neato_state_t *, Agraph_t *, int, int, double *);
+    extern void diffeq_model(neato_state_t *, graph_t *, int);
+    extern double distvec(double *, double *, double *, int);
+    extern void final_energy(neato_state_t *, graph_t *, int);
     extern double fpow32(double);
     extern Ppolyline_t getPath(edge_t *, vconfig_t *, int, Ppoly_t **,
 			       int);
-    extern void heapdown(Agnode_t *);
-    extern void heapup(Agnode_t *);
-    extern void initial_positions(graph_t *, int);
+    extern void heapdown(neato_state_t *, Agnode_t *);
+    extern void heapup(neato_state_t *, Agnode_t *);
+    extern void initial_positions(neato_state_t *, graph_t *, int);
     extern int init_port(Agnode_t *, Agedge_t *, char *, boolean);
     extern void jitter3d(Agnode_t *, int);
     extern void jitter_d(Agnode_t *, int, int);
@@ -40,23 +81,23 @@ extern "C" {
     extern void makeSelfArcs(path * P, edge_t * e, int stepx);
     extern void makeSpline(graph_t*, edge_t *, Ppoly_t **, int, boolean);
     extern void make_spring(graph_t *, Agnode_t *, Agnode_t *, double);
-    extern void move_node(graph_t *, int, Agnode_t *);
+    extern void move_node(neato_state_t *, graph_t *, int, Agnode_t *);
     extern int init_nop(graph_t * g, int);
     extern void neato_cleanup(graph_t * g);
-    extern node_t *neato_dequeue(void);
-    extern void neato_enqueue(node_t *);
+    extern node_t *neato_dequeue(neato_state_t *);
+    extern void neato_enqueue(neato_state_t *, node_t *);
     extern void neato_init_node(node_t * n);
     extern void neato_layout(Agraph_t * g);
     extern int Plegal_arrangement(Ppoly_t ** polys, int n_polys);
     extern void randompos(Agnode_t *, int);
-    extern void s1(graph_t *, node_t *);
-    extern int scan_graph(graph_t *);
-    extern int scan_graph_mode(graph_t * G, int mode);
+    extern void s1(neato_state_t *, graph_t *, node_t *);
+    extern int scan_graph(neato_state_t *, graph_t *);
+    extern int scan_graph_mode(neato_state_t *, graph_t * G, int mode);
     extern void free_scan_graph(graph_t *);
     extern int setSeed (graph_t*, int dflt, long* seedp);
-    extern void shortest_path(graph_t *, int);
+    extern void shortest_path(neato_state_t *, graph_t *, int);
     extern void solve(double *, double *, double *, int);
-    extern void solve_model(graph_t *, int);
+    extern void solve_model(neato_state_t *, graph_t *, int);
     extern int solveCircuit(int nG, double **Gm, double **Gm_inv);
     extern void spline_edges(Agraph_t *);
     extern void spline_edges0(Agraph_t *, boolean);
@@ -66,7 +107,7 @@ extern "C" {
     extern void neato_translate(Agraph_t * g);
     extern boolean neato_set_aspect(graph_t * g);
     extern void toggle(int);
-    extern int user_pos(Agsym_t *, Agsym_t *, Agnode_t *, int);
+    extern int user_pos(Agsym_t *, Agsym_t *, Agnode_t *, int, double);
     extern double **new_array(int i, int j, double val);
     extern void free_array(double **rv);
     extern int matinv(double **A, double **Ainv, int n);
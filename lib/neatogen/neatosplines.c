@@ -19,9 +19,6 @@
 #include "pathplan.h"
 #include "vispath.h"
 #include "multispline.h"
-#ifndef HAVE_DRAND48
-extern double drand48(void);
-#endif
 
 #ifdef ORTHO
 #include <ortho.h>
@@ -323,7 +320,7 @@ Ppoly_t *makeObstacle(node_t * n, expand_t* pmargin, boolean isOrtho)
 	} else {		/* ellipse */
 	    isPoly = 0;
 	    sides = 8;
-	    adj = drand48() * .01;
+	    adj = gvdrand48() * .01;
 	}
 	obs->pn = sides;
 	obs->ps = N_NEW(sides, Ppoint_t);
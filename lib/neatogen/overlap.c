@@ -17,13 +17,18 @@
 
 #include "SparseMatrix.h"
 #include "overlap.h"
+#include "sparse_solve.h"
 #include "call_tri.h"
-#include "red_black_tree.h"
 #include "types.h"
 #include "memory.h"
 #include "globals.h"
 #include <time.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define OVERLAP_SIMD
+#include <emmintrin.h>
+#endif
+
 static void ideal_distance_avoid_overlap(int dim, SparseMatrix A, real *x, real *width, real *ideal_distance, real *tmax, real *tmin){
   /*  if (x1>x2 && y1 > y2) we want either x1 + t (x1-x2) - x2 > (width1+width2), or y1 + t (y1-y2) - y2 > (height1+height2),
       hence t = MAX(expandmin, MIN(expandmax, (width1+width2)/(x1-x2) - 1, (height1+height2)/(y1-y2) - 1)), and
@@ -77,23 +82,19 @@ static void ideal_distance_avoid_overlap(int dim, SparseMatrix A, real *x, real
 
 #define collide(i,j) ((ABS(x[(i)*dim] - x[(j)*dim]) < width[(i)*dim]+width[(j)*dim]) || (ABS(x[(i)*dim+1] - x[(j)*dim+1]) < width[(i)*dim+1]+width[(j)*dim+1]))
 
-enum {INTV_OPEN, INTV_CLOSE};
-
-struct scan_point_struct{
+struct scan_box_struct{
+  real lo;/* left end of the x-interval */
   int node;
-  real x;
-  int status;
 };
 
-typedef struct scan_point_struct scan_point;
-
+typedef struct scan_box_struct scan_box;
 
-static int comp_scan_points(const void *p, const void *q){
-  scan_point *pp = (scan_point *) p;
-  scan_point *qq = (scan_point *) q;
-  if (pp->x > qq->x){
+static int comp_scan_boxes(const void *p, const void *q){
+  scan_box *pp = (scan_box *) p;
+  scan_box *qq = (scan_box *) q;
+  if (pp->lo > qq->lo){
     return 1;
-  } else if (pp->x < qq->x){
+  } else if (pp->lo < qq->lo){
     return -1;
   } else {
     if (pp->node > qq->node){
@@ -106,157 +107,156 @@ static int comp_scan_points(const void *p, const void *q){
   return 0;
 }
 
-
-void NodeDest(void* a) {
-  /*  free((int*)a);*/
-}
-
-
-
-int NodeComp(const void* a,const void* b) {
-  return comp_scan_points(a,b);
-
-}
-
-void NodePrint(const void* a) {
-  scan_point *aa;
-
-  aa = (scan_point *) a;
-  fprintf(stderr, "node {%d, %f, %d}\n", aa->node, aa->x, aa->status);
-
+static int overlap_count(real c, real w, real *yc, real *yw, int m0, int m1){
+  /* the number of boxes m0 <= m < m1 whose y-interval, of center yc[m] and half height yw[m],
+     overlaps the one of center c and half height w */
+  int m, cnt = 0;
+#ifdef OVERLAP_SIMD
+  __m128d cc = _mm_set1_pd(c), ww = _mm_set1_pd(w), sign = _mm_set1_pd(-0.), d;
+  int mask;
+
+  for (m = m0; m + 2 <= m1; m += 2){
+    d = _mm_andnot_pd(sign, _mm_sub_pd(cc, _mm_loadu_pd(yc + m)));
+    mask = _mm_movemask_pd(_mm_cmplt_pd(d, _mm_add_pd(ww, _mm_loadu_pd(yw + m))));
+    cnt += (mask & 1) + (mask >> 1);
+  }
+#else
+  m = m0;
+#endif
+  for (; m < m1; m++) cnt += (fabs(c - yc[m]) < w + yw[m]);
+  return cnt;
 }
 
-void InfoPrint(void* a) {
-  ;
-}
+static int overlap_pairs(int k, int n, real *lo, real *hi, real *yc, real *yw, int *last){
+  /* the number of boxes after k in sweep order that overlap box k. On return *last is
+     one past the last box whose x-interval starts before the end of that of k. */
+  int e, l = k, h = n;
 
-void InfoDest(void *a){
-  ;
+  /* lo is sorted, find the first e > k with lo[e] > hi[k] by bisection */
+  while (h - l > 1){
+    e = (l + h)/2;
+    if (lo[e] <= hi[k]) {
+      l = e;
+    } else {
+      h = e;
+    }
+  }
+  e = h;
+  *last = e;
+  return overlap_count(yc[k], yw[k], yc, yw, k + 1, e);
 }
 
 static SparseMatrix get_overlap_graph(int dim, int n, real *x, real *width, int check_overlap_only){
-  /* if check_overlap_only = TRUE, we only check whether there is one overlap */
-  scan_point *scanpointsx, *scanpointsy;
-  int i, k, neighbor;
-  SparseMatrix A = NULL, B = NULL;
-  rb_red_blk_node *newNode, *newNode0, *newNode2 = NULL;
-  rb_red_blk_tree* treey;
-  real one = 1;
-
-  A = SparseMatrix_new(n, n, 1, MATRIX_TYPE_REAL, FORMAT_COORD);
-
-  scanpointsx = N_GNEW(2*n,scan_point);
+  /* if check_overlap_only = TRUE, we only check whether there is one overlap.
+     Boxes i and j overlap if their x-intervals meet and the distance of the centers of their
+     y-intervals is less than the sum of the half heights. The boxes are swept in order of the
+     left ends of their x-intervals, so the boxes that may overlap box k are the ones that follow
+     it in this order and start before its right end. The candidates of each box are counted and
+     then written out in a second pass, so with OpenMP the boxes can be shared among the
+     SparseMatrix_threads(n) threads of the layout and the graph does not depend on the number
+     of threads. */
+  scan_box *boxes;
+  int i, j, k, m, e, nz, *node, *ia, *ja, *last, *start, nthreads = SparseMatrix_threads(n);
+  real *lo, *hi, *yc, *yw, *a, lo_y, hi_y;
+  int *pairs = NULL;
+  SparseMatrix A = NULL;
+
+  boxes = N_GNEW(n,scan_box);
   for (i = 0; i < n; i++){
-    scanpointsx[2*i].node = i;
-    scanpointsx[2*i].x = x[i*dim] - width[i*dim];
-    scanpointsx[2*i].status = INTV_OPEN;
-    scanpointsx[2*i+1].node = i+n;
-    scanpointsx[2*i+1].x = x[i*dim] + width[i*dim];
-    scanpointsx[2*i+1].status = INTV_CLOSE;
+    boxes[i].lo = x[i*dim] - width[i*dim];
+    boxes[i].node = i;
   }
-  qsort(scanpointsx, 2*n, sizeof(scan_point), comp_scan_points);
-
-  scanpointsy = N_GNEW(2*n,scan_point);
-  for (i = 0; i < n; i++){
-    scanpointsy[i].node = i;
-    scanpointsy[i].x = x[i*dim+1] - width[i*dim+1];
-    scanpointsy[i].status = INTV_OPEN;
-    scanpointsy[i+n].node = i;
-    scanpointsy[i+n].x = x[i*dim+1] + width[i*dim+1];
-    scanpointsy[i+n].status = INTV_CLOSE;
+  qsort(boxes, n, sizeof(scan_box), comp_scan_boxes);
+
+  /* the boxes in sweep order: the ends of the x-interval, the center of the y-interval and
+     the half height */
+  node = N_GNEW(n,int);
+  lo = N_GNEW(n,real);
+  hi = N_GNEW(n,real);
+  yc = N_GNEW(n,real);
+  yw = N_GNEW(n,real);
+  for (k = 0; k < n; k++){
+    i = node[k] = boxes[k].node;
+    hi[k] = x[i*dim] + width[i*dim];
+    lo_y = x[i*dim+1] - width[i*dim+1];
+    hi_y = x[i*dim+1] + width[i*dim+1];
+    lo[k] = boxes[k].lo;
+    yc[k] = 0.5*(lo_y + hi_y);
+    yw[k] = 0.5*(hi_y - lo_y);
   }
+  FREE(boxes);
 
+  last = N_GNEW(n,int);
+  start = N_GNEW(n+1,int);
+  start[0] = 0;
 
-  treey = RBTreeCreate(NodeComp,NodeDest,InfoDest,NodePrint,InfoPrint);
-
-  for (i = 0; i < 2*n; i++){
-#ifdef DEBUG_RBTREE
-    fprintf(stderr," k = %d node = %d x====%f\n",(scanpointsx[i].node)%n, (scanpointsx[i].node), (scanpointsx[i].x));
-#endif
-
-    k = (scanpointsx[i].node)%n;
-
-
-    if (scanpointsx[i].status == INTV_OPEN){
-#ifdef DEBUG_RBTREE
-      fprintf(stderr, "inserting...");
-      treey->PrintKey(&(scanpointsy[k]));
-#endif
-
-      RBTreeInsert(treey, &(scanpointsy[k]), NULL); /* add both open and close int for y */
-
-#ifdef DEBUG_RBTREE
-      fprintf(stderr, "inserting2...");
-      treey->PrintKey(&(scanpointsy[k+n]));
-#endif
-
-      RBTreeInsert(treey, &(scanpointsy[k+n]), NULL);
+  if (check_overlap_only){
+    for (k = 0; k < n; k++){
+      start[k+1] = overlap_pairs(k, n, lo, hi, yc, yw, &(last[k]));
+      if (start[k+1] > 0) break;
+    }
+    if (k < n){
+      for (m = k + 1; fabs(yc[k] - yc[m]) >= yw[k] + yw[m]; m++);
+      pairs = N_GNEW(2,int);
+      pairs[0] = node[k]; pairs[1] = node[m];
+      nz = 1;
     } else {
-      real bsta, bbsta, bsto, bbsto; int ii; 
-
-      assert(scanpointsx[i].node >= n);
-
-      newNode = newNode0 = RBExactQuery(treey, &(scanpointsy[k + n]));
-      ii = ((scan_point *)newNode->key)->node;
-      assert(ii < n);
-      bsta = scanpointsy[ii].x; bsto = scanpointsy[ii+n].x;
-
-#ifdef DEBUG_RBTREE
-      fprintf(stderr, "poping..%d....yinterval={%f,%f}\n", scanpointsy[k + n].node, bsta, bsto);
-      treey->PrintKey(newNode->key);
+      nz = 0;
+    }
+  } else {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 256) num_threads(nthreads) if (nthreads > 1)
 #endif
+    for (k = 0; k < n; k++) start[k+1] = overlap_pairs(k, n, lo, hi, yc, yw, &(last[k]));
+    for (k = 0; k < n; k++) start[k+1] += start[k];
+    nz = start[n];
 
-     assert(treey->nil != newNode);
-      while ((newNode) && ((newNode = TreePredecessor(treey, newNode)) != treey->nil)){
-	neighbor = (((scan_point *)newNode->key)->node)%n;
-	bbsta = scanpointsy[neighbor].x; bbsto = scanpointsy[neighbor+n].x;/* the y-interval of the node that has one end of the interval lower than the top of the leaving interval (bsto) */
-#ifdef DEBUG_RBTREE
-	fprintf(stderr," predecessor is node %d y = %f\n", ((scan_point *)newNode->key)->node, ((scan_point *)newNode->key)->x);
+    pairs = N_GNEW(2*MAX(nz, 1),int);
+#ifdef _OPENMP
+#pragma omp parallel for private(m, e) schedule(dynamic, 256) num_threads(nthreads) if (nthreads > 1)
 #endif
-	if (neighbor != k){
-	  if (ABS(0.5*(bsta+bsto) - 0.5*(bbsta+bbsto)) < 0.5*(bsto-bsta) + 0.5*(bbsto-bbsta)){/* if the distance of the centers of the interval is less than sum of width, we have overlap */
-	    A = SparseMatrix_coordinate_form_add_entries(A, 1, &neighbor, &k, &one);
-#ifdef DEBUG_RBTREE
-	    fprintf(stderr,"======================================  %d %d\n",k,neighbor);
-#endif
-	    if (check_overlap_only) goto check_overlap_RETURN;
-	  }
-	} else {
-	  newNode2 = newNode;
+    for (k = 0; k < n; k++){
+      e = start[k];
+      for (m = k + 1; m < last[k]; m++){
+	if (fabs(yc[k] - yc[m]) < yw[k] + yw[m]){
+	  pairs[2*e] = node[k];
+	  pairs[2*e+1] = node[m];
+	  e++;
 	}
-
       }
-
-#ifdef DEBUG_RBTREE
-      fprintf(stderr, "deleteing...");
-      treey->PrintKey(newNode0->key);
-#endif
-
-      if (newNode0) RBDelete(treey,newNode0);
-
-
-     if (newNode2 && newNode2 != treey->nil && newNode2 != newNode0) {
-
-#ifdef DEBUG_RBTREE
-	fprintf(stderr, "deleteing2...");
-	treey->PrintKey(newNode2->key);
-#endif
-
-	if (newNode0) RBDelete(treey,newNode2);
-      }
-
     }
   }
 
-check_overlap_RETURN:
-   FREE(scanpointsx);
-  FREE(scanpointsy);
-  RBTreeDestroy(treey);
+  FREE(node);
+  FREE(lo);
+  FREE(hi);
+  FREE(yc);
+  FREE(yw);
+  FREE(last);
+
+  /* each pair is an entry of both its rows */
+  A = SparseMatrix_new(n, n, 2*nz, MATRIX_TYPE_REAL, FORMAT_CSR);
+  ia = A->ia; ja = A->ja; a = (real*) A->a;
+  for (i = 0; i <= n; i++) ia[i] = 0;
+  for (k = 0; k < nz; k++){
+    ia[pairs[2*k]+1]++;
+    ia[pairs[2*k+1]+1]++;
+  }
+  for (i = 0; i < n; i++) ia[i+1] += ia[i];
+  for (i = 0; i < n; i++) start[i] = ia[i];
+  for (k = 0; k < nz; k++){
+    i = pairs[2*k]; j = pairs[2*k+1];
+    ja[start[i]++] = j;
+    ja[start[j]++] = i;
+  }
+  for (k = 0; k < 2*nz; k++) a[k] = 1.;
+  A->nz = 2*nz;
+  SparseMatrix_set_symmetric(A);
+  SparseMatrix_set_pattern_symmetric(A);
+
+  FREE(start);
+  FREE(pairs);
 
-  B = SparseMatrix_from_coordinate_format(A);
-  SparseMatrix_delete(A);
-  A = SparseMatrix_symmetrize(B, FALSE);
-  SparseMatrix_delete(B);
   if (Verbose) fprintf(stderr, "found %d clashes\n", A->nz);
   return A;
 }
@@ -397,6 +397,7 @@ OverlapSmoother OverlapSmoother_new(SparseMatrix A, int m,
 
   sm->tol_cg = 0.01;
   sm->maxit_cg = sqrt((double) A->m);
+  sm->solve_method = SOLVE_METHOD_CG;
 
   lambda = sm->lambda = N_GNEW(m,real);
   for (i = 0; i < m; i++) sm->lambda[i] = lambda0;
@@ -550,7 +551,7 @@ static int check_convergence(real max_overlap, real res, int has_penalty_terms,
 }
 
 void remove_overlap(int dim, SparseMatrix A, real *x, real *label_sizes, int ntry, real initial_scaling, 
-		    int edge_labeling_scheme, int n_constr_nodes, int *constr_nodes, SparseMatrix A_constr, int do_shrinking, int *flag){
+		    int edge_labeling_scheme, int n_constr_nodes, int *constr_nodes, SparseMatrix A_constr, int do_shrinking, convparms_t *cp, int *flag){
   /* 
      edge_labeling_scheme: if ELSCHEME_NONE, n_constr_nodes/constr_nodes/A_constr are not used
 
@@ -560,6 +561,7 @@ void remove_overlap(int dim, SparseMatrix A, real *x, real *label_sizes, int ntr
      A_constr: neighbors of node i are in the row i of this matrix. i needs to sit
      .         in between these neighbors as much as possible. this must not be NULL
      .         if constr_nodes != NULL.
+     cp: time budget and relative tolerance for the convergence monitor. May be NULL.
 
   */
 
@@ -573,6 +575,7 @@ void remove_overlap(int dim, SparseMatrix A, real *x, real *label_sizes, int ntr
   int has_penalty_terms = FALSE;
   real epsilon = 0.005;
   int shrink = 0;
+  convmon_t cm;
 
 #ifdef TIME
   clock_t  cpu;
@@ -616,6 +619,7 @@ void remove_overlap(int dim, SparseMatrix A, real *x, real *label_sizes, int ntr
 #endif
 
   has_penalty_terms = (edge_labeling_scheme != ELSCHEME_NONE && n_constr_nodes > 0);
+  convInit(&cm, cp, "prism", ntry);
   for (i = 0; i < ntry; i++){
     if (Verbose) print_bounding_box(A->m, dim, x);
     sm = OverlapSmoother_new(A, A->m, dim, lambda, x, label_sizes, include_original_graph, neighborhood_only,
@@ -640,6 +644,7 @@ void remove_overlap(int dim, SparseMatrix A, real *x, real *label_sizes, int ntr
     export_embedding(fp, dim, A, x, label_sizes);
 #endif
     OverlapSmoother_delete(sm);
+    if (convStep(&cm, -1, res)) break;
   }
   if (Verbose) fprintf(stderr, "overlap removal neighbors only?= %d iter -- %d, overlap factor = %g underlap factor = %g\n", neighborhood_only, i, max_overlap - 1, min_overlap);
 
@@ -652,7 +657,7 @@ void remove_overlap(int dim, SparseMatrix A, real *x, real *label_sizes, int ntr
   if (has_penalty_terms){
     /* now do without penalty */
     remove_overlap(dim, A, x, label_sizes, ntry, 0.,
-		   ELSCHEME_NONE, 0, NULL, NULL, do_shrinking, flag);
+		   ELSCHEME_NONE, 0, NULL, NULL, do_shrinking, cp, flag);
   }
 
 #ifdef DEBUG
@@ -683,13 +688,19 @@ void remove_overlap(int dim, SparseMatrix A, real *x, real *label_sizes, int ntr
 #else
 #include "types.h"
 #include "SparseMatrix.h"
+#include "agxbuf.h"
+#include "utils.h"
 void remove_overlap(int dim, SparseMatrix A, int m, real *x, real *label_sizes, int ntry, real initial_scaling, int do_shrinking, int *flag)
 {
     static int once;
 
+    /* sfdp may call this from several threads (see layoutComps) */
+#ifdef _OPENMP
+#pragma omp critical (remove_overlap)
+#endif
     if (once == 0) {
 	once = 1;
-	agerr(AGERR, "remove_overlap: Graphviz not built with triangulation library\n");
+	gvagerr(AGERR, "remove_overlap: Graphviz not built with triangulation library\n");
     }
 }
 #endif
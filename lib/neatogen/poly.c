@@ -27,20 +27,15 @@
 #define CIRCLE 2
 #define ISCIRCLE(p) ((p)->kind & CIRCLE)
 
-static int maxcnt = 0;
-static Point *tp1 = NULL;
-static Point *tp2 = NULL;
-static Point *tp3 = NULL;
-
-void polyFree()
+void polyFree(polywork_t * wp)
 {
-    maxcnt = 0;
-    free(tp1);
-    free(tp2);
-    free(tp3);
-    tp1 = NULL;
-    tp2 = NULL;
-    tp3 = NULL;
+    wp->maxcnt = 0;
+    free(wp->tp1);
+    free(wp->tp2);
+    free(wp->tp3);
+    wp->tp1 = NULL;
+    wp->tp2 = NULL;
+    wp->tp3 = NULL;
 }
 
 void breakPoly(Poly * pp)
@@ -267,8 +262,6 @@ int makeAddPoly(Poly * pp, Agnode_t * n, float xmargin, float ymargin)
     pp->nverts = sides;
     bbox(verts, sides, &pp->origin, &pp->corner);
 
-    if (sides > maxcnt)
-	maxcnt = sides;
     return 0;
 }
 
@@ -348,8 +341,6 @@ int makePoly(Poly * pp, Agnode_t * n, float xmargin, float ymargin)
     pp->nverts = sides;
     bbox(verts, sides, &pp->origin, &pp->corner);
 
-    if (sides > maxcnt)
-	maxcnt = sides;
     return 0;
 }
 
@@ -425,15 +416,12 @@ static int edgesIntersect(Point * P, Point * Q, int n, int m)
  * Return 1 if q is inside polygon vertex[]
  * Assume points are in CCW order
  */
-static int inPoly(Point vertex[], int n, Point q)
+static int inPoly(Point vertex[], int n, Point q, Point * tp3)
 {
     int i, i1;			/* point index; i1 = i-1 mod n */
     double x;			/* x intersection of e with ray */
     double crossings = 0;	/* number of edge/ray crossings */
 
-    if (tp3 == NULL)
-	tp3 = N_GNEW(maxcnt, Point);
-
     /* Shift so that q is the origin. */
     for (i = 0; i < n; i++) {
 	tp3[i].x = vertex[i].x - q.x;
@@ -501,10 +489,12 @@ static void transCopy(Point * inp, int cnt, Point off, Point * outp)
     }
 }
 
-int polyOverlap(Point p, Poly * pp, Point q, Poly * qp)
+int polyOverlap(Point p, Poly * pp, Point q, Poly * qp, polywork_t * wp)
 {
     Point op, cp;
     Point oq, cq;
+    Point *tp1, *tp2;
+    int cnt;
 
     /* translate bounding boxes */
     addpt(&op, p, pp->origin);
@@ -529,14 +519,19 @@ int polyOverlap(Point p, Poly * pp, Point q, Poly * qp)
 	    return 1;
     }
 
-    if (tp1 == NULL) {
-	tp1 = N_GNEW(maxcnt, Point);
-	tp2 = N_GNEW(maxcnt, Point);
+    cnt = MAX(pp->nverts, qp->nverts);
+    if (cnt > wp->maxcnt) {
+	wp->tp1 = ALLOC(cnt, wp->tp1, Point);
+	wp->tp2 = ALLOC(cnt, wp->tp2, Point);
+	wp->tp3 = ALLOC(cnt, wp->tp3, Point);
+	wp->maxcnt = cnt;
     }
+    tp1 = wp->tp1;
+    tp2 = wp->tp2;
 
     transCopy(pp->verts, pp->nverts, p, tp1);
     transCopy(qp->verts, qp->nverts, q, tp2);
     return (edgesIntersect(tp1, tp2, pp->nverts, qp->nverts) ||
-	    (inBox(*tp1, oq, cq) && inPoly(tp2, qp->nverts, *tp1)) ||
-	    (inBox(*tp2, op, cp) && inPoly(tp1, pp->nverts, *tp2)));
+	    (inBox(*tp1, oq, cq) && inPoly(tp2, qp->nverts, *tp1, wp->tp3)) ||
+	    (inBox(*tp2, op, cp) && inPoly(tp1, pp->nverts, *tp2, wp->tp3)));
 }
@@ -28,8 +28,18 @@ extern "C" {
 	int kind;
     } Poly;
 
-    extern void polyFree(void);
-    extern int polyOverlap(Point, Poly *, Point, Poly *);
+    /* Scratch space of polyOverlap, owned by the caller. It starts
+     * zeroed, grows as needed, and is released by polyFree.
+     */
+    typedef struct {
+	int maxcnt;
+	Point *tp1;
+	Point *tp2;
+	Point *tp3;
+    } polywork_t;
+
+    extern void polyFree(polywork_t *);
+    extern int polyOverlap(Point, Poly *, Point, Poly *, polywork_t *);
     extern int makePoly(Poly *, Agnode_t *, float, float);
     extern int makeAddPoly(Poly *, Agnode_t *, float, float);
     extern void breakPoly(Poly *);
@@ -405,6 +405,7 @@ constrained_majorization_new(CMajEnv * e, float *b, float **coords,
 
 #ifdef IPSEPCOLA
 static float *place;
+#pragma omp threadprivate(place)
 static int compare_incr(const void *a, const void *b)
 {
     if (place[*(int *) a] > place[*(int *) b]) {
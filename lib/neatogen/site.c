@@ -12,30 +12,20 @@
  *************************************************************************/
 
 #include "mem.h"
-#include "site.h"
+#include "voronoi.h"
 #include <math.h>
 
 
-int siteidx;
-Site *bottomsite;
-
-static Freelist sfl;
-static int nvertices;
-
-void siteinit()
+void siteinit(vstate_t * vs)
 {
-    /* double sn; */
-
-    freeinit(&sfl, sizeof(Site));
-    nvertices = 0;
-    /* sn = nsites+4; */
-    /* sqrt_nsites = sqrt(sn); */
+    freereset(&vs->sfl);
+    vs->nvertices = 0;
 }
 
 
-Site *getsite()
+Site *getsite(vstate_t * vs)
 {
-    return ((Site *) getfree(&sfl));
+    return ((Site *) getfree(&vs->sfl));
 }
 
 double dist(Site * s, Site * t)
@@ -50,21 +40,21 @@ double dist(Site * s, Site * t)
 }
 
 
-void makevertex(Site * v)
+void makevertex(vstate_t * vs, Site * v)
 {
-    v->sitenbr = nvertices;
-    nvertices += 1;
+    v->sitenbr = vs->nvertices;
+    vs->nvertices += 1;
 #ifdef STANDALONE
     out_vertex(v);
 #endif
 }
 
 
-void deref(Site * v)
+void deref(vstate_t * vs, Site * v)
 {
     v->refcnt -= 1;
     if (v->refcnt == 0)
-	makefree(v, &sfl);
+	makefree(v, &vs->sfl);
 }
 
 void ref(Site * v)
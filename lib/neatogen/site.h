@@ -29,15 +29,12 @@ extern "C" {
 	int refcnt;
     } Site;
 
-    extern int siteidx;
-    extern Site *bottomsite;
-
-    extern void siteinit(void);
-    extern Site *getsite(void);
+    extern void siteinit(vstate_t *);
+    extern Site *getsite(vstate_t *);
     extern double dist(Site *, Site *);	/* Distance between two sites */
-    extern void deref(Site *);	/* Increment refcnt of site  */
-    extern void ref(Site *);	/* Decrement refcnt of site  */
-    extern void makevertex(Site *);	/* Transform a site into a vertex */
+    extern void deref(vstate_t *, Site *);	/* Decrement refcnt of site  */
+    extern void ref(Site *);	/* Increment refcnt of site  */
+    extern void makevertex(vstate_t *, Site *);	/* Transform a site into a vertex */
 #endif
 
 #ifdef __cplusplus
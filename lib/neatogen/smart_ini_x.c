@@ -86,7 +86,7 @@ power_iteration_orthog(float** square_mat, int n, int neigs,
 		/* guess the i-th eigen vector */
 choose:
 		for (j=0; j<n; j++) {
-			curr_vector[j] = rand()%100;
+			curr_vector[j] = gvrand()%100;
 		}
 
 		if (orthog!=NULL) {
@@ -142,7 +142,7 @@ exit:
 		curr_vector = eigs[i];
 		/* guess the i-th eigen vector */
 		for (j=0; j<n; j++)
-			curr_vector[j] = rand()%100;
+			curr_vector[j] = gvrand()%100;
 		/* orthogonalize against higher eigenvectors */
 		for (j=0; j<i; j++) {
 			alpha = -dot(eigs[j], 0, n-1, curr_vector);
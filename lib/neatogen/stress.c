@@ -21,15 +21,13 @@
 #include "embed_graph.h"
 #include "kkutils.h"
 #include "stress.h"
+#include "SparseMatrix.h"
+#include "Multilevel.h"
 #include <math.h>
 #include <stdlib.h>
 #include <time.h>
 
 
-#ifndef HAVE_DRAND48
-extern double drand48(void);
-#endif
-
 #define Dij2			/* If defined, the terms in the stress energy are normalized 
 				   by d_{ij}^{-2} otherwise, they are normalized by d_{ij}^{-1}
 				 */
@@ -181,11 +179,11 @@ initLayout(vtx_data * graph, int n, int dim, double **coords,
 	    if (isFixed(np))
 		pinned = 1;
 	} else {
-	    *xp++ = drand48();
-	    *yp++ = drand48();
+	    *xp++ = gvdrand48();
+	    *yp++ = gvdrand48();
 	    if (dim > 2) {
 		for (d = 2; d < dim; d++)
-		    coords[d][i] = drand48();
+		    coords[d][i] = gvdrand48();
 	    }
 	}
     }
@@ -266,6 +264,7 @@ static int sparse_stress_subspace_majorization_kD(vtx_data * graph,	/* Input gra
 						  int exp,	/* scale exponent */
 						  int reweight_graph,	/* difference model */
 						  int n_iterations,	/* max #iterations */
+						  double eps,	/* convergence tolerance */
 						  int dist_bound,	/* neighborhood size in sparse distance matrix    */
 						  int num_centers	/* #pivots in sparse distance matrix  */
     )
@@ -382,7 +381,7 @@ static int sparse_stress_subspace_majorization_kD(vtx_data * graph,	/* Input gra
     /* select 'num_centers' pivots that are uniformaly spreaded over the graph */
 
     /* the first pivots is selected randomly */
-    node = rand() % n;
+    node = gvrand() % n;
     CenterIndex[node] = 0;
     invCenterIndex[0] = node;
 
@@ -414,7 +413,7 @@ static int sparse_stress_subspace_majorization_kD(vtx_data * graph,	/* Input gra
 	for (j = 0; j < n; j++) {
 	    dist[j] = MIN(dist[j], Dij[i][j]);
 	    if (dist[j] > max_dist
-		|| (dist[j] == max_dist && rand() % (j + 1) == 0)) {
+		|| (dist[j] == max_dist && gvrand() % (j + 1) == 0)) {
 		node = j;
 		max_dist = dist[j];
 	    }
@@ -596,7 +595,7 @@ static int sparse_stress_subspace_majorization_kD(vtx_data * graph,	/* Input gra
 	/* random initialization */
 	for (k = 0; k < dim; k++) {
 	    for (i = 0; i < subspace_dim; i++) {
-		directions[k][i] = (double) (rand()) / RAND_MAX;
+		directions[k][i] = (double) (gvrand()) / RAND_MAX;
 	    }
 	}
     }
@@ -669,7 +668,7 @@ static int sparse_stress_subspace_majorization_kD(vtx_data * graph,	/* Input gra
 	    new_stress = compute_stress1(coords, distances, dim, n, exp);
 	    converged =
 		fabs(new_stress - old_stress) / (new_stress + 1e-10) <
-		Epsilon;
+		eps;
 	    old_stress = new_stress;
 	}
     }
@@ -707,28 +706,48 @@ finish0:
     return iterations;
 }
 
+/* Minimum number of nodes before the all-pairs shortest path
+ * computations are spread over nthreads threads. Each source fills its
+ * own row of the packed matrix, so the result does not depend on the
+ * number of threads.
+ */
+#define APSP_PARALLEL_MIN 1000
+
+/* packed_row:
+ * Offset of row i (entries i..n-1) in a packed upper triangular
+ * n x n matrix.
+ */
+#define packed_row(i,n) ((i)*(n) - (i)*((i)-1)/2)
+
 /* compute_weighted_apsp_packed:
  * Edge lengths can be any float > 0
  */
-static float *compute_weighted_apsp_packed(vtx_data * graph, int n)
+static float *compute_weighted_apsp_packed(vtx_data * graph, int n,
+					    int nthreads)
 {
-    int i, j, count;
+    int i;
     float *Dij = N_NEW(n * (n + 1) / 2, float);
 
-    float *Di = N_NEW(n, float);
-    Queue Q;
-
-    mkQueue(&Q, n);
+#ifdef _OPENMP
+#pragma omp parallel num_threads(MAX(nthreads, 1)) if (n >= APSP_PARALLEL_MIN && nthreads > 1)
+#endif
+    {
+	float *Di = N_NEW(n, float);
+	float *row;
+	int j;
 
-    count = 0;
-    for (i = 0; i < n; i++) {
-	dijkstra_f(i, graph, n, Di);
-	for (j = i; j < n; j++) {
-	    Dij[count++] = Di[j];
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+	for (i = 0; i < n; i++) {
+	    dijkstra_f(i, graph, n, Di);
+	    row = Dij + packed_row(i, n);
+	    for (j = i; j < n; j++) {
+		row[j - i] = Di[j];
+	    }
 	}
+	free(Di);
     }
-    free(Di);
-    freeQueue(&Q);
     return Dij;
 }
 
@@ -736,7 +755,7 @@ static float *compute_weighted_apsp_packed(vtx_data * graph, int n)
 /* mdsModel:
  * Update matrix with actual edge lengths
  */
-float *mdsModel(vtx_data * graph, int nG)
+float *mdsModel(vtx_data * graph, int nG, int nthreads)
 {
     int i, j, e;
     float *Dij;
@@ -747,7 +766,7 @@ float *mdsModel(vtx_data * graph, int nG)
 	return 0;
 
     /* first, compute shortest paths to fill in non-edges */
-    Dij = compute_weighted_apsp_packed(graph, nG);
+    Dij = compute_weighted_apsp_packed(graph, nG, nthreads);
 
     /* then, replace edge entries will user-supplied len */
     for (i = 0; i < nG; i++) {
@@ -769,31 +788,41 @@ float *mdsModel(vtx_data * graph, int nG)
 /* compute_apsp_packed:
  * Assumes integral weights > 0.
  */
-float *compute_apsp_packed(vtx_data * graph, int n)
+float *compute_apsp_packed(vtx_data * graph, int n, int nthreads)
 {
-    int i, j, count;
+    int i;
     float *Dij = N_NEW(n * (n + 1) / 2, float);
 
-    DistType *Di = N_NEW(n, DistType);
-    Queue Q;
-
-    mkQueue(&Q, n);
-
-    count = 0;
-    for (i = 0; i < n; i++) {
-	bfs(i, graph, n, Di, &Q);
-	for (j = i; j < n; j++) {
-	    Dij[count++] = ((float) Di[j]);
+#ifdef _OPENMP
+#pragma omp parallel num_threads(MAX(nthreads, 1)) if (n >= APSP_PARALLEL_MIN && nthreads > 1)
+#endif
+    {
+	DistType *Di = N_NEW(n, DistType);
+	float *row;
+	Queue Q;
+	int j;
+
+	mkQueue(&Q, n);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+	for (i = 0; i < n; i++) {
+	    bfs(i, graph, n, Di, &Q);
+	    row = Dij + packed_row(i, n);
+	    for (j = i; j < n; j++) {
+		row[j - i] = ((float) Di[j]);
+	    }
 	}
+	free(Di);
+	freeQueue(&Q);
     }
-    free(Di);
-    freeQueue(&Q);
     return Dij;
 }
 
 #define max(x,y) ((x)>(y)?(x):(y))
 
-float *compute_apsp_artifical_weights_packed(vtx_data * graph, int n)
+float *compute_apsp_artifical_weights_packed(vtx_data * graph, int n,
+					      int nthreads)
 {
     /* compute all-pairs-shortest-path-length while weighting the graph */
     /* so high-degree nodes are distantly located */
@@ -834,7 +863,7 @@ float *compute_apsp_artifical_weights_packed(vtx_data * graph, int n)
 	    graph[i].ewgts = weights;
 	    weights += graph[i].nedges;
 	}
-	Dij = compute_weighted_apsp_packed(graph, n);
+	Dij = compute_weighted_apsp_packed(graph, n, nthreads);
     } else {
 	for (i = 0; i < n; i++) {
 	    graph[i].ewgts = weights;
@@ -850,7 +879,7 @@ float *compute_apsp_artifical_weights_packed(vtx_data * graph, int n)
 	    empty_neighbors_vec(graph, i, vtx_vec);
 	    weights += graph[i].nedges;
 	}
-	Dij = compute_apsp_packed(graph, n);
+	Dij = compute_apsp_packed(graph, n, nthreads);
     }
 
     free(vtx_vec);
@@ -883,27 +912,166 @@ static void dumpMatrix(float *Dij, int n)
  */
 #define DegType long double
 
-/* stress_majorization_kD_mkernel:
- * At present, if any nodes have pos set, smart_ini is false.
+/* The rows of the packed matrices are split into at most STRESS_NBLOCKS
+ * blocks of roughly equal work, each accumulating into its own copy of
+ * the right-hand side. The blocks are summed in a fixed order, so the
+ * layout does not depend on the number of threads, nthreads, which the
+ * caller passes down from the threads attribute. Within a row, the
+ * columns are handled in strips of STRESS_STRIP entries whose scratch
+ * arrays stay in cache and whose loops the compiler can vectorize.
  */
-int stress_majorization_kD_mkernel(vtx_data * graph,	/* Input graph in sparse representation */
-				   int n,	/* Number of nodes */
-				   int nedges_graph,	/* Number of edges */
-				   double **d_coords,	/* coordinates of nodes (output layout) */
-				   node_t ** nodes,	/* original nodes */
-				   int dim,	/* dimemsionality of layout */
-				   int opts,    /* options */
-				   int model,	/* model */
-				   int maxi	/* max iterations */
-    )
+#define STRESS_NBLOCKS 16
+#define STRESS_BLOCK_MIN_ROWS 256
+#define STRESS_STRIP 256
+
+/* stress_blocks:
+ * Split rows 0..n-1 of a packed n x n matrix into nblocks ranges
+ * rowstart[b]..rowstart[b+1]-1 with about the same number of
+ * off-diagonal entries each.
+ */
+static void stress_blocks(int n, int nblocks, int *rowstart)
+{
+    double total = (double) n * (n - 1) / 2;
+    double work = 0;
+    int i, blk = 1;
+
+    rowstart[0] = 0;
+    for (i = 0; i < n && blk < nblocks; i++) {
+	while (blk < nblocks && work >= total * blk / nblocks)
+	    rowstart[blk++] = i;
+	work += n - 1 - i;
+    }
+    while (blk <= nblocks)
+	rowstart[blk++] = n;
+}
+
+/* stress_rows:
+ * For rows lo..hi-1, add the product of the Laplacian with weights
+ * wd_{ij}/|p_i-p_j| and coords into b, without forming the Laplacian.
+ * wd holds the packed factors w_{ij}*d_{ij}, lap2 the packed weights
+ * w_{ij}. As in the rest of this file, the Laplacian is negated.
+ * Returns the part of the stress coming from these rows, minus the
+ * constant term \sum w_{ij}d_{ij}^2:
+ *   \sum w_{ij}|p_i-p_j|^2 - 2 \sum w_{ij}d_{ij}|p_i-p_j|
+ */
+static double
+stress_rows(float **coords, float *wd, float *lap2, int n, int dim,
+	    int lo, int hi, float **b)
+{
+    float d2[STRESS_STRIP];
+    float dist[STRESS_STRIP];
+    float lw[STRESS_STRIP];
+    double stress = 0;
+    int i, j0, k, m, t, t0, len, idx;
+
+    for (i = lo; i < hi; i++) {
+	len = n - i - 1;
+	idx = packed_row(i, n) + 1;	/* skip main diagonal */
+	for (t0 = 0; t0 < len; t0 += STRESS_STRIP) {
+	    float *wrow = wd + idx + t0;
+	    float *lrow = lap2 + idx + t0;
+	    float s = 0;
+
+	    m = MIN(STRESS_STRIP, len - t0);
+	    j0 = i + 1 + t0;
+	    if (dim == 2) {
+		float xi = coords[0][i], yi = coords[1][i];
+		float *xj = coords[0] + j0, *yj = coords[1] + j0;
+		float *bxj = b[0] + j0, *byj = b[1] + j0;
+		float bxi = 0, byi = 0;
+
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+		for (t = 0; t < m; t++) {
+		    float dx = xj[t] - xi, dy = yj[t] - yi;
+		    d2[t] = dx * dx + dy * dy;
+		}
+		for (t = 0; t < m; t++)
+		    dist[t] = sqrtf(d2[t]);
+#ifdef _OPENMP
+#pragma omp simd reduction(+:s,bxi,byi)
+#endif
+		for (t = 0; t < m; t++) {
+		    float dx = xj[t] - xi, dy = yj[t] - yi;
+		    float inv = 1.0f / dist[t];
+		    float l;
+
+		    /* coincident nodes get no weight */
+		    inv = (inv < MAXFLOAT) ? inv : 0;
+		    l = wrow[t] * inv;
+		    bxi += l * dx;
+		    byi += l * dy;
+		    bxj[t] -= l * dx;
+		    byj[t] -= l * dy;
+		    s += lrow[t] * d2[t] - 2 * wrow[t] * dist[t];
+		}
+		b[0][i] += bxi;
+		b[1][i] += byi;
+	    } else {
+		for (t = 0; t < m; t++)
+		    d2[t] = 0;
+		for (k = 0; k < dim; k++) {
+		    float ci = coords[k][i];
+		    float *cj = coords[k] + j0;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+		    for (t = 0; t < m; t++)
+			d2[t] += (cj[t] - ci) * (cj[t] - ci);
+		}
+		for (t = 0; t < m; t++)
+		    dist[t] = sqrtf(d2[t]);
+#ifdef _OPENMP
+#pragma omp simd reduction(+:s)
+#endif
+		for (t = 0; t < m; t++) {
+		    float inv = 1.0f / dist[t];
+		    inv = (inv < MAXFLOAT) ? inv : 0;
+		    lw[t] = wrow[t] * inv;
+		    s += lrow[t] * d2[t] - 2 * wrow[t] * dist[t];
+		}
+		for (k = 0; k < dim; k++) {
+		    float ci = coords[k][i];
+		    float *cj = coords[k] + j0;
+		    float *bj = b[k] + j0;
+		    float bi = 0;
+#ifdef _OPENMP
+#pragma omp simd reduction(+:bi)
+#endif
+		    for (t = 0; t < m; t++) {
+			float v = lw[t] * (cj[t] - ci);
+			bi += v;
+			bj[t] -= v;
+		    }
+		    b[k][i] += bi;
+		}
+	    }
+	    stress += s;
+	}
+    }
+    return stress;
+}
+
+/* stress_solve:
+ * Minimize the stress of the n x n packed distance matrix Dij in
+ * dim dimensions by majorization, starting from coords, for at most
+ * maxi iterations or until the relative change of the stress is below
+ * eps. Dij is overwritten by the weights.
+ * If havePinned is true, fixed nodes are not moved.
+ * Each iteration is reported to the convergence monitor with limits cp.
+ * The row blocks are shared among up to nthreads threads.
+ * Return the number of iterations, or -1 on error.
+ */
+static int
+stress_solve(float *Dij, int n, int dim, float **coords, node_t ** nodes,
+	     int havePinned, int exp, int maxi, double eps, convparms_t * cp,
+	     int nthreads)
 {
     int iterations;		/* output: number of iteration of the process */
 
     double conj_tol = tolerance_cg;	/* tolerance of Conjugate Gradient */
-    float *Dij = NULL;
     int i, j, k;
-    float **coords = NULL;
-    float *f_storage = NULL;
     float constant_term;
     int count;
     DegType degree;
@@ -916,125 +1084,20 @@ int stress_majorization_kD_mkernel(vtx_data * graph,	/* Input graph in sparse re
     boolean converged;
     float **b = NULL;
     float *tmp_coords = NULL;
-    float *dist_accumulator = NULL;
     float *lap1 = NULL;
-    int smart_ini = opts & opt_smart_init;
-    int exp = opts & opt_exp_flag;
-    int len;
-    int havePinned;		/* some node is pinned */
+    float **bblk = NULL;
+    double *blk_stress = NULL;
+    int *rowstart = NULL;
+    int nblocks, blk;
+    convmon_t cm;
 #ifdef ALTERNATIVE_STRESS_CALC
     double mat_stress;
 #endif
-#ifdef NONCORE
-    FILE *fp = NULL;
-#endif
-
-
-	/*************************************************
-	** Computation of full, dense, unrestricted k-D ** 
-	** stress minimization by majorization          **    
-	*************************************************/
-
-	/****************************************************
-	** Compute the all-pairs-shortest-distances matrix **
-	****************************************************/
-
-    if (maxi < 0)
-	return 0;
-
-    if (Verbose)
-	start_timer();
-
-    if (model == MODEL_SUBSET) {
-	/* weight graph to separate high-degree nodes */
-	/* and perform slower Dijkstra-based computation */
-	if (Verbose)
-	    fprintf(stderr, "Calculating subset model");
-	Dij = compute_apsp_artifical_weights_packed(graph, n);
-    } else if (model == MODEL_CIRCUIT) {
-	Dij = circuitModel(graph, n);
-	if (!Dij) {
-	    agerr(AGWARN,
-		  "graph is disconnected. Hence, the circuit model\n");
-	    agerr(AGPREV,
-		  "is undefined. Reverting to the shortest path model.\n");
-	}
-    } else if (model == MODEL_MDS) {
-	if (Verbose)
-	    fprintf(stderr, "Calculating MDS model");
-	Dij = mdsModel(graph, n);
-    }
-    if (!Dij) {
-	if (Verbose)
-	    fprintf(stderr, "Calculating shortest paths");
-	if (graph->ewgts)
-	    Dij = compute_weighted_apsp_packed(graph, n);
-	else
-	    Dij = compute_apsp_packed(graph, n);
-    }
-
-    if (Verbose) {
-	fprintf(stderr, ": %.2f sec\n", elapsed_sec());
-	fprintf(stderr, "Setting initial positions");
-	start_timer();
-    }
-
-	/**************************
-	** Layout initialization **
-	**************************/
-
-    if (smart_ini && (n > 1)) {
-	havePinned = 0;
-	/* optimize layout quickly within subspace */
-	/* perform at most 50 iterations within 30-D subspace to 
-	   get an estimate */
-	if (sparse_stress_subspace_majorization_kD(graph, n, nedges_graph,
-					       d_coords, dim, smart_ini, exp,
-					       (model == MODEL_SUBSET), 50,
-					       neighborhood_radius_subspace,
-					       num_pivots_stress) < 0) {
-	    iterations = -1;
-	    goto finish1;
-	}
-
-	for (i = 0; i < dim; i++) {
-	    /* for numerical stability, scale down layout */
-	    double max = 1;
-	    for (j = 0; j < n; j++) {
-		if (fabs(d_coords[i][j]) > max) {
-		    max = fabs(d_coords[i][j]);
-		}
-	    }
-	    for (j = 0; j < n; j++) {
-		d_coords[i][j] /= max;
-	    }
-	    /* add small random noise */
-	    for (j = 0; j < n; j++) {
-		d_coords[i][j] += 1e-6 * (drand48() - 0.5);
-	    }
-	    orthog1(n, d_coords[i]);
-	}
-    } else {
-	havePinned = initLayout(graph, n, dim, d_coords, nodes);
-    }
-    if (Verbose)
-	fprintf(stderr, ": %.2f sec", elapsed_sec());
-    if ((n == 1) || (maxi == 0))
-	return 0;
 
     if (Verbose) {
-	fprintf(stderr, ": %.2f sec\n", elapsed_sec());
 	fprintf(stderr, "Setting up stress function");
 	start_timer();
     }
-    coords = N_NEW(dim, float *);
-    f_storage = N_NEW(dim * n, float);
-    for (i = 0; i < dim; i++) {
-	coords[i] = f_storage + i * n;
-	for (j = 0; j < n; j++) {
-	    coords[i][j] = ((float) d_coords[i][j]);
-	}
-    }
 
     /* compute constant term in stress sum */
     /* which is \sum_{i<j} w_{ij}d_{ij}^2 */
@@ -1093,16 +1156,6 @@ int stress_majorization_kD_mkernel(vtx_data * graph,	/* Input graph in sparse re
 	lap2[count] = degrees[i];
     }
 
-#ifdef NONCORE
-    if (n > max_nodes_in_mem) {
-#define FILENAME "tmp_Dij$$$.bin"
-	fp = fopen(FILENAME, "wb");
-	fwrite(lap2, sizeof(float), lap_length, fp);
-	fclose(fp);
-	fp = NULL;
-    }
-#endif
-
 	/*************************
 	** Layout optimization  **
 	*************************/
@@ -1114,20 +1167,31 @@ int stress_majorization_kD_mkernel(vtx_data * graph,	/* Input graph in sparse re
     }
 
     tmp_coords = N_NEW(n, float);
-    dist_accumulator = N_NEW(n, float);
-    lap1 = NULL;
-#ifdef NONCORE
-    if (n <= max_nodes_in_mem) {
-	lap1 = N_NEW(lap_length, float);
-    } else {
-	lap1 = lap2;
-	fp = fopen(FILENAME, "rb");
-	fgetpos(fp, &pos);
-    }
-#else
+
+    /* The Laplacian of 1/(d_ij*|p_i-p_j|) is never formed; lap1 only
+     * keeps the constant factors w_ij*d_ij by which 1/|p_i-p_j| is scaled.
+     */
     lap1 = N_NEW(lap_length, float);
+#ifdef Dij2
+    if (exp == 2)
+	sqrt_vecf(lap_length, lap2, lap1);
+    else
 #endif
-
+	set_vector_valf(lap_length, 1, lap1);
+
+    nblocks = MIN(STRESS_NBLOCKS, MAX(1, n / STRESS_BLOCK_MIN_ROWS));
+    nthreads = MIN(nblocks, MAX(nthreads, 1));
+    rowstart = N_NEW(nblocks + 1, int);
+    stress_blocks(n, nblocks, rowstart);
+    blk_stress = N_NEW(nblocks, double);
+    bblk = N_NEW(nblocks * dim, float *);
+    for (k = 0; k < dim; k++)
+	bblk[k] = b[k];
+    if (nblocks > 1) {
+	bblk[dim] = N_NEW((nblocks - 1) * dim * n, float);
+	for (k = dim + 1; k < nblocks * dim; k++)
+	    bblk[k] = bblk[dim] + (k - dim) * n;
+    }
 
 #ifdef USE_MAXFLOAT
     old_stress = MAXFLOAT;	/* at least one iteration */
@@ -1140,100 +1204,29 @@ int stress_majorization_kD_mkernel(vtx_data * graph,	/* Input graph in sparse re
 	start_timer();
     }
 
+    convInit(&cm, cp, "stress", maxi);
     for (converged = FALSE, iterations = 0;
 	 iterations < maxi && !converged; iterations++) {
 
-	/* First, construct Laplacian of 1/(d_ij*|p_i-p_j|)  */
-	/* set_vector_val(n, 0, degrees); */
-	memset(degrees, 0, n * sizeof(DegType));
-	if (exp == 2) {
-#ifdef Dij2
-#ifdef NONCORE
-	    if (n <= max_nodes_in_mem) {
-		sqrt_vecf(lap_length, lap2, lap1);
-	    } else {
-		sqrt_vec(lap_length, lap1);
-	    }
-#else
-	    sqrt_vecf(lap_length, lap2, lap1);
-#endif
-#endif
-	}
-	for (count = 0, i = 0; i < n - 1; i++) {
-	    len = n - i - 1;
-	    /* init 'dist_accumulator' with zeros */
-	    set_vector_valf(len, 0, dist_accumulator);
-
-	    /* put into 'dist_accumulator' all squared distances between 'i' and 'i'+1,...,'n'-1 */
-	    for (k = 0; k < dim; k++) {
-		set_vector_valf(len, coords[k][i], tmp_coords);
-		vectors_mult_additionf(len, tmp_coords, -1,
-				       coords[k] + i + 1);
-		square_vec(len, tmp_coords);
-		vectors_additionf(len, tmp_coords, dist_accumulator,
-				  dist_accumulator);
-	    }
-
-	    /* convert to 1/d_{ij} */
-	    invert_sqrt_vec(len, dist_accumulator);
-	    /* detect overflows */
-	    for (j = 0; j < len; j++) {
-		if (dist_accumulator[j] >= MAXFLOAT
-		    || dist_accumulator[j] < 0) {
-		    dist_accumulator[j] = 0;
-		}
-	    }
-
-	    count++;		/* save place for the main diagonal entry */
-	    degree = 0;
-	    if (exp == 2) {
-		for (j = 0; j < len; j++, count++) {
-#ifdef Dij2
-		    val = lap1[count] *= dist_accumulator[j];
-#else
-		    val = lap1[count] = dist_accumulator[j];
+	/* Compute b[k] := lap1*coords[k], where lap1 is the Laplacian
+	 * of 1/(d_ij*|p_i-p_j|), together with the stress of the current
+	 * layout, in a single pass over the packed matrices.
+	 */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) num_threads(nthreads) if (nthreads > 1)
 #endif
-		    degree += val;
-		    degrees[i + j + 1] -= val;
-		}
-	    } else {
-		for (j = 0; j < len; j++, count++) {
-		    val = lap1[count] = dist_accumulator[j];
-		    degree += val;
-		    degrees[i + j + 1] -= val;
-		}
-	    }
-	    degrees[i] -= degree;
-	}
-	for (step = n, count = 0, i = 0; i < n; i++, count += step, step--) {
-	    lap1[count] = degrees[i];
-	}
-
-	/* Now compute b[] */
-	for (k = 0; k < dim; k++) {
-	    /* b[k] := lap1*coords[k] */
-	    right_mult_with_vector_ff(lap1, n, coords[k], b[k]);
-	}
-
-
-	/* compute new stress  */
-	/* remember that the Laplacians are negated, so we subtract instead of add and vice versa */
-	new_stress = 0;
-	for (k = 0; k < dim; k++) {
-	    new_stress += vectors_inner_productf(n, coords[k], b[k]);
-	}
-	new_stress *= 2;
-	new_stress += constant_term;	/* only after mult by 2 */
-#ifdef NONCORE
-	if (n > max_nodes_in_mem) {
-	    /* restore lap2 from memory */
-	    fsetpos(fp, &pos);
-	    fread(lap2, sizeof(float), lap_length, fp);
+	for (blk = 0; blk < nblocks; blk++) {
+	    memset(bblk[blk * dim], 0, dim * n * sizeof(float));
+	    blk_stress[blk] =
+		stress_rows(coords, lap1, lap2, n, dim, rowstart[blk],
+			    rowstart[blk + 1], bblk + blk * dim);
 	}
-#endif
-	for (k = 0; k < dim; k++) {
-	    right_mult_with_vector_ff(lap2, n, coords[k], tmp_coords);
-	    new_stress -= vectors_inner_productf(n, coords[k], tmp_coords);
+	new_stress = constant_term;
+	for (blk = 0; blk < nblocks; blk++)
+	    new_stress += blk_stress[blk];
+	for (blk = 1; blk < nblocks; blk++) {
+	    for (k = 0; k < dim; k++)
+		vectors_additionf(n, b[k], bblk[blk * dim + k], b[k]);
 	}
 #ifdef ALTERNATIVE_STRESS_CALC
 	mat_stress = new_stress;
@@ -1250,8 +1243,8 @@ int stress_majorization_kD_mkernel(vtx_data * graph,	/* Input graph in sparse re
 	{
 	    double diff = old_stress - new_stress;
 	    double change = ABS(diff);
-	    converged = (((change / old_stress) < Epsilon)
-			 || (new_stress < Epsilon));
+	    converged = (((change / old_stress) < eps)
+			 || (new_stress < eps));
 	}
 	old_stress = new_stress;
 
@@ -1277,6 +1270,8 @@ int stress_majorization_kD_mkernel(vtx_data * graph,	/* Input graph in sparse re
 		}
 	    }
 	}
+	if (convStep(&cm, new_stress, -1))
+	    converged = TRUE;
 	if (Verbose && (iterations % 5 == 0)) {
 	    fprintf(stderr, "%.3f ", new_stress);
 	    if ((iterations + 5) % 50 == 0)
@@ -1289,27 +1284,759 @@ int stress_majorization_kD_mkernel(vtx_data * graph,	/* Input graph in sparse re
 		iterations, elapsed_sec());
     }
 
-    for (i = 0; i < dim; i++) {
-	for (j = 0; j < n; j++) {
-	    d_coords[i][j] = coords[i][j];
-	}
-    }
-#ifdef NONCORE
-    if (fp)
-	fclose(fp);
-#endif
 finish1:
-    free(f_storage);
-    free(coords);
-
-    free(lap2);
     if (b) {
 	free(b[0]);
 	free(b);
     }
     free(tmp_coords);
-    free(dist_accumulator);
     free(degrees);
     free(lap1);
+    if (bblk) {
+	if (nblocks > 1)
+	    free(bblk[dim]);
+	free(bblk);
+    }
+    free(rowstart);
+    free(blk_stress);
+    return iterations;
+}
+
+/* Coarsening stops once a level has fewer than this many nodes */
+#define ML_MINSIZE 50
+
+/* sub_dist:
+ * Packed m x m distance matrix between the nodes idx[0..m-1], taken
+ * from the packed n x n matrix Dij.
+ */
+static float *sub_dist(float *Dij, int n, int *idx, int m)
+{
+    float *D = N_GNEW(m * (m + 1) / 2, float);
+    int a, b, i, j, t, count = 0;
+
+    for (a = 0; a < m; a++) {
+	for (b = a; b < m; b++) {
+	    i = idx[a];
+	    j = idx[b];
+	    if (i > j) {
+		t = i;
+		i = j;
+		j = t;
+	    }
+	    D[count++] = Dij[packed_row(i, n) + j - i];
+	}
+    }
+    return D;
+}
+
+/* multilevel_init:
+ * Initial layout of the graph, computed coarse to fine. The graph is
+ * coarsened by matching as in sfdp. Each coarse node is represented by
+ * the first node of its cluster, so every level is a subset of the
+ * nodes and its distances are a submatrix of Dij. The coarsest level
+ * starts at random and each level is solved by stress majorization
+ * before its nodes are placed around their representatives at the next
+ * finer level. Only the finest level, the whole graph, is left to the
+ * caller.
+ * Return 1 if d_coords is set, 0 if the graph could not be coarsened,
+ * and -1 on error.
+ */
+static int
+multilevel_init(vtx_data * graph, int n, int dim, float *Dij,
+		double **d_coords, node_t ** nodes, int exp, int maxi,
+		double eps, convparms_t * cp, int nthreads)
+{
+    SparseMatrix A, P;
+    Multilevel_control ctrl;
+    Multilevel grid0, grid;
+    int *irn, *jcn, *idx, *cidx, *parent;
+    real *val;
+    float **coords, **ccoords, *D;
+    double ang, len;
+    int nlevels, nz, level, m, cm, i, j, k, rv = 1;
+    int **levels, **parents, *sizes;
+
+    nz = 0;
+    for (i = 0; i < n; i++)
+	nz += graph[i].nedges - 1;
+    irn = N_GNEW(MAX(nz, 1), int);
+    jcn = N_GNEW(MAX(nz, 1), int);
+    val = N_GNEW(MAX(nz, 1), real);
+    for (nz = 0, i = 0; i < n; i++) {
+	for (j = 1; j < graph[i].nedges; j++) {
+	    irn[nz] = i;
+	    jcn[nz] = graph[i].edges[j];
+	    val[nz++] = 1;
+	}
+    }
+    A = SparseMatrix_from_coordinate_arrays(nz, n, n, irn, jcn, val,
+					    MATRIX_TYPE_REAL, sizeof(real));
+    free(irn);
+    free(jcn);
+    free(val);
+
+    ctrl = Multilevel_control_new(COARSEN_INDEPENDENT_EDGE_SET_HEAVEST_EDGE_PERNODE_SUPERNODES_FIRST,
+				  COARSEN_MODE_FORCEFUL);
+    ctrl->randomize = FALSE;	/* keep the layout reproducible */
+    ctrl->minsize = ML_MINSIZE;
+    grid0 = Multilevel_new(A, NULL, NULL, ctrl);
+
+    nlevels = 1;
+    for (grid = grid0; grid->next; grid = grid->next)
+	nlevels++;
+    if (nlevels == 1) {
+	rv = 0;
+	goto finish;
+    }
+
+    /* levels[l] lists the nodes of level l, by index in the graph;
+     * parents[l][i] is the index in level l+1 of the cluster of the
+     * i-th node of level l.
+     */
+    levels = N_GNEW(nlevels, int *);
+    parents = N_GNEW(nlevels, int *);
+    sizes = N_GNEW(nlevels, int);
+    levels[0] = N_GNEW(n, int);
+    for (i = 0; i < n; i++)
+	levels[0][i] = i;
+    sizes[0] = n;
+    for (grid = grid0, level = 0; grid->next; grid = grid->next, level++) {
+	P = grid->next->P;
+	m = sizes[level];
+	cm = sizes[level + 1] = grid->next->n;
+	idx = levels[level];
+	cidx = levels[level + 1] = N_GNEW(cm, int);
+	parent = parents[level] = N_GNEW(m, int);
+	for (k = 0; k < cm; k++)
+	    cidx[k] = -1;
+	for (i = 0; i < m; i++) {
+	    k = parent[i] = P->ja[P->ia[i]];
+	    if (cidx[k] < 0)
+		cidx[k] = idx[i];
+	}
+    }
+    parents[nlevels - 1] = NULL;
+
+    /* coarsest level */
+    m = sizes[nlevels - 1];
+    ccoords = N_GNEW(dim, float *);
+    ccoords[0] = N_GNEW(dim * m, float);
+    for (k = 0; k < dim; k++) {
+	ccoords[k] = ccoords[0] + k * m;
+	for (i = 0; i < m; i++)
+	    ccoords[k][i] = gvdrand48();
+    }
+    for (level = nlevels - 1; level >= 0; level--) {
+	m = sizes[level];
+	idx = levels[level];
+	if (level < nlevels - 1) {
+	    /* place the nodes of this level around their representatives */
+	    cidx = levels[level + 1];
+	    parent = parents[level];
+	    coords = N_GNEW(dim, float *);
+	    coords[0] = N_GNEW(dim * m, float);
+	    for (k = 1; k < dim; k++)
+		coords[k] = coords[0] + k * m;
+	    for (i = 0; i < m; i++) {
+		j = parent[i];
+		for (k = 0; k < dim; k++)
+		    coords[k][i] = ccoords[k][j];
+		if (cidx[j] != idx[i]) {
+		    int s = MIN(idx[i], cidx[j]), t = MAX(idx[i], cidx[j]);
+		    len = Dij[packed_row(s, n) + t - s];
+		    ang = 2 * M_PI * gvdrand48();
+		    coords[0][i] += len * cos(ang);
+		    coords[1][i] += len * sin(ang);
+		}
+	    }
+	    free(ccoords[0]);
+	    free(ccoords);
+	    ccoords = coords;
+	}
+	if (level == 0)
+	    break;
+	if (Verbose)
+	    fprintf(stderr, "level %d, %d nodes\n", level, m);
+	D = sub_dist(Dij, n, idx, m);
+	if (stress_solve(D, m, dim, ccoords, nodes, 0, exp, maxi, eps, cp,
+			 nthreads) < 0)
+	    rv = -1;
+	free(D);
+	if (rv < 0)
+	    break;
+    }
+
+    if (rv > 0) {
+	for (k = 0; k < dim; k++)
+	    for (i = 0; i < n; i++)
+		d_coords[k][i] = ccoords[k][i];
+    }
+    free(ccoords[0]);
+    free(ccoords);
+
+    for (level = 0; level < nlevels; level++) {
+	free(levels[level]);
+	free(parents[level]);
+    }
+    free(levels);
+    free(parents);
+    free(sizes);
+
+  finish:
+    Multilevel_delete(grid0);
+    Multilevel_control_delete(ctrl);
+    SparseMatrix_delete(A);
+    return rv;
+}
+
+/* stress_majorization_kD_mkernel:
+ * At present, if any nodes have pos set, smart_ini is false.
+ * With opt_multilevel_init, the layout starts from a coarse to fine
+ * solution of the stress (see multilevel_init), and node positions are
+ * ignored as with smart_ini.
+ */
+int stress_majorization_kD_mkernel(vtx_data * graph,	/* Input graph in sparse representation */
+				   int n,	/* Number of nodes */
+				   int nedges_graph,	/* Number of edges */
+				   double **d_coords,	/* coordinates of nodes (output layout) */
+				   node_t ** nodes,	/* original nodes */
+				   int dim,	/* dimemsionality of layout */
+				   int opts,    /* options */
+				   int model,	/* model */
+				   int maxi,	/* max iterations */
+				   double eps,	/* convergence tolerance */
+				   convparms_t * cp,	/* convergence limits; may be NULL */
+				   int nthreads	/* threads for the distances and solver */
+    )
+{
+    int iterations;		/* output: number of iteration of the process */
+
+    float *Dij = NULL;
+    int i, j;
+    float **coords = NULL;
+    float *f_storage = NULL;
+    int smart_ini = opts & opt_smart_init;
+    int ml_ini = opts & opt_multilevel_init;
+    int exp = opts & opt_exp_flag;
+    int havePinned;		/* some node is pinned */
+    int rv;
+
+
+	/*************************************************
+	** Computation of full, dense, unrestricted k-D ** 
+	** stress minimization by majorization          **    
+	*************************************************/
+
+	/****************************************************
+	** Compute the all-pairs-shortest-distances matrix **
+	****************************************************/
+
+    if (maxi < 0)
+	return 0;
+
+    if (Verbose)
+	start_timer();
+
+    if (model == MODEL_SUBSET) {
+	/* weight graph to separate high-degree nodes */
+	/* and perform slower Dijkstra-based computation */
+	if (Verbose)
+	    fprintf(stderr, "Calculating subset model");
+	Dij = compute_apsp_artifical_weights_packed(graph, n, nthreads);
+    } else if (model == MODEL_CIRCUIT) {
+	Dij = circuitModel(graph, n);
+	if (!Dij) {
+	    gvagerr(AGWARN,
+		  "graph is disconnected. Hence, the circuit model\n");
+	    gvagerr(AGPREV,
+		  "is undefined. Reverting to the shortest path model.\n");
+	}
+    } else if (model == MODEL_MDS) {
+	if (Verbose)
+	    fprintf(stderr, "Calculating MDS model");
+	Dij = mdsModel(graph, n, nthreads);
+    }
+    if (!Dij) {
+	if (Verbose)
+	    fprintf(stderr, "Calculating shortest paths");
+	if (graph->ewgts)
+	    Dij = compute_weighted_apsp_packed(graph, n, nthreads);
+	else
+	    Dij = compute_apsp_packed(graph, n, nthreads);
+    }
+
+    if (Verbose) {
+	fprintf(stderr, ": %.2f sec\n", elapsed_sec());
+	fprintf(stderr, "Setting initial positions");
+	start_timer();
+    }
+
+	/**************************
+	** Layout initialization **
+	**************************/
+
+    rv = 0;
+    if (ml_ini && (n > 1)) {
+	if (Verbose)
+	    fprintf(stderr, "\n");
+	rv = multilevel_init(graph, n, dim, Dij, d_coords, nodes, exp, maxi,
+			     eps, cp, nthreads);
+	if (rv < 0) {
+	    iterations = -1;
+	    goto finish1;
+	}
+    }
+    if (rv > 0)
+	havePinned = 0;
+    else if ((smart_ini || ml_ini) && (n > 1)) {
+	havePinned = 0;
+	/* optimize layout quickly within subspace */
+	/* perform at most 50 iterations within 30-D subspace to 
+	   get an estimate */
+	if (sparse_stress_subspace_majorization_kD(graph, n, nedges_graph,
+					       d_coords, dim, 1, exp,
+					       (model == MODEL_SUBSET), 50, eps,
+					       neighborhood_radius_subspace,
+					       num_pivots_stress) < 0) {
+	    iterations = -1;
+	    goto finish1;
+	}
+
+	for (i = 0; i < dim; i++) {
+	    /* for numerical stability, scale down layout */
+	    double max = 1;
+	    for (j = 0; j < n; j++) {
+		if (fabs(d_coords[i][j]) > max) {
+		    max = fabs(d_coords[i][j]);
+		}
+	    }
+	    for (j = 0; j < n; j++) {
+		d_coords[i][j] /= max;
+	    }
+	    /* add small random noise */
+	    for (j = 0; j < n; j++) {
+		d_coords[i][j] += 1e-6 * (gvdrand48() - 0.5);
+	    }
+	    orthog1(n, d_coords[i]);
+	}
+    } else {
+	havePinned = initLayout(graph, n, dim, d_coords, nodes);
+    }
+    if (Verbose)
+	fprintf(stderr, ": %.2f sec", elapsed_sec());
+    if ((n == 1) || (maxi == 0)) {
+	free(Dij);
+	return 0;
+    }
+
+    if (Verbose)
+	fprintf(stderr, "\n");
+    coords = N_NEW(dim, float *);
+    f_storage = N_NEW(dim * n, float);
+    for (i = 0; i < dim; i++) {
+	coords[i] = f_storage + i * n;
+	for (j = 0; j < n; j++) {
+	    coords[i][j] = ((float) d_coords[i][j]);
+	}
+    }
+
+    iterations = stress_solve(Dij, n, dim, coords, nodes, havePinned, exp, maxi,
+		     eps, cp, nthreads);
+    if (iterations >= 0) {
+	for (i = 0; i < dim; i++) {
+	    for (j = 0; j < n; j++) {
+		d_coords[i][j] = coords[i][j];
+	    }
+	}
+    }
+
+finish1:
+    free(f_storage);
+    free(coords);
+    free(Dij);
+    return iterations;
+}
+
+/* pivot_distances:
+ * Distances from src to all nodes, as in the full model. Nodes that
+ * cannot be reached are put a little beyond the farthest one.
+ */
+static void
+pivot_distances(vtx_data * graph, int n, int src, float *dist,
+		DistType * Di, Queue * Q)
+{
+    int i;
+    float maxd = 0;
+
+    if (graph->ewgts) {
+	dijkstra_f(src, graph, n, dist);
+	for (i = 0; i < n; i++)
+	    if (dist[i] < MAXFLOAT && dist[i] > maxd)
+		maxd = dist[i];
+	for (i = 0; i < n; i++)
+	    if (dist[i] >= MAXFLOAT)
+		dist[i] = maxd + 10;
+    } else {
+	bfs(src, graph, n, Di, Q);
+	for (i = 0; i < n; i++)
+	    dist[i] = (float) Di[i];
+    }
+}
+
+static int fcmp(const void *a, const void *b)
+{
+    float x = *(float *) a, y = *(float *) b;
+    if (x < y)
+	return -1;
+    if (x > y)
+	return 1;
+    return 0;
+}
+
+/* pivotMDS:
+ * Initial layout by pivot MDS (Brandes and Pich). With D the n x k matrix of
+ * squared distances to the pivots, C is D double centered and times -1/2, and
+ * the coordinates are C times the top eigenvectors of C^T C. 
+ * Returns false if the eigenvectors could not be computed.
+ */
+static boolean
+pivotMDS(int n, int k, float *Dn, int dim, double **coords)
+{
+    double *rmean = N_NEW(n, double);
+    double *cmean = N_NEW(k, double);
+    double *c = N_NEW(k, double);
+    double **CtC = N_NEW(k, double *);
+    double **eigs = N_NEW(dim, double *);
+    double *evals = N_NEW(dim, double);
+    double gmean = 0, d2;
+    int i, l, m, d;
+    boolean rv = TRUE;
+
+    CtC[0] = N_NEW(k * k, double);
+    for (l = 1; l < k; l++)
+	CtC[l] = CtC[0] + l * k;
+    eigs[0] = N_NEW(dim * k, double);
+    for (d = 1; d < dim; d++)
+	eigs[d] = eigs[0] + d * k;
+
+    for (i = 0; i < n; i++) {
+	for (l = 0; l < k; l++) {
+	    d2 = (double) Dn[i * k + l] * Dn[i * k + l];
+	    rmean[i] += d2;
+	    cmean[l] += d2;
+	}
+	gmean += rmean[i];
+	rmean[i] /= k;
+    }
+    for (l = 0; l < k; l++)
+	cmean[l] /= n;
+    gmean /= (double) n *k;
+
+    for (i = 0; i < n; i++) {
+	for (l = 0; l < k; l++) {
+	    d2 = (double) Dn[i * k + l] * Dn[i * k + l];
+	    c[l] = -0.5 * (d2 - rmean[i] - cmean[l] + gmean);
+	}
+	for (l = 0; l < k; l++)
+	    for (m = l; m < k; m++)
+		CtC[l][m] += c[l] * c[m];
+    }
+    for (l = 0; l < k; l++)
+	for (m = 0; m < l; m++)
+	    CtC[l][m] = CtC[m][l];
+
+    if (!power_iteration(CtC, k, dim, eigs, evals, TRUE))
+	rv = FALSE;
+    else {
+	for (i = 0; i < n; i++) {
+	    for (d = 0; d < dim; d++)
+		coords[d][i] = 0;
+	    for (l = 0; l < k; l++) {
+		d2 = (double) Dn[i * k + l] * Dn[i * k + l];
+		c[l] = -0.5 * (d2 - rmean[i] - cmean[l] + gmean);
+		for (d = 0; d < dim; d++)
+		    coords[d][i] += c[l] * eigs[d][l];
+	    }
+	}
+    }
+
+    free(rmean);
+    free(cmean);
+    free(c);
+    free(CtC[0]);
+    free(CtC);
+    free(eigs[0]);
+    free(eigs);
+    free(evals);
+    return rv;
+}
+
+/* sparse_stress_majorization_kD:
+ * Sparse stress model of Ortmann, Klimenta and Brandes. Only the terms
+ * for the edges of the graph and for the distances to k pivots are kept,
+ * so time and memory are O(k*n) rather than O(n^2).
+ * The pivots are picked by max-min sampling, and every node belongs to the
+ * region of its closest pivot. The term between node i and pivot p stands
+ * for the nodes of the region of p that are at most d(i,p)/2 from p, so its
+ * weight is multiplied by their number.
+ * The layout starts from pivot MDS if smart_init is set and no node is
+ * pinned, and otherwise from the input positions (see initLayout). It is
+ * then improved by localized majorization, moving one node at a time to
+ * the weighted average of the positions its terms ask for.
+ * Returns the number of iterations, or -1 on error.
+ */
+int sparse_stress_majorization_kD(vtx_data * graph,	/* Input graph in sparse representation */
+				  int n,	/* Number of nodes */
+				  double **d_coords,	/* coordinates of nodes (output layout) */
+				  node_t ** nodes,	/* original nodes */
+				  int dim,	/* dimemsionality of layout */
+				  int opts,	/* options */
+				  int model,	/* model */
+				  int maxi,	/* max iterations */
+				  double eps,	/* convergence tolerance */
+				  convparms_t * cp	/* convergence limits; may be NULL */
+    )
+{
+    int k = MIN(n, num_pivots_sparse_stress);
+    int smart_ini = opts & opt_smart_init;
+    int *pivots, *region, *rstart, *mark;
+    float *Dp, *Dn, *Wn, *rdist, *mind;
+    DistType *Di;
+    Queue Q;
+    double *newx, *xi, w, wsum, dij, dist, diff, num, den;
+    double old_stress, new_stress;
+    boolean converged;
+    int havePinned = 0;
+    int iterations = 0;
+    int i, j, l, e, d, p, lo, hi, mid;
+    convmon_t cm;
+
+    if (maxi < 0)
+	return 0;
+
+    if (model == MODEL_SUBSET || model == MODEL_CIRCUIT)
+	gvagerr(AGWARN,
+	      "mode=sparse_stress only supports the shortpath and mds models - using shortpath\n");
+
+    if (Verbose) {
+	fprintf(stderr, "Calculating distances to %d pivots", k);
+	start_timer();
+    }
+
+	/**********************************************
+	** Distances to the pivots, max-min sampling **
+	**********************************************/
+
+    pivots = N_NEW(k, int);
+    region = N_NEW(n, int);
+    mind = N_NEW(n, float);
+    Dp = N_NEW(k * n, float);
+    Di = N_NEW(n, DistType);
+    mkQueue(&Q, n);
+
+    p = (int) (gvdrand48() * n);
+    if (p >= n)
+	p = n - 1;
+    for (l = 0; l < k; l++) {
+	pivots[l] = p;
+	pivot_distances(graph, n, p, Dp + l * n, Di, &Q);
+	for (i = 0; i < n; i++) {
+	    if (l == 0 || Dp[l * n + i] < mind[i]) {
+		mind[i] = Dp[l * n + i];
+		region[i] = l;
+	    }
+	}
+	for (p = 0, i = 1; i < n; i++)
+	    if (mind[i] > mind[p])
+		p = i;
+    }
+    free(Di);
+    freeQueue(&Q);
+
+    /* node major copy, so that the terms of a node are contiguous */
+    Dn = N_NEW(n * k, float);
+    for (l = 0; l < k; l++)
+	for (i = 0; i < n; i++)
+	    Dn[i * k + l] = Dp[l * n + i];
+    free(Dp);
+
+	/****************************
+	** Weights of pivot terms  **
+	****************************/
+
+    /* distances of the members of each region to its pivot, sorted */
+    rstart = N_NEW(k + 1, int);
+    rdist = N_NEW(n, float);
+    for (i = 0; i < n; i++)
+	rstart[region[i] + 1]++;
+    for (l = 0; l < k; l++)
+	rstart[l + 1] += rstart[l];
+    for (i = 0; i < n; i++)
+	rdist[rstart[region[i]]++] = mind[i];
+    for (l = k; l > 0; l--)
+	rstart[l] = rstart[l - 1];
+    rstart[0] = 0;
+    for (l = 0; l < k; l++)
+	qsort(rdist + rstart[l], rstart[l + 1] - rstart[l], sizeof(float),
+	      fcmp);
+
+    Wn = N_NEW(n * k, float);
+    mark = N_NEW(n, int);
+    for (i = 0; i < n; i++)
+	mark[i] = -1;
+    for (i = 0; i < n; i++) {
+	for (e = 1; e < graph[i].nedges; e++)
+	    mark[graph[i].edges[e]] = i;
+	for (l = 0; l < k; l++) {
+	    p = pivots[l];
+	    dij = Dn[i * k + l];
+	    /* pairs joined by an edge are already accounted for */
+	    if (p == i || mark[p] == i || dij <= 0)
+		continue;
+	    /* number of region members within dij/2 of the pivot */
+	    lo = rstart[l];
+	    hi = rstart[l + 1];
+	    while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (rdist[mid] <= dij / 2)
+		    lo = mid + 1;
+		else
+		    hi = mid;
+	    }
+	    Wn[i * k + l] = (float) ((lo - rstart[l]) / (dij * dij));
+	}
+    }
+    free(mark);
+    free(rdist);
+    free(rstart);
+    free(mind);
+    free(region);
+
+    if (Verbose) {
+	fprintf(stderr, ": %.2f sec\n", elapsed_sec());
+	fprintf(stderr, "Setting initial positions");
+	start_timer();
+    }
+
+	/**************************
+	** Layout initialization **
+	**************************/
+
+    /* pivot MDS would move pinned nodes, so start from their positions */
+    for (i = 0; i < n && !havePinned; i++)
+	havePinned = isFixed(nodes[i]);
+    if (havePinned || !smart_ini || k <= dim || !pivotMDS(n, k, Dn, dim, d_coords))
+	havePinned = initLayout(graph, n, dim, d_coords, nodes);
+
+    if (!havePinned) {
+	/* scale the layout to best fit the ideal distances */
+	num = den = 0;
+	for (i = 0; i < n; i++) {
+	    for (e = 1; e < graph[i].nedges; e++) {
+		j = graph[i].edges[e];
+		dij = graph->ewgts ? graph[i].ewgts[e] : 1;
+		for (dist = 0, d = 0; d < dim; d++)
+		    dist += (d_coords[d][i] - d_coords[d][j]) * (d_coords[d][i] - d_coords[d][j]);
+		dist = sqrt(dist);
+		num += dist / dij;
+		den += dist * dist / (dij * dij);
+	    }
+	    for (l = 0; l < k; l++) {
+		if ((w = Wn[i * k + l]) == 0)
+		    continue;
+		p = pivots[l];
+		dij = Dn[i * k + l];
+		for (dist = 0, d = 0; d < dim; d++)
+		    dist += (d_coords[d][i] - d_coords[d][p]) * (d_coords[d][i] - d_coords[d][p]);
+		dist = sqrt(dist);
+		num += w * dij * dist;
+		den += w * dist * dist;
+	    }
+	}
+	if (den > 0) {
+	    for (d = 0; d < dim; d++)
+		for (i = 0; i < n; i++)
+		    d_coords[d][i] *= num / den;
+	}
+    }
+
+    if (Verbose)
+	fprintf(stderr, ": %.2f sec\n", elapsed_sec());
+    if ((n == 1) || (maxi == 0))
+	goto finish;
+
+	/*************************
+	** Layout optimization  **
+	*************************/
+
+    if (Verbose) {
+	fprintf(stderr, "Solving model: ");
+	start_timer();
+    }
+    newx = N_NEW(dim, double);
+    xi = N_NEW(dim, double);
+    old_stress = MAXDOUBLE;
+    convInit(&cm, cp, "stress", maxi);
+    for (converged = FALSE; iterations < maxi && !converged; iterations++) {
+	new_stress = 0;
+	for (i = 0; i < n; i++) {
+	    if (havePinned && isFixed(nodes[i]))
+		continue;
+	    for (d = 0; d < dim; d++) {
+		xi[d] = d_coords[d][i];
+		newx[d] = 0;
+	    }
+	    wsum = 0;
+	    for (e = 1; e < graph[i].nedges + k; e++) {
+		if (e < graph[i].nedges) {
+		    j = graph[i].edges[e];
+		    dij = graph->ewgts ? graph[i].ewgts[e] : 1;
+		    w = 1 / (dij * dij);
+		} else {
+		    l = e - graph[i].nedges;
+		    if ((w = Wn[i * k + l]) == 0)
+			continue;
+		    j = pivots[l];
+		    dij = Dn[i * k + l];
+		}
+		for (dist = 0, d = 0; d < dim; d++)
+		    dist += (xi[d] - d_coords[d][j]) * (xi[d] - d_coords[d][j]);
+		dist = sqrt(dist);
+		new_stress += w * (dist - dij) * (dist - dij);
+		wsum += w;
+		if (dist > 1e-9) {
+		    for (d = 0; d < dim; d++)
+			newx[d] += w * (d_coords[d][j] + dij * (xi[d] - d_coords[d][j]) / dist);
+		} else {
+		    for (d = 0; d < dim; d++)
+			newx[d] += w * d_coords[d][j];
+		}
+	    }
+	    if (wsum > 0)
+		for (d = 0; d < dim; d++)
+		    d_coords[d][i] = newx[d] / wsum;
+	}
+	diff = old_stress - new_stress;
+	converged = ((fabs(diff) / old_stress) < eps)
+		    || (new_stress < eps);
+	old_stress = new_stress;
+	if (convStep(&cm, new_stress, -1))
+	    converged = TRUE;
+	if (Verbose && (iterations % 5 == 0)) {
+	    fprintf(stderr, "%.3f ", new_stress);
+	    if ((iterations + 5) % 50 == 0)
+		fprintf(stderr, "\n");
+	}
+    }
+    free(newx);
+    free(xi);
+    if (Verbose)
+	fprintf(stderr, "\nfinal e = %f %d iterations %.2f sec\n",
+		old_stress, iterations, elapsed_sec());
+
+finish:
+    free(pivots);
+    free(Dn);
+    free(Wn);
     return iterations;
 }
@@ -20,6 +20,7 @@ extern "C" {
 #define STRESS_H
 
 #include "defs.h"
+#include "converge.h"
 
 #define tolerance_cg 1e-3
 
@@ -32,6 +33,9 @@ extern "C" {
 #define num_pivots_smart_ini   0
 #define num_pivots_no_ini   50
 
+    /* number of pivots in the sparse stress model */
+#define num_pivots_sparse_stress 100
+
     /* relevant when using sparse distance matrix
      * when optimizing within subspace it can be set to 0
      * otherwise, recommended value is above zero (usually around 3-6)
@@ -41,6 +45,7 @@ extern "C" {
 #define neighborhood_radius_subspace 0
 
 #define opt_smart_init 0x4
+#define opt_multilevel_init 0x8
 #define opt_exp_flag   0x3
 
     /* Full dense stress optimization (equivalent to Kamada-Kawai's energy) */
@@ -53,13 +58,29 @@ extern "C" {
 					      int dim,	/* dimemsionality of layout */
 					      int opts,	/* option flags */
 					      int model,	/* model */
-					      int maxi	/* max iterations */
+					      int maxi,	/* max iterations */
+					      double eps,	/* convergence tolerance */
+					      convparms_t * cp,	/* convergence limits; may be NULL */
+					      int nthreads	/* threads for the distances and solver */
+	);
+
+    /* Sparse stress model with pivots; O(k*n) time and memory per iteration */
+    extern int sparse_stress_majorization_kD(vtx_data * graph,	/* Input graph in sparse representation */
+					     int n,	/* Number of nodes */
+					     double **coords,	/* coordinates of nodes (output layout)  */
+					     node_t **nodes,	/* original nodes  */
+					     int dim,	/* dimemsionality of layout */
+					     int opts,	/* option flags */
+					     int model,	/* model */
+					     int maxi,	/* max iterations */
+					     double eps,	/* convergence tolerance */
+					     convparms_t * cp	/* convergence limits; may be NULL */
 	);
 
-extern float *compute_apsp_packed(vtx_data * graph, int n);
-extern float *compute_apsp_artifical_weights_packed(vtx_data * graph, int n);
+extern float *compute_apsp_packed(vtx_data * graph, int n, int nthreads);
+extern float *compute_apsp_artifical_weights_packed(vtx_data * graph, int n, int nthreads);
 extern float* circuitModel(vtx_data * graph, int nG);
-extern float* mdsModel (vtx_data * graph, int nG);
+extern float* mdsModel (vtx_data * graph, int nG, int nthreads);
 extern int initLayout(vtx_data * graph, int n, int dim, double **coords, node_t** nodes);
 
 #endif
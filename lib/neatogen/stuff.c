@@ -21,7 +21,14 @@
 #include	<unistd.h>
 #endif
 
-static double Epsilon2;
+/* The KK solver keeps its working state in the neato_state_t passed
+ * to it. Krow holds the spring constants of the row being worked on;
+ * the full matrix of spring constants is not stored, see spring_row.
+ * Maxnode and Maxgrad give the index and squared gradient of the node
+ * choose_node will return. Every move changes the force on every node,
+ * so rather than keeping the gradients in a priority queue, the maximum
+ * is tracked while update_arrays recomputes the forces.
+ */
 
 
 double fpow32(double x)
@@ -30,12 +37,12 @@ double fpow32(double x)
     return x * x * x;
 }
 
-double distvec(double *p0, double *p1, double *vec)
+double distvec(double *p0, double *p1, double *vec, int dim)
 {
     int k;
     double dist = 0.0;
 
-    for (k = 0; k < Ndim; k++) {
+    for (k = 0; k < dim; k++) {
 	vec[k] = p0[k] - p1[k];
 	dist += (vec[k] * vec[k]);
     }
@@ -69,45 +76,11 @@ void free_array(double **rv)
 }
 
 
-static double ***new_3array(int m, int n, int p, double ival)
-{
-    double ***rv;
-    int i, j, k;
-
-    rv = N_NEW(m + 1, double **);
-    for (i = 0; i < m; i++) {
-	rv[i] = N_NEW(n + 1, double *);
-	for (j = 0; j < n; j++) {
-	    rv[i][j] = N_NEW(p, double);
-	    for (k = 0; k < p; k++)
-		rv[i][j][k] = ival;
-	}
-	rv[i][j] = NULL;	/* NULL terminate so we can clean up */
-    }
-    rv[i] = NULL;
-    return rv;
-}
-
-static void free_3array(double ***rv)
-{
-    int i, j;
-
-    if (rv) {
-	for (i = 0; rv[i]; i++) {
-	    for (j = 0; rv[i][j]; j++)
-		free(rv[i][j]);
-	    free(rv[i]);
-	}
-	free(rv);
-    }
-}
-
-
 /* lenattr:
  * Return 1 if attribute not defined
  * Return 2 if attribute string bad
  */
-static int lenattr(edge_t* e, Agsym_t* index, double* val)
+static int lenattr(edge_t* e, Agsym_t* index, double* val, int nop)
 {
     char* s;
 
@@ -117,7 +90,7 @@ static int lenattr(edge_t* e, Agsym_t* index, double* val)
     s = agxget(e, index);
     if (*s == '\0') return 1;
 
-    if ((sscanf(s, "%lf", val) < 1) || (*val < 0) || ((*val == 0) && !Nop)) {
+    if ((sscanf(s, "%lf", val) < 1) || (*val < 0) || ((*val == 0) && !nop)) {
 	agerr(AGWARN, "bad edge len \"%s\"", s);
 	return 2;
     }
@@ -191,7 +164,7 @@ static node_t *prune(graph_t * G, node_t * np, node_t * next)
     return next;
 }
 
-static double setEdgeLen(graph_t * G, node_t * np, Agsym_t* lenx, double dfltlen)
+static double setEdgeLen(graph_t * G, node_t * np, Agsym_t* lenx, double dfltlen, int nop)
 {
     edge_t *ep;
     double total_len = 0.0;
@@ -199,7 +172,7 @@ static double setEdgeLen(graph_t * G, node_t * np, Agsym_t* lenx, double dfltlen
     int err;
 
     for (ep = agfstout(G, np); ep; ep = agnxtout(G, ep)) {
-	if ((err = lenattr(ep, lenx, &len))) {
+	if ((err = lenattr(ep, lenx, &len, nop))) {
 	    if (err == 2) agerr(AGPREV, " in %s - setting to %.02f\n", agnameof(G), dfltlen);
 	    len = dfltlen;
 	}
@@ -215,7 +188,7 @@ static double setEdgeLen(graph_t * G, node_t * np, Agsym_t* lenx, double dfltlen
  * subgraph, we remove the nodes from the root graph.
  * Return the number of nodes in the reduced graph.
  */
-int scan_graph_mode(graph_t * G, int mode)
+int scan_graph_mode(neato_state_t * st, graph_t * G, int mode)
 {
     int i, nV, nE, deg;
     char *str;
@@ -248,66 +221,65 @@ int scan_graph_mode(graph_t * G, int mode)
 
     lenx = agattr(G, AGEDGE, "len", 0);
     if (mode == MODE_KK) {
-	Epsilon = .0001 * nV;
-	getdouble(G, "epsilon", &Epsilon);
+	st->Epsilon = .0001 * nV;
+	getdouble(G, "epsilon", &st->Epsilon);
 	if ((str = agget(G->root, "Damping")))
-	    Damping = atof(str);
+	    st->Damping = atof(str);
 	else
-	    Damping = .99;
+	    st->Damping = .99;
 	GD_neato_nlist(G) = N_NEW(nV + 1, node_t *);
 	for (i = 0, np = agfstnode(G); np; np = agnxtnode(G, np)) {
 	    GD_neato_nlist(G)[i] = np;
 	    ND_id(np) = i++;
 	    ND_heapindex(np) = -1;
-	    total_len += setEdgeLen(G, np, lenx, dfltlen);
+	    total_len += setEdgeLen(G, np, lenx, dfltlen, st->Nop);
 	}
     } else {
-	Epsilon = DFLT_TOLERANCE;
-	getdouble(G, "epsilon", &Epsilon);
+	st->Epsilon = DFLT_TOLERANCE;
+	getdouble(G, "epsilon", &st->Epsilon);
 	for (i = 0, np = agfstnode(G); np; np = agnxtnode(G, np)) {
 	    ND_id(np) = i++;
-	    total_len += setEdgeLen(G, np, lenx, dfltlen);
+	    total_len += setEdgeLen(G, np, lenx, dfltlen, st->Nop);
 	}
     }
 
     str = agget(G, "defaultdist");
     if (str && str[0])
-	Initial_dist = MAX(Epsilon, atof(str));
+	st->Initial_dist = MAX(st->Epsilon, atof(str));
     else
-	Initial_dist = total_len / (nE > 0 ? nE : 1) * sqrt(nV) + 1;
+	st->Initial_dist = total_len / (nE > 0 ? nE : 1) * sqrt(nV) + 1;
 
-    if (!Nop && (mode == MODE_KK)) {
-	GD_dist(G) = new_array(nV, nV, Initial_dist);
-	GD_spring(G) = new_array(nV, nV, 1.0);
-	GD_sum_t(G) = new_array(nV, Ndim, 1.0);
-	GD_t(G) = new_3array(nV, nV, Ndim, 0.0);
+    if (!st->Nop && (mode == MODE_KK)) {
+	GD_dist(G) = new_array(nV, nV, st->Initial_dist);
+	GD_sum_t(G) = new_array(nV, st->Ndim, 1.0);
     }
 
     return nV;
 }
 
-int scan_graph(graph_t * g)
+int scan_graph(neato_state_t * st, graph_t * g)
 {
-    return scan_graph_mode(g, MODE_KK);
+    return scan_graph_mode(st, g, MODE_KK);
 }
 
+/* free_scan_graph:
+ * Free the data allocated by scan_graph_mode, if any.
+ */
 void free_scan_graph(graph_t * g)
 {
     free(GD_neato_nlist(g));
-    if (!Nop) {
-	free_array(GD_dist(g));
-	free_array(GD_spring(g));
-	free_array(GD_sum_t(g));
-	free_3array(GD_t(g));
-	GD_t(g) = NULL;
-    }
+    GD_neato_nlist(g) = NULL;
+    free_array(GD_dist(g));
+    GD_dist(g) = NULL;
+    free_array(GD_sum_t(g));
+    GD_sum_t(g) = NULL;
 }
 
 void jitter_d(node_t * np, int nG, int n)
 {
     int k;
-    for (k = n; k < Ndim; k++)
-	ND_pos(np)[k] = nG * drand48();
+    for (k = n; k < GD_ndim(agraphof(np)); k++)
+	ND_pos(np)[k] = nG * gvdrand48();
 }
 
 void jitter3d(node_t * np, int nG)
@@ -317,27 +289,26 @@ void jitter3d(node_t * np, int nG)
 
 void randompos(node_t * np, int nG)
 {
-    ND_pos(np)[0] = nG * drand48();
-    ND_pos(np)[1] = nG * drand48();
-    if (Ndim > 2)
+    ND_pos(np)[0] = nG * gvdrand48();
+    ND_pos(np)[1] = nG * gvdrand48();
+    if (GD_ndim(agraphof(np)) > 2)
 	jitter3d(np, nG);
 }
 
-void initial_positions(graph_t * G, int nG)
+void initial_positions(neato_state_t * st, graph_t * G, int nG)
 {
     int init, i;
     node_t *np;
-    static int once = 0;
 
     if (Verbose)
 	fprintf(stderr, "Setting initial positions\n");
 
-    init = checkStart(G, nG, INIT_RANDOM);
+    init = applyStart(st, G, nG);
     if (init == INIT_REGULAR)
 	return;
-    if ((init == INIT_SELF) && (once == 0)) {
-	agerr(AGWARN, "start=%s not supported with mode=self - ignored\n");
-	once = 1;
+    if ((init == INIT_SELF) && !st->warned_self) {
+	gvagerr(AGWARN, "start=self not supported with mode=self - ignored\n");
+	st->warned_self = 1;
     }
 
     for (i = 0; (np = GD_neato_nlist(G)[i]); i++) {
@@ -347,49 +318,95 @@ void initial_positions(graph_t * G, int nG)
     }
 }
 
-void diffeq_model(graph_t * G, int nG)
+/* track_max:
+ * Update Maxnode and Maxgrad with node j. Ties go to the lowest index,
+ * so the result is the same as scanning the nodes in order.
+ */
+static void track_max(neato_state_t * st, graph_t * G, int j, node_t * np)
+{
+    int k;
+    double m;
+
+    if (ND_pinned(np) > P_SET)
+	return;
+    for (m = 0.0, k = 0; k < st->Ndim; k++)
+	m += (GD_sum_t(G)[j][k] * GD_sum_t(G)[j][k]);
+    /* could set the color=energy of the node here */
+    if ((m > st->Maxgrad) || ((m == st->Maxgrad) && (st->Maxnode >= 0) && (j < st->Maxnode))) {
+	st->Maxgrad = m;
+	st->Maxnode = j;
+    }
+}
+
+/* spring_row:
+ * Compute the spring constants between node i and all other nodes.
+ * They are derived from GD_dist, scaled by the factor of the edge
+ * joining the nodes, if any, so only the incident edges of i need to
+ * be looked at. Returns st->Krow.
+ */
+static double *spring_row(neato_state_t * st, graph_t * G, int nG, int i)
+{
+    double *Krow = st->Krow;
+    double *D = GD_dist(G)[i];
+    node_t *np = GD_neato_nlist(G)[i];
+    node_t *op;
+    edge_t *e, *ep;
+    int j;
+
+    for (j = 0; j < nG; j++)
+	Krow[j] = Spring_coeff / (D[j] * D[j]);
+    for (e = agfstedge(G, np); e; e = agnxtedge(G, e, np)) {
+	if ((op = agtail(e)) == np)
+	    op = aghead(e);
+	if (op == np)
+	    continue;
+	j = ND_id(op);
+	/* use the same edge whichever endpoint we start from */
+	if (j < i)
+	    ep = agfindedge(G, np, op);
+	else
+	    ep = agfindedge(G, op, np);
+	if (ep)
+	    Krow[j] = Spring_coeff / (D[j] * D[j]) * ED_factor(ep);
+    }
+    return Krow;
+}
+
+void diffeq_model(neato_state_t * st, graph_t * G, int nG)
 {
     int i, j, k;
-    double dist, **D, **K, del[MAXDIM], f;
+    double dist, *D, *K, del[MAXDIM];
     node_t *vi, *vj;
-    edge_t *e;
 
     if (Verbose) {
 	fprintf(stderr, "Setting up spring model: ");
 	start_timer();
     }
-    /* init springs */
-    K = GD_spring(G);
-    D = GD_dist(G);
-    for (i = 0; i < nG; i++) {
-	for (j = 0; j < i; j++) {
-	    f = Spring_coeff / (D[i][j] * D[i][j]);
-	    if ((e = agfindedge(G, GD_neato_nlist(G)[i], GD_neato_nlist(G)[j])))
-		f = f * ED_factor(e);
-	    K[i][j] = K[j][i] = f;
-	}
-    }
+    st->Krow = ALLOC(nG, st->Krow, double);
 
     /* init differential equation solver */
     for (i = 0; i < nG; i++)
-	for (k = 0; k < Ndim; k++)
+	for (k = 0; k < st->Ndim; k++)
 	    GD_sum_t(G)[i][k] = 0.0;
 
     for (i = 0; (vi = GD_neato_nlist(G)[i]); i++) {
+	K = spring_row(st, G, nG, i);
+	D = GD_dist(G)[i];
 	for (j = 0; j < nG; j++) {
 	    if (i == j)
 		continue;
 	    vj = GD_neato_nlist(G)[j];
-	    dist = distvec(ND_pos(vi), ND_pos(vj), del);
-	    for (k = 0; k < Ndim; k++) {
-		GD_t(G)[i][j][k] =
-		    GD_spring(G)[i][j] * (del[k] -
-					  GD_dist(G)[i][j] * del[k] /
-					  dist);
-		GD_sum_t(G)[i][k] += GD_t(G)[i][j][k];
+	    dist = distvec(ND_pos(vi), ND_pos(vj), del, st->Ndim);
+	    for (k = 0; k < st->Ndim; k++) {
+		GD_sum_t(G)[i][k] +=
+		    K[j] * (del[k] - D[j] * del[k] / dist);
 	    }
 	}
     }
+    st->Maxgrad = 0.0;
+    st->Maxnode = -1;
+    for (i = 0; (vi = GD_neato_nlist(G)[i]); i++)
+	track_max(st, G, i, vi);
     if (Verbose) {
 	fprintf(stderr, "%.2f sec\n", elapsed_sec());
     }
@@ -398,155 +415,167 @@ void diffeq_model(graph_t * G, int nG)
 /* total_e:
  * Return 2*energy of system.
  */
-static double total_e(graph_t * G, int nG)
+static double total_e(neato_state_t * st, graph_t * G, int nG)
 {
     int i, j, d;
     double e = 0.0;		/* 2*energy */
     double t0;			/* distance squared */
     double t1;
+    double *K, *D;
     node_t *ip, *jp;
 
     for (i = 0; i < nG - 1; i++) {
 	ip = GD_neato_nlist(G)[i];
+	K = spring_row(st, G, nG, i);
+	D = GD_dist(G)[i];
 	for (j = i + 1; j < nG; j++) {
 	    jp = GD_neato_nlist(G)[j];
-	    for (t0 = 0.0, d = 0; d < Ndim; d++) {
+	    for (t0 = 0.0, d = 0; d < st->Ndim; d++) {
 		t1 = (ND_pos(ip)[d] - ND_pos(jp)[d]);
 		t0 += t1 * t1;
 	    }
-	    e = e + GD_spring(G)[i][j] *
-		(t0 + GD_dist(G)[i][j] * GD_dist(G)[i][j]
-		 - 2.0 * GD_dist(G)[i][j] * sqrt(t0));
+	    e = e + K[j] * (t0 + D[j] * D[j] - 2.0 * D[j] * sqrt(t0));
 	}
     }
     return e;
 }
 
-void solve_model(graph_t * G, int nG)
+/* solve_model:
+ * Move the node with the largest gradient until all gradients are below
+ * Epsilon or MaxIter moves are made. Every nG moves count as one
+ * iteration for the convergence monitor.
+ */
+void solve_model(neato_state_t * st, graph_t * G, int nG)
 {
     node_t *np;
-
-    Epsilon2 = Epsilon * Epsilon;
-
-    while ((np = choose_node(G, nG))) {
-	move_node(G, nG, np);
+    convmon_t cm;
+    boolean active;
+    double oldpos[MAXDIM], disp = 0, d, t;
+    int i, moves = 0;
+
+    st->Epsilon2 = st->Epsilon * st->Epsilon;
+    convInit(&cm, &st->conv, "kk", st->MaxIter / MAX(nG, 1));
+    active = convActive(&cm);
+
+    while ((np = choose_node(st, G))) {
+	if (active)
+	    for (i = 0; i < st->Ndim; i++)
+		oldpos[i] = ND_pos(np)[i];
+	move_node(st, G, nG, np);
+	if (active) {
+	    for (d = 0, i = 0; i < st->Ndim; i++) {
+		t = ND_pos(np)[i] - oldpos[i];
+		d += t * t;
+	    }
+	    disp += sqrt(d);
+	}
+	if (++moves == nG) {
+	    if (convStep(&cm, (active ? total_e(st, G, nG) / 2 : -1),
+			 (active ? disp : -1)))
+		break;
+	    moves = 0;
+	    disp = 0;
+	}
     }
     if (Verbose) {
-	fprintf(stderr, "\nfinal e = %f", total_e(G, nG));
+	fprintf(stderr, "\nfinal e = %f", total_e(st, G, nG));
 	fprintf(stderr, " %d%s iterations %.2f sec\n",
-		GD_move(G), (GD_move(G) == MaxIter ? "!" : ""),
+		GD_move(G), (GD_move(G) == st->MaxIter ? "!" : ""),
 		elapsed_sec());
     }
-    if (GD_move(G) == MaxIter)
-	agerr(AGWARN, "Max. iterations (%d) reached on graph %s\n",
-	      MaxIter, agnameof(G));
 }
 
-void update_arrays(graph_t * G, int nG, int i)
+/* update_arrays:
+ * Node i has moved from oldpos. Recompute its force and update the
+ * forces on the other nodes. The contribution of i to the force on j
+ * is the negation of the contribution of j to the force on i, so its
+ * old value is recomputed from oldpos rather than stored.
+ */
+static void update_arrays(neato_state_t * st, graph_t * G, int nG, int i, double *oldpos)
 {
     int j, k;
-    double del[MAXDIM], dist, old;
+    double del[MAXDIM], odel[MAXDIM], dist, odist, t, old;
+    double *K, *D;
     node_t *vi, *vj;
 
     vi = GD_neato_nlist(G)[i];
-    for (k = 0; k < Ndim; k++)
+    K = spring_row(st, G, nG, i);
+    D = GD_dist(G)[i];
+    for (k = 0; k < st->Ndim; k++)
 	GD_sum_t(G)[i][k] = 0.0;
+    st->Maxgrad = 0.0;
+    st->Maxnode = -1;
     for (j = 0; j < nG; j++) {
 	if (i == j)
 	    continue;
 	vj = GD_neato_nlist(G)[j];
-	dist = distvec(ND_pos(vi), ND_pos(vj), del);
-	for (k = 0; k < Ndim; k++) {
-	    old = GD_t(G)[i][j][k];
-	    GD_t(G)[i][j][k] =
-		GD_spring(G)[i][j] * (del[k] -
-				      GD_dist(G)[i][j] * del[k] / dist);
-	    GD_sum_t(G)[i][k] += GD_t(G)[i][j][k];
-	    old = GD_t(G)[j][i][k];
-	    GD_t(G)[j][i][k] = -GD_t(G)[i][j][k];
-	    GD_sum_t(G)[j][k] += (GD_t(G)[j][i][k] - old);
+	dist = distvec(ND_pos(vi), ND_pos(vj), del, st->Ndim);
+	odist = distvec(oldpos, ND_pos(vj), odel, st->Ndim);
+	for (k = 0; k < st->Ndim; k++) {
+	    t = K[j] * (del[k] - D[j] * del[k] / dist);
+	    GD_sum_t(G)[i][k] += t;
+	    old = -(K[j] * (odel[k] - D[j] * odel[k] / odist));
+	    GD_sum_t(G)[j][k] += (-t - old);
 	}
+	track_max(st, G, j, vj);
     }
+    track_max(st, G, i, vi);
 }
 
-#define Msub(i,j)  M[(i)*Ndim+(j)]
-void D2E(graph_t * G, int nG, int n, double *M)
+#define Msub(i,j)  M[(i)*dim+(j)]
+void D2E(neato_state_t * st, graph_t * G, int nG, int n, double *M)
 {
     int i, l, k;
+    int dim = st->Ndim;
     node_t *vi, *vn;
     double scale, sq, t[MAXDIM];
-    double **K = GD_spring(G);
-    double **D = GD_dist(G);
+    double *K = spring_row(st, G, nG, n);
+    double *D = GD_dist(G)[n];
 
     vn = GD_neato_nlist(G)[n];
-    for (l = 0; l < Ndim; l++)
-	for (k = 0; k < Ndim; k++)
+    for (l = 0; l < dim; l++)
+	for (k = 0; k < dim; k++)
 	    Msub(l, k) = 0.0;
     for (i = 0; i < nG; i++) {
 	if (n == i)
 	    continue;
 	vi = GD_neato_nlist(G)[i];
 	sq = 0.0;
-	for (k = 0; k < Ndim; k++) {
+	for (k = 0; k < dim; k++) {
 	    t[k] = ND_pos(vn)[k] - ND_pos(vi)[k];
 	    sq += (t[k] * t[k]);
 	}
 	scale = 1 / fpow32(sq);
-	for (k = 0; k < Ndim; k++) {
+	for (k = 0; k < dim; k++) {
 	    for (l = 0; l < k; l++)
-		Msub(l, k) += K[n][i] * D[n][i] * t[k] * t[l] * scale;
+		Msub(l, k) += K[i] * D[i] * t[k] * t[l] * scale;
 	    Msub(k, k) +=
-		K[n][i] * (1.0 - D[n][i] * (sq - (t[k] * t[k])) * scale);
+		K[i] * (1.0 - D[i] * (sq - (t[k] * t[k])) * scale);
 	}
     }
-    for (k = 1; k < Ndim; k++)
+    for (k = 1; k < dim; k++)
 	for (l = 0; l < k; l++)
 	    Msub(k, l) = Msub(l, k);
 }
 
-void final_energy(graph_t * G, int nG)
+void final_energy(neato_state_t * st, graph_t * G, int nG)
 {
     fprintf(stderr, "iterations = %d final e = %f\n", GD_move(G),
-	    total_e(G, nG));
+	    total_e(st, G, nG));
 }
 
-node_t *choose_node(graph_t * G, int nG)
+node_t *choose_node(neato_state_t * st, graph_t * G)
 {
-    int i, k;
-    double m, max;
-    node_t *choice, *np;
-    static int cnt = 0;
-#if 0
-    double e;
-    static double save_e = MAXDOUBLE;
-#endif
+    double max;
+    node_t *choice;
+    int cnt;
 
-    cnt++;
-    if (GD_move(G) >= MaxIter)
+    cnt = ++st->cnt;
+    if (GD_move(G) >= st->MaxIter)
 	return NULL;
-#if 0
-    if ((cnt % 100) == 0) {
-	e = total_e(G, nG);
-	if (e - save_e > 0)
-	    return NULL;
-	save_e = e;
-    }
-#endif
-    max = 0.0;
-    choice = NULL;
-    for (i = 0; i < nG; i++) {
-	np = GD_neato_nlist(G)[i];
-	if (ND_pinned(np) > P_SET)
-	    continue;
-	for (m = 0.0, k = 0; k < Ndim; k++)
-	    m += (GD_sum_t(G)[i][k] * GD_sum_t(G)[i][k]);
-	/* could set the color=energy of the node here */
-	if (m > max) {
-	    choice = np;
-	    max = m;
-	}
-    }
-    if (max < Epsilon2)
+    max = st->Maxgrad;
+    choice = (st->Maxnode >= 0) ? GD_neato_nlist(G)[st->Maxnode] : NULL;
+    if (max < st->Epsilon2)
 	choice = NULL;
     else {
 	if (Verbose && (cnt % 100 == 0)) {
@@ -554,36 +583,33 @@ node_t *choose_node(graph_t * G, int nG)
 	    if (cnt % 1000 == 0)
 		fprintf(stderr, "\n");
 	}
-#if 0
-	e = total_e(G, nG);
-	if (fabs((e - save_e) / save_e) < 1e-5) {
-	    choice = NULL;
-	}
-#endif
     }
     return choice;
 }
 
-void move_node(graph_t * G, int nG, node_t * n)
+void move_node(neato_state_t * st, graph_t * G, int nG, node_t * n)
 {
     int i, m;
-    static double *a, b[MAXDIM], c[MAXDIM];
+    int dim = st->Ndim;
+    double *a, b[MAXDIM], c[MAXDIM];
+    double oldpos[MAXDIM];
 
     m = ND_id(n);
-    a = ALLOC(Ndim * Ndim, a, double);
-    D2E(G, nG, m, a);
-    for (i = 0; i < Ndim; i++)
+    a = st->Hess = ALLOC(dim * dim, st->Hess, double);
+    D2E(st, G, nG, m, a);
+    for (i = 0; i < dim; i++)
 	c[i] = -GD_sum_t(G)[m][i];
-    solve(a, b, c, Ndim);
-    for (i = 0; i < Ndim; i++) {
-	b[i] = (Damping + 2 * (1 - Damping) * drand48()) * b[i];
+    solve(a, b, c, dim);
+    for (i = 0; i < dim; i++) {
+	b[i] = (st->Damping + 2 * (1 - st->Damping) * gvdrand48()) * b[i];
+	oldpos[i] = ND_pos(n)[i];
 	ND_pos(n)[i] += b[i];
     }
     GD_move(G)++;
-    update_arrays(G, nG, m);
+    update_arrays(st, G, nG, m, oldpos);
     if (test_toggle()) {
 	double sum = 0;
-	for (i = 0; i < Ndim; i++) {
+	for (i = 0; i < dim; i++) {
 	    sum += fabs(b[i]);
 	}			/* Why not squared? */
 	sum = sqrt(sum);
@@ -591,14 +617,11 @@ void move_node(graph_t * G, int nG, node_t * n)
     }
 }
 
-static node_t **Heap;
-static int Heapsize;
-static node_t *Src;
-
-void heapup(node_t * v)
+void heapup(neato_state_t * st, node_t * v)
 {
     int i, par;
     node_t *u;
+    node_t **Heap = st->Heap;
 
     for (i = ND_heapindex(v); i > 0; i = par) {
 	par = (i - 1) / 2;
@@ -612,10 +635,12 @@ void heapup(node_t * v)
     }
 }
 
-void heapdown(node_t * v)
+void heapdown(neato_state_t * st, node_t * v)
 {
     int i, left, right, c;
     node_t *u;
+    node_t **Heap = st->Heap;
+    int Heapsize = st->Heapsize;
 
     i = ND_heapindex(v);
     while ((left = 2 * i + 1) < Heapsize) {
@@ -636,54 +661,56 @@ void heapdown(node_t * v)
     }
 }
 
-void neato_enqueue(node_t * v)
+void neato_enqueue(neato_state_t * st, node_t * v)
 {
     int i;
 
     assert(ND_heapindex(v) < 0);
-    i = Heapsize++;
+    i = st->Heapsize++;
     ND_heapindex(v) = i;
-    Heap[i] = v;
+    st->Heap[i] = v;
     if (i > 0)
-	heapup(v);
+	heapup(st, v);
 }
 
-node_t *neato_dequeue(void)
+node_t *neato_dequeue(neato_state_t * st)
 {
     int i;
     node_t *rv, *v;
 
-    if (Heapsize == 0)
+    if (st->Heapsize == 0)
 	return NULL;
-    rv = Heap[0];
-    i = --Heapsize;
-    v = Heap[i];
-    Heap[0] = v;
+    rv = st->Heap[0];
+    i = --st->Heapsize;
+    v = st->Heap[i];
+    st->Heap[0] = v;
     ND_heapindex(v) = 0;
     if (i > 1)
-	heapdown(v);
+	heapdown(st, v);
     ND_heapindex(rv) = -1;
     return rv;
 }
 
-void shortest_path(graph_t * G, int nG)
+void shortest_path(neato_state_t * st, graph_t * G, int nG)
 {
     node_t *v;
 
-    Heap = N_NEW(nG + 1, node_t *);
+    st->Heap = N_NEW(nG + 1, node_t *);
+    st->Heapsize = 0;
     if (Verbose) {
 	fprintf(stderr, "Calculating shortest paths: ");
 	start_timer();
     }
     for (v = agfstnode(G); v; v = agnxtnode(G, v))
-	s1(G, v);
+	s1(st, G, v);
     if (Verbose) {
 	fprintf(stderr, "%.2f sec\n", elapsed_sec());
     }
-    free(Heap);
+    free(st->Heap);
+    st->Heap = NULL;
 }
 
-void s1(graph_t * G, node_t * node)
+void s1(neato_state_t * st, graph_t * G, node_t * node)
 {
     node_t *v, *u;
     edge_t *e;
@@ -691,15 +718,15 @@ void s1(graph_t * G, node_t * node)
     double f;
 
     for (t = 0; (v = GD_neato_nlist(G)[t]); t++)
-	ND_dist(v) = Initial_dist;
-    Src = node;
-    ND_dist(Src) = 0;
-    ND_hops(Src) = 0;
-    neato_enqueue(Src);
-
-    while ((v = neato_dequeue())) {
-	if (v != Src)
-	    make_spring(G, Src, v, ND_dist(v));
+	ND_dist(v) = st->Initial_dist;
+    st->Src = node;
+    ND_dist(node) = 0;
+    ND_hops(node) = 0;
+    neato_enqueue(st, node);
+
+    while ((v = neato_dequeue(st))) {
+	if (v != st->Src)
+	    make_spring(G, st->Src, v, ND_dist(v));
 	for (e = agfstedge(G, v); e; e = agnxtedge(G, e, v)) {
 	    if ((u = agtail(e)) == v)
 		u = aghead(e);
@@ -707,10 +734,10 @@ void s1(graph_t * G, node_t * node)
 	    if (ND_dist(u) > f) {
 		ND_dist(u) = f;
 		if (ND_heapindex(u) >= 0)
-		    heapup(u);
+		    heapup(st, u);
 		else {
 		    ND_hops(u) = ND_hops(v) + 1;
-		    neato_enqueue(u);
+		    neato_enqueue(st, u);
 		}
 	    }
 	}
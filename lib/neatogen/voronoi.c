@@ -17,9 +17,52 @@
 #include "hedges.h"
 #include "heap.h"
 #include "voronoi.h"
+#include <math.h>
+#include <string.h>
 
 
-void voronoi(int triangulate, Site * (*nextsite) (void))
+/* vinit:
+ * Set up vs for the diagram of nsites sites. The caller fills in
+ * sites, nodeInfo and the bounds.
+ */
+void vinit(vstate_t * vs, int nsites)
+{
+    memset(vs, 0, sizeof(vstate_t));
+    vs->nsites = nsites;
+    vs->sqrt_nsites = (int) sqrt((double) (nsites + 4));
+    freeinit(&vs->sfl, sizeof(Site), vs->sqrt_nsites);
+    freeinit(&vs->efl, sizeof(Edge), vs->sqrt_nsites);
+    freeinit(&vs->hfl, sizeof(Halfedge), vs->sqrt_nsites);
+    freeinit(&vs->pfl, sizeof(PtItem), vs->sqrt_nsites);
+}
+
+/* vfree:
+ * Release the memory held by vs, apart from sites and nodeInfo.
+ */
+void vfree(vstate_t * vs)
+{
+    PQcleanup(vs);
+    ELcleanup(vs);
+    freeinit(&vs->sfl, sizeof(Site), vs->sqrt_nsites);
+    freeinit(&vs->efl, sizeof(Edge), vs->sqrt_nsites);
+    freeinit(&vs->hfl, sizeof(Halfedge), vs->sqrt_nsites);
+    freeinit(&vs->pfl, sizeof(PtItem), vs->sqrt_nsites);
+}
+
+static Site *nextsite(vstate_t * vs)
+{
+    if (vs->nextSite < vs->endSite)
+	return *vs->nextSite++;
+    else
+	return ((Site *) NULL);
+}
+
+/* voronoi:
+ * Compute the diagram of the sites vs->sites, which must be sorted,
+ * starting from vs->nextSite. The edges clipped to the window are
+ * added to the vertex lists of the sites' nodeInfo.
+ */
+void voronoi(vstate_t * vs)
 {
     Site *newsite, *bot, *top, *temp, *p;
     Site *v;
@@ -28,21 +71,21 @@ void voronoi(int triangulate, Site * (*nextsite) (void))
     Halfedge *lbnd, *rbnd, *llbnd, *rrbnd, *bisector;
     Edge *e;
 
-    edgeinit();
-    siteinit();
-    PQinitialize();
-    bottomsite = (*nextsite) ();
+    edgeinit(vs);
+    siteinit(vs);
+    PQinitialize(vs);
+    vs->bottomsite = nextsite(vs);
 #ifdef STANDALONE
-    out_site(bottomsite);
+    out_site(vs->bottomsite);
 #endif
-    ELinitialize();
+    ELinitialize(vs);
 
-    newsite = (*nextsite) ();
+    newsite = nextsite(vs);
     while (1) {
-	if (!PQempty())
-	    newintstar = PQ_min();
+	if (!PQempty(vs))
+	    newintstar = PQ_min(vs);
 
-	if (newsite != (struct Site *) NULL && (PQempty()
+	if (newsite != (struct Site *) NULL && (PQempty(vs)
 						|| newsite->coord.y <
 						newintstar.y
 						|| (newsite->coord.y ==
@@ -53,39 +96,39 @@ void voronoi(int triangulate, Site * (*nextsite) (void))
 #ifdef STANDALONE
 	    out_site(newsite);
 #endif
-	    lbnd = ELleftbnd(&(newsite->coord));
+	    lbnd = ELleftbnd(vs, &(newsite->coord));
 	    rbnd = ELright(lbnd);
-	    bot = rightreg(lbnd);
-	    e = gvbisect(bot, newsite);
-	    bisector = HEcreate(e, le);
+	    bot = rightreg(vs, lbnd);
+	    e = gvbisect(vs, bot, newsite);
+	    bisector = HEcreate(vs, e, le);
 	    ELinsert(lbnd, bisector);
-	    if ((p = hintersect(lbnd, bisector)) != (struct Site *) NULL) {
-		PQdelete(lbnd);
-		PQinsert(lbnd, p, dist(p, newsite));
+	    if ((p = hintersect(vs, lbnd, bisector)) != (struct Site *) NULL) {
+		PQdelete(vs, lbnd);
+		PQinsert(vs, lbnd, p, dist(p, newsite));
 	    }
 	    lbnd = bisector;
-	    bisector = HEcreate(e, re);
+	    bisector = HEcreate(vs, e, re);
 	    ELinsert(lbnd, bisector);
-	    if ((p = hintersect(bisector, rbnd)) != (struct Site *) NULL)
-		PQinsert(bisector, p, dist(p, newsite));
-	    newsite = (*nextsite) ();
-	} else if (!PQempty()) {
+	    if ((p = hintersect(vs, bisector, rbnd)) != (struct Site *) NULL)
+		PQinsert(vs, bisector, p, dist(p, newsite));
+	    newsite = nextsite(vs);
+	} else if (!PQempty(vs)) {
 	    /* intersection is smallest */
-	    lbnd = PQextractmin();
+	    lbnd = PQextractmin(vs);
 	    llbnd = ELleft(lbnd);
 	    rbnd = ELright(lbnd);
 	    rrbnd = ELright(rbnd);
-	    bot = leftreg(lbnd);
-	    top = rightreg(rbnd);
+	    bot = leftreg(vs, lbnd);
+	    top = rightreg(vs, rbnd);
 #ifdef STANDALONE
-	    out_triple(bot, top, rightreg(lbnd));
+	    out_triple(bot, top, rightreg(vs, lbnd));
 #endif
 	    v = lbnd->vertex;
-	    makevertex(v);
-	    endpoint(lbnd->ELedge, lbnd->ELpm, v);
-	    endpoint(rbnd->ELedge, rbnd->ELpm, v);
+	    makevertex(vs, v);
+	    endpoint(vs, lbnd->ELedge, lbnd->ELpm, v);
+	    endpoint(vs, rbnd->ELedge, rbnd->ELpm, v);
 	    ELdelete(lbnd);
-	    PQdelete(rbnd);
+	    PQdelete(vs, rbnd);
 	    ELdelete(rbnd);
 	    pm = le;
 	    if (bot->coord.y > top->coord.y) {
@@ -94,26 +137,26 @@ void voronoi(int triangulate, Site * (*nextsite) (void))
 		top = temp;
 		pm = re;
 	    }
-	    e = gvbisect(bot, top);
-	    bisector = HEcreate(e, pm);
+	    e = gvbisect(vs, bot, top);
+	    bisector = HEcreate(vs, e, pm);
 	    ELinsert(llbnd, bisector);
-	    endpoint(e, re - pm, v);
-	    deref(v);
-	    if ((p = hintersect(llbnd, bisector)) != (struct Site *) NULL) {
-		PQdelete(llbnd);
-		PQinsert(llbnd, p, dist(p, bot));
+	    endpoint(vs, e, re - pm, v);
+	    deref(vs, v);
+	    if ((p = hintersect(vs, llbnd, bisector)) != (struct Site *) NULL) {
+		PQdelete(vs, llbnd);
+		PQinsert(vs, llbnd, p, dist(p, bot));
 	    }
-	    if ((p = hintersect(bisector, rrbnd)) != (struct Site *) NULL) {
-		PQinsert(bisector, p, dist(p, bot));
+	    if ((p = hintersect(vs, bisector, rrbnd)) != (struct Site *) NULL) {
+		PQinsert(vs, bisector, p, dist(p, bot));
 	    }
 	} else
 	    break;
     }
 
-    for (lbnd = ELright(ELleftend); lbnd != ELrightend;
+    for (lbnd = ELright(vs->ELleftend); lbnd != vs->ELrightend;
 	 lbnd = ELright(lbnd)) {
 	e = lbnd->ELedge;
-	clip_line(e);
+	clip_line(vs, e);
 #ifdef STANDALONE
 	out_ep(e);
 #endif
@@ -20,9 +20,48 @@ extern "C" {
 #ifndef VORONOI_H
 #define VORONOI_H
 
-#include "site.h"
+#include "mem.h"
+#include "hedges.h"
 
-    extern void voronoi(int, Site * (*)(void));
+    typedef struct ptitem {	/* Point list */
+	struct ptitem *next;
+	Point p;
+    } PtItem;
+
+    /* All the state of a Voronoi diagram computation, so that several
+     * diagrams can be computed concurrently. Storage for sites, edges,
+     * half-edges and polygon vertices comes from freelists which are
+     * reset, not freed, between diagrams of the same set of sites.
+     */
+    struct vstate_s {
+	int nsites;		/* Number of sites */
+	int sqrt_nsites;
+	Site **sites;		/* Sites sorted by y, then x */
+	Site **endSite;		/* Sentinel on sites array */
+	Site **nextSite;	/* Next site for the sweep */
+	double xmin, xmax, ymin, ymax;	/* extreme x,y values of sites */
+	double deltax, deltay;	/* xmax - xmin, ymax - ymin */
+	double pxmin, pxmax, pymin, pymax;	/* clipping window */
+	Site *bottomsite;
+	int nvertices;
+	int nedges;
+	Freelist sfl;		/* Sites and vertices */
+	Freelist efl;		/* Edges */
+	Freelist hfl;		/* Half-edges */
+	Freelist pfl;		/* Vertices of voronoi polygons */
+	Halfedge *ELleftend, *ELrightend;
+	Halfedge **ELhash;
+	int ELhashsize;
+	Halfedge *PQhash;
+	int PQhashsize;
+	int PQcount;
+	int PQmin;
+	struct Info_t *nodeInfo;	/* Array of node info, indexed by sitenbr */
+    };
+
+    extern void vinit(vstate_t *, int);
+    extern void vfree(vstate_t *);
+    extern void voronoi(vstate_t *);
 
 #endif
 
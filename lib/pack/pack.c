@@ -1411,3 +1411,90 @@ getPackInfo(Agraph_t * g, pack_mode dflt, int dfltMargin, pack_info* pinfo)
 }
 
 
+
+/* getPackThreads:
+ * Return the "packthreads" attribute of g, the number of threads
+ * layoutComps may use. The default 0 means the components are laid
+ * out one after another, as they always were.
+ */
+int getPackThreads(Agraph_t * g)
+{
+    return late_int(g, agfindgraphattr(g, "packthreads"), 0, 0);
+}
+
+typedef struct {
+    int size;			/* no. of nodes */
+    int idx;			/* index in component array */
+} csize_t;
+
+/* csizecmpf;
+ * Sort components by decreasing size; ties keep their input order.
+ */
+static int csizecmpf(const void *X, const void *Y)
+{
+    csize_t *x = (csize_t *) X;
+    csize_t *y = (csize_t *) Y;
+    if (x->size != y->size)
+	return (y->size - x->size);
+    return (x->idx - y->idx);
+}
+
+static void
+layoutComp(Agraph_t ** ccs, int i, long seed, pack_layoutf layoutf,
+	   void *state, gverr_t ** errs)
+{
+    gvLocalRandom(TRUE, seed);
+    gvDeferErrors(TRUE);
+    layoutf(ccs[i], i, state);
+    errs[i] = gvDeferErrors(FALSE);
+    gvLocalRandom(FALSE, 0);
+}
+
+/* layoutComps:
+ * Lay out the ncc components in ccs by calling layoutf(ccs[i], i, state)
+ * for each of them. With OpenMP, up to nthreads components are laid out
+ * at a time, largest first. A component holding more than 1/nthreads of
+ * all the nodes is laid out before the others and alone, so that threads
+ * used inside its layout are not starved.
+ * Each call draws its random numbers from generators of its own, started
+ * from seed (see gvLocalRandom), so the layouts do not depend on nthreads.
+ * Likewise, the messages each call reports through gvagerr are held back
+ * and passed on to agerr afterwards, component by component in order.
+ * As cgraph does not support concurrent lookups or updates, layoutf may
+ * only change its own component's nodes and edges and the i'th part of
+ * state; it must not find attributes or objects by name, call agnameof
+ * or agerr, or create or delete graph objects.
+ */
+void layoutComps(int ncc, Agraph_t ** ccs, int nthreads, long seed,
+		 pack_layoutf layoutf, void *state)
+{
+    csize_t *cs = N_NEW(ncc, csize_t);
+    gverr_t **errs = N_NEW(ncc, gverr_t *);
+    int i, nbig, total = 0;
+
+    if (Verbose)		/* keep the progress reports apart */
+	nthreads = 1;
+    for (i = 0; i < ncc; i++) {
+	cs[i].size = agnnodes(ccs[i]);
+	cs[i].idx = i;
+	total += cs[i].size;
+    }
+    qsort(cs, ncc, sizeof(csize_t), csizecmpf);
+
+    nbig = 0;
+    if (nthreads > 1) {
+	while ((nbig < ncc) && ((double) cs[nbig].size * nthreads > total))
+	    nbig++;
+    }
+    for (i = 0; i < nbig; i++)
+	layoutComp(ccs, cs[i].idx, seed, layoutf, state, errs);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(MAX(nthreads, 1))
+#endif
+    for (i = nbig; i < ncc; i++)
+	layoutComp(ccs, cs[i].idx, seed, layoutf, state, errs);
+    for (i = 0; i < ncc; i++)
+	gvReportErrors(errs[i]);
+    free(errs);
+    free(cs);
+}
@@ -46,6 +46,9 @@ extern "C" {
 
 typedef unsigned int packval_t;
 
+    /* lays out the i'th component; see layoutComps */
+    typedef void (*pack_layoutf) (Agraph_t * g, int i, void *state);
+
     typedef struct {
 	float aspect;		/* desired aspect ratio */
 	int sz;			/* row/column size size */
@@ -80,6 +83,9 @@ typedef unsigned int packval_t;
     extern pack_mode getPackInfo(Agraph_t * g, pack_mode dflt, int dfltMargin, pack_info*);
     extern pack_mode getPackModeInfo(Agraph_t * g, pack_mode dflt, pack_info*);
     extern pack_mode parsePackModeInfo(char* p, pack_mode dflt, pack_info* pinfo);
+    extern int getPackThreads(Agraph_t * g);
+    extern void layoutComps(int ncc, Agraph_t ** ccs, int nthreads,
+			    long seed, pack_layoutf layoutf, void *state);
 
     extern int isConnected(Agraph_t *);
     extern Agraph_t **ccomps(Agraph_t *, int *, char *);
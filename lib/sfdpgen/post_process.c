@@ -30,6 +30,10 @@
 
 #define node_degree(i) (ia[(i)+1] - ia[(i)])
 
+/* Laplacians of at least this size are solved with the multigrid preconditioner. It cuts the
+   number of CG iterations several fold, which for smaller graphs does not pay for its set up. */
+#define AMG_MIN_SIZE 1000
+
 #ifdef UNUSED
 static void  get_neighborhood_precision_recall(char *outfile, SparseMatrix A0, real *ideal_dist_matrix, real *dist_matrix){
   SparseMatrix A = A0;
@@ -340,6 +344,7 @@ StressMajorizationSmoother StressMajorizationSmoother2_new(SparseMatrix A, int d
   sm->scheme = SM_SCHEME_NORMAL;
   sm->tol_cg = 0.01;
   sm->maxit_cg = (int)sqrt((double) A->m);
+  sm->solve_method = (A->m >= AMG_MIN_SIZE) ? SOLVE_METHOD_CG_AMG : SOLVE_METHOD_CG;
 
   lambda = sm->lambda = N_GNEW(m,real);
   for (i = 0; i < m; i++) sm->lambda[i] = lambda0;
@@ -542,6 +547,7 @@ StressMajorizationSmoother SparseStressMajorizationSmoother_new(SparseMatrix A,
   sm->D = A;
   sm->tol_cg = 0.01;
   sm->maxit_cg = (int)sqrt((double) A->m);
+  sm->solve_method = (A->m >= AMG_MIN_SIZE) ? SOLVE_METHOD_CG_AMG : SOLVE_METHOD_CG;
 
   lambda = sm->lambda = MALLOC(sizeof(real)*m);
   for (i = 0; i < m; i++) sm->lambda[i] = lambda0;
@@ -809,15 +815,32 @@ static real uniform_stress_solve(SparseMatrix Lw, real alpha, int dim, real *x0,
 
 }
 
+static void multiply_dense_sreal(int m, int *ia, int *ja, sreal *a, real *v, real *u, int dim){
+  /* u = A v for the m x n matrix with the pattern ia, ja and values a, as
+     SparseMatrix_multiply_dense does it, with v of dimension n x dim */
+  int i, j, k;
+
+#ifdef _OPENMP
+#pragma omp parallel for private(j, k) schedule(static) num_threads(SparseMatrix_threads(ia[m])) if (SparseMatrix_threads(ia[m]) > 1)
+#endif
+  for (i = 0; i < m; i++){
+    for (k = 0; k < dim; k++) u[i*dim+k] = 0.;
+    for (j = ia[i]; j < ia[i+1]; j++){
+      for (k = 0; k < dim; k++) u[i*dim+k] += a[j]*v[ja[j]*dim+k];
+    }
+  }
+}
+
 real StressMajorizationSmoother_smooth(StressMajorizationSmoother sm, int dim, real *x, int maxit_sm, real tol) {
-  SparseMatrix Lw = sm->Lw, Lwd = sm->Lwd, Lwdd = NULL;
+  SparseMatrix Lw = sm->Lw, Lwd = sm->Lwd;
   int i, j, k, m, *id, *jd, *iw, *jw, idiag, flag = 0, iter = 0;
-  real *w, *dd, *d, *y = NULL, *x0 = NULL, *x00 = NULL, diag, diff = 1, *lambda = sm->lambda, res, alpha = 0., M = 0.;
+  real *w, *d, *y = NULL, *x0 = NULL, *x00 = NULL, diag, diff = 1, *lambda = sm->lambda, res, alpha = 0., M = 0.;
+  sreal *dd = NULL;
   SparseMatrix Lc = NULL;
   real dij, dist;
+  Operator Ax = NULL, precon = NULL;
 
 
-  Lwdd = SparseMatrix_copy(Lwd);
   m = Lw->m;
   x0 = N_GNEW(dim*m,real);
   if (!x0) goto RETURN;
@@ -828,7 +851,10 @@ real StressMajorizationSmoother_smooth(StressMajorizationSmoother sm, int dim, r
 
   id = Lwd->ia; jd = Lwd->ja;
   d = (real*) Lwd->a;
-  dd = (real*) Lwdd->a;
+  /* the values of Lwdd = Lwd with each entry divided by the current distance. It has
+     the pattern of Lwd, so only the values are kept */
+  dd = N_GNEW(id[m],sreal);
+  if (!dd) goto RETURN;
   w = (real*) Lw->a;
   iw = Lw->ia; jw = Lw->ja;
 
@@ -844,6 +870,12 @@ real StressMajorizationSmoother_smooth(StressMajorizationSmoother sm, int dim, r
     M = ((real*) (sm->data))[1];
   }
 
+  /* Lw stays the same through the iterations, so the multigrid hierarchy is set up once */
+  if (sm->solve_method == SOLVE_METHOD_CG_AMG && sm->scheme != SM_SCHEME_UNIFORM_STRESS){
+    Ax = Operator_matmul_new(Lw);
+    precon = Operator_amg_precon_new(Lw);
+  }
+
   while (iter++ < maxit_sm && diff > tol){
 #ifdef GVIEWER
     if (Gviewer) {
@@ -897,7 +929,7 @@ real StressMajorizationSmoother_smooth(StressMajorizationSmoother sm, int dim, r
       }
       /* solve (Lw+lambda*I) x = Lwdd y + lambda x0 */
 
-      SparseMatrix_multiply_dense(Lwdd, FALSE, x, FALSE, &y, FALSE, dim);
+      multiply_dense_sreal(m, id, jd, dd, x, y, dim);
     } else {
       for (i = 0; i < m; i++){
 	for (j = 0; j < dim; j++){
@@ -972,6 +1004,8 @@ real StressMajorizationSmoother_smooth(StressMajorizationSmoother sm, int dim, r
 
     if (sm->scheme == SM_SCHEME_UNIFORM_STRESS){
       res = uniform_stress_solve(Lw, alpha, dim, x, y, sm->tol_cg, sm->maxit_cg, &flag);
+    } else if (precon) {
+      res = cg(Ax, precon, m, dim, x, y, sm->tol_cg, sm->maxit_cg, &flag);
     } else {
       res = SparseMatrix_solve(Lw, dim, x, y,  sm->tol_cg, sm->maxit_cg, SOLVE_METHOD_CG, &flag);
       //res = SparseMatrix_solve(Lw, dim, x, y,  sm->tol_cg, 1, SOLVE_METHOD_JACOBI, &flag);
@@ -1001,7 +1035,11 @@ real StressMajorizationSmoother_smooth(StressMajorizationSmoother sm, int dim, r
 #endif
 
  RETURN:
-  SparseMatrix_delete(Lwdd);
+  if (dd) FREE(dd);
+  if (precon) {
+    Operator_matmul_delete(Ax);
+    Operator_amg_precon_delete(precon);
+  }
   if (Lc) {
     SparseMatrix_delete(Lc);
     SparseMatrix_delete(Lw);
@@ -1053,6 +1091,7 @@ TriangleSmoother TriangleSmoother_new(SparseMatrix A, int dim, real lambda0, rea
   sm->scheme = SM_SCHEME_NORMAL;
   sm->tol_cg = 0.01;
   sm->maxit_cg = (int)sqrt((double) A->m);
+  sm->solve_method = (A->m >= AMG_MIN_SIZE) ? SOLVE_METHOD_CG_AMG : SOLVE_METHOD_CG;
 
   lambda = sm->lambda = N_GNEW(m,real);
   for (i = 0; i < m; i++) sm->lambda[i] = lambda0;
@@ -31,6 +31,7 @@ struct StressMajorizationSmoother_struct {
 		 typically the Laplacian only needs to be solved very crudely as it is part of an
 		 outer iteration.*/
   int maxit_cg;
+  int solve_method;/* SOLVE_METHOD_CG (diagonal preconditioner) or SOLVE_METHOD_CG_AMG (multigrid preconditioner) */
 };
 
 typedef struct StressMajorizationSmoother_struct *StressMajorizationSmoother;
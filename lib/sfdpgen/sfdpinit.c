@@ -44,7 +44,7 @@ static void sfdp_init_node_edge(graph_t * g)
 	neato_init_node(n);
 #if 0
    FIX so that user positions works with multiscale
-	user_pos(N_pos, NULL, n, nnodes); 
+	user_pos(N_pos, NULL, n, nnodes, PSinputscale); 
 #endif
     }
     for (n = agfstnode(g); n; n = agnxtnode(g, n)) {
@@ -88,31 +88,57 @@ static real *getPos(Agraph_t * g, spring_electrical_control ctrl)
     return pos;
 }
 
-static void sfdpLayout(graph_t * g, spring_electrical_control ctrl,
-		       int hops, pointf pad)
-{
+typedef struct {
+    SparseMatrix A;
+    SparseMatrix D;
     real *sizes;
     real *pos;
-    Agnode_t *n;
-    int flag, i;
-    int n_edge_label_nodes = 0, *edge_label_nodes = NULL;
-    SparseMatrix D = NULL;
-    SparseMatrix A;
+    int n_edge_label_nodes;
+    int *edge_label_nodes;
+} sfdp_data_t;
+
+/* sfdpSetup:
+ * Gather from g what the embedding needs.
+ */
+static void sfdpSetup(graph_t * g, spring_electrical_control ctrl,
+		      pointf pad, sfdp_data_t * d)
+{
+    d->D = NULL;
+    d->n_edge_label_nodes = 0;
+    d->edge_label_nodes = NULL;
 
     if (ctrl->method == METHOD_SPRING_MAXENT) /* maxent can work with distance matrix */
-	A = makeMatrix(g, Ndim, &D);
+	d->A = makeMatrix(g, Ndim, &d->D);
     else
-	A = makeMatrix(g, Ndim, NULL);
+	d->A = makeMatrix(g, Ndim, NULL);
 
     if (ctrl->overlap >= 0) {
 	if (ctrl->edge_labeling_scheme > 0)
-	    sizes = getSizes(g, pad, &n_edge_label_nodes, &edge_label_nodes);
+	    d->sizes = getSizes(g, pad, &d->n_edge_label_nodes, &d->edge_label_nodes);
 	else
-	    sizes = getSizes(g, pad, NULL, NULL);
+	    d->sizes = getSizes(g, pad, NULL, NULL);
     }
     else
-	sizes = NULL;
-    pos = getPos(g, ctrl);
+	d->sizes = NULL;
+    d->pos = getPos(g, ctrl);
+}
+
+/* sfdpSolve:
+ * Compute the embedding set up by sfdpSetup, store it in the nodes of g,
+ * and free d. Only g's own nodes are touched, so the components of a
+ * graph can be solved at the same time.
+ */
+static void sfdpSolve(graph_t * g, spring_electrical_control ctrl,
+		      int hops, sfdp_data_t * d)
+{
+    real *sizes = d->sizes;
+    real *pos = d->pos;
+    Agnode_t *n;
+    int flag, i;
+    int n_edge_label_nodes = d->n_edge_label_nodes;
+    int *edge_label_nodes = d->edge_label_nodes;
+    SparseMatrix D = d->D;
+    SparseMatrix A = d->A;
 
     switch (ctrl->method) {
     case METHOD_SPRING_ELECTRICAL:
@@ -164,6 +190,64 @@ static void sfdpLayout(graph_t * g, spring_electrical_control ctrl,
     if (edge_label_nodes) FREE(edge_label_nodes);
 }
 
+static void sfdpLayout(graph_t * g, spring_electrical_control ctrl,
+		       int hops, pointf pad)
+{
+    sfdp_data_t d;
+
+    sfdpSetup(g, ctrl, pad, &d);
+    sfdpSolve(g, ctrl, hops, &d);
+}
+
+typedef struct {
+    struct spring_electrical_control_struct *ctrl;	/* control of each component */
+    sfdp_data_t *data;
+    int hops;
+} sfdp_comps_t;
+
+static void solveComp(graph_t * g, int i, void *state)
+{
+    sfdp_comps_t *cs = (sfdp_comps_t *) state;
+
+    sfdpSolve(g, cs->ctrl + i, cs->hops, cs->data + i);
+}
+
+/* sfdpLayoutComps:
+ * Lay out the ncc components ccs as sfdpLayout does, with the embeddings
+ * computed concurrently on up to nthreads threads (see layoutComps).
+ * Each component starts from its own copy of ctrl, which the embedding
+ * changes as it goes, so a component's layout does not depend on which
+ * were done before it.
+ * Returns FALSE, having done nothing, if the embedding would triangulate:
+ * GTS and Triangle keep static state.
+ */
+static boolean
+sfdpLayoutComps(Agraph_t ** ccs, int ncc, spring_electrical_control ctrl,
+		int hops, pointf pad, int nthreads)
+{
+    sfdp_comps_t cs;
+    int i;
+
+#if (HAVE_GTS || HAVE_TRIANGLE)
+    if ((ctrl->overlap >= 0) || (ctrl->smoothing == SMOOTHING_RNG) ||
+	(ctrl->smoothing == SMOOTHING_TRIANGLE))
+	return FALSE;
+#endif
+
+    cs.ctrl = N_NEW(ncc, struct spring_electrical_control_struct);
+    cs.data = N_NEW(ncc, sfdp_data_t);
+    cs.hops = hops;
+    for (i = 0; i < ncc; i++) {
+	nodeInduce(ccs[i]);
+	cs.ctrl[i] = *ctrl;
+	sfdpSetup(ccs[i], cs.ctrl + i, pad, cs.data + i);
+    }
+    layoutComps(ncc, ccs, nthreads, ctrl->random_seed, solveComp, &cs);
+    free(cs.ctrl);
+    free(cs.data);
+    return TRUE;
+}
+
 #if UNUSED
 static int
 late_mode (graph_t* g, Agsym_t* sym, int dflt)
@@ -308,6 +392,9 @@ tuneControl (graph_t* g, spring_electrical_control ctrl)
     ctrl->do_shrinking = mapBool (agget(g, "overlap_shrink"), TRUE);
     ctrl->rotation = late_double(g, agfindgraphattr(g, "rotation"), 0.0, -MAXDOUBLE);
     ctrl->edge_labeling_scheme = late_int(g, agfindgraphattr(g, "label_scheme"), 0, 0);
+    ctrl->nthreads = late_int(g, agfindgraphattr(g, "threads"), 0, 0);
+    ctrl->fmm_order = late_int(g, agfindgraphattr(g, "fmm_order"), 0, 0);
+    getConvParms(g, &ctrl->conv);
     if (ctrl->edge_labeling_scheme > 4) {
 	agerr (AGWARN, "label_scheme = %d > 4 : ignoring\n", ctrl->edge_labeling_scheme);
 	ctrl->edge_labeling_scheme = 0;
@@ -326,12 +413,13 @@ void sfdp_layout(graph_t * g)
 	Agraph_t **ccs;
 	Agraph_t *sg;
 	int ncc;
-	int i;
+	int i, oldthreads;
 	expand_t sep;
 	pointf pad;
 	spring_electrical_control ctrl = spring_electrical_control_new();
 
 	tuneControl (g, ctrl);
+	oldthreads = SparseMatrix_set_threads(ctrl->nthreads);
 #if (HAVE_GTS || HAVE_TRIANGLE)
 	graphAdjustMode(g, &am, "prism0");
 #else
@@ -366,13 +454,18 @@ void sfdp_layout(graph_t * g)
 	    spline_edges(g);
 	} else {
 	    pack_info pinfo;
+	    int nthreads = getPackThreads(g);
+	    boolean done = (nthreads > 0) &&
+		sfdpLayoutComps(ccs, ncc, ctrl, hops, pad, nthreads);
 	    getPackInfo(g, l_node, CL_OFFSET, &pinfo);
 	    pinfo.doSplines = 1;
 
 	    for (i = 0; i < ncc; i++) {
 		sg = ccs[i];
-		nodeInduce(sg);
-		sfdpLayout(sg, ctrl, hops, pad);
+		if (!done) {
+		    nodeInduce(sg);
+		    sfdpLayout(sg, ctrl, hops, pad);
+		}
 		if (doAdjust) removeOverlapWith(sg, &am);
 		setEdgeType(sg, ET_LINE);
 		spline_edges(sg);
@@ -383,6 +476,7 @@ void sfdp_layout(graph_t * g)
 	    agdelete(g, ccs[i]);
 	}
 	free(ccs);
+	SparseMatrix_set_threads(oldthreads);
 	spring_electrical_control_delete(ctrl);
     }
 
@@ -14,6 +14,7 @@
 #include <assert.h>
 #include <string.h>
 #include "sparse_solve.h"
+#include "Multilevel.h"
 #include "sfdpinternal.h"
 #include "memory.h"
 #include "logic.h"
@@ -159,6 +160,145 @@ void Operator_diag_precon_delete(Operator o){
   if (o) FREE(o);
 }
 
+/* algebraic multigrid preconditioner. The aggregates are the clusters of the multilevel
+   hierarchy of sfdp, built on the graph of the off diagonal entries |a_ij|, and the coarse
+   operators are the Galerkin products P^T A P. One V-cycle with a forward Gauss-Seidel
+   sweep before and a backward sweep after the coarse grid correction is applied,
+   which keeps the preconditioner symmetric. */
+
+enum {AMG_MINSIZE = 64, AMG_COARSEST_SWEEPS = 10};
+
+struct amg_precon_data {
+  int nlevels;
+  SparseMatrix *A;/* A[0] is the matrix being solved and is not owned */
+  SparseMatrix *P;/* P[l] prolongates from level l+1 to level l */
+  SparseMatrix *R;/* R[l] = P[l]^T */
+  real **x, **b, **r;/* work space per level */
+};
+
+static void gauss_seidel_sweep(SparseMatrix A, real *x, real *b, int forward){
+  int *ia = A->ia, *ja = A->ja, m = A->m, i, ii, j;
+  real *a = (real*) A->a, s, diag;
+
+  for (ii = 0; ii < m; ii++){
+    i = forward ? ii : m - 1 - ii;
+    s = b[i];
+    diag = 0;
+    for (j = ia[i]; j < ia[i+1]; j++){
+      if (ja[j] == i) {
+	diag = a[j];
+      } else {
+	s -= a[j]*x[ja[j]];
+      }
+    }
+    if (diag > 0) x[i] = s/diag;
+  }
+}
+
+static void amg_vcycle(struct amg_precon_data *d, int l, real *b, real *x){
+  SparseMatrix A = d->A[l];
+  real *r = d->r[l];
+  int i, k, m = A->m;
+
+  for (i = 0; i < m; i++) x[i] = 0;
+
+  if (l == d->nlevels - 1){
+    for (k = 0; k < AMG_COARSEST_SWEEPS; k++){
+      gauss_seidel_sweep(A, x, b, TRUE);
+      gauss_seidel_sweep(A, x, b, FALSE);
+    }
+    return;
+  }
+
+  gauss_seidel_sweep(A, x, b, TRUE);
+  SparseMatrix_multiply_vector(A, x, &r, FALSE);
+  for (i = 0; i < m; i++) r[i] = b[i] - r[i];
+  SparseMatrix_multiply_vector(d->R[l], r, &(d->b[l+1]), FALSE);
+  amg_vcycle(d, l + 1, d->b[l+1], d->x[l+1]);
+  SparseMatrix_multiply_vector(d->P[l], d->x[l+1], &r, FALSE);
+  for (i = 0; i < m; i++) x[i] += r[i];
+  gauss_seidel_sweep(A, x, b, FALSE);
+}
+
+static real* Operator_amg_precon_apply(Operator o, real *x, real *y){
+  amg_vcycle((struct amg_precon_data*) o->data, 0, x, y);
+  return y;
+}
+
+Operator Operator_amg_precon_new(SparseMatrix A){
+  Operator o;
+  struct amg_precon_data *d;
+  SparseMatrix S;
+  Multilevel_control ctrl;
+  Multilevel grid0, grid;
+  real *s;
+  int i, l;
+
+  assert(A->type == MATRIX_TYPE_REAL);
+  assert(A->m == A->n);
+
+  /* strength of connection */
+  S = SparseMatrix_copy(A);
+  s = (real*) S->a;
+  for (i = 0; i < S->nz; i++) s[i] = ABS(s[i]);
+  S = SparseMatrix_remove_diagonal(S);
+
+  ctrl = Multilevel_control_new(COARSEN_INDEPENDENT_EDGE_SET_HEAVEST_EDGE_PERNODE_SUPERNODES_FIRST, COARSEN_MODE_FORCEFUL);
+  ctrl->randomize = FALSE;/* do not disturb the random sequence of the caller */
+  ctrl->minsize = AMG_MINSIZE;
+  grid0 = Multilevel_new(S, NULL, NULL, ctrl);
+
+  o = N_GNEW(1,struct Operator_struct);
+  o->data = d = N_GNEW(1,struct amg_precon_data);
+  d->nlevels = 1;
+  for (grid = grid0; grid->next; grid = grid->next) d->nlevels++;
+  d->A = N_GNEW(d->nlevels,SparseMatrix);
+  d->P = N_GNEW(d->nlevels,SparseMatrix);
+  d->R = N_GNEW(d->nlevels,SparseMatrix);
+  d->x = N_GNEW(d->nlevels,real*);
+  d->b = N_GNEW(d->nlevels,real*);
+  d->r = N_GNEW(d->nlevels,real*);
+
+  d->A[0] = A;
+  for (grid = grid0, l = 0; grid->next; grid = grid->next, l++){
+    d->P[l] = grid->next->P;
+    grid->next->P = NULL;
+    d->R[l] = SparseMatrix_transpose(d->P[l]);
+    d->A[l+1] = SparseMatrix_multiply3(d->R[l], d->A[l], d->P[l]);
+  }
+  d->P[l] = d->R[l] = NULL;
+  for (l = 0; l < d->nlevels; l++){
+    d->x[l] = N_GNEW(d->A[l]->m,real);
+    d->b[l] = N_GNEW(d->A[l]->m,real);
+    d->r[l] = N_GNEW(d->A[l]->m,real);
+  }
+
+  Multilevel_delete(grid0);
+  Multilevel_control_delete(ctrl);
+  SparseMatrix_delete(S);
+
+  o->Operator_apply = Operator_amg_precon_apply;
+  return o;
+}
+
+void Operator_amg_precon_delete(Operator o){
+  struct amg_precon_data *d = (struct amg_precon_data*) o->data;
+  int l;
+
+  for (l = 0; l < d->nlevels; l++){
+    if (l > 0) SparseMatrix_delete(d->A[l]);
+    SparseMatrix_delete(d->P[l]);
+    SparseMatrix_delete(d->R[l]);
+    FREE(d->x[l]);
+    FREE(d->b[l]);
+    FREE(d->r[l]);
+  }
+  FREE(d->A); FREE(d->P); FREE(d->R);
+  FREE(d->x); FREE(d->b); FREE(d->r);
+  FREE(d);
+  FREE(o);
+}
+
 static real conjugate_gradient(Operator A, Operator precon, int n, real *x, real *rhs, real tol, int maxit, int *flag){
   real *z, *r, *p, *q, res = 10*tol, alpha;
   real rho = 1.0e20, rho_old = 1, res0, beta;
@@ -307,6 +447,13 @@ real SparseMatrix_solve(SparseMatrix A, int dim, real *x0, real *rhs, real tol,
     Operator_matmul_delete(Ax);
     Operator_diag_precon_delete(precond);
     break;
+  case SOLVE_METHOD_CG_AMG:
+    Ax =  Operator_matmul_new(A);
+    precond = Operator_amg_precon_new(A);
+    res = cg(Ax, precond, n, dim, x0, rhs, tol, maxit, flag);
+    Operator_matmul_delete(Ax);
+    Operator_amg_precon_delete(precond);
+    break;
   case SOLVE_METHOD_JACOBI:{
     jacobi(A, dim, x0, rhs, maxit, flag);
     break;
@@ -17,7 +17,7 @@
 
 #include "SparseMatrix.h"
 
-enum {SOLVE_METHOD_CG, SOLVE_METHOD_JACOBI};
+enum {SOLVE_METHOD_CG, SOLVE_METHOD_JACOBI, SOLVE_METHOD_CG_AMG};
 
 typedef struct Operator_struct *Operator;
 
@@ -34,5 +34,15 @@ Operator Operator_uniform_stress_matmul(SparseMatrix A, real alpha);
 
 Operator Operator_uniform_stress_diag_precon_new(SparseMatrix A, real alpha);
 
+Operator Operator_matmul_new(SparseMatrix A);
+
+void Operator_matmul_delete(Operator o);
+
+/* V-cycle of algebraic multigrid, for symmetric matrices with positive diagonal
+   and nonpositive off diagonal entries such as weighted Laplacians */
+Operator Operator_amg_precon_new(SparseMatrix A);
+
+void Operator_amg_precon_delete(Operator o);
+
 #endif
  
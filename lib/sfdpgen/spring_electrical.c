@@ -28,6 +28,11 @@
 #include <string.h>
 #include <time.h>
 
+#if defined(__GNUC__) && defined(__SSE2__)
+#define SPRING2_SSE2
+#include <emmintrin.h>
+#endif
+
 #define PI M_PI
 
 spring_electrical_control spring_electrical_control_new(){
@@ -67,6 +72,11 @@ spring_electrical_control spring_electrical_control_new(){
   ctrl->initial_scaling = -4;
   ctrl->rotation = 0.;
   ctrl->edge_labeling_scheme = 0;
+  ctrl->nthreads = 0;
+  ctrl->fmm_order = 0;
+  ctrl->conv.maxtime = 0;
+  ctrl->conv.reltol = 0;
+  ctrl->conv.start = gvWallTime();
   return ctrl;
 }
 
@@ -102,6 +112,7 @@ void spring_electrical_control_print(spring_electrical_control ctrl){
     smoothings[ctrl->smoothing], ctrl->overlap, ctrl->initial_scaling, ctrl->do_shrinking);
   fprintf (stderr, "  octree scheme %s method %s\n", tschemes[ctrl->tscheme], methods[ctrl->method]);
   fprintf (stderr, "  edge_labeling_scheme %d\n", ctrl->edge_labeling_scheme);
+  fprintf (stderr, "  threads %d fmm_order %d\n", ctrl->nthreads, ctrl->fmm_order);
 }
 
 void oned_optimizer_delete(oned_optimizer opt){
@@ -298,6 +309,38 @@ void export_embedding(FILE *fp, int dim, SparseMatrix A, real *x, real *width){
 
 }
 
+static void attractive_force(int dim, real *x, int i, int *ja, int first, int last, real CRK, real *f){
+  /* subtract from f the attractive force C^((2-p)/3) ||x_i-x_j||/K * (x_i - x_j) on node i
+     from its neighbors ja[first], ..., ja[last-1]. In 2D both coordinates are done as one
+     SSE2 pair. Each coordinate goes through the same operations in the same order as in the
+     generic loop, so the result is identical either way. */
+  int j, k;
+  real dist;
+
+#ifdef SPRING2_SSE2
+  if (dim == 2){
+    __m128d xi = _mm_loadu_pd(&(x[2*i])), crk = _mm_set1_pd(CRK), fi = _mm_loadu_pd(f), d, d2;
+
+    for (j = first; j < last; j++){
+      if (ja[j] == i) continue;
+      d = _mm_sub_pd(xi, _mm_loadu_pd(&(x[2*ja[j]])));
+      d2 = _mm_mul_pd(d, d);
+      d2 = _mm_sqrt_sd(d2, _mm_add_sd(d2, _mm_unpackhi_pd(d2, d2)));
+      fi = _mm_sub_pd(fi, _mm_mul_pd(_mm_mul_pd(crk, d), _mm_unpacklo_pd(d2, d2)));
+    }
+    _mm_storeu_pd(f, fi);
+    return;
+  }
+#endif
+  for (j = first; j < last; j++){
+    if (ja[j] == i) continue;
+    dist = distance(x, dim, i, ja[j]);
+    for (k = 0; k < dim; k++){
+      f[k] -= CRK*(x[i*dim+k] - x[ja[j]*dim+k])*dist;
+    }
+  }
+}
+
 static real update_step(int adaptive_cooling, real step, real Fnorm, real Fnorm0, real cool){
 
   if (!adaptive_cooling) {
@@ -485,18 +528,47 @@ void force_print(FILE *fp, int n, int dim, real *x, real *force){
 }
 
 
+/* conv_save:
+ * Keep the positions for conv_disp. xold is only allocated when the
+ * convergence monitor is active, and is stored as sreal.
+ */
+static void conv_save(int dim, int n, real *x, sreal *xold){
+  int i;
+
+  if (!xold) return;
+  for (i = 0; i < dim*n; i++) xold[i] = x[i];
+}
+
+/* conv_disp:
+ * Total distance moved by the nodes in the last iteration, for the
+ * convergence monitor; -1 if nobody is asking.
+ */
+static real conv_disp(convmon_t *cm, int dim, int n, real *x, sreal *xold){
+  int i, k;
+  real d, dist = 0;
+
+  if (!xold || !convActive(cm)) return -1;
+  for (i = 0; i < n; i++){
+    d = 0;
+    for (k = 0; k < dim; k++) d += (x[i*dim+k] - xold[i*dim+k])*(x[i*dim+k] - xold[i*dim+k]);
+    dist += sqrt(d);
+  }
+  return dist;
+}
+
 void spring_electrical_embedding_fast(int dim, SparseMatrix A0, spring_electrical_control ctrl, real *node_weights, real *x, int *flag){
   /* x is a point to a 1D array, x[i*dim+j] gives the coordinate of the i-th node at dimension j.  */
   SparseMatrix A = A0;
   int m, n;
-  int i, j, k;
+  int i, k;
   real p = ctrl->p, K = ctrl->K, C = ctrl->C, CRK, tol = ctrl->tol, maxiter = ctrl->maxiter, cool = ctrl->cool, step = ctrl->step, KP;
   int *ia = NULL, *ja = NULL;
-  real *xold = NULL;
-  real *f = NULL, dist, F, Fnorm = 0, Fnorm0;
+  sreal *xold = NULL;
+  convmon_t cm;
+  real *f = NULL, F, Fnorm = 0, Fnorm0;
   int iter = 0;
   int adaptive_cooling = ctrl->adaptive_cooling;
-  QuadTree qt = NULL;
+  FlatQuadTree qt = NULL;
   real counts[4], *force = NULL;
 #ifdef TIME
   clock_t start, end, start0;
@@ -525,7 +597,7 @@ void spring_electrical_embedding_fast(int dim, SparseMatrix A0, spring_electrica
   ja = A->ja;
 
   if (ctrl->random_start){
-    srand(ctrl->random_seed);
+    gvsrand(ctrl->random_seed);
     for (i = 0; i < dim*n; i++) x[i] = drand();
   }
   if (K < 0){
@@ -536,9 +608,11 @@ void spring_electrical_embedding_fast(int dim, SparseMatrix A0, spring_electrica
   KP = pow(K, 1 - p);
   CRK = pow(C, (2.-p)/3.)/K;
 
-  xold = MALLOC(sizeof(real)*dim*n);
   force = MALLOC(sizeof(real)*dim*n);
+  qt = FlatQuadTree_new(dim, n);
 
+  convInit(&cm, &ctrl->conv, "sfdp", (int) maxiter);
+  if (convActive(&cm)) xold = MALLOC(sizeof(sreal)*dim*n);
   do {
 #ifdef TIME
     //start2 = clock();
@@ -559,7 +633,7 @@ void spring_electrical_embedding_fast(int dim, SparseMatrix A0, spring_electrica
 #endif
 
     iter++;
-    xold = MEMCPY(xold, x, sizeof(real)*dim*n);
+    conv_save(dim, n, x, xold);
     Fnorm0 = Fnorm;
     Fnorm = 0.;
 
@@ -569,9 +643,9 @@ void spring_electrical_embedding_fast(int dim, SparseMatrix A0, spring_electrica
     start = clock();
 #endif
     if (ctrl->use_node_weights){
-      qt = QuadTree_new_from_point_list(dim, n, max_qtree_level, x, node_weights);
+      FlatQuadTree_build(qt, max_qtree_level, x, node_weights);
     } else {
-      qt = QuadTree_new_from_point_list(dim, n, max_qtree_level, x, NULL);
+      FlatQuadTree_build(qt, max_qtree_level, x, NULL);
     }
 
 #ifdef TIME
@@ -583,7 +657,23 @@ void spring_electrical_embedding_fast(int dim, SparseMatrix A0, spring_electrica
     start = clock();
 #endif
 
-    QuadTree_get_repulsive_force(qt, force, x, ctrl->bh, p, KP, counts, flag);
+    if (ctrl->fmm_order > 0 && dim == 2 && p == -1){
+      FlatQuadTree_get_fmm_forces(qt, force, ctrl->bh, KP, ctrl->fmm_order, counts);
+      if (ctrl->use_node_weights){
+	for (i = 0; i < n; i++){
+	  for (k = 0; k < dim; k++) force[i*dim+k] *= node_weights[i];
+	}
+      }
+    } else if (ctrl->nthreads > 0){
+      FlatQuadTree_get_node_forces(qt, force, ctrl->bh, p, KP, counts, ctrl->nthreads);
+      if (ctrl->use_node_weights){
+	for (i = 0; i < n; i++){
+	  for (k = 0; k < dim; k++) force[i*dim+k] *= node_weights[i];
+	}
+      }
+    } else {
+      FlatQuadTree_get_repulsive_force(qt, force, x, ctrl->bh, p, KP, counts, flag);
+    }
 
     assert(!(*flag));
 
@@ -593,15 +683,12 @@ void spring_electrical_embedding_fast(int dim, SparseMatrix A0, spring_electrica
 #endif
 
     /* attractive force   C^((2-p)/3) ||x_i-x_j||/K * (x_j - x_i) */
+#ifdef _OPENMP
+#pragma omp parallel for private(f) schedule(static) num_threads(MAX(ctrl->nthreads, 1)) if (ctrl->nthreads > 1)
+#endif
     for (i = 0; i < n; i++){
       f = &(force[i*dim]);
-      for (j = ia[i]; j < ia[i+1]; j++){
-	if (ja[j] == i) continue;
-	dist = distance(x, dim, i, ja[j]);
-	for (k = 0; k < dim; k++){
-	  f[k] -= CRK*(x[i*dim+k] - x[ja[j]*dim+k])*dist;
-	}
-      }
+      attractive_force(dim, x, i, ja, ia[i], ia[i+1], CRK, f);
     }
 
 
@@ -619,15 +706,6 @@ void spring_electrical_embedding_fast(int dim, SparseMatrix A0, spring_electrica
 
 
     if (qt) {
-#ifdef TIME
-      start = clock();
-#endif
-      QuadTree_delete(qt);
-#ifdef TIME
-      end = clock();
-      qtree_new_cpu += ((real) (end - start)) / CLOCKS_PER_SEC;
-#endif
-
 #ifdef TIME
       qtree_cpu0 = qtree_cpu - qtree_cpu0;
       qtree_new_cpu0 = qtree_new_cpu - qtree_new_cpu0;
@@ -651,6 +729,7 @@ void spring_electrical_embedding_fast(int dim, SparseMatrix A0, spring_electrica
     }
 
     step = update_step(adaptive_cooling, step, Fnorm, Fnorm0, cool);
+    if (convStep(&cm, -1, conv_disp(&cm, dim, n, x, xold))) break;
   } while (step > tol && iter < maxiter);
 
 #ifdef DEBUG_PRINT
@@ -679,6 +758,7 @@ void spring_electrical_embedding_fast(int dim, SparseMatrix A0, spring_electrica
   if (xold) FREE(xold);
   if (A != A0) SparseMatrix_delete(A);
   if (force) FREE(force);
+  FlatQuadTree_delete(qt);
 
 }
 
@@ -691,7 +771,8 @@ void spring_electrical_embedding_slow(int dim, SparseMatrix A0, spring_electrica
   int i, j, k;
   real p = ctrl->p, K = ctrl->K, C = ctrl->C, CRK, tol = ctrl->tol, maxiter = ctrl->maxiter, cool = ctrl->cool, step = ctrl->step, KP;
   int *ia = NULL, *ja = NULL;
-  real *xold = NULL;
+  sreal *xold = NULL;
+  convmon_t cm;
   real *f = NULL, dist, F, Fnorm = 0, Fnorm0;
   int iter = 0;
   int adaptive_cooling = ctrl->adaptive_cooling;
@@ -735,7 +816,7 @@ void spring_electrical_embedding_slow(int dim, SparseMatrix A0, spring_electrica
   ja = A->ja;
 
   if (ctrl->random_start){
-    srand(ctrl->random_seed);
+    gvsrand(ctrl->random_seed);
     for (i = 0; i < dim*n; i++) x[i] = drand();
   }
   if (K < 0){
@@ -759,12 +840,13 @@ void spring_electrical_embedding_slow(int dim, SparseMatrix A0, spring_electrica
 #endif
 
   f = MALLOC(sizeof(real)*dim);
-  xold = MALLOC(sizeof(real)*dim*n);
+  convInit(&cm, &ctrl->conv, "sfdp", (int) maxiter);
+  if (convActive(&cm)) xold = MALLOC(sizeof(sreal)*dim*n);
   do {
     for (i = 0; i < dim*n; i++) force[i] = 0;
 
     iter++;
-    xold = MEMCPY(xold, x, sizeof(real)*dim*n);
+    conv_save(dim, n, x, xold);
     Fnorm0 = Fnorm;
     Fnorm = 0.;
     nsuper_avg = 0;
@@ -892,6 +974,7 @@ void spring_electrical_embedding_slow(int dim, SparseMatrix A0, spring_electrica
 
 
     step = update_step(adaptive_cooling, step, Fnorm, Fnorm0, cool);
+    if (convStep(&cm, -1, conv_disp(&cm, dim, n, x, xold))) break;
   } while (step > tol && iter < maxiter);
 
 #ifdef DEBUG_PRINT
@@ -952,17 +1035,17 @@ void spring_electrical_embedding(int dim, SparseMatrix A0, spring_electrical_con
   int i, j, k;
   real p = ctrl->p, K = ctrl->K, C = ctrl->C, CRK, tol = ctrl->tol, maxiter = ctrl->maxiter, cool = ctrl->cool, step = ctrl->step, KP;
   int *ia = NULL, *ja = NULL;
-  real *xold = NULL;
+  sreal *xold = NULL;
+  convmon_t cm;
   real *f = NULL, dist, F, Fnorm = 0, Fnorm0;
   int iter = 0;
   int adaptive_cooling = ctrl->adaptive_cooling;
-  QuadTree qt = NULL;
+  FlatQuadTree fqt = NULL;
+  real *rforce = NULL, qcounts[4];
   int USE_QT = FALSE;
-  int nsuper = 0, nsupermax = 10;
-  real *center = NULL, *supernode_wgts = NULL, *distances = NULL, nsuper_avg, counts = 0, counts_avg = 0;
+  real nsuper_avg, counts_avg = 0;
 #ifdef TIME
-  clock_t start, end, start0, start2;
-  real qtree_cpu = 0, qtree_cpu0 = 0;
+  clock_t start0, start2;
   real total_cpu = 0;
   start0 = clock();
 #endif
@@ -977,9 +1060,11 @@ void spring_electrical_embedding(int dim, SparseMatrix A0, spring_electrical_con
   if (n >= ctrl->quadtree_size) {
     USE_QT = TRUE;
     qtree_level_optimizer = oned_optimizer_new(max_qtree_level);
-    center = MALLOC(sizeof(real)*nsupermax*dim);
-    supernode_wgts = MALLOC(sizeof(real)*nsupermax);
-    distances = MALLOC(sizeof(real)*nsupermax);
+    /* the repulsive force on node i only depends on the positions at the start of the
+       sweep, since i has not moved yet when it is reached. So these can all be found up
+       front, in parallel or by FMM, leaving only the attractive force to the sequential sweep. */
+    fqt = FlatQuadTree_new(dim, n);
+    rforce = MALLOC(sizeof(real)*dim*n);
   }
   *flag = 0;
   if (m != n) {
@@ -992,7 +1077,7 @@ void spring_electrical_embedding(int dim, SparseMatrix A0, spring_electrical_con
   ja = A->ja;
 
   if (ctrl->random_start){
-    srand(ctrl->random_seed);
+    gvsrand(ctrl->random_seed);
     for (i = 0; i < dim*n; i++) x[i] = drand();
   }
   if (K < 0){
@@ -1016,7 +1101,8 @@ void spring_electrical_embedding(int dim, SparseMatrix A0, spring_electrical_con
 #endif
 
   f = MALLOC(sizeof(real)*dim);
-  xold = MALLOC(sizeof(real)*dim*n);
+  convInit(&cm, &ctrl->conv, "sfdp", (int) maxiter);
+  if (convActive(&cm)) xold = MALLOC(sizeof(sreal)*dim*n);
   do {
 
     //#define VIS_MULTILEVEL
@@ -1046,22 +1132,20 @@ void spring_electrical_embedding(int dim, SparseMatrix A0, spring_electrical_con
 #endif
 
     iter++;
-    xold = MEMCPY(xold, x, sizeof(real)*dim*n);
+    conv_save(dim, n, x, xold);
     Fnorm0 = Fnorm;
     Fnorm = 0.;
     nsuper_avg = 0;
     counts_avg = 0;
 
     if (USE_QT) {
-
       max_qtree_level = oned_optimizer_get(qtree_level_optimizer);
-      if (ctrl->use_node_weights){
-	qt = QuadTree_new_from_point_list(dim, n, max_qtree_level, x, node_weights);
+      FlatQuadTree_build(fqt, max_qtree_level, x, ctrl->use_node_weights ? node_weights : NULL);
+      if (ctrl->fmm_order > 0 && dim == 2 && p == -1){
+	FlatQuadTree_get_fmm_forces(fqt, rforce, ctrl->bh, KP, ctrl->fmm_order, qcounts);
       } else {
-	qt = QuadTree_new_from_point_list(dim, n, max_qtree_level, x, NULL);
+	FlatQuadTree_get_node_forces(fqt, rforce, ctrl->bh, p, KP, qcounts, ctrl->nthreads);
       }
-
-	
     }
 #ifdef TIME
     start2 = clock();
@@ -1070,39 +1154,11 @@ void spring_electrical_embedding(int dim, SparseMatrix A0, spring_electrical_con
     for (i = 0; i < n; i++){
       for (k = 0; k < dim; k++) f[k] = 0.;
       /* attractive force   C^((2-p)/3) ||x_i-x_j||/K * (x_j - x_i) */
-      for (j = ia[i]; j < ia[i+1]; j++){
-	if (ja[j] == i) continue;
-	dist = distance(x, dim, i, ja[j]);
-	for (k = 0; k < dim; k++){
-	  f[k] -= CRK*(x[i*dim+k] - x[ja[j]*dim+k])*dist;
-	}
-      }
+      attractive_force(dim, x, i, ja, ia[i], ia[i+1], CRK, f);
 
       /* repulsive force K^(1 - p)/||x_i-x_j||^(1 - p) (x_i - x_j) */
       if (USE_QT){
-#ifdef TIME
-	start = clock();
-#endif
-	QuadTree_get_supernodes(qt, ctrl->bh, &(x[dim*i]), i, &nsuper, &nsupermax,
-				&center, &supernode_wgts, &distances, &counts, flag);
-
-#ifdef TIME
-	end = clock();
-	qtree_cpu += ((real) (end - start)) / CLOCKS_PER_SEC;
-#endif
-	counts_avg += counts;
-	nsuper_avg += nsuper;
-	if (*flag) goto RETURN;
-	for (j = 0; j < nsuper; j++){
-	  dist = MAX(distances[j], MINDIST);
-	  for (k = 0; k < dim; k++){
-	    if (p == -1){
-	      f[k] += supernode_wgts[j]*KP*(x[i*dim+k] - center[j*dim+k])/(dist*dist);
-	    } else {
-	      f[k] += supernode_wgts[j]*KP*(x[i*dim+k] - center[j*dim+k])/pow(dist, 1.- p);
-	    }
-	  }
-	}
+	for (k = 0; k < dim; k++) f[k] += rforce[i*dim+k];
       } else {
 	if (ctrl->use_node_weights && node_weights){
 	  for (j = 0; j < n; j++){
@@ -1143,16 +1199,9 @@ void spring_electrical_embedding(int dim, SparseMatrix A0, spring_electrical_con
 
     }/* done vertex i */
 
-    if (qt) {
-      QuadTree_delete(qt);
-      nsuper_avg /= n;
-      counts_avg /= n;
-#ifdef TIME
-      qtree_cpu0 = qtree_cpu - qtree_cpu0;
-      if (Verbose && 0) fprintf(stderr, "\n cpu this outer iter = %f, quadtree time = %f other time = %f\n",((real) (clock() - start2)) / CLOCKS_PER_SEC, qtree_cpu0,((real) (clock() - start2))/CLOCKS_PER_SEC - qtree_cpu0);
-      qtree_cpu0 = qtree_cpu;
-#endif
-      if (Verbose & 0) fprintf(stderr, "nsuper_avg=%f, counts_avg = %f 2*nsuper+counts=%f\n",nsuper_avg,counts_avg, 2*nsuper_avg+counts_avg);
+    if (USE_QT) {
+      nsuper_avg = qcounts[0] + qcounts[1];
+      counts_avg = qcounts[2];
       oned_optimizer_train(qtree_level_optimizer, 5*nsuper_avg + counts_avg);
     }
 
@@ -1165,6 +1214,7 @@ void spring_electrical_embedding(int dim, SparseMatrix A0, spring_electrical_con
 
 
     step = update_step(adaptive_cooling, step, Fnorm, Fnorm0, cool);
+    if (convStep(&cm, -1, conv_disp(&cm, dim, n, x, xold))) break;
   } while (step > tol && iter < maxiter);
 
 #ifdef DEBUG_PRINT
@@ -1198,7 +1248,7 @@ void spring_electrical_embedding(int dim, SparseMatrix A0, spring_electrical_con
 
 #ifdef TIME
   total_cpu += ((real) (clock() - start0)) / CLOCKS_PER_SEC;
-  if (Verbose) fprintf(stderr, "time for supernode = %f, total cpu = %f\n",qtree_cpu, total_cpu);
+  if (Verbose) fprintf(stderr, "total cpu = %f\n", total_cpu);
 #endif
 
  RETURN:
@@ -1209,9 +1259,8 @@ void spring_electrical_embedding(int dim, SparseMatrix A0, spring_electrical_con
   if (xold) FREE(xold);
   if (A != A0) SparseMatrix_delete(A);
   if (f) FREE(f);
-  if (center) FREE(center);
-  if (supernode_wgts) FREE(supernode_wgts);
-  if (distances) FREE(distances);
+  if (rforce) FREE(rforce);
+  FlatQuadTree_delete(fqt);
 
 }
 
@@ -1332,7 +1381,7 @@ void spring_maxent_embedding(int dim, SparseMatrix A0, SparseMatrix D, spring_el
 
   if (ctrl->random_start){
     fprintf(stderr, "send random coordinates\n");
-    srand(ctrl->random_seed);
+    gvsrand(ctrl->random_seed);
     for (i = 0; i < dim*n; i++) x[i] = drand();
   /* rescale x to give minimum stress:
      Min \Sum_{(i,j)\in E} w_ij (s ||x_i-x_j||-d_ij)^2
@@ -1577,7 +1626,7 @@ void spring_electrical_spring_embedding(int dim, SparseMatrix A0, SparseMatrix D
   d = (real*) D->a;
 
   if (ctrl->random_start){
-    srand(ctrl->random_seed);
+    gvsrand(ctrl->random_seed);
     for (i = 0; i < dim*n; i++) x[i] = drand();
   }
   if (K < 0){
@@ -2105,7 +2154,7 @@ static void multilevel_spring_electrical_embedding_core(int dim, SparseMatrix A0
     assert(!(*flag));
     attach_edge_label_coordinates(dim, A, n_edge_label_nodes, edge_label_nodes, x, x2);
     remove_overlap(dim, A, x, label_sizes, ctrl->overlap, ctrl->initial_scaling,
-		   ctrl->edge_labeling_scheme, n_edge_label_nodes, edge_label_nodes, A, ctrl->do_shrinking, flag);
+		   ctrl->edge_labeling_scheme, n_edge_label_nodes, edge_label_nodes, A, ctrl->do_shrinking, &ctrl->conv, flag);
     SparseMatrix_delete(A2);
     FREE(x2);
     if (A != A0) SparseMatrix_delete(A);
@@ -2115,6 +2164,8 @@ static void multilevel_spring_electrical_embedding_core(int dim, SparseMatrix A0
 
   mctrl = Multilevel_control_new(ctrl->multilevel_coarsen_scheme, ctrl->multilevel_coarsen_mode);
   mctrl->maxlevel = ctrl->multilevels;
+  mctrl->nthreads = ctrl->nthreads;
+  mctrl->seed = ctrl->random_seed;
   grid0 = Multilevel_new(A, D, node_weights, mctrl);
 
   grid = Multilevel_get_coarsest(grid0);
@@ -2225,7 +2276,7 @@ static void multilevel_spring_electrical_embedding_core(int dim, SparseMatrix A0
 
 
   remove_overlap(dim, A, x, label_sizes, ctrl->overlap, ctrl->initial_scaling,
-		 ctrl->edge_labeling_scheme, n_edge_label_nodes, edge_label_nodes, A, ctrl->do_shrinking, flag);
+		 ctrl->edge_labeling_scheme, n_edge_label_nodes, edge_label_nodes, A, ctrl->do_shrinking, &ctrl->conv, flag);
 
  RETURN:
   *ctrl = ctrl0;
@@ -15,6 +15,7 @@
 #define SPRING_ELECTRICAL_H
 
 #include <SparseMatrix.h>
+#include "converge.h"
 
 enum {ERROR_NOT_SQUARE_MATRIX = -100};
 
@@ -63,6 +64,10 @@ struct spring_electrical_control_struct {
 			       0 (no action, default), 1 (penalty based method to make that kind of node close to the center of its neighbor), 
 			       1 (penalty based method to make that kind of node close to the old center of its neighbor),
 			       3 (two step process of overlap removal and straightening) */
+  int nthreads;/* if > 0, repulsive forces are computed node by node, shared among this many threads */
+  int fmm_order;/* if > 0, repulsive forces are computed by the fast multipole method with expansions
+		   of this order. Only for dim = 2 and p = -1; Barnes-Hut is used otherwise */
+  convparms_t conv;/* time budget and relative tolerance, see converge.h */
 };
 
 typedef struct  spring_electrical_control_struct  *spring_electrical_control; 
@@ -26,7 +26,7 @@ void stress_model_core(int dim, SparseMatrix B, real **x, int edge_len_weighted,
   m = A->m;
   if (!x) {
     *x = MALLOC(sizeof(real)*m*dim);
-    srand(123);
+    gvsrand(123);
     for (i = 0; i < dim*m; i++) (*x)[i] = drand();
   }
 
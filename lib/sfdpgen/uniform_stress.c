@@ -46,6 +46,7 @@ UniformStressSmoother UniformStressSmoother_new(int dim, SparseMatrix A, real *x
   sm->data_deallocator = FREE;
   sm->tol_cg = 0.01;
   sm->maxit_cg = (int)sqrt((double) A->m);
+  sm->solve_method = SOLVE_METHOD_CG;
 
   /* Lw and Lwd have diagonals */
   sm->Lw = SparseMatrix_new(m, m, A->nz + m, MATRIX_TYPE_REAL, FORMAT_CSR);
@@ -153,7 +154,7 @@ void uniform_stress(int dim, SparseMatrix A, real *x, int *flag){
   }
 
   if (samepoint){
-    srand(1);
+    gvsrand(1);
 #ifdef DEBUG_PRINT
     fprintf(stderr,"input coordinates to uniform_stress are the same, use random coordinates as initial input");
 #endif
@@ -38,6 +38,8 @@ Multilevel_control Multilevel_control_new(int scheme, int mode){
 
   ctrl->coarsen_scheme = scheme;
   ctrl->coarsen_mode = mode;
+  ctrl->nthreads = 0;
+  ctrl->seed = 123;
   return ctrl;
 }
 
@@ -628,6 +630,189 @@ static void maximal_independent_edge_set_heavest_edge_pernode_supernodes_first(S
   FREE(matched);
 }
 
+static unsigned int edge_hash(int i, int j, unsigned int seed){
+  /* a symmetric pseudo random key for edge {i,j}, used to break ties between equally heavy edges */
+  unsigned int h;
+  if (i > j) {
+    h = (unsigned int) i; i = j; j = (int) h;
+  }
+  h = seed ^ ((unsigned int) i*0x9E3779B1u);
+  h ^= h >> 15; h *= 0x85EBCA77u;
+  h ^= (unsigned int) j*0xC2B2AE3Du;
+  h ^= h >> 13; h *= 0x27D4EB2Fu;
+  h ^= h >> 16;
+  return h;
+}
+
+static void maximal_independent_edge_set_handshake(SparseMatrix A, unsigned int seed, int nthreads, int **cluster, int **clusterp, int *ncluster){
+  /* heavy edge matching by handshaking: in each round every unmatched node points to its heaviest
+     unmatched neighbor, and pairs of nodes pointing at each other are matched. Ties are broken by a
+     hash of the edge and the seed, so the key of an edge is the same seen from both ends, the heaviest
+     remaining edge is always matched and the result does not depend on the number of threads.
+     Rounds are done in parallel with nthreads threads; the few nodes left after MAX_ROUNDS are matched greedily. */
+  enum {MAX_ROUNDS = 16};
+  int i, j, m = A->m, *ia = A->ia, *ja = A->ja, *mate, *cand, nz, round, nmatched;
+  real *a = NULL;
+
+  assert(A->m == A->n);
+  assert(SparseMatrix_known_strucural_symmetric(A));
+  if (A->type == MATRIX_TYPE_REAL) a = (real*) A->a;
+
+  *cluster = N_GNEW(m,int);
+  *clusterp = N_GNEW((m+1),int);
+  mate = N_GNEW(m,int);
+  cand = N_GNEW(m,int);
+
+  for (i = 0; i < m; i++) mate[i] = -1;
+
+  for (round = 0; round < MAX_ROUNDS; round++){
+    nmatched = 0;
+#ifdef _OPENMP
+#pragma omp parallel for private(j) schedule(dynamic, 1024) num_threads(MAX(nthreads, 1))
+#endif
+    for (i = 0; i < m; i++){
+      real w, wmax = 0;
+      unsigned int h, hmax = 0;
+      cand[i] = -1;
+      if (mate[i] >= 0) continue;
+      for (j = ia[i]; j < ia[i+1]; j++){
+	if (ja[j] == i || mate[ja[j]] >= 0) continue;
+	w = a ? a[j] : 1.;
+	h = edge_hash(i, ja[j], seed);
+	if (cand[i] < 0 || w > wmax || (w == wmax && h > hmax)){
+	  cand[i] = ja[j];
+	  wmax = w;
+	  hmax = h;
+	}
+      }
+    }
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+:nmatched) schedule(static) num_threads(MAX(nthreads, 1))
+#endif
+    for (i = 0; i < m; i++){
+      if (cand[i] >= 0 && cand[cand[i]] == i){
+	mate[i] = cand[i];
+	nmatched++;
+      }
+    }
+    if (nmatched == 0) break;
+  }
+
+  /* greedy clean up, so that the matching is maximal */
+  if (round == MAX_ROUNDS){
+    for (i = 0; i < m; i++){
+      if (mate[i] >= 0) continue;
+      for (j = ia[i]; j < ia[i+1]; j++){
+	if (ja[j] != i && mate[ja[j]] < 0){
+	  mate[i] = ja[j];
+	  mate[ja[j]] = i;
+	  break;
+	}
+      }
+    }
+  }
+
+  *ncluster = 0;
+  (*clusterp)[0] = 0;
+  nz = 0;
+  for (i = 0; i < m; i++){
+    if (mate[i] >= 0 && mate[i] < i) continue;
+    (*cluster)[nz++] = i;
+    if (mate[i] >= 0) (*cluster)[nz++] = mate[i];
+    (*clusterp)[++(*ncluster)] = nz;
+  }
+  assert(nz == m);
+
+  FREE(mate);
+  FREE(cand);
+}
+
+static SparseMatrix cluster_galerkin_product(SparseMatrix A, int ncluster, int *clusterp, int *cluster, int nthreads){
+  /* the coarse matrix R A P for the piecewise constant prolongation P defined by the clusters,
+     i.e., entry (I,J) is the sum of A(i,j) over i in cluster I and j in cluster J. Rows of the
+     coarse matrix are formed in parallel with nthreads threads. The result is identical
+     for any number of threads. */
+  SparseMatrix C;
+  int *ia = A->ia, *ja = A->ja, *map, *cia, *cja, I, i;
+  real *a = NULL, *ca;
+
+  assert(A->m == A->n && A->format == FORMAT_CSR);
+  if (A->type == MATRIX_TYPE_REAL) a = (real*) A->a;
+
+  map = N_GNEW(A->m,int);
+  cia = N_GNEW((ncluster+1),int);
+  for (I = 0; I < ncluster; I++){
+    for (i = clusterp[I]; i < clusterp[I+1]; i++) map[cluster[i]] = I;
+  }
+
+  /* symbolic pass: number of nonzeros of each coarse row */
+  cia[0] = 0;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(MAX(nthreads, 1))
+#endif
+  {
+    int *mask = N_GNEW(ncluster,int), II, ii, jj, nz;
+
+    for (II = 0; II < ncluster; II++) mask[II] = -1;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 256)
+#endif
+    for (II = 0; II < ncluster; II++){
+      nz = 0;
+      for (ii = clusterp[II]; ii < clusterp[II+1]; ii++){
+	for (jj = ia[cluster[ii]]; jj < ia[cluster[ii]+1]; jj++){
+	  if (mask[map[ja[jj]]] != II){
+	    mask[map[ja[jj]]] = II;
+	    nz++;
+	  }
+	}
+      }
+      cia[II+1] = nz;
+    }
+    FREE(mask);
+  }
+  for (I = 0; I < ncluster; I++) cia[I+1] += cia[I];
+
+  C = SparseMatrix_new(ncluster, ncluster, cia[ncluster], MATRIX_TYPE_REAL, FORMAT_CSR);
+  FREE(C->ia);
+  C->ia = cia;
+  cja = C->ja;
+  ca = (real*) C->a;
+
+  /* numeric pass */
+#ifdef _OPENMP
+#pragma omp parallel num_threads(MAX(nthreads, 1))
+#endif
+  {
+    int *mask = N_GNEW(ncluster,int), II, ii, jj, J, nz;
+
+    for (II = 0; II < ncluster; II++) mask[II] = -1;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 256)
+#endif
+    for (II = 0; II < ncluster; II++){
+      nz = cia[II];
+      for (ii = clusterp[II]; ii < clusterp[II+1]; ii++){
+	for (jj = ia[cluster[ii]]; jj < ia[cluster[ii]+1]; jj++){
+	  J = map[ja[jj]];
+	  if (mask[J] < cia[II]){
+	    mask[J] = nz;
+	    cja[nz] = J;
+	    ca[nz++] = a ? a[jj] : 1.;
+	  } else {
+	    ca[mask[J]] += a ? a[jj] : 1.;
+	  }
+	}
+      }
+    }
+    FREE(mask);
+  }
+  C->nz = cia[ncluster];
+
+  FREE(map);
+  return C;
+}
+
 static int scomp(const void *s1, const void *s2){
   real *ss1, *ss2;
   ss1 = (real*) s1;
@@ -1014,7 +1199,9 @@ static void Multilevel_coarsen_internal(SparseMatrix A, SparseMatrix *cA, Sparse
   case  COARSEN_INDEPENDENT_EDGE_SET_HEAVEST_EDGE_PERNODE_SUPERNODES_FIRST:
   case  COARSEN_INDEPENDENT_EDGE_SET_HEAVEST_CLUSTER_PERNODE_LEAVES_FIRST:
   case COARSEN_INDEPENDENT_EDGE_SET_HEAVEST_EDGE_PERNODE_LEAVES_FIRST:
-    if (ctrl->coarsen_scheme == COARSEN_INDEPENDENT_EDGE_SET_HEAVEST_EDGE_PERNODE_LEAVES_FIRST) {
+    if (ctrl->nthreads > 0) {
+      maximal_independent_edge_set_handshake(A, (unsigned int) ctrl->seed, ctrl->nthreads, &cluster, &clusterp, &ncluster);
+    } else if (ctrl->coarsen_scheme == COARSEN_INDEPENDENT_EDGE_SET_HEAVEST_EDGE_PERNODE_LEAVES_FIRST) {
       maximal_independent_edge_set_heavest_edge_pernode_leaves_first(A, ctrl->randomize, &cluster, &clusterp, &ncluster);
     } else if (ctrl->coarsen_scheme == COARSEN_INDEPENDENT_EDGE_SET_HEAVEST_EDGE_PERNODE_SUPERNODES_FIRST) {
       maximal_independent_edge_set_heavest_edge_pernode_supernodes_first(A, ctrl->randomize, &cluster, &clusterp, &ncluster);
@@ -1048,7 +1235,11 @@ static void Multilevel_coarsen_internal(SparseMatrix A, SparseMatrix *cA, Sparse
 
     *cD = DistanceMatrix_restrict_cluster(ncluster, clusterp, cluster, *P, *R, D);
 
-    *cA = SparseMatrix_multiply3(*R, A, *P); 
+    if (ctrl->nthreads > 0) {
+      *cA = cluster_galerkin_product(A, ncluster, clusterp, cluster, ctrl->nthreads);
+    } else {
+      *cA = SparseMatrix_multiply3(*R, A, *P); 
+    }
 
     /*
       B = SparseMatrix_multiply(*R, A);
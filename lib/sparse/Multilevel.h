@@ -48,6 +48,8 @@ struct Multilevel_control_struct {
   int randomize;
   int coarsen_scheme;
   int coarsen_mode;
+  int nthreads;/* if > 0, edge set schemes use parallel handshake matching and form the coarse matrix with this many threads */
+  int seed;/* seed of the tie breaking in handshake matching */
 };
 
 typedef struct Multilevel_control_struct *Multilevel_control;
@@ -11,6 +11,8 @@
  * Contributors: See CVS logs. Details at http://www.graphviz.org/
  *************************************************************************/
 
+#include "config.h"
+
 #include "general.h"
 #include "geom.h"
 #include "arith.h"
@@ -18,6 +20,11 @@
 #include "LinkedList.h"
 #include "QuadTree.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define FORCE2_SIMD
+#include <immintrin.h>
+#endif
+
 extern real distance_cropped(real *x, int dim, int i, int j);
 
 struct node_data_struct {
@@ -735,3 +742,942 @@ void QuadTree_get_nearest(QuadTree qt, real *x, real *ymin, int *imin, real *min
 
 
 }
+
+FlatQuadTree FlatQuadTree_new(int dim, int n){
+  FlatQuadTree qt;
+
+  qt = MALLOC(sizeof(struct FlatQuadTree_struct));
+  qt->dim = dim;
+  qt->n = n;
+  qt->max_level = 0;
+  qt->ncells = 0;
+  qt->ncells_max = MAX(16, 2*n);
+  qt->cells = MALLOC(sizeof(FlatQuadTree_cell)*qt->ncells_max);
+  qt->center = MALLOC(sizeof(sreal)*dim*qt->ncells_max);
+  qt->average = MALLOC(sizeof(sreal)*dim*qt->ncells_max);
+  qt->force = MALLOC(sizeof(real)*dim*qt->ncells_max);
+  qt->id = MALLOC(sizeof(int)*n);
+  qt->coord = MALLOC(sizeof(sreal)*dim*n);
+  qt->weight = MALLOC(sizeof(sreal)*n);
+  qt->code = MALLOC(sizeof(uint64_t)*n);
+  qt->code_tmp = MALLOC(sizeof(uint64_t)*n);
+  qt->id_tmp = MALLOC(sizeof(int)*n);
+  return qt;
+}
+
+void FlatQuadTree_delete(FlatQuadTree qt){
+  if (!qt) return;
+  FREE(qt->cells);
+  FREE(qt->center);
+  FREE(qt->average);
+  FREE(qt->force);
+  FREE(qt->id);
+  FREE(qt->coord);
+  FREE(qt->weight);
+  FREE(qt->code);
+  FREE(qt->code_tmp);
+  FREE(qt->id_tmp);
+  FREE(qt);
+}
+
+static void FlatQuadTree_grow(FlatQuadTree qt, int ncells){
+  int dim = qt->dim;
+
+  if (ncells <= qt->ncells_max) return;
+  qt->ncells_max = MAX(ncells, 2*qt->ncells_max);
+  qt->cells = REALLOC(qt->cells, sizeof(FlatQuadTree_cell)*qt->ncells_max);
+  qt->center = REALLOC(qt->center, sizeof(sreal)*dim*qt->ncells_max);
+  qt->average = REALLOC(qt->average, sizeof(sreal)*dim*qt->ncells_max);
+  qt->force = REALLOC(qt->force, sizeof(real)*dim*qt->ncells_max);
+}
+
+static void FlatQuadTree_sort(FlatQuadTree qt, int nbits){
+  /* LSD radix sort of the Morton codes, 8 bits at a time, carrying the point ids along.
+     The sort is stable, so points with the same code stay in index order. */
+  int n = qt->n, i, shift, cnt[257];
+  uint64_t *code = qt->code, *code2 = qt->code_tmp, *ctmp;
+  int *id = qt->id, *id2 = qt->id_tmp, *itmp, d;
+
+  for (shift = 0; shift < nbits; shift += 8){
+    for (i = 0; i < 257; i++) cnt[i] = 0;
+    for (i = 0; i < n; i++) cnt[((code[i] >> shift) & 0xff) + 1]++;
+    for (i = 0; i < 256; i++) cnt[i+1] += cnt[i];
+    for (i = 0; i < n; i++){
+      d = cnt[(code[i] >> shift) & 0xff]++;
+      code2[d] = code[i];
+      id2[d] = id[i];
+    }
+    ctmp = code; code = code2; code2 = ctmp;
+    itmp = id; id = id2; id2 = itmp;
+  }
+  qt->code = code; qt->code_tmp = code2;
+  qt->id = id; qt->id_tmp = id2;
+}
+
+void FlatQuadTree_build(FlatQuadTree qt, int max_level, real *coord, real *weight){
+  /* build the tree on the points coord, replacing whatever was there before. The cells
+     are the same as those of QuadTree_new_from_point_list: a cell is split into 2^dim
+     quadrants if it has more than one point and is above max_level, and empty quadrants
+     are not created. */
+  int dim = qt->dim, n = qt->n, i, j, k, c, lev, first, nchild, shift;
+  int mask = (1<<dim) - 1;
+  real xmin[64], xmax[64], sum[64], width, scale, t, w, wsum;
+  uint64_t q, side, digit, d;
+  FlatQuadTree_cell *cell;
+  sreal *average, *avg2;
+
+  assert(dim > 0 && dim <= 63);
+  max_level = MIN(max_level, 63/dim);
+  qt->max_level = max_level;
+
+  /* bounding box, as in QuadTree_new_from_point_list */
+  for (k = 0; k < dim; k++) xmin[k] = xmax[k] = coord[k];
+  for (i = 1; i < n; i++){
+    for (k = 0; k < dim; k++){
+      xmin[k] = MIN(xmin[k], coord[i*dim+k]);
+      xmax[k] = MAX(xmax[k], coord[i*dim+k]);
+    }
+  }
+  width = 0;
+  for (k = 0; k < dim; k++) width = MAX(width, xmax[k] - xmin[k]);
+  if (width == 0) width = 0.00001;
+  width *= 0.52;
+  for (k = 0; k < dim; k++) xmin[k] = (xmin[k] + xmax[k])*0.5 - width;
+
+  /* Morton codes: bit l*dim+k of the code, counted from the top, says which half of the
+     level-l cell the point lies in along dimension k */
+  side = ((uint64_t) 1) << max_level;
+  scale = ((real) side)/(2*width);
+  for (i = 0; i < n; i++){
+    q = 0;
+    for (k = 0; k < dim; k++){
+      t = (coord[i*dim+k] - xmin[k])*scale;
+      d = (t <= 0) ? 0 : (t >= side) ? side - 1 : (uint64_t) t;
+      for (lev = 0; lev < max_level; lev++){
+	q |= ((d >> lev) & 1) << (lev*dim + k);
+      }
+    }
+    qt->code[i] = q;
+    qt->id[i] = i;
+  }
+  FlatQuadTree_sort(qt, max_level*dim);
+
+  for (i = 0; i < n; i++){
+    j = qt->id[i];
+    for (k = 0; k < dim; k++) qt->coord[i*dim+k] = coord[j*dim+k];
+    qt->weight[i] = weight ? weight[j] : 1;
+  }
+
+  /* cells, breadth first */
+  qt->ncells = 1;
+  cell = &(qt->cells[0]);
+  cell->first = 0;
+  cell->last = n;
+  cell->level = 0;
+  cell->width = width;
+  for (k = 0; k < dim; k++) qt->center[k] = xmin[k] + width;
+  for (c = 0; c < qt->ncells; c++){
+    cell = &(qt->cells[c]);
+    cell->child = qt->ncells;
+    cell->nchild = 0;
+    if (cell->last - cell->first <= 1 || cell->level >= max_level) continue;
+
+    shift = dim*(max_level - 1 - cell->level);
+    nchild = 1;
+    for (i = cell->first + 1; i < cell->last; i++){
+      if (((qt->code[i] ^ qt->code[i-1]) >> shift) & mask) nchild++;
+    }
+    FlatQuadTree_grow(qt, qt->ncells + nchild);
+    cell = &(qt->cells[c]);
+    cell->nchild = nchild;
+
+    first = cell->first;
+    for (i = cell->first + 1; i <= cell->last; i++){
+      if (i < cell->last && !(((qt->code[i] ^ qt->code[i-1]) >> shift) & mask)) continue;
+      digit = (qt->code[first] >> shift) & mask;
+      j = qt->ncells++;
+      qt->cells[j].first = first;
+      qt->cells[j].last = i;
+      qt->cells[j].level = cell->level + 1;
+      w = qt->cells[j].width = cell->width/2;
+      for (k = 0; k < dim; k++){
+	qt->center[j*dim+k] = qt->center[c*dim+k] + (((digit >> k) & 1) ? w : -w);
+      }
+      first = i;
+    }
+  }
+
+  /* weights and averages, bottom up */
+  for (c = qt->ncells - 1; c >= 0; c--){
+    cell = &(qt->cells[c]);
+    average = &(qt->average[c*dim]);
+    for (k = 0; k < dim; k++) sum[k] = 0;
+    wsum = 0;
+    if (cell->nchild == 0){
+      for (i = cell->first; i < cell->last; i++){
+	wsum += qt->weight[i];
+	for (k = 0; k < dim; k++) sum[k] += qt->coord[i*dim+k];
+      }
+    } else {
+      for (j = cell->child; j < cell->child + cell->nchild; j++){
+	wsum += qt->cells[j].total_weight;
+	avg2 = &(qt->average[j*dim]);
+	t = qt->cells[j].last - qt->cells[j].first;
+	for (k = 0; k < dim; k++) sum[k] += t*avg2[k];
+      }
+    }
+    cell->total_weight = wsum;
+    t = cell->last - cell->first;
+    for (k = 0; k < dim; k++) average[k] = sum[k]/t;
+  }
+}
+
+static real flat_distance(sreal *p1, sreal *p2, int dim){
+  /* point_distance on the stored coordinates */
+  real dist = 0, d;
+  int i;
+
+  for (i = 0; i < dim; i++){
+    d = (real) p1[i] - p2[i];
+    dist += d*d;
+  }
+  return sqrt(dist);
+}
+
+static void FlatQuadTree_repulsive_force_interact(FlatQuadTree qt, int c1, int c2, real *x, real *force, real bh, real p, real KP, real *counts){
+  /* the same algorithm as QuadTree_repulsive_force_interact, on cells c1 and c2 */
+  FlatQuadTree_cell *q1 = &(qt->cells[c1]), *q2 = &(qt->cells[c2]);
+  sreal *x1, *x2;
+  real dist, wgt1, wgt2, f, *f1, *f2;
+  int dim = qt->dim, i, j, i1, i2, k, split, other;
+
+  /* far enough, calculate repulsive force */
+  x1 = &(qt->average[c1*dim]);
+  x2 = &(qt->average[c2*dim]);
+  dist = flat_distance(x1, x2, dim);
+  if (q1->width + q2->width < bh*dist){
+    counts[0]++;
+    wgt1 = q1->total_weight;
+    wgt2 = q2->total_weight;
+    f1 = &(qt->force[c1*dim]);
+    f2 = &(qt->force[c2*dim]);
+    assert(dist > 0);
+    for (k = 0; k < dim; k++){
+      if (p == -1){
+	f = wgt1*wgt2*KP*((real) x1[k] - x2[k])/(dist*dist);
+      } else {
+	f = wgt1*wgt2*KP*((real) x1[k] - x2[k])/pow(dist, 1.- p);
+      }
+      f1[k] += f;
+      f2[k] -= f;
+    }
+    return;
+  }
+
+  /* both at leaves, calculate repulsive force */
+  if (q1->nchild == 0 && q2->nchild == 0){
+    for (i = q1->first; i < q1->last; i++){
+      x1 = &(qt->coord[i*dim]);
+      wgt1 = qt->weight[i];
+      i1 = qt->id[i];
+      f1 = &(force[i1*dim]);
+      for (j = (c1 == c2) ? i + 1 : q2->first; j < q2->last; j++){
+	x2 = &(qt->coord[j*dim]);
+	wgt2 = qt->weight[j];
+	i2 = qt->id[j];
+	f2 = &(force[i2*dim]);
+	counts[1]++;
+	dist = distance_cropped(x, dim, i1, i2);
+	for (k = 0; k < dim; k++){
+	  if (p == -1){
+	    f = wgt1*wgt2*KP*((real) x1[k] - x2[k])/(dist*dist);
+	  } else {
+	    f = wgt1*wgt2*KP*((real) x1[k] - x2[k])/pow(dist, 1.- p);
+	  }
+	  f1[k] += f;
+	  f2[k] -= f;
+	}
+      }
+    }
+    return;
+  }
+
+  /* identical, split one */
+  if (c1 == c2){
+    for (i = q1->child; i < q1->child + q1->nchild; i++){
+      for (j = i; j < q1->child + q1->nchild; j++){
+	FlatQuadTree_repulsive_force_interact(qt, i, j, x, force, bh, p, KP, counts);
+      }
+    }
+  } else {
+    /* split the one with bigger box, or one not at the last level */
+    if (q1->width > q2->width && q1->nchild){
+      split = c1;
+    } else if (q2->width > q1->width && q2->nchild){
+      split = c2;
+    } else if (q1->nchild){/* pick one that is not at the last level */
+      split = c1;
+    } else {
+      split = c2;
+    }
+    other = (split == c1) ? c2 : c1;
+    for (i = qt->cells[split].child; i < qt->cells[split].child + qt->cells[split].nchild; i++){
+      FlatQuadTree_repulsive_force_interact(qt, i, other, x, force, bh, p, KP, counts);
+    }
+  }
+}
+
+static void FlatQuadTree_repulsive_force_accumulate(FlatQuadTree qt, real *force, real *counts){
+  /* push down forces on cells into the node level. Parents come before their
+     children in the cell array, so one forward sweep does it */
+  int dim = qt->dim, c, i, j, k;
+  FlatQuadTree_cell *cell;
+  real *f, *f2, wgt2;
+
+  for (c = 0; c < qt->ncells; c++){
+    cell = &(qt->cells[c]);
+    f = &(qt->force[c*dim]);
+    assert(cell->total_weight > 0);
+    counts[2]++;
+    if (cell->nchild == 0){
+      for (i = cell->first; i < cell->last; i++){
+	f2 = &(force[qt->id[i]*dim]);
+	wgt2 = qt->weight[i]/cell->total_weight;
+	for (k = 0; k < dim; k++) f2[k] += wgt2*f[k];
+      }
+    } else {
+      for (j = cell->child; j < cell->child + cell->nchild; j++){
+	f2 = &(qt->force[j*dim]);
+	wgt2 = qt->cells[j].total_weight/cell->total_weight;
+	for (k = 0; k < dim; k++) f2[k] += wgt2*f[k];
+      }
+    }
+  }
+}
+
+void FlatQuadTree_get_repulsive_force(FlatQuadTree qt, real *force, real *x, real bh, real p, real KP, real *counts, int *flag){
+  /* see QuadTree_get_repulsive_force. The tree must have been built on x. */
+  int n = qt->n, dim = qt->dim, i;
+
+  for (i = 0; i < 4; i++) counts[i] = 0;
+
+  *flag = 0;
+
+  for (i = 0; i < dim*n; i++) force[i] = 0;
+  for (i = 0; i < dim*qt->ncells; i++) qt->force[i] = 0;
+
+  FlatQuadTree_repulsive_force_interact(qt, 0, 0, x, force, bh, p, KP, counts);
+  FlatQuadTree_repulsive_force_accumulate(qt, force, counts);
+  for (i = 0; i < 4; i++) counts[i] /= n;
+
+}
+
+static void FlatQuadTree_node_force(FlatQuadTree qt, int i, real bh, real p, real KP, int *stack, real *f, real *counts){
+  /* add to f the repulsive force on the point at Morton position i, found by walking the tree
+     from the root. As in QuadTree_get_supernodes, a cell whose width is less than bh times its
+     distance to the point is treated as a supernode; other cells are opened, and points in
+     leaves are taken one by one. A cell containing the point itself is always opened. */
+  int dim = qt->dim, top = 0, c, j, k;
+  sreal *xi = &(qt->coord[i*dim]), *y;
+  real dist, w;
+  FlatQuadTree_cell *cell;
+
+  for (k = 0; k < dim; k++) f[k] = 0;
+  stack[top++] = 0;
+  while (top > 0){
+    c = stack[--top];
+    cell = &(qt->cells[c]);
+    counts[2]++;
+    if (i < cell->first || i >= cell->last){
+      dist = flat_distance(&(qt->center[c*dim]), xi, dim);
+      if (cell->width < bh*dist){
+	counts[0]++;
+	y = &(qt->average[c*dim]);
+	w = cell->total_weight;
+	dist = MAX(flat_distance(y, xi, dim), MINDIST);
+	for (k = 0; k < dim; k++){
+	  if (p == -1){
+	    f[k] += w*KP*((real) xi[k] - y[k])/(dist*dist);
+	  } else {
+	    f[k] += w*KP*((real) xi[k] - y[k])/pow(dist, 1.- p);
+	  }
+	}
+	continue;
+      }
+    }
+    if (cell->nchild == 0){
+      for (j = cell->first; j < cell->last; j++){
+	if (j == i) continue;
+	counts[1]++;
+	y = &(qt->coord[j*dim]);
+	w = qt->weight[j];
+	dist = MAX(flat_distance(y, xi, dim), MINDIST);
+	for (k = 0; k < dim; k++){
+	  if (p == -1){
+	    f[k] += w*KP*((real) xi[k] - y[k])/(dist*dist);
+	  } else {
+	    f[k] += w*KP*((real) xi[k] - y[k])/pow(dist, 1.- p);
+	  }
+	}
+      }
+    } else {
+      for (j = cell->child + cell->nchild - 1; j >= cell->child; j--) stack[top++] = j;
+    }
+  }
+}
+
+/* 2D kernels for p = -1. Given a point (xi, yi) and a list of m points or supernodes
+   (px[j], py[j]) with weights pw[j], add sum_j pw[j]*(xi - px[j])/d_j^2 to f[0] and likewise
+   for y, where d_j is the distance, cropped below at MINDIST. All versions split the sum over
+   the same four lanes (j mod 4, remainder separately) and combine them in the same order, so
+   they give identical results and the choice made at run time does not show in the layout.
+   With SFDP_FLOAT the points are stored as floats; the SIMD versions widen them to double
+   on loading, so the arithmetic is the same in all versions either way. */
+#define MINDIST2 (MINDIST*MINDIST)
+
+static void force2_lanes(real *fx, real *fy, real tx, real ty, real *f){
+  f[0] += ((fx[0] + fx[1]) + (fx[2] + fx[3])) + tx;
+  f[1] += ((fy[0] + fy[1]) + (fy[2] + fy[3])) + ty;
+}
+
+static void force2_tail(real xi, real yi, sreal *px, sreal *py, sreal *pw, int j, int m, real *tx, real *ty){
+  real dx, dy, d2, s;
+
+  for (; j < m; j++){
+    dx = xi - px[j];
+    dy = yi - py[j];
+    d2 = dx*dx + dy*dy;
+    if (d2 < MINDIST2) d2 = MINDIST2;
+    s = pw[j]/d2;
+    *tx += s*dx;
+    *ty += s*dy;
+  }
+}
+
+#ifndef FORCE2_SIMD
+static void force2_scalar(real xi, real yi, sreal *px, sreal *py, sreal *pw, int m, real *f){
+  real fx[4] = {0, 0, 0, 0}, fy[4] = {0, 0, 0, 0}, tx = 0, ty = 0, dx, dy, d2, s;
+  int j, l;
+
+  for (j = 0; j + 4 <= m; j += 4){
+    for (l = 0; l < 4; l++){
+      dx = xi - px[j+l];
+      dy = yi - py[j+l];
+      d2 = dx*dx + dy*dy;
+      if (d2 < MINDIST2) d2 = MINDIST2;
+      s = pw[j+l]/d2;
+      fx[l] += s*dx;
+      fy[l] += s*dy;
+    }
+  }
+  force2_tail(xi, yi, px, py, pw, j, m, &tx, &ty);
+  force2_lanes(fx, fy, tx, ty, f);
+}
+#endif
+
+#ifdef FORCE2_SIMD
+#ifdef SFDP_FLOAT
+#define LOAD2_PD(p) _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i *) (p))))
+#define LOAD4_PD(p) _mm256_cvtps_pd(_mm_loadu_ps(p))
+#else
+#define LOAD2_PD(p) _mm_loadu_pd(p)
+#define LOAD4_PD(p) _mm256_loadu_pd(p)
+#endif
+
+static void force2_sse2(real xi, real yi, sreal *px, sreal *py, sreal *pw, int m, real *f){
+  __m128d x = _mm_set1_pd(xi), y = _mm_set1_pd(yi), dmin = _mm_set1_pd(MINDIST2);
+  __m128d fx0 = _mm_setzero_pd(), fx1 = _mm_setzero_pd(), fy0 = _mm_setzero_pd(), fy1 = _mm_setzero_pd();
+  __m128d dx, dy, s;
+  real fx[4], fy[4], tx = 0, ty = 0;
+  int j;
+
+  for (j = 0; j + 4 <= m; j += 4){
+    dx = _mm_sub_pd(x, LOAD2_PD(px + j));
+    dy = _mm_sub_pd(y, LOAD2_PD(py + j));
+    s = _mm_div_pd(LOAD2_PD(pw + j), _mm_max_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), dmin));
+    fx0 = _mm_add_pd(fx0, _mm_mul_pd(s, dx));
+    fy0 = _mm_add_pd(fy0, _mm_mul_pd(s, dy));
+    dx = _mm_sub_pd(x, LOAD2_PD(px + j + 2));
+    dy = _mm_sub_pd(y, LOAD2_PD(py + j + 2));
+    s = _mm_div_pd(LOAD2_PD(pw + j + 2), _mm_max_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), dmin));
+    fx1 = _mm_add_pd(fx1, _mm_mul_pd(s, dx));
+    fy1 = _mm_add_pd(fy1, _mm_mul_pd(s, dy));
+  }
+  _mm_storeu_pd(fx, fx0);
+  _mm_storeu_pd(fx + 2, fx1);
+  _mm_storeu_pd(fy, fy0);
+  _mm_storeu_pd(fy + 2, fy1);
+  force2_tail(xi, yi, px, py, pw, j, m, &tx, &ty);
+  force2_lanes(fx, fy, tx, ty, f);
+}
+
+__attribute__((target("avx")))
+static void force2_avx(real xi, real yi, sreal *px, sreal *py, sreal *pw, int m, real *f){
+  __m256d x = _mm256_set1_pd(xi), y = _mm256_set1_pd(yi), dmin = _mm256_set1_pd(MINDIST2);
+  __m256d fx0 = _mm256_setzero_pd(), fy0 = _mm256_setzero_pd();
+  __m256d dx, dy, s;
+  real fx[4], fy[4], tx = 0, ty = 0;
+  int j;
+
+  for (j = 0; j + 4 <= m; j += 4){
+    dx = _mm256_sub_pd(x, LOAD4_PD(px + j));
+    dy = _mm256_sub_pd(y, LOAD4_PD(py + j));
+    s = _mm256_div_pd(LOAD4_PD(pw + j),
+		      _mm256_max_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), dmin));
+    fx0 = _mm256_add_pd(fx0, _mm256_mul_pd(s, dx));
+    fy0 = _mm256_add_pd(fy0, _mm256_mul_pd(s, dy));
+  }
+  _mm256_storeu_pd(fx, fx0);
+  _mm256_storeu_pd(fy, fy0);
+  force2_tail(xi, yi, px, py, pw, j, m, &tx, &ty);
+  force2_lanes(fx, fy, tx, ty, f);
+}
+#endif
+
+typedef void (*force2_fn)(real xi, real yi, sreal *px, sreal *py, sreal *pw, int m, real *f);
+
+static force2_fn force2_select(void){
+#ifdef FORCE2_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx")) return force2_avx;
+  return force2_sse2;
+#else
+  return force2_scalar;
+#endif
+}
+
+typedef struct {
+  int m, mmax;
+  sreal *x, *y, *w;
+} force2_list;
+
+static void force2_list_add(force2_list *l, sreal x, sreal y, sreal w){
+  if (l->m >= l->mmax){
+    l->mmax = MAX(64, 2*l->mmax);
+    l->x = REALLOC(l->x, sizeof(sreal)*l->mmax);
+    l->y = REALLOC(l->y, sizeof(sreal)*l->mmax);
+    l->w = REALLOC(l->w, sizeof(sreal)*l->mmax);
+  }
+  l->x[l->m] = x;
+  l->y[l->m] = y;
+  l->w[l->m] = w;
+  l->m++;
+}
+
+static void FlatQuadTree_node_force2(FlatQuadTree qt, int i, real bh, real KP, int *stack, force2_list *l, force2_fn kernel, real *f, real *counts){
+  /* FlatQuadTree_node_force for dim = 2 and p = -1. The walk only collects the supernodes and
+     points into l, which are then handed to the kernel in one go. */
+  int top = 0, c, j;
+  real xi = qt->coord[2*i], yi = qt->coord[2*i+1], dx, dy, bh2 = bh*bh;
+  FlatQuadTree_cell *cell;
+
+  l->m = 0;
+  stack[top++] = 0;
+  while (top > 0){
+    c = stack[--top];
+    cell = &(qt->cells[c]);
+    counts[2]++;
+    if (i < cell->first || i >= cell->last){
+      dx = qt->center[2*c] - xi;
+      dy = qt->center[2*c+1] - yi;
+      if (cell->width*cell->width < bh2*(dx*dx + dy*dy)){
+	counts[0]++;
+	force2_list_add(l, qt->average[2*c], qt->average[2*c+1], cell->total_weight);
+	continue;
+      }
+    }
+    if (cell->nchild == 0){
+      for (j = cell->first; j < cell->last; j++){
+	if (j == i) continue;
+	counts[1]++;
+	force2_list_add(l, qt->coord[2*j], qt->coord[2*j+1], qt->weight[j]);
+      }
+    } else {
+      for (j = cell->child + cell->nchild - 1; j >= cell->child; j--) stack[top++] = j;
+    }
+  }
+
+  f[0] = f[1] = 0;
+  kernel(xi, yi, l->x, l->y, l->w, l->m, f);
+  f[0] *= KP;
+  f[1] *= KP;
+}
+
+void FlatQuadTree_get_node_forces(FlatQuadTree qt, real *force, real bh, real p, real KP, real *counts, int nthreads){
+  /* repulsive force on every point, each computed on its own by FlatQuadTree_node_force, so
+     the points can be shared among nthreads threads. They are handed out in chunks of
+     consecutive Morton positions, which keeps the cells a thread walks in cache. Every force is
+     written by exactly one thread and the counts are sums of integers, so the result does not
+     depend on the number of threads.
+     force: force on point i is at force[i*dim+j]. Unlike QuadTree_get_repulsive_force, it is
+     not multiplied by the weight of i.
+     counts: counts[0] supernodes, counts[1] points, counts[2] cells visited, averaged over points
+     In 2D with p = -1, the common case, the forces are summed by the vectorized kernels above. */
+  int n = qt->n, dim = qt->dim, i;
+  real c0 = 0, c1 = 0, c2 = 0;
+  force2_fn kernel = NULL;
+
+  for (i = 0; i < 4; i++) counts[i] = 0;
+  if (dim == 2 && p == -1) kernel = force2_select();
+  nthreads = MAX(nthreads, 1);
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nthreads) reduction(+:c0,c1,c2)
+#endif
+  {
+    int *stack = MALLOC(sizeof(int)*((qt->max_level + 1) << dim));
+    real cnt[3] = {0, 0, 0};
+    force2_list l = {0, 0, NULL, NULL, NULL};
+    int ii;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 256)
+#endif
+    for (ii = 0; ii < n; ii++){
+      if (kernel){
+	FlatQuadTree_node_force2(qt, ii, bh, KP, stack, &l, kernel, &(force[qt->id[ii]*dim]), cnt);
+      } else {
+	FlatQuadTree_node_force(qt, ii, bh, p, KP, stack, &(force[qt->id[ii]*dim]), cnt);
+      }
+    }
+    c0 += cnt[0];
+    c1 += cnt[1];
+    c2 += cnt[2];
+    FREE(stack);
+    FREE(l.x);
+    FREE(l.y);
+    FREE(l.w);
+  }
+  counts[0] = c0/n;
+  counts[1] = c1/n;
+  counts[2] = c2/n;
+}
+
+/* 2D fast multipole method for p = -1. In complex notation the repulsive force on z_i is
+   KP * conj(sum_j w_j/(z_i - z_j)), so the field sum_j w_j/(z - z_j) is expanded as
+   sum_k b_k/(z - z_c)^(k+1) about the center z_c of a cell (multipole expansion) and as
+   sum_l c_l (z - z_c)^l for the far field acting on a cell (local expansion), both
+   truncated after "order" terms. Well separated pairs of cells are found by the same dual
+   tree walk as in QuadTree_repulsive_force_interact, which makes the method O(n).
+   Cells with at most FMM_LEAF points are not opened. Coordinates are shifted and scaled so
+   that the tree spans the unit square, which keeps the powers in the expansions in range.
+   Complex numbers are stored as (re, im) pairs. */
+#define FMM_LEAF 16
+#define FMM_IS_LEAF(cell) ((cell)->nchild == 0 || (cell)->last - (cell)->first <= FMM_LEAF)
+
+typedef struct {
+  FlatQuadTree qt;
+  int order;
+  int *slot;/* expansion slot of cell c, or -1 if the walk never reaches it */
+  real *me, *le;/* multipole and local expansions, 2*order reals per slot */
+  real *binom;/* binom[i*2*order+j] = i choose j, for i, j < 2*order */
+  real *z;/* scaled point coordinates, in Morton order */
+  real *zc;/* scaled cell centers */
+  real *fld;/* field at each point, in Morton order */
+  real *pw;/* powers, work space of 2*(2*order+1) reals */
+  real *g;/* work space of 2*order reals */
+  real theta, mind2;
+  real scale;/* from original to scaled coordinates */
+  real counts[3];
+} fmm_data;
+
+static void cmul(real *a, real *b, real *c){
+  /* c = a*b, c may be a or b */
+  real re = a[0]*b[0] - a[1]*b[1], im = a[0]*b[1] + a[1]*b[0];
+  c[0] = re;
+  c[1] = im;
+}
+
+static void cpowers(real *d, int m, real *pw){
+  /* pw[2*k], pw[2*k+1] = d^k, k = 0, ..., m - 1 */
+  int k;
+  pw[0] = 1;
+  pw[1] = 0;
+  for (k = 1; k < m; k++) cmul(&(pw[2*(k-1)]), d, &(pw[2*k]));
+}
+
+static void fmm_p2m(fmm_data *F, int c){
+  /* b_k = sum_j w_j (z_j - z_c)^k */
+  FlatQuadTree qt = F->qt;
+  FlatQuadTree_cell *cell = &(qt->cells[c]);
+  int P = F->order, j, k;
+  real *b = &(F->me[2*P*F->slot[c]]), d[2], t[2];
+
+  for (k = 0; k < 2*P; k++) b[k] = 0;
+  for (j = cell->first; j < cell->last; j++){
+    d[0] = F->z[2*j] - F->zc[2*c];
+    d[1] = F->z[2*j+1] - F->zc[2*c+1];
+    t[0] = qt->weight[j];
+    t[1] = 0;
+    for (k = 0; k < P; k++){
+      b[2*k] += t[0];
+      b[2*k+1] += t[1];
+      cmul(t, d, t);
+    }
+  }
+}
+
+static void fmm_m2m(fmm_data *F, int c, int ch){
+  /* shift the expansion of child ch to the center of c and add it:
+     b_k += sum_{l<=k} (k choose l) d^(k-l) b'_l, d = z_ch - z_c */
+  int P = F->order, k, l;
+  real *b = &(F->me[2*P*F->slot[c]]), *b1 = &(F->me[2*P*F->slot[ch]]), d[2], t[2];
+
+  d[0] = F->zc[2*ch] - F->zc[2*c];
+  d[1] = F->zc[2*ch+1] - F->zc[2*c+1];
+  cpowers(d, P, F->pw);
+  for (k = 0; k < P; k++){
+    for (l = 0; l <= k; l++){
+      cmul(&(F->pw[2*(k-l)]), &(b1[2*l]), t);
+      b[2*k] += F->binom[k*2*P+l]*t[0];
+      b[2*k+1] += F->binom[k*2*P+l]*t[1];
+    }
+  }
+}
+
+static void fmm_m2l(fmm_data *F, int cl, int cm){
+  /* add the multipole expansion of cm to the local expansion of cl:
+     c_l += (-1)^l t^-l sum_k (k+l choose l) b_k t^-(k+1), t = z_cl - z_cm.
+     The factors b_k t^-(k+1) are formed first, since t^-(k+l+1) alone may overflow. */
+  int P = F->order, k, l;
+  real *b = &(F->me[2*P*F->slot[cm]]), *c = &(F->le[2*P*F->slot[cl]]), *g = F->g, it[2], t[2], s[2], r;
+
+  t[0] = F->zc[2*cl] - F->zc[2*cm];
+  t[1] = F->zc[2*cl+1] - F->zc[2*cm+1];
+  r = t[0]*t[0] + t[1]*t[1];
+  it[0] = t[0]/r;
+  it[1] = -t[1]/r;
+  cpowers(it, P + 1, F->pw);
+  for (k = 0; k < P; k++) cmul(&(b[2*k]), &(F->pw[2*(k+1)]), &(g[2*k]));
+  for (l = 0; l < P; l++){
+    s[0] = s[1] = 0;
+    for (k = 0; k < P; k++){
+      s[0] += F->binom[(k+l)*2*P+l]*g[2*k];
+      s[1] += F->binom[(k+l)*2*P+l]*g[2*k+1];
+    }
+    cmul(s, &(F->pw[2*l]), s);
+    if (l%2){
+      s[0] = -s[0];
+      s[1] = -s[1];
+    }
+    c[2*l] += s[0];
+    c[2*l+1] += s[1];
+  }
+}
+
+static void fmm_l2l(fmm_data *F, int c, int ch){
+  /* shift the local expansion of c to the center of child ch and add it:
+     c'_m += sum_{l>=m} (l choose m) s^(l-m) c_l, s = z_ch - z_c */
+  int P = F->order, l, m;
+  real *a = &(F->le[2*P*F->slot[c]]), *a1 = &(F->le[2*P*F->slot[ch]]), s[2], t[2];
+
+  s[0] = F->zc[2*ch] - F->zc[2*c];
+  s[1] = F->zc[2*ch+1] - F->zc[2*c+1];
+  cpowers(s, P, F->pw);
+  for (m = 0; m < P; m++){
+    for (l = m; l < P; l++){
+      cmul(&(F->pw[2*(l-m)]), &(a[2*l]), t);
+      a1[2*m] += F->binom[l*2*P+m]*t[0];
+      a1[2*m+1] += F->binom[l*2*P+m]*t[1];
+    }
+  }
+}
+
+static void fmm_l2p(fmm_data *F, int c){
+  /* evaluate the local expansion of c at its points, by Horner's rule */
+  FlatQuadTree_cell *cell = &(F->qt->cells[c]);
+  int P = F->order, j, l;
+  real *a = &(F->le[2*P*F->slot[c]]), u[2], f[2];
+
+  for (j = cell->first; j < cell->last; j++){
+    u[0] = F->z[2*j] - F->zc[2*c];
+    u[1] = F->z[2*j+1] - F->zc[2*c+1];
+    f[0] = a[2*(P-1)];
+    f[1] = a[2*(P-1)+1];
+    for (l = P - 2; l >= 0; l--){
+      cmul(f, u, f);
+      f[0] += a[2*l];
+      f[1] += a[2*l+1];
+    }
+    F->fld[2*j] += f[0];
+    F->fld[2*j+1] += f[1];
+  }
+}
+
+static void fmm_p2p(fmm_data *F, int c1, int c2){
+  /* direct interaction between the points of c1 and c2, or among those of c1 if c1 == c2 */
+  FlatQuadTree qt = F->qt;
+  FlatQuadTree_cell *q1 = &(qt->cells[c1]), *q2 = &(qt->cells[c2]);
+  real *z = F->z, *fld = F->fld, dx, dy, r;
+  int i, j;
+
+  for (i = q1->first; i < q1->last; i++){
+    for (j = (c1 == c2) ? i + 1 : q2->first; j < q2->last; j++){
+      F->counts[1]++;
+      dx = z[2*i] - z[2*j];
+      dy = z[2*i+1] - z[2*j+1];
+      r = MAX(dx*dx + dy*dy, F->mind2);
+      dx /= r;
+      dy /= r;
+      fld[2*i] += qt->weight[j]*dx;
+      fld[2*i+1] -= qt->weight[j]*dy;
+      fld[2*j] -= qt->weight[i]*dx;
+      fld[2*j+1] += qt->weight[i]*dy;
+    }
+  }
+}
+
+static void fmm_interact(fmm_data *F, int c1, int c2){
+  FlatQuadTree_cell *q1 = &(F->qt->cells[c1]), *q2 = &(F->qt->cells[c2]);
+  int leaf1 = FMM_IS_LEAF(q1), leaf2 = FMM_IS_LEAF(q2), i, j, split, other;
+  real dx, dy, r;
+
+  if (c1 == c2){
+    if (leaf1){
+      fmm_p2p(F, c1, c1);
+    } else {
+      for (i = q1->child; i < q1->child + q1->nchild; i++){
+	for (j = i; j < q1->child + q1->nchild; j++) fmm_interact(F, i, j);
+      }
+    }
+    return;
+  }
+
+  /* well separated: the circles around the cells, of radius sqrt(2)*width, are far apart */
+  dx = F->zc[2*c1] - F->zc[2*c2];
+  dy = F->zc[2*c1+1] - F->zc[2*c2+1];
+  r = (q1->width + q2->width)*F->scale;
+  if (2*r*r < F->theta*F->theta*(dx*dx + dy*dy)){
+    F->counts[0] += 2;
+    fmm_m2l(F, c1, c2);
+    fmm_m2l(F, c2, c1);
+    return;
+  }
+
+  if (leaf1 && leaf2){
+    fmm_p2p(F, c1, c2);
+    return;
+  }
+
+  /* split the one with bigger box, or one that is not a leaf */
+  if (q1->width > q2->width && !leaf1){
+    split = c1;
+  } else if (q2->width > q1->width && !leaf2){
+    split = c2;
+  } else if (!leaf1){
+    split = c1;
+  } else {
+    split = c2;
+  }
+  other = (split == c1) ? c2 : c1;
+  for (i = F->qt->cells[split].child; i < F->qt->cells[split].child + F->qt->cells[split].nchild; i++){
+    fmm_interact(F, i, other);
+  }
+}
+
+void FlatQuadTree_get_fmm_forces(FlatQuadTree qt, real *force, real theta, real KP, int order, real *counts){
+  /* repulsive force on every point for p = -1 in 2D, by the fast multipole method with
+     expansions of "order" terms. theta plays the role of bh: two cells interact through their
+     expansions if the sum of their radii is less than theta times the distance of their
+     centers. The result is as for FlatQuadTree_get_node_forces, so the force is not
+     multiplied by the weight of the point itself.
+     counts: counts[0] cell-cell interactions, counts[1] point-point interactions,
+     counts[2] cells with expansions, averaged over points */
+  fmm_data F;
+  int n = qt->n, P = order, nslots, c, i, j, k;
+  real scale, x0, y0;
+  FlatQuadTree_cell *cell;
+
+  assert(qt->dim == 2 && order > 0);
+  for (i = 0; i < 4; i++) counts[i] = 0;
+
+  F.qt = qt;
+  F.order = P;
+  F.theta = theta;
+  F.counts[0] = F.counts[1] = F.counts[2] = 0;
+
+  /* the root cell becomes [-0.5, 0.5]^2 */
+  F.scale = scale = 1/(2*qt->cells[0].width);
+  x0 = qt->center[0];
+  y0 = qt->center[1];
+  F.mind2 = (MINDIST*scale)*(MINDIST*scale);
+
+  F.slot = MALLOC(sizeof(int)*qt->ncells);
+  for (c = 0; c < qt->ncells; c++) F.slot[c] = -1;
+  nslots = 0;
+  F.slot[0] = nslots++;
+  for (c = 0; c < qt->ncells; c++){
+    cell = &(qt->cells[c]);
+    if (F.slot[c] < 0 || FMM_IS_LEAF(cell)) continue;
+    for (j = cell->child; j < cell->child + cell->nchild; j++) F.slot[j] = nslots++;
+  }
+  F.counts[2] = nslots;
+
+  F.me = MALLOC(sizeof(real)*2*P*nslots);
+  F.le = MALLOC(sizeof(real)*2*P*nslots);
+  for (i = 0; i < 2*P*nslots; i++) F.le[i] = 0;
+  F.binom = MALLOC(sizeof(real)*4*P*P);
+  for (i = 0; i < 2*P; i++){
+    F.binom[i*2*P] = 1;
+    for (j = 1; j < 2*P; j++){
+      F.binom[i*2*P+j] = (j > i) ? 0 : F.binom[(i-1)*2*P+j-1] + ((j < i) ? F.binom[(i-1)*2*P+j] : 0);
+    }
+  }
+  F.z = MALLOC(sizeof(real)*2*n);
+  F.fld = MALLOC(sizeof(real)*2*n);
+  for (i = 0; i < n; i++){
+    F.z[2*i] = (qt->coord[2*i] - x0)*scale;
+    F.z[2*i+1] = (qt->coord[2*i+1] - y0)*scale;
+    F.fld[2*i] = F.fld[2*i+1] = 0;
+  }
+  F.zc = MALLOC(sizeof(real)*2*qt->ncells);
+  for (c = 0; c < qt->ncells; c++){
+    F.zc[2*c] = (qt->center[2*c] - x0)*scale;
+    F.zc[2*c+1] = (qt->center[2*c+1] - y0)*scale;
+  }
+  F.pw = MALLOC(sizeof(real)*2*(2*P+1));
+  F.g = MALLOC(sizeof(real)*2*P);
+
+  /* upward pass: children come after their parent */
+  for (c = qt->ncells - 1; c >= 0; c--){
+    cell = &(qt->cells[c]);
+    if (F.slot[c] < 0) continue;
+    if (FMM_IS_LEAF(cell)){
+      fmm_p2m(&F, c);
+    } else {
+      for (k = 0; k < 2*P; k++) F.me[2*P*F.slot[c]+k] = 0;
+      for (j = cell->child; j < cell->child + cell->nchild; j++) fmm_m2m(&F, c, j);
+    }
+  }
+
+  fmm_interact(&F, 0, 0);
+
+  /* downward pass */
+  for (c = 0; c < qt->ncells; c++){
+    cell = &(qt->cells[c]);
+    if (F.slot[c] < 0) continue;
+    if (FMM_IS_LEAF(cell)){
+      fmm_l2p(&F, c);
+    } else {
+      for (j = cell->child; j < cell->child + cell->nchild; j++) fmm_l2l(&F, c, j);
+    }
+  }
+
+  /* back to the original scale; the field is conj(force) */
+  for (i = 0; i < n; i++){
+    j = qt->id[i];
+    force[2*j] = KP*scale*F.fld[2*i];
+    force[2*j+1] = -KP*scale*F.fld[2*i+1];
+  }
+  for (i = 0; i < 3; i++) counts[i] = F.counts[i]/n;
+
+  FREE(F.slot);
+  FREE(F.me);
+  FREE(F.le);
+  FREE(F.binom);
+  FREE(F.z);
+  FREE(F.fld);
+  FREE(F.zc);
+  FREE(F.pw);
+  FREE(F.g);
+}
@@ -17,6 +17,7 @@
 #include "LinkedList.h"
 /* #include "sfdpinternal.h" */
 #include <stdio.h>
+#include <stdint.h>
 
 typedef struct QuadTree_struct *QuadTree;
 
@@ -61,4 +62,52 @@ void QuadTree_get_nearest(QuadTree qt, real *x, real *ymin, int *imin, real *min
 
 QuadTree QuadTree_new_in_quadrant(int dim, real *center, real width, int max_level, int i);
 
+/* A linearized QuadTree. Points are sorted by their Morton code, so every cell covers a
+   contiguous range of them, and cells are laid out breadth first in one array with the
+   children of a cell next to each other. No allocation is done per cell or per point, and
+   the buffers are kept between rebuilds, so the tree can be rebuilt cheaply every iteration. */
+typedef struct FlatQuadTree_struct *FlatQuadTree;
+
+typedef struct {
+  int first, last;/* the cell holds points first, ..., last - 1 in Morton order */
+  int child, nchild;/* children are cells child, ..., child + nchild - 1. nchild = 0 for a leaf */
+  int level;
+  real width;/* as in QuadTree, center +/- width gives the bounding box */
+  real total_weight;
+} FlatQuadTree_cell;
+
+struct FlatQuadTree_struct {
+  int dim;
+  int n;/* number of points */
+  int max_level;/* levels actually used, at most 63/dim so the Morton code fits in 64 bits */
+  int ncells;
+  int ncells_max;
+  FlatQuadTree_cell *cells;
+  sreal *center;/* center of cell i is center[i*dim+k] */
+  sreal *average;/* average coordinates of the points in cell i, average[i*dim+k] */
+  real *force;/* cell level force, force[i*dim+k] */
+  int *id;/* original index of the i-th point in Morton order */
+  sreal *coord;/* coordinates of the points in Morton order */
+  sreal *weight;/* weights of the points in Morton order */
+  uint64_t *code;/* Morton codes, sorted */
+  uint64_t *code_tmp;/* work space for sorting */
+  int *id_tmp;
+};
+
+FlatQuadTree FlatQuadTree_new(int dim, int n);
+
+void FlatQuadTree_delete(FlatQuadTree qt);
+
+/* (re)build the tree on n points. weight may be NULL for unit weights */
+void FlatQuadTree_build(FlatQuadTree qt, int max_level, real *coord, real *weight);
+
+/* same as QuadTree_get_repulsive_force */
+void FlatQuadTree_get_repulsive_force(FlatQuadTree qt, real *force, real *x, real bh, real p, real KP, real *counts, int *flag);
+
+/* repulsive force on each point on its own, shared among nthreads threads if built with OpenMP */
+void FlatQuadTree_get_node_forces(FlatQuadTree qt, real *force, real bh, real p, real KP, real *counts, int nthreads);
+
+/* the same for p = -1 in 2D, by the fast multipole method with expansions of the given order */
+void FlatQuadTree_get_fmm_forces(FlatQuadTree qt, real *force, real theta, real KP, int order, real *counts);
+
 #endif
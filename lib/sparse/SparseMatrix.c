@@ -25,6 +25,41 @@
 #include "PriorityQueue.h"
 #endif
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* with OpenMP and SparseMatrix_set_threads, real matrices with at least PARALLEL_NZ nonzeros
+   are transposed, multiplied and applied to vectors by several threads. Each thread works on
+   a block of rows and every entry of the result is summed in the same order as in the
+   sequential code, so results do not depend on the number of threads. */
+#define PARALLEL_NZ 20000
+#define MAX_SPARSE_THREADS 16
+
+/* private to each thread, so that layouts running at the same time (see layoutComps)
+   each have their own setting */
+static int SparseThreads;
+#ifdef _OPENMP
+#pragma omp threadprivate(SparseThreads)
+#endif
+
+int SparseMatrix_set_threads(int nthreads){
+  int old = SparseThreads;
+  SparseThreads = nthreads;
+  return old;
+}
+
+int SparseMatrix_threads(int nz){
+  /* number of threads to use on a matrix with nz nonzeros: 1 unless threads were asked for,
+     the matrix is large enough and we are not already inside a parallel region */
+#ifdef _OPENMP
+  if (SparseThreads <= 1 || nz < PARALLEL_NZ || omp_in_parallel()) return 1;
+  return MIN(SparseThreads, MAX_SPARSE_THREADS);
+#else
+  return 1;
+#endif
+}
+
 static size_t size_of_matrix_type(int type){
   int size = 0;
   switch (type){
@@ -66,6 +101,67 @@ SparseMatrix SparseMatrix_make_undirected(SparseMatrix A){
   SparseMatrix_set_undirected(B);
   return SparseMatrix_remove_upper(B);
 }
+#ifdef _OPENMP
+static SparseMatrix SparseMatrix_transpose_real_parallel(SparseMatrix A, int nthreads){
+  /* transpose by counting sort over blocks of rows, one per thread. Entries of a column of A
+     are placed block by block, so B is the same as the one from the sequential loop. */
+  int *ia = A->ia, *ja = A->ja, *ib, *jb, nz = A->nz, m = A->m, n = A->n;
+  int *count = NULL;
+  real *a = (real*) A->a, *b;
+  SparseMatrix B;
+
+  B = SparseMatrix_new(n, m, nz, MATRIX_TYPE_REAL, FORMAT_CSR);
+  B->nz = nz;
+  ib = B->ia;
+  jb = B->ja;
+  b = (real*) B->a;
+
+#pragma omp parallel num_threads(nthreads)
+  {
+    int t = omp_get_thread_num(), nt = omp_get_num_threads(), i, j, k, pos, c;
+    int lo = (int) (((long) m*t)/nt), hi = (int) (((long) m*(t + 1))/nt);
+    int *cnt;
+
+#pragma omp single
+    {
+      count = MALLOC(sizeof(int)*((size_t) n)*((size_t) nt));
+      memset(count, 0, sizeof(int)*((size_t) n)*((size_t) nt));
+    }
+
+    cnt = &(count[((size_t) n)*t]);
+    for (i = lo; i < hi; i++){
+      for (j = ia[i]; j < ia[i+1]; j++) cnt[ja[j]]++;
+    }
+#pragma omp barrier
+
+#pragma omp single
+    {
+      pos = 0;
+      for (j = 0; j < n; j++){
+	ib[j] = pos;
+	for (k = 0; k < nt; k++){
+	  c = count[((size_t) n)*k + j];
+	  count[((size_t) n)*k + j] = pos;
+	  pos += c;
+	}
+      }
+      ib[n] = pos;
+    }
+
+    for (i = lo; i < hi; i++){
+      for (j = ia[i]; j < ia[i+1]; j++){
+	pos = cnt[ja[j]]++;
+	jb[pos] = i;
+	b[pos] = a[j];
+      }
+    }
+  }
+
+  FREE(count);
+  return B;
+}
+#endif
+
 SparseMatrix SparseMatrix_transpose(SparseMatrix A){
   if (!A) return NULL;
 
@@ -75,6 +171,11 @@ SparseMatrix SparseMatrix_transpose(SparseMatrix A){
 
   assert(A->format == FORMAT_CSR);/* only implemented for CSR right now */
 
+#ifdef _OPENMP
+  if (type == MATRIX_TYPE_REAL && SparseMatrix_threads(nz) > 1)
+    return SparseMatrix_transpose_real_parallel(A, SparseMatrix_threads(nz));
+#endif
+
   B = SparseMatrix_new(n, m, nz, type, format);
   B->nz = nz;
   ib = B->ia;
@@ -1130,6 +1231,9 @@ static void SparseMatrix_multiply_dense1(SparseMatrix A, real *v, real **res, in
 
   if (!transposed){
     if (!u) u = MALLOC(sizeof(real)*((size_t) m)*((size_t) dim));
+#ifdef _OPENMP
+#pragma omp parallel for private(j, k) schedule(static) num_threads(SparseMatrix_threads(A->nz)) if (SparseMatrix_threads(A->nz) > 1)
+#endif
     for (i = 0; i < m; i++){
       for (k = 0; k < dim; k++) u[i*dim+k] = 0.;
       for (j = ia[i]; j < ia[i+1]; j++){
@@ -1234,6 +1338,9 @@ void SparseMatrix_multiply_vector(SparseMatrix A, real *v, real **res, int trans
     if (v){
       if (!transposed){
 	if (!u) u = MALLOC(sizeof(real)*((size_t)m));
+#ifdef _OPENMP
+#pragma omp parallel for private(j) schedule(static) num_threads(SparseMatrix_threads(A->nz)) if (SparseMatrix_threads(A->nz) > 1)
+#endif
 	for (i = 0; i < m; i++){
 	  u[i] = 0.;
 	  for (j = ia[i]; j < ia[i+1]; j++){
@@ -1398,6 +1505,77 @@ SparseMatrix SparseMatrix_multiply_by_scaler(SparseMatrix A, real s){
 }
 
 
+#ifdef _OPENMP
+static SparseMatrix SparseMatrix_multiply_real_parallel(SparseMatrix A, SparseMatrix B, int nthreads){
+  /* A*B for real matrices, rows of the product shared among threads. A symbolic pass counts
+     the nonzeros of each row of the product, a numeric pass then fills the rows in place. */
+  int m = A->m, *ia = A->ia, *ja = A->ja, *ib = B->ia, *jb = B->ja, *ic, *jc, i;
+  real *a = (real*) A->a, *b = (real*) B->a, *c;
+  SparseMatrix C;
+
+  ic = MALLOC(sizeof(int)*((size_t) m + 1));
+  ic[0] = 0;
+
+#pragma omp parallel num_threads(nthreads)
+  {
+    int *mask = MALLOC(sizeof(int)*((size_t) B->n)), ii, j, k, nz;
+
+    for (ii = 0; ii < B->n; ii++) mask[ii] = -1;
+#pragma omp for schedule(dynamic, 256)
+    for (ii = 0; ii < m; ii++){
+      nz = 0;
+      for (j = ia[ii]; j < ia[ii+1]; j++){
+	for (k = ib[ja[j]]; k < ib[ja[j]+1]; k++){
+	  if (mask[jb[k]] != ii){
+	    mask[jb[k]] = ii;
+	    nz++;
+	  }
+	}
+      }
+      ic[ii+1] = nz;
+    }
+    FREE(mask);
+  }
+  for (i = 0; i < m; i++) ic[i+1] += ic[i];
+
+  C = SparseMatrix_new(m, B->n, ic[m], MATRIX_TYPE_REAL, FORMAT_CSR);
+  if (!C) {
+    FREE(ic);
+    return NULL;
+  }
+  FREE(C->ia);
+  C->ia = ic;
+  jc = C->ja;
+  c = (real*) C->a;
+
+#pragma omp parallel num_threads(nthreads)
+  {
+    int *mask = MALLOC(sizeof(int)*((size_t) B->n)), ii, j, k, nz;
+
+    for (ii = 0; ii < B->n; ii++) mask[ii] = -1;
+#pragma omp for schedule(dynamic, 256)
+    for (ii = 0; ii < m; ii++){
+      nz = ic[ii];
+      for (j = ia[ii]; j < ia[ii+1]; j++){
+	for (k = ib[ja[j]]; k < ib[ja[j]+1]; k++){
+	  if (mask[jb[k]] < ic[ii]){
+	    mask[jb[k]] = nz;
+	    jc[nz] = jb[k];
+	    c[nz++] = a[j]*b[k];
+	  } else {
+	    c[mask[jb[k]]] += a[j]*b[k];
+	  }
+	}
+      }
+    }
+    FREE(mask);
+  }
+  C->nz = ic[m];
+
+  return C;
+}
+#endif
+
 SparseMatrix SparseMatrix_multiply(SparseMatrix A, SparseMatrix B){
   int m;
   SparseMatrix C = NULL;
@@ -1416,6 +1594,11 @@ SparseMatrix SparseMatrix_multiply(SparseMatrix A, SparseMatrix B){
     return NULL;
   }
   type = A->type;
+
+#ifdef _OPENMP
+  if (type == MATRIX_TYPE_REAL && SparseMatrix_threads(A->nz + B->nz) > 1)
+    return SparseMatrix_multiply_real_parallel(A, B, SparseMatrix_threads(A->nz + B->nz));
+#endif
   
   mask = MALLOC(sizeof(int)*((size_t)(B->n)));
   if (!mask) return NULL;
@@ -93,6 +93,8 @@ SparseMatrix SparseMatrix_divide_row_by_degree(SparseMatrix A);
 SparseMatrix SparseMatrix_get_real_adjacency_matrix_symmetrized(SparseMatrix A);  /* symmetric, all entries to 1, diaginal removed */
 SparseMatrix SparseMatrix_normalize_to_rowsum1(SparseMatrix A);/* for real only! */
 void SparseMatrix_multiply_dense(SparseMatrix A, int ATranspose, real *v, int vTransposed, real **res, int res_transpose, int dim);
+int SparseMatrix_set_threads(int nthreads);/* threads for the real CSR kernels of the calling thread (default 1); returns the old value */
+int SparseMatrix_threads(int nz);/* threads used on a matrix with nz nonzeros */
 SparseMatrix SparseMatrix_apply_fun(SparseMatrix A, double (*fun)(double x));/* for real only! */
 SparseMatrix SparseMatrix_apply_fun_general(SparseMatrix A, void (*fun)(int i, int j, int n, double *x));/* for real and complex (n=2) */
 SparseMatrix SparseMatrix_copy(SparseMatrix A);
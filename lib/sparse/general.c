@@ -50,14 +50,14 @@ real vector_percentile(int n, real *x, real y){
 }
 
 real drand(){
-  return rand()/(real) RAND_MAX;
+  return gvrand()/(real) RAND_MAX;
 }
 
 int irand(int n){
   /* 0, 1, ..., n-1 */
   assert(n > 1);
   /*return (int) MIN(floor(drand()*n),n-1);*/
-  return rand()%n;
+  return gvrand()%n;
 }
 
 int *random_permutation(int n){
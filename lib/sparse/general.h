@@ -33,6 +33,17 @@
 
 #define real double
 
+/* type for large arrays of coordinates and weights that are only read back, such as those
+   of FlatQuadTree. With SFDP_FLOAT they are kept in single precision, which halves the memory
+   traffic; sums and the layout itself stay in real. This is only a partial float mode: the
+   layout coordinates, SparseMatrix values and CG vectors, which take most of the memory of a
+   large layout, are still real. */
+#ifdef SFDP_FLOAT
+#define sreal float
+#else
+#define sreal real
+#endif
+
 #define set_flag(a, flag) ((a)=((a)|(flag)))
 #define test_flag(a, flag) ((a)&(flag))
 #define clear_flag(a, flag) ((a) &=(~(flag)))
@@ -86,6 +97,16 @@ extern double _statistics[10];
 
 extern int irand(int n);
 extern real drand(void);
+
+/* random numbers go through lib/common/random.c; see gvLocalRandom there */
+#ifdef STANDALONE
+#define gvrand rand
+#define gvsrand srand
+#else
+extern int gvrand(void);
+extern void gvsrand(unsigned int seed);
+#endif
+
 extern int *random_permutation(int n);/* random permutation of 0 to n-1 */
 
 